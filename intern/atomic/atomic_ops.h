@@ -98,6 +98,8 @@ ATOMIC_INLINE unsigned atomic_add_u(unsigned *p, unsigned x);
 ATOMIC_INLINE unsigned atomic_sub_u(unsigned *p, unsigned x);
 ATOMIC_INLINE unsigned atomic_cas_u(unsigned *v, unsigned old, unsigned _new);
 
+ATOMIC_INLINE void *atomic_cas_ptr(void **v, void *old, void *_new);
+
 /******************************************************************************/
 /* 64-bit operations. */
 #if (LG_SIZEOF_PTR == 3 || LG_SIZEOF_INT == 3)
@@ -465,4 +467,22 @@ atomic_cas_u(unsigned *v, unsigned old, unsigned _new)
 #endif
 }
 
+/******************************************************************************/
+/* Pointer operations. */
+ATOMIC_INLINE void *
+atomic_cas_ptr(void **v, void *old, void *_new)
+{
+	assert(sizeof(void *) == 1 << LG_SIZEOF_PTR);
+
+#if (LG_SIZEOF_PTR == 3)
+	return (void *)(uintptr_t)atomic_cas_uint64((uint64_t *)v,
+	                                            (uint64_t)(uintptr_t)old,
+	                                            (uint64_t)(uintptr_t)_new);
+#elif (LG_SIZEOF_PTR == 2)
+	return (void *)(uintptr_t)atomic_cas_uint32((uint32_t *)v,
+	                                            (uint32_t)(uintptr_t)old,
+	                                            (uint32_t)(uintptr_t)_new);
+#endif
+}
+
 #endif /* __ATOMIC_OPS_H__ */
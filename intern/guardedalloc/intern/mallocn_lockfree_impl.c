@@ -51,8 +51,25 @@ typedef struct MemHeadAligned {
 	size_t len;
 } MemHeadAligned;
 
-static unsigned int totblock = 0;
-static size_t mem_in_use = 0, mmap_in_use = 0, peak_mem = 0;
+/* Statistics are split in slots, threads are assigned a slot on their first allocation.
+ * A single set of counters updated by all threads bounces its cache line between CPUs on every
+ * allocation, with slots threads only touch their own line and totals are summed on demand.
+ * Blocks can be freed by another thread than the one allocating them, so the counters of a
+ * single slot may wrap around below zero, only the sum of all slots is meaningful. */
+#define MEM_STATS_SLOTS 64
+
+typedef struct MemStats {
+	size_t mem_in_use;
+	size_t mmap_in_use;
+	unsigned int totblock;
+
+	/* Stride of 128 bytes, so counters of two slots are never on the same cache line,
+	 * whatever the alignment of the array. */
+	char pad[128 - 2 * sizeof(size_t) - sizeof(unsigned int)];
+} MemStats;
+
+static MemStats mem_stats[MEM_STATS_SLOTS];
+static size_t peak_mem = 0;
 static bool malloc_debug_memset = false;
 
 static void (*error_callback)(const char *) = NULL;
@@ -87,6 +104,86 @@ MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
 #endif
 }
 
+#if defined(_MSC_VER)
+#  define MEM_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#  define MEM_THREAD_LOCAL __thread
+#endif
+
+MEM_INLINE MemStats *mem_stats_get(void)
+{
+#ifdef MEM_THREAD_LOCAL
+	static MEM_THREAD_LOCAL unsigned int thread_slot = 0;
+	static unsigned int num_threads = 0;
+
+	/* slots are handed out round robin, 0 means not assigned yet */
+	if (UNLIKELY(thread_slot == 0)) {
+		thread_slot = atomic_add_u(&num_threads, 1);
+	}
+
+	return &mem_stats[thread_slot & (MEM_STATS_SLOTS - 1)];
+#else
+	return &mem_stats[0];
+#endif
+}
+
+static size_t mem_stats_mem_in_use(void)
+{
+	size_t mem_in_use = 0;
+	int i;
+
+	for (i = 0; i < MEM_STATS_SLOTS; i++) {
+		mem_in_use += mem_stats[i].mem_in_use;
+	}
+
+	return mem_in_use;
+}
+
+static size_t mem_stats_mmap_in_use(void)
+{
+	size_t mmap_in_use = 0;
+	int i;
+
+	for (i = 0; i < MEM_STATS_SLOTS; i++) {
+		mmap_in_use += mem_stats[i].mmap_in_use;
+	}
+
+	return mmap_in_use;
+}
+
+static unsigned int mem_stats_totblock(void)
+{
+	unsigned int totblock = 0;
+	int i;
+
+	for (i = 0; i < MEM_STATS_SLOTS; i++) {
+		totblock += mem_stats[i].totblock;
+	}
+
+	return totblock;
+}
+
+/* Summing all slots on every allocation would cost more than the contention it avoids,
+ * so the peak is only updated when the memory of a slot crosses a multiple of this size
+ * (or for allocations larger than it). The peak is then exact up to this size per thread. */
+#define MEM_PEAK_UPDATE_STEP ((size_t)1 << 20)
+
+MEM_INLINE void mem_stats_add(MemStats *stats, size_t len)
+{
+	const size_t mem_in_use = atomic_add_z(&stats->mem_in_use, len);
+	atomic_add_u(&stats->totblock, 1);
+
+	if (UNLIKELY((mem_in_use / MEM_PEAK_UPDATE_STEP) != ((mem_in_use - len) / MEM_PEAK_UPDATE_STEP))) {
+		update_maximum(&peak_mem, mem_stats_mem_in_use());
+	}
+}
+
+MEM_INLINE void mem_stats_sub(MemStats *stats, size_t len)
+{
+	atomic_sub_u(&stats->totblock, 1);
+	atomic_sub_z(&stats->mem_in_use, len);
+}
+
 #ifdef __GNUC__
 __attribute__ ((format(printf, 1, 2)))
 #endif
@@ -133,6 +230,7 @@ void MEM_lockfree_freeN(void *vmemh)
 {
 	MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
 	size_t len = MEM_lockfree_allocN_len(vmemh);
+	MemStats *stats;
 
 	if (vmemh == NULL) {
 		print_error("Attempt to free NULL pointer\n");
@@ -142,11 +240,11 @@ void MEM_lockfree_freeN(void *vmemh)
 		return;
 	}
 
-	atomic_sub_u(&totblock, 1);
-	atomic_sub_z(&mem_in_use, len);
+	stats = mem_stats_get();
+	mem_stats_sub(stats, len);
 
 	if (MEMHEAD_IS_MMAP(memh)) {
-		atomic_sub_z(&mmap_in_use, len);
+		atomic_sub_z(&stats->mmap_in_use, len);
 #if defined(WIN32)
 		/* our windows mmap implementation is not thread safe */
 		mem_lock_thread();
@@ -287,14 +385,12 @@ void *MEM_lockfree_callocN(size_t len, const char *str)
 
 	if (LIKELY(memh)) {
 		memh->len = len;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_stats_add(mem_stats_get(), len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_stats_mem_in_use());
 	return NULL;
 }
 
@@ -312,14 +408,12 @@ void *MEM_lockfree_mallocN(size_t len, const char *str)
 		}
 
 		memh->len = len;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_stats_add(mem_stats_get(), len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_stats_mem_in_use());
 	return NULL;
 }
 
@@ -361,14 +455,12 @@ void *MEM_lockfree_mallocN_aligned(size_t len, size_t alignment, const char *str
 
 		memh->len = len | (size_t) MEMHEAD_ALIGN_FLAG;
 		memh->alignment = (short) alignment;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_stats_add(mem_stats_get(), len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_stats_mem_in_use());
 	return NULL;
 }
 
@@ -395,19 +487,17 @@ void *MEM_lockfree_mapallocN(size_t len, const char *str)
 #endif
 
 	if (memh != (MemHead *)-1) {
-		memh->len = len | (size_t) MEMHEAD_MMAP_FLAG;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		atomic_add_z(&mmap_in_use, len);
+		MemStats *stats = mem_stats_get();
 
-		update_maximum(&peak_mem, mem_in_use);
-		update_maximum(&peak_mem, mmap_in_use);
+		memh->len = len | (size_t) MEMHEAD_MMAP_FLAG;
+		atomic_add_z(&stats->mmap_in_use, len);
+		mem_stats_add(stats, len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Mapalloc returns null, fallback to regular malloc: "
 	            "len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mmap_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_stats_mmap_in_use());
 	return MEM_lockfree_callocN(len, str);
 }
 
@@ -428,7 +518,7 @@ void MEM_lockfree_callbackmemlist(void (*func)(void *))
 void MEM_lockfree_printmemlist_stats(void)
 {
 	printf("\ntotal memory len: %.3f MB\n",
-	       (double)mem_in_use / (double)(1024 * 1024));
+	       (double)mem_stats_mem_in_use() / (double)(1024 * 1024));
 	printf("peak memory len: %.3f MB\n",
 	       (double)peak_mem / (double)(1024 * 1024));
 	printf("\nFor more detailed per-block statistics run Blender with memory debugging command line argument.\n");
@@ -462,23 +552,23 @@ void MEM_lockfree_set_memory_debug(void)
 
 size_t MEM_lockfree_get_memory_in_use(void)
 {
-	return mem_in_use;
+	return mem_stats_mem_in_use();
 }
 
 size_t MEM_lockfree_get_mapped_memory_in_use(void)
 {
-	return mmap_in_use;
+	return mem_stats_mmap_in_use();
 }
 
 unsigned int MEM_lockfree_get_memory_blocks_in_use(void)
 {
-	return totblock;
+	return mem_stats_totblock();
 }
 
 /* dummy */
 void MEM_lockfree_reset_peak_memory(void)
 {
-	peak_mem = mem_in_use;
+	peak_mem = mem_stats_mem_in_use();
 }
 
 size_t MEM_lockfree_get_peak_memory(void)
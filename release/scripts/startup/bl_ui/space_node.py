@@ -132,6 +132,14 @@ class NODE_HT_header(Header):
 
         layout.template_running_jobs()
 
+        # Profiling statistics of the last compositing
+        if snode.tree_type == 'CompositorNodeTree' and snode.edit_tree:
+            node = snode.edit_tree.nodes.active
+            if node and node.execution_chunks:
+                layout.label(text="%s: %.2f ms (group) | %d chunks | %.2f MB" %
+                             (node.name, node.execution_time, node.execution_chunks,
+                              node.execution_memory / 1024.0))
+
 
 class NODE_MT_editor_menus(Menu):
     bl_idname = "NODE_MT_editor_menus"
@@ -425,6 +433,7 @@ class NODE_PT_quality(bpy.types.Panel):
         col.prop(tree, "use_opencl")
         col.prop(tree, "use_groupnode_buffer")
         col.prop(tree, "use_two_pass")
+        col.prop(tree, "use_progressive")
         col.prop(tree, "use_viewer_border")
         col.prop(snode, "show_highlight")
 
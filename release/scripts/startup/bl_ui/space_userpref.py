@@ -956,6 +956,7 @@ class USERPREF_PT_file(Panel):
         col.prop(paths, "save_version")
         col.prop(paths, "recent_files")
         col.prop(paths, "use_save_preview_images")
+        col.prop(paths, "use_save_background")
 
         col.separator()
 
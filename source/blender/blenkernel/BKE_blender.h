@@ -72,7 +72,7 @@ bool BKE_read_file_from_memory(
         struct bContext *C, const void *filebuf,
         int filelength, struct ReportList *reports, bool update_defaults);
 bool BKE_read_file_from_memfile(
-        struct bContext *C, struct MemFile *memfile,
+        struct bContext *C, struct MemFile *memfile, struct MemFile *oldmain_memfile,
         struct ReportList *reports);
 
 int BKE_read_file_userdef(const char *filepath, struct ReportList *reports);
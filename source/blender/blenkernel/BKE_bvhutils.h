@@ -172,5 +172,11 @@ void bvhcache_insert(BVHCache *cache, BVHTree *tree, int type);
 void bvhcache_init(BVHCache *cache);
 void bvhcache_free(BVHCache *cache);
 
+/**
+ * keeps the trees of a mesh which is re-evaluated, to refit them when only coordinates changed
+ */
+BVHCache bvhcache_detach(struct DerivedMesh *dm);
+void bvhcache_reuse(struct DerivedMesh *dm, BVHCache *cache_prev);
+
 #endif
 
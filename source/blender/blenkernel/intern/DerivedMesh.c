@@ -2568,8 +2568,15 @@ static void mesh_build_data(
         Scene *scene, Object *ob, CustomDataMask dataMask,
         const bool build_shapekey_layers, const bool need_mapping)
 {
+	BVHCache bvhcache_prev = NULL;
+
 	BLI_assert(ob->type == OB_MESH);
 
+	/* keep the BVH trees, they are refit when only the coordinates changed */
+	if (ob->derivedFinal) {
+		bvhcache_prev = bvhcache_detach(ob->derivedFinal);
+	}
+
 	BKE_object_free_derived_caches(ob);
 	BKE_object_sculpt_modifiers_changed(ob);
 
@@ -2586,6 +2593,10 @@ static void mesh_build_data(
 
 	DM_set_object_boundbox(ob, ob->derivedFinal);
 
+	if (bvhcache_prev) {
+		bvhcache_reuse(ob->derivedFinal, &bvhcache_prev);
+	}
+
 	ob->derivedFinal->needsFree = 0;
 	ob->derivedDeform->needsFree = 0;
 	ob->lastDataMask = dataMask;
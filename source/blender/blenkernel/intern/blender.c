@@ -49,10 +49,13 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "DNA_material_types.h"
+#include "DNA_object_types.h"
 #include "DNA_userdef_types.h"
 #include "DNA_scene_types.h"
 #include "DNA_screen_types.h"
 #include "DNA_windowmanager_types.h"
+#include "DNA_world_types.h"
 
 #include "BLI_blenlib.h"
 #include "BLI_utildefines.h"
@@ -85,6 +88,8 @@
 
 #include "BLF_api.h"
 
+#include "GPU_material.h"
+
 #include "BLO_undofile.h"
 #include "BLO_readfile.h" 
 #include "BLO_writefile.h" 
@@ -196,6 +201,88 @@ static bool wm_scene_is_visible(wmWindowManager *wm, Scene *scene)
 	return false;
 }
 
+/* ID's kept from the old main when reading an undo step (see BLO_read_from_memfile) have their users
+ * counted for the new main already, freeing the old ID's that used them must not change that */
+typedef struct ReusedIDUsers {
+	ID *id;
+	int us;
+} ReusedIDUsers;
+
+static ReusedIDUsers *reused_id_users_store(Main *bmain, int *r_len)
+{
+	ListBase *lbarray[MAX_LIBARRAY];
+	ReusedIDUsers *users;
+	ID *id;
+	int len = 0, a;
+
+	a = set_listbasepointers(bmain, lbarray);
+	while (a--) {
+		for (id = lbarray[a]->first; id; id = id->next) {
+			if (id->tag & LIB_TAG_UNDO_OLD_ID_REUSED) {
+				len++;
+			}
+		}
+	}
+
+	*r_len = len;
+	if (len == 0) {
+		return NULL;
+	}
+
+	users = MEM_mallocN(sizeof(*users) * (size_t)len, __func__);
+	len = 0;
+
+	a = set_listbasepointers(bmain, lbarray);
+	while (a--) {
+		for (id = lbarray[a]->first; id; id = id->next) {
+			if (id->tag & LIB_TAG_UNDO_OLD_ID_REUSED) {
+				users[len].id = id;
+				users[len].us = id->us;
+				len++;
+			}
+		}
+	}
+
+	return users;
+}
+
+static void reused_id_users_restore(ReusedIDUsers *users, const int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		users[i].id->us = users[i].us;
+		users[i].id->tag &= ~LIB_TAG_UNDO_OLD_ID_REUSED;
+	}
+
+	MEM_freeN(users);
+}
+
+/* GPU materials and lamps of the kept ID's are matched with the scene by its address,
+ * the scene is always read again so they have to be created again */
+static void reused_id_gpu_free(Main *bmain)
+{
+	Material *ma;
+	World *wo;
+	Object *ob;
+
+	for (ma = bmain->mat.first; ma; ma = ma->id.next) {
+		if (ma->id.tag & LIB_TAG_UNDO_OLD_ID_REUSED) {
+			GPU_material_free(&ma->gpumaterial);
+		}
+	}
+	for (wo = bmain->world.first; wo; wo = wo->id.next) {
+		if (wo->id.tag & LIB_TAG_UNDO_OLD_ID_REUSED) {
+			GPU_material_free(&wo->gpumaterial);
+		}
+	}
+	for (ob = bmain->object.first; ob; ob = ob->id.next) {
+		if ((ob->id.tag & LIB_TAG_UNDO_OLD_ID_REUSED) && ob->gpulamp.first) {
+			GPU_lamp_free(ob);
+		}
+	}
+}
+
 /* context matching */
 /* handle no-ui case */
 
@@ -206,6 +293,8 @@ static void setup_app_data(bContext *C, BlendFileData *bfd, const char *filepath
 {
 	bScreen *curscreen = NULL;
 	Scene *curscene = NULL;
+	ReusedIDUsers *reused_users = NULL;
+	int reused_users_len = 0;
 	int recover;
 	enum {
 		LOAD_UI = 1,
@@ -299,7 +388,16 @@ static void setup_app_data(bContext *C, BlendFileData *bfd, const char *filepath
 	
 	/* free G.main Main database */
 //	CTX_wm_manager_set(C, NULL);
+	if (mode == LOAD_UNDO) {
+		reused_id_gpu_free(bfd->main);
+		reused_users = reused_id_users_store(bfd->main, &reused_users_len);
+	}
+
 	clear_global();
+
+	if (reused_users) {
+		reused_id_users_restore(reused_users, reused_users_len);
+	}
 	
 	/* clear old property update cache, in case some old references are left dangling */
 	RNA_property_update_cache_free();
@@ -555,13 +653,14 @@ bool BKE_read_file_from_memory(
 }
 
 /* memfile is the undo buffer */
+/* oldmain_memfile: optional, see BLO_read_from_memfile */
 bool BKE_read_file_from_memfile(
-        bContext *C, MemFile *memfile,
+        bContext *C, MemFile *memfile, MemFile *oldmain_memfile,
         ReportList *reports)
 {
 	BlendFileData *bfd;
 
-	bfd = BLO_read_from_memfile(CTX_data_main(C), G.main->name, memfile, reports);
+	bfd = BLO_read_from_memfile(CTX_data_main(C), G.main->name, memfile, oldmain_memfile, reports);
 	if (bfd) {
 		/* remove the unused screens and wm */
 		while (bfd->main->wm.first)
@@ -647,7 +746,6 @@ typedef struct UndoElem {
 	char str[FILE_MAX];
 	char name[BKE_UNDO_STR_MAX];
 	MemFile memfile;
-	uintptr_t undosize;
 } UndoElem;
 
 static ListBase undobase = {NULL, NULL};
@@ -667,10 +765,18 @@ static int read_undosave(bContext *C, UndoElem *uel)
 	fileflags = G.fileflags;
 	G.fileflags |= G_FILE_NO_UI;
 
-	if (UNDO_DISK) 
+	if (UNDO_DISK) {
 		success = (BKE_read_file(C, uel->str, NULL) != BKE_READ_FILE_FAIL);
-	else
-		success = BKE_read_file_from_memfile(C, &uel->memfile, NULL);
+	}
+	else {
+		/* write the current state with the undo step as reference,
+		 * so the ID's that are the same in both can be kept instead of being read */
+		MemFile memfile_current = {{NULL, NULL}, 0};
+
+		BLO_write_file_mem(G.main, &uel->memfile, &memfile_current, G.fileflags);
+		success = BKE_read_file_from_memfile(C, &uel->memfile, &memfile_current, NULL);
+		BLO_memfile_free(&memfile_current);
+	}
 
 	/* restore */
 	BLI_strncpy(G.main->name, mainstr, sizeof(G.main->name)); /* restore */
@@ -687,7 +793,7 @@ static int read_undosave(bContext *C, UndoElem *uel)
 /* name can be a dynamic string */
 void BKE_undo_write(bContext *C, const char *name)
 {
-	uintptr_t maxmem, totmem, memused;
+	uintptr_t maxmem, totmem;
 	int nr /*, success */ /* UNUSED */;
 	UndoElem *uel;
 	
@@ -754,9 +860,7 @@ void BKE_undo_write(bContext *C, const char *name)
 		
 		if (curundo->prev) prevfile = &(curundo->prev->memfile);
 		
-		memused = MEM_get_memory_in_use();
 		/* success = */ /* UNUSED */ BLO_write_file_mem(CTX_data_main(C), prevfile, &curundo->memfile, G.fileflags);
-		curundo->undosize = MEM_get_memory_in_use() - memused;
 	}
 
 	if (U.undomemory != 0) {
@@ -767,7 +871,7 @@ void BKE_undo_write(bContext *C, const char *name)
 		/* keep at least two (original + other) */
 		uel = undobase.last;
 		while (uel && uel->prev) {
-			totmem += uel->undosize;
+			totmem += uel->memfile.size;
 			if (totmem > maxmem) break;
 			uel = uel->prev;
 		}
@@ -942,7 +1046,7 @@ bool BKE_undo_save_file(const char *filename)
 Main *BKE_undo_get_main(Scene **r_scene)
 {
 	Main *mainp = NULL;
-	BlendFileData *bfd = BLO_read_from_memfile(G.main, G.main->name, &curundo->memfile, NULL);
+	BlendFileData *bfd = BLO_read_from_memfile(G.main, G.main->name, &curundo->memfile, NULL, NULL);
 	
 	if (bfd) {
 		mainp = bfd->main;
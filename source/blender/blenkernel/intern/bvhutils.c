@@ -48,6 +48,10 @@
 
 static ThreadRWMutex cache_rwlock = BLI_RWLOCK_INITIALIZER;
 
+static BVHTree *bvhcache_refit(
+        BVHCache *cache, DerivedMesh *dm, int type,
+        BVHTree_LeafPointsCallback callback, void *userdata);
+
 /* -------------------------------------------------------------------- */
 /** \name Local Callbacks
  * \{ */
@@ -446,6 +450,23 @@ static void bvhtree_from_mesh_verts_setup_data(
 	}
 }
 
+/* Mesh arrays used to refit cached trees, see #bvhcache_refit */
+typedef struct BVHRefitData {
+	const MVert *vert;
+	const MEdge *edge;
+	const MFace *face;
+	const MLoop *loop;
+	const MLoopTri *looptri;
+} BVHRefitData;
+
+static int bvhtree_refit_verts_cb(void *userdata, int index, float r_co[][3])
+{
+	const BVHRefitData *data = userdata;
+
+	copy_v3_v3(r_co[0], data->vert[index].co);
+	return 1;
+}
+
 /* Builds a bvh tree where nodes are the vertices of the given dm */
 BVHTree *bvhtree_from_mesh_verts(BVHTreeFromMesh *data, DerivedMesh *dm, float epsilon, int tree_type, int axis)
 {
@@ -463,6 +484,10 @@ BVHTree *bvhtree_from_mesh_verts(BVHTreeFromMesh *data, DerivedMesh *dm, float e
 	if (tree == NULL) {
 		BLI_rw_mutex_lock(&cache_rwlock, THREAD_LOCK_WRITE);
 		tree = bvhcache_find(&dm->bvhCache, BVHTREE_FROM_VERTS);
+		if (tree == NULL && vert) {
+			BVHRefitData refit_data = {.vert = vert};
+			tree = bvhcache_refit(&dm->bvhCache, dm, BVHTREE_FROM_VERTS, bvhtree_refit_verts_cb, &refit_data);
+		}
 		if (tree == NULL) {
 			tree = bvhtree_from_mesh_verts_create_tree(epsilon, tree_type, axis, vert, dm->getNumVerts(dm), NULL, -1);
 			if (tree) {
@@ -510,6 +535,16 @@ BVHTree *bvhtree_from_mesh_verts_ex(
 /** \name Edge Builder
  * \{ */
 
+static int bvhtree_refit_edges_cb(void *userdata, int index, float r_co[][3])
+{
+	const BVHRefitData *data = userdata;
+	const MEdge *edge = &data->edge[index];
+
+	copy_v3_v3(r_co[0], data->vert[edge->v1].co);
+	copy_v3_v3(r_co[1], data->vert[edge->v2].co);
+	return 2;
+}
+
 /* Builds a bvh tree where nodes are the edges of the given dm */
 BVHTree *bvhtree_from_mesh_edges(BVHTreeFromMesh *data, DerivedMesh *dm, float epsilon, int tree_type, int axis)
 {
@@ -529,6 +564,10 @@ BVHTree *bvhtree_from_mesh_edges(BVHTreeFromMesh *data, DerivedMesh *dm, float e
 	if (tree == NULL) {
 		BLI_rw_mutex_lock(&cache_rwlock, THREAD_LOCK_WRITE);
 		tree = bvhcache_find(&dm->bvhCache, BVHTREE_FROM_EDGES);
+		if (tree == NULL && vert && edge) {
+			BVHRefitData refit_data = {.vert = vert, .edge = edge};
+			tree = bvhcache_refit(&dm->bvhCache, dm, BVHTREE_FROM_EDGES, bvhtree_refit_edges_cb, &refit_data);
+		}
 		if (tree == NULL) {
 			int i;
 			int numEdges = dm->getNumEdges(dm);
@@ -746,6 +785,21 @@ static void bvhtree_from_mesh_faces_setup_data(
 	}
 }
 
+static int bvhtree_refit_faces_cb(void *userdata, int index, float r_co[][3])
+{
+	const BVHRefitData *data = userdata;
+	const MFace *face = &data->face[index];
+
+	copy_v3_v3(r_co[0], data->vert[face->v1].co);
+	copy_v3_v3(r_co[1], data->vert[face->v2].co);
+	copy_v3_v3(r_co[2], data->vert[face->v3].co);
+	if (face->v4) {
+		copy_v3_v3(r_co[3], data->vert[face->v4].co);
+		return 4;
+	}
+	return 3;
+}
+
 /* Builds a bvh tree where nodes are the tesselated faces of the given dm */
 BVHTree *bvhtree_from_mesh_faces(BVHTreeFromMesh *data, DerivedMesh *dm, float epsilon, int tree_type, int axis)
 {
@@ -771,6 +825,10 @@ BVHTree *bvhtree_from_mesh_faces(BVHTreeFromMesh *data, DerivedMesh *dm, float e
 	if (tree == NULL) {
 		BLI_rw_mutex_lock(&cache_rwlock, THREAD_LOCK_WRITE);
 		tree = bvhcache_find(&dm->bvhCache, bvhcache_type);
+		if (tree == NULL && em == NULL && vert && face) {
+			BVHRefitData refit_data = {.vert = vert, .face = face};
+			tree = bvhcache_refit(&dm->bvhCache, dm, bvhcache_type, bvhtree_refit_faces_cb, &refit_data);
+		}
 		if (tree == NULL) {
 			int numFaces;
 
@@ -996,6 +1054,17 @@ static void bvhtree_from_mesh_looptri_setup_data(
 	}
 }
 
+static int bvhtree_refit_looptri_cb(void *userdata, int index, float r_co[][3])
+{
+	const BVHRefitData *data = userdata;
+	const MLoopTri *lt = &data->looptri[index];
+
+	copy_v3_v3(r_co[0], data->vert[data->loop[lt->tri[0]].v].co);
+	copy_v3_v3(r_co[1], data->vert[data->loop[lt->tri[1]].v].co);
+	copy_v3_v3(r_co[2], data->vert[data->loop[lt->tri[2]].v].co);
+	return 3;
+}
+
 /**
  * Builds a bvh tree where nodes are the looptri faces of the given dm
  *
@@ -1044,6 +1113,10 @@ BVHTree *bvhtree_from_mesh_looptri(BVHTreeFromMesh *data, DerivedMesh *dm, float
 	if (tree == NULL) {
 		BLI_rw_mutex_lock(&cache_rwlock, THREAD_LOCK_WRITE);
 		tree = bvhcache_find(&dm->bvhCache, bvhcache_type);
+		if (tree == NULL && em == NULL && mvert && looptri) {
+			BVHRefitData refit_data = {.vert = mvert, .loop = mloop, .looptri = looptri};
+			tree = bvhcache_refit(&dm->bvhCache, dm, bvhcache_type, bvhtree_refit_looptri_cb, &refit_data);
+		}
 		if (tree == NULL) {
 			int looptri_num;
 
@@ -1151,26 +1224,31 @@ typedef struct BVHCacheItem {
 	int type;
 	BVHTree *tree;
 
+	/* set on trees kept from a previous mesh, see #bvhcache_reuse */
+	bool needs_refit;
+	/* number of vertices and elements of the mesh the tree was built for */
+	int totvert, totelem;
 } BVHCacheItem;
 
-static void bvhcacheitem_set_if_match(void *_cached, void *_search)
+static BVHCacheItem *bvhcache_find_item(BVHCache *cache, int type)
 {
-	BVHCacheItem *cached = (BVHCacheItem *)_cached;
-	BVHCacheItem *search = (BVHCacheItem *)_search;
+	LinkNode *node;
 
-	if (search->type == cached->type) {
-		search->tree = cached->tree;
+	for (node = *cache; node; node = node->next) {
+		BVHCacheItem *item = node->link;
+		if (item->type == type) {
+			return item;
+		}
 	}
-} 
+	return NULL;
+}
 
 BVHTree *bvhcache_find(BVHCache *cache, int type)
 {
-	BVHCacheItem item;
-	item.type = type;
-	item.tree = NULL;
+	BVHCacheItem *item = bvhcache_find_item(cache, type);
 
-	BLI_linklist_apply(*cache, bvhcacheitem_set_if_match, &item);
-	return item.tree;
+	/* trees waiting for a refit are not usable yet */
+	return (item && !item->needs_refit) ? item->tree : NULL;
 }
 
 void bvhcache_insert(BVHCache *cache, BVHTree *tree, int type)
@@ -1178,9 +1256,9 @@ void bvhcache_insert(BVHCache *cache, BVHTree *tree, int type)
 	BVHCacheItem *item = NULL;
 
 	assert(tree != NULL);
-	assert(bvhcache_find(cache, type) == NULL);
+	assert(bvhcache_find_item(cache, type) == NULL);
 
-	item = MEM_mallocN(sizeof(BVHCacheItem), "BVHCacheItem");
+	item = MEM_callocN(sizeof(BVHCacheItem), "BVHCacheItem");
 	assert(item != NULL);
 
 	item->type = type;
@@ -1189,7 +1267,6 @@ void bvhcache_insert(BVHCache *cache, BVHTree *tree, int type)
 	BLI_linklist_prepend(cache, item);
 }
 
-
 void bvhcache_init(BVHCache *cache)
 {
 	*cache = NULL;
@@ -1210,4 +1287,113 @@ void bvhcache_free(BVHCache *cache)
 	*cache = NULL;
 }
 
+static void bvhcache_topology_get(DerivedMesh *dm, int type, int *r_totvert, int *r_totelem)
+{
+	*r_totvert = dm->getNumVerts(dm);
+
+	switch (type) {
+		case BVHTREE_FROM_VERTS:
+			*r_totelem = *r_totvert;
+			break;
+		case BVHTREE_FROM_EDGES:
+			*r_totelem = dm->getNumEdges(dm);
+			break;
+		case BVHTREE_FROM_FACES:
+			*r_totelem = dm->getNumTessFaces(dm);
+			break;
+		case BVHTREE_FROM_LOOPTRI:
+			*r_totelem = dm->getNumLoopTri(dm);
+			break;
+		default:
+			BLI_assert(0);
+			*r_totelem = -1;
+			break;
+	}
+}
+
+/**
+ * Takes the cache of a derived mesh which is about to be freed,
+ * so the trees can be refit for the next evaluation of the same object, see #bvhcache_reuse.
+ */
+BVHCache bvhcache_detach(DerivedMesh *dm)
+{
+	BVHCache cache = dm->bvhCache;
+	LinkNode *node;
+
+	for (node = cache; node; node = node->next) {
+		BVHCacheItem *item = node->link;
+		if (item->type <= BVHTREE_FROM_LOOPTRI) {
+			bvhcache_topology_get(dm, item->type, &item->totvert, &item->totelem);
+		}
+	}
+
+	dm->bvhCache = NULL;
+	return cache;
+}
+
+/**
+ * Hands the trees of a detached cache over to \a dm. They are refit to the new coordinates
+ * the first time they are requested, if the element counts still match (otherwise they are rebuilt),
+ * so deforming a mesh doesn't rebuild its trees on every evaluation.
+ *
+ * Trees of edit-mesh caches depend on selection and visibility and are freed.
+ */
+void bvhcache_reuse(DerivedMesh *dm, BVHCache *cache_prev)
+{
+	LinkNode *node, *node_next;
+
+	BLI_rw_mutex_lock(&cache_rwlock, THREAD_LOCK_WRITE);
+	for (node = *cache_prev; node; node = node_next) {
+		BVHCacheItem *item = node->link;
+		node_next = node->next;
+
+		if (item->type <= BVHTREE_FROM_LOOPTRI && bvhcache_find_item(&dm->bvhCache, item->type) == NULL) {
+			item->needs_refit = true;
+			BLI_linklist_prepend(&dm->bvhCache, item);
+		}
+		else {
+			bvhcacheitem_free(item);
+		}
+		MEM_freeN(node);
+	}
+	BLI_rw_mutex_unlock(&cache_rwlock);
+
+	*cache_prev = NULL;
+}
+
+/**
+ * Refits a reused tree (see #bvhcache_reuse) when the mesh still has the same number of elements,
+ * otherwise removes it from the cache so a new one is built. Call with the write lock held.
+ */
+static BVHTree *bvhcache_refit(
+        BVHCache *cache, DerivedMesh *dm, int type,
+        BVHTree_LeafPointsCallback callback, void *userdata)
+{
+	LinkNode **node_p;
+
+	for (node_p = cache; *node_p; node_p = &(*node_p)->next) {
+		BVHCacheItem *item = (*node_p)->link;
+
+		if (item->type == type && item->needs_refit) {
+			int totvert, totelem;
+
+			bvhcache_topology_get(dm, type, &totvert, &totelem);
+
+			if (totvert == item->totvert && totelem == item->totelem) {
+				BLI_bvhtree_refit(item->tree, callback, userdata);
+				item->needs_refit = false;
+				return item->tree;
+			}
+			else {
+				LinkNode *node = *node_p;
+				*node_p = node->next;
+				bvhcacheitem_free(item);
+				MEM_freeN(node);
+				return NULL;
+			}
+		}
+	}
+	return NULL;
+}
+
 /** \} */
@@ -41,6 +41,7 @@
 #include "BLI_listbase.h"
 #include "BLI_edgehash.h"
 #include "BLI_string.h"
+#include "BLI_task.h"
 
 #include "BKE_animsys.h"
 #include "BKE_main.h"
@@ -1918,15 +1919,45 @@ int BKE_mesh_edge_other_vert(const MEdge *e, int v)
 }
 
 /* basic vertex data functions */
+typedef struct MinMaxData {
+	float min[3], max[3];
+} MinMaxData;
+
+static void mesh_minmax_task_cb(void *userdata, void *userdata_chunk, int i)
+{
+	const MVert *mvert = userdata;
+	MinMaxData *minmax = userdata_chunk;
+
+	minmax_v3v3_v3(minmax->min, minmax->max, mvert[i].co);
+}
+
+static void mesh_minmax_reduce(void *UNUSED(userdata), void *__restrict chunk_join, void *__restrict chunk)
+{
+	MinMaxData *minmax_join = chunk_join;
+	const MinMaxData *minmax = chunk;
+
+	minmax_v3v3_v3(minmax_join->min, minmax_join->max, minmax->min);
+	minmax_v3v3_v3(minmax_join->min, minmax_join->max, minmax->max);
+}
+
 bool BKE_mesh_minmax(const Mesh *me, float r_min[3], float r_max[3])
 {
-	int i = me->totvert;
-	MVert *mvert;
-	for (mvert = me->mvert; i--; mvert++) {
-		minmax_v3v3_v3(r_min, r_max, mvert->co);
+	MinMaxData minmax;
+
+	if (me->totvert == 0) {
+		return false;
 	}
-	
-	return (me->totvert != 0);
+
+	INIT_MINMAX(minmax.min, minmax.max);
+
+	BLI_task_parallel_reduce(
+	        0, me->totvert, me->mvert, &minmax, sizeof(minmax), mesh_minmax_task_cb, mesh_minmax_reduce,
+	        me->totvert >= BKE_MESH_OMP_LIMIT);
+
+	minmax_v3v3_v3(r_min, r_max, minmax.min);
+	minmax_v3v3_v3(r_min, r_max, minmax.max);
+
+	return true;
 }
 
 void BKE_mesh_transform(Mesh *me, float mat[4][4], bool do_keys)
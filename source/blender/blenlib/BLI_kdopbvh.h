@@ -78,6 +78,11 @@ enum {
 };
 #define BVH_RAYCAST_DEFAULT (BVH_RAYCAST_WATERTIGHT)
 
+enum {
+	/* choose split axes using the surface area heuristic */
+	BVH_BALANCE_SAH		= (1 << 0),
+};
+
 /* callback must update nearest in case it finds a nearest result */
 typedef void (*BVHTree_NearestPointCallback)(void *userdata, int index, const float co[3], BVHTreeNearest *nearest);
 
@@ -90,16 +95,22 @@ typedef bool (*BVHTree_OverlapCallback)(void *userdata, int index_a, int index_b
 /* callback to range search query */
 typedef void (*BVHTree_RangeQuery)(void *userdata, int index, float dist_sq);
 
+/* callback to refit a leaf, fills in (up to BVH_LEAF_MAX_POINTS) points of an element, returns their number */
+typedef int (*BVHTree_LeafPointsCallback)(void *userdata, int index, float r_co[][3]);
+#define BVH_LEAF_MAX_POINTS 4
+
 BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis);
 void BLI_bvhtree_free(BVHTree *tree);
 
 /* construct: first insert points, then call balance */
 void BLI_bvhtree_insert(BVHTree *tree, int index, const float co[3], int numpoints);
 void BLI_bvhtree_balance(BVHTree *tree);
+void BLI_bvhtree_balance_ex(BVHTree *tree, const int flag);
 
 /* update: first update points/nodes, then call update_tree to refit the bounding volumes */
 bool BLI_bvhtree_update_node(BVHTree *tree, int index, const float co[3], const float co_moving[3], int numpoints);
 void BLI_bvhtree_update_tree(BVHTree *tree);
+void BLI_bvhtree_refit(BVHTree *tree, BVHTree_LeafPointsCallback callback, void *userdata);
 
 int BLI_bvhtree_overlap_thread_num(const BVHTree *tree);
 
@@ -131,6 +142,12 @@ int BLI_bvhtree_ray_cast_all(
         BVHTree *tree, const float co[3], const float dir[3], float radius,
         BVHTree_RayCastCallback callback, void *userdata);
 
+/* cast many rays using multiple threads, callback must be thread-safe */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int totray, float radius,
+        BVHTreeRayHit *hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag);
+
 float BLI_bvhtree_bb_raycast(const float bv[6], const float light_start[3], const float light_end[3], float pos[3]);
 
 /* range query */
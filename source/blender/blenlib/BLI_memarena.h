@@ -56,6 +56,19 @@ void               *BLI_memarena_alloc(struct MemArena *ma, size_t size) ATTR_WA
 void               *BLI_memarena_calloc(struct MemArena *ma, size_t size) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(1) ATTR_MALLOC ATTR_ALLOC_SIZE(2);
 
 void BLI_memarena_clear(MemArena *ma) ATTR_NONNULL(1);
+void BLI_memarena_merge(MemArena *ma_dst, MemArena *ma_src) ATTR_NONNULL(1, 2);
+
+/* thread-local arenas, one per thread of a parallel region, see #BLI_task_scheduler_thread_id */
+struct MemArenaThreaded;
+typedef struct MemArenaThreaded MemArenaThreaded;
+
+MemArenaThreaded *BLI_memarena_threaded_new(const size_t bufsize, const char *name,
+                                            const int num_threads) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(2) ATTR_MALLOC;
+void              BLI_memarena_threaded_use_calloc(MemArenaThreaded *mat) ATTR_NONNULL(1);
+void              BLI_memarena_threaded_use_align(MemArenaThreaded *mat, const size_t align) ATTR_NONNULL(1);
+struct MemArena  *BLI_memarena_threaded_get(MemArenaThreaded *mat, const int thread_id) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(1);
+struct MemArena  *BLI_memarena_threaded_merge(MemArenaThreaded *mat) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(1);
+void              BLI_memarena_threaded_free(MemArenaThreaded *mat) ATTR_NONNULL(1);
 
 #ifdef __cplusplus
 }
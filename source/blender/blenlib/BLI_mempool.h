@@ -54,6 +54,7 @@ void         BLI_mempool_clear_ex(BLI_mempool *pool,
 void         BLI_mempool_clear(BLI_mempool *pool) ATTR_NONNULL(1);
 void         BLI_mempool_destroy(BLI_mempool *pool) ATTR_NONNULL(1);
 int          BLI_mempool_count(BLI_mempool *pool) ATTR_NONNULL(1);
+void         BLI_mempool_merge(BLI_mempool *pool, BLI_mempool *pool_src) ATTR_NONNULL(1, 2);
 void        *BLI_mempool_findelem(BLI_mempool *pool, unsigned int index) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(1);
 
 void        BLI_mempool_as_table(BLI_mempool *pool, void **data) ATTR_NONNULL(1, 2);
@@ -71,6 +72,9 @@ typedef struct BLI_mempool_iter {
 	BLI_mempool *pool;
 	struct BLI_mempool_chunk *curchunk;
 	unsigned int curindex;
+
+	/* next chunk to claim, shared by the iterators from BLI_mempool_iter_threadsafe_create */
+	struct BLI_mempool_chunk **curchunk_threadsafe;
 } BLI_mempool_iter;
 
 /* flag */
@@ -87,6 +91,22 @@ enum {
 void  BLI_mempool_iternew(BLI_mempool *pool, BLI_mempool_iter *iter) ATTR_NONNULL();
 void *BLI_mempool_iterstep(BLI_mempool_iter *iter) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL();
 
+BLI_mempool_iter *BLI_mempool_iter_threadsafe_create(BLI_mempool *pool, const size_t num_iter)
+ATTR_WARN_UNUSED_RESULT ATTR_NONNULL();
+void  BLI_mempool_iter_threadsafe_free(BLI_mempool_iter *iter_arr) ATTR_NONNULL();
+void *BLI_mempool_iterstep_threadsafe(BLI_mempool_iter *iter) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL();
+
+/** thread-local pools, one per thread of a parallel region, see #BLI_task_scheduler_thread_id **/
+typedef struct BLI_mempool_threaded BLI_mempool_threaded;
+
+BLI_mempool_threaded *BLI_mempool_threaded_create(unsigned int esize, unsigned int totelem,
+                                                  unsigned int pchunk, unsigned int flag,
+                                                  const int num_threads) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+BLI_mempool *BLI_mempool_threaded_get(BLI_mempool_threaded *tpool, const int thread_id)
+ATTR_WARN_UNUSED_RESULT ATTR_NONNULL(1);
+void         BLI_mempool_threaded_merge(BLI_mempool_threaded *tpool, BLI_mempool *pool) ATTR_NONNULL(1, 2);
+void         BLI_mempool_threaded_destroy(BLI_mempool_threaded *tpool) ATTR_NONNULL(1);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,96 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+#ifndef __BLI_OAHASH_H__
+#define __BLI_OAHASH_H__
+
+/** \file BLI_oahash.h
+ *  \ingroup bli
+ *
+ * Open addressing (pointer -> pointer) hash table, same usage as GHash but entries are stored
+ * in the table itself, so lookups don't chase pointers.
+ */
+
+#include "BLI_sys_types.h" /* for bool */
+#include "BLI_compiler_attrs.h"
+#include "BLI_ghash.h"  /* for hash/compare/free function types */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct OAHash OAHash;
+
+typedef struct OAHashIterator {
+	OAHash *oh;
+	unsigned int index;
+} OAHashIterator;
+
+/* *** */
+
+OAHash *BLI_oahash_new_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                          const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+OAHash *BLI_oahash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+/* keys are pointers or integers (SET_INT_IN_POINTER) compared by value, hashing and comparing is inlined */
+OAHash *BLI_oahash_ptr_new_ex(const char *info, const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+OAHash *BLI_oahash_ptr_new(const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+#define BLI_oahash_int_new_ex BLI_oahash_ptr_new_ex
+#define BLI_oahash_int_new BLI_oahash_ptr_new
+void    BLI_oahash_free(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void    BLI_oahash_reserve(OAHash *oh, const unsigned int nentries_reserve);
+void    BLI_oahash_insert(OAHash *oh, void *key, void *val);
+bool    BLI_oahash_reinsert(OAHash *oh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void   *BLI_oahash_lookup(const OAHash *oh, const void *key) ATTR_WARN_UNUSED_RESULT;
+void   *BLI_oahash_lookup_default(const OAHash *oh, const void *key, void *val_default) ATTR_WARN_UNUSED_RESULT;
+void  **BLI_oahash_lookup_p(OAHash *oh, const void *key) ATTR_WARN_UNUSED_RESULT;
+bool    BLI_oahash_ensure_p(OAHash *oh, void *key, void ***r_val) ATTR_WARN_UNUSED_RESULT;
+bool    BLI_oahash_remove(OAHash *oh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void    BLI_oahash_clear(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void    BLI_oahash_clear_ex(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp,
+                            const unsigned int nentries_reserve);
+void   *BLI_oahash_popkey(OAHash *oh, const void *key, GHashKeyFreeFP keyfreefp) ATTR_WARN_UNUSED_RESULT;
+bool    BLI_oahash_haskey(const OAHash *oh, const void *key) ATTR_WARN_UNUSED_RESULT;
+unsigned int BLI_oahash_size(const OAHash *oh) ATTR_WARN_UNUSED_RESULT;
+
+/* *** */
+
+/* note: removing or inserting items while iterating is not supported, entries move around */
+void   BLI_oahashIterator_init(OAHashIterator *ohi, OAHash *oh);
+void   BLI_oahashIterator_step(OAHashIterator *ohi);
+void  *BLI_oahashIterator_getKey(OAHashIterator *ohi) ATTR_WARN_UNUSED_RESULT;
+void  *BLI_oahashIterator_getValue(OAHashIterator *ohi) ATTR_WARN_UNUSED_RESULT;
+void **BLI_oahashIterator_getValue_p(OAHashIterator *ohi) ATTR_WARN_UNUSED_RESULT;
+bool   BLI_oahashIterator_done(OAHashIterator *ohi) ATTR_WARN_UNUSED_RESULT;
+
+#define OAHASH_ITER(oh_iter_, oahash_) \
+	for (BLI_oahashIterator_init(&oh_iter_, oahash_); \
+	     BLI_oahashIterator_done(&oh_iter_) == false; \
+	     BLI_oahashIterator_step(&oh_iter_))
+
+/* *** */
+
+double BLI_oahash_calc_quality_ex(OAHash *oh, double *r_load, unsigned int *r_probe_max);
+double BLI_oahash_calc_quality(OAHash *oh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __BLI_OAHASH_H__ */
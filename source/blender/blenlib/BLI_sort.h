@@ -45,7 +45,7 @@ typedef int (*BLI_sort_cmp_t)(const void *a, const void *b, void *ctx);
 
 void BLI_qsort_r(void *a, size_t n, size_t es, BLI_sort_cmp_t cmp, void *thunk)
 #ifdef __GNUC__
-__attribute__((nonnull(1, 5)))
+__attribute__((nonnull(1, 4)))
 #endif
 ;
 
@@ -32,10 +32,16 @@ extern "C" {
 #include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
+struct BLI_mempool;
+struct Link;
+struct ListBase;
+
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A single
- * queue holds the task from all pools.
+ * Central scheduler that holds running threads ready to execute tasks. Each
+ * worker thread has its own queue holding the tasks it pushed, tasks pushed
+ * from other threads go to a shared queue. Threads without work steal tasks
+ * from the other queues.
  *
  * Init/exit must be called before/after any task pools are created/freed, and
  * must be called from the main threads. All other scheduler and pool functions
@@ -52,6 +58,10 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads);
 void BLI_task_scheduler_free(TaskScheduler *scheduler);
 
 int BLI_task_scheduler_num_threads(TaskScheduler *scheduler);
+/* Index of the calling thread in [0, BLI_task_scheduler_num_threads), 0 for threads not owned by the
+ * scheduler. Use to index per thread data in tasks (e.g. thread-local mempools), the data may only be
+ * used from one thread not owned by the scheduler, the one waiting for the tasks. */
+int BLI_task_scheduler_thread_id(TaskScheduler *scheduler);
 
 /* Task Pool
  *
@@ -64,7 +74,9 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler);
  * Pools may be nested, i.e. a thread running a task can create another task
  * pool with smaller tasks. When other threads are busy they will continue
  * working on their own tasks, if not they will join in, no new threads will
- * be launched.
+ * be launched. Threads waiting for a pool run the tasks of that pool and of
+ * the pools nested in it, so waiting inside a task (for example for a
+ * BLI_task_parallel_range) keeps the thread busy instead of blocking it.
  */
 
 typedef enum TaskPriority {
@@ -126,6 +138,48 @@ void BLI_task_parallel_range(
         void *userdata,
         TaskParallelRangeFunc func);
 
+/* Parallel reduction, userdata_chunk holds the initial value and receives the result */
+typedef void (*TaskParallelReduceFunc)(void *userdata, void *__restrict chunk_join, void *__restrict chunk);
+void BLI_task_parallel_reduce(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeFunc func,
+        TaskParallelReduceFunc reduce,
+        const bool use_threading);
+
+/* Parallel prefix sum (exclusive), returns the total */
+int BLI_task_parallel_prefix_sum_i(int *data, const int num, const bool use_threading);
+
+/* Parallel sort and stable partition of arrays */
+typedef bool (*TaskParallelPredicateFunc)(const void *elem, void *userdata);
+/* cmp is a #BLI_sort_cmp_t, spelled out to avoid including BLI_sort.h here */
+void BLI_task_parallel_sort(
+        void *array, const size_t num, const size_t size,
+        int (*cmp)(const void *a, const void *b, void *ctx), void *thunk,
+        const bool use_threading);
+size_t BLI_task_parallel_partition(
+        void *array, const size_t num, const size_t size,
+        TaskParallelPredicateFunc pred, void *userdata,
+        const bool use_threading);
+
+/* Parallel iteration over lists and mempools */
+typedef void (*TaskParallelListbaseFunc)(void *userdata, struct Link *iter, int index);
+void BLI_task_parallel_listbase(
+        struct ListBase *listbase,
+        void *userdata,
+        TaskParallelListbaseFunc func,
+        const bool use_threading);
+
+typedef struct MempoolIterData MempoolIterData;
+typedef void (*TaskParallelMempoolFunc)(void *userdata, MempoolIterData *iter);
+void BLI_task_parallel_mempool(
+        struct BLI_mempool *mempool,
+        void *userdata,
+        TaskParallelMempoolFunc func,
+        const bool use_threading);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,440 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/BLI_concurrent_ghash.c
+ *  \ingroup bli
+ *
+ * A thread safe hash table using lock striping: keys are distributed over a number of shards,
+ * each one a regular GHash protected by its own read/write lock. Threads working on different
+ * shards never wait on each other, and lookups only take a read lock so they run concurrently
+ * even on the same shard.
+ *
+ * The shard is chosen from the high bits of the (scrambled) key hash, while GHash uses the
+ * hash modulo its bucket count, so keys of one shard still spread over all of its buckets.
+ *
+ * Values returned by lookups are not protected once the function returns, callers which
+ * remove entries while other threads use their values need their own reference counting.
+ */
+
+#include <stdlib.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_concurrent_ghash.h"
+#include "BLI_math_base.h"
+#include "BLI_threads.h"
+
+#include "BLI_strict_flags.h"
+
+/* shards per thread, more shards make collisions of threads on one lock less likely */
+#define CGHASH_SHARDS_PER_THREAD 4
+#define CGHASH_SHARDS_MIN 16
+#define CGHASH_SHARDS_MAX 1024
+
+typedef struct ConcurrentGHashShard {
+	GHash *gh;
+	ThreadRWMutex lock;
+
+	/* avoid false sharing of the locks of different shards */
+	char pad[64 - (sizeof(GHash *) + sizeof(ThreadRWMutex)) % 64];
+} ConcurrentGHashShard;
+
+struct ConcurrentGHash {
+	GHashHashFP hashfp;
+
+	ConcurrentGHashShard *shards;
+	unsigned int shards_num;
+	/* 32 - log2(shards_num) */
+	unsigned int shard_shift;
+};
+
+/* -------------------------------------------------------------------- */
+/* ConcurrentGHash API */
+
+/** \name Internal Utility API
+ * \{ */
+
+BLI_INLINE ConcurrentGHashShard *cghash_shard_get(ConcurrentGHash *cgh, const void *key)
+{
+	/* Fibonacci hashing, so hash functions with poor high bits still use all shards */
+	const unsigned int hash = cgh->hashfp(key) * 0x9E3779B1u;
+	return &cgh->shards[hash >> cgh->shard_shift];
+}
+
+/** \} */
+
+
+/** \name Public API
+ * \{ */
+
+/**
+ * Creates a new, empty ConcurrentGHash.
+ *
+ * \param hashfp  Hash callback, must be thread safe.
+ * \param cmpfp  Comparison callback, must be thread safe.
+ * \param info  Identifier string for the ConcurrentGHash.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ * \return  A ConcurrentGHash struct.
+ */
+ConcurrentGHash *BLI_concurrent_ghash_new_ex(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+        const unsigned int nentries_reserve)
+{
+	ConcurrentGHash *cgh = MEM_mallocN(sizeof(*cgh), info);
+	unsigned int shards_num = (unsigned int)BLI_system_thread_count() * CGHASH_SHARDS_PER_THREAD;
+	unsigned int i;
+
+	shards_num = power_of_2_max_u(CLAMPIS(shards_num, CGHASH_SHARDS_MIN, CGHASH_SHARDS_MAX));
+
+	cgh->hashfp = hashfp;
+	cgh->shards_num = shards_num;
+	cgh->shard_shift = 32;
+	while (shards_num > 1) {
+		cgh->shard_shift--;
+		shards_num >>= 1;
+	}
+
+	cgh->shards = MEM_mallocN_aligned(sizeof(*cgh->shards) * cgh->shards_num, 64, info);
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+		shard->gh = BLI_ghash_new_ex(hashfp, cmpfp, info, nentries_reserve / cgh->shards_num);
+		BLI_rw_mutex_init(&shard->lock);
+	}
+
+	return cgh;
+}
+
+/**
+ * Wraps #BLI_concurrent_ghash_new_ex with zero entries reserved.
+ */
+ConcurrentGHash *BLI_concurrent_ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
+{
+	return BLI_concurrent_ghash_new_ex(hashfp, cmpfp, info, 0);
+}
+
+/**
+ * Frees the ConcurrentGHash and its members, no other thread may use it at this point.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_concurrent_ghash_free(ConcurrentGHash *cgh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+		BLI_ghash_free(shard->gh, keyfreefp, valfreefp);
+		BLI_rw_mutex_end(&shard->lock);
+	}
+
+	MEM_freeN(cgh->shards);
+	MEM_freeN(cgh);
+}
+
+/**
+ * Insert a key/value pair into the \a cgh.
+ *
+ * \note Duplicates are not checked, the caller is expected to ensure elements are unique,
+ * use #BLI_concurrent_ghash_add when other threads may add the same key.
+ */
+void BLI_concurrent_ghash_insert(ConcurrentGHash *cgh, void *key, void *val)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	BLI_ghash_insert(shard->gh, key, val);
+	BLI_rw_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Insert a key/value pair if the key is not in \a cgh yet.
+ *
+ * \returns true if the key has been added, false if it was already there (\a cgh is unchanged).
+ */
+bool BLI_concurrent_ghash_add(ConcurrentGHash *cgh, void *key, void *val)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void **val_p;
+	bool haskey;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	haskey = BLI_ghash_ensure_p(shard->gh, key, &val_p);
+	if (!haskey) {
+		*val_p = val;
+	}
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return !haskey;
+}
+
+/**
+ * Inserts a new value to a key that may already be in \a cgh.
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_concurrent_ghash_reinsert(ConcurrentGHash *cgh, void *key, void *val,
+                                   GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	bool added;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	added = BLI_ghash_reinsert(shard->gh, key, val, keyfreefp, valfreefp);
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return added;
+}
+
+/**
+ * Lookup the value of \a key in \a cgh.
+ *
+ * \returns the value for \a key or NULL.
+ */
+void *BLI_concurrent_ghash_lookup(ConcurrentGHash *cgh, const void *key)
+{
+	return BLI_concurrent_ghash_lookup_default(cgh, key, NULL);
+}
+
+/**
+ * A version of #BLI_concurrent_ghash_lookup which accepts a fallback argument.
+ */
+void *BLI_concurrent_ghash_lookup_default(ConcurrentGHash *cgh, const void *key, void *val_default)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void *val;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+	val = BLI_ghash_lookup_default(shard->gh, key, val_default);
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return val;
+}
+
+/**
+ * Ensure \a key is in \a cgh, creating its value when it isn't.
+ *
+ * This is the thread safe version of the #BLI_ghash_ensure_p pattern, the value is created by
+ * \a valcreatefp while the shard is locked, so when multiple threads ensure the same key
+ * only one of them creates the value and the others get it.
+ *
+ * \param keycopyfp  Optional callback to copy the key when it's added (when NULL \a key is stored).
+ * \param valcreatefp  Creates the value of a new key, called with the shard locked so it
+ * must not use \a cgh.
+ * \param r_val  The value of \a key, existing or created.
+ * \returns true when the value didn't need to be created.
+ */
+bool BLI_concurrent_ghash_ensure(ConcurrentGHash *cgh, const void *key, GHashKeyCopyFP keycopyfp,
+                                 ConcurrentGHashValCreateFP valcreatefp, void *userdata, void **r_val)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void **val_p;
+	bool haskey;
+
+	/* common case of an existing key only needs the read lock */
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+	val_p = BLI_ghash_lookup_p(shard->gh, key);
+	if (val_p) {
+		*r_val = *val_p;
+	}
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	if (val_p) {
+		return true;
+	}
+
+	/* another thread may have added the key in between, ensure_p checks again */
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	if (keycopyfp) {
+		haskey = BLI_ghash_ensure_p_ex(shard->gh, key, &val_p, keycopyfp);
+	}
+	else {
+		haskey = BLI_ghash_ensure_p(shard->gh, (void *)key, &val_p);
+	}
+	if (!haskey) {
+		*val_p = valcreatefp(key, userdata);
+	}
+	*r_val = *val_p;
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return haskey;
+}
+
+/**
+ * Remove \a key from \a cgh, or return false if the key wasn't found.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \return true if \a key was removed from \a cgh.
+ */
+bool BLI_concurrent_ghash_remove(ConcurrentGHash *cgh, const void *key,
+                                 GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	bool removed;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	removed = BLI_ghash_remove(shard->gh, key, keyfreefp, valfreefp);
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return removed;
+}
+
+/**
+ * Remove \a key from \a cgh, returning the value or NULL if the key wasn't found.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \return the value of \a key int \a cgh or NULL.
+ */
+void *BLI_concurrent_ghash_popkey(ConcurrentGHash *cgh, const void *key, GHashKeyFreeFP keyfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void *val;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+	val = BLI_ghash_popkey(shard->gh, key, keyfreefp);
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return val;
+}
+
+/**
+ * \return true if the \a key is in \a cgh.
+ */
+bool BLI_concurrent_ghash_haskey(ConcurrentGHash *cgh, const void *key)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	bool haskey;
+
+	BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+	haskey = BLI_ghash_haskey(shard->gh, key);
+	BLI_rw_mutex_unlock(&shard->lock);
+
+	return haskey;
+}
+
+/**
+ * Remove all entries from \a cgh. Entries added by other threads at the same time may or may not be removed.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_concurrent_ghash_clear(ConcurrentGHash *cgh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+
+		BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+		BLI_ghash_clear(shard->gh, keyfreefp, valfreefp);
+		BLI_rw_mutex_unlock(&shard->lock);
+	}
+}
+
+/**
+ * \return size of the \a cgh, only exact when no other thread is modifying it.
+ */
+unsigned int BLI_concurrent_ghash_size(ConcurrentGHash *cgh)
+{
+	unsigned int size = 0;
+	unsigned int i;
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+
+		BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+		size += BLI_ghash_size(shard->gh);
+		BLI_rw_mutex_unlock(&shard->lock);
+	}
+
+	return size;
+}
+
+/** \} */
+
+
+/** \name Iteration
+ *
+ * There is no iterator since it would have to keep a shard locked between calls,
+ * instead callbacks are called with the shard of the entry locked.
+ * \{ */
+
+/**
+ * Call \a foreachfp for all entries of \a cgh. The callback must not modify \a cgh.
+ */
+void BLI_concurrent_ghash_foreach(ConcurrentGHash *cgh, ConcurrentGHashForeachFP foreachfp, void *userdata)
+{
+	unsigned int i;
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+		GHashIterator gh_iter;
+
+		BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_READ);
+		GHASH_ITER (gh_iter, shard->gh) {
+			foreachfp(BLI_ghashIterator_getKey(&gh_iter), BLI_ghashIterator_getValue(&gh_iter), userdata);
+		}
+		BLI_rw_mutex_unlock(&shard->lock);
+	}
+}
+
+/**
+ * Remove all entries for which \a checkfp returns true. The callback must not modify \a cgh.
+ *
+ * \return the number of removed entries.
+ */
+unsigned int BLI_concurrent_ghash_remove_if(
+        ConcurrentGHash *cgh, ConcurrentGHashCheckFP checkfp, void *userdata,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int removed = 0;
+	unsigned int i;
+
+	for (i = 0; i < cgh->shards_num; i++) {
+		ConcurrentGHashShard *shard = &cgh->shards[i];
+		GHashIterator gh_iter;
+
+		BLI_rw_mutex_lock(&shard->lock, THREAD_LOCK_WRITE);
+
+		BLI_ghashIterator_init(&gh_iter, shard->gh);
+		while (!BLI_ghashIterator_done(&gh_iter)) {
+			void *key = BLI_ghashIterator_getKey(&gh_iter);
+			void *val = BLI_ghashIterator_getValue(&gh_iter);
+
+			/* step first, removing the current entry invalidates it */
+			BLI_ghashIterator_step(&gh_iter);
+
+			if (checkfp(key, val, userdata)) {
+				BLI_ghash_remove(shard->gh, key, keyfreefp, valfreefp);
+				removed++;
+			}
+		}
+
+		BLI_rw_mutex_unlock(&shard->lock);
+	}
+
+	return removed;
+}
+
+/** \} */
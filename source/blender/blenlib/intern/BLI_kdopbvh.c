@@ -51,6 +51,10 @@
 #include "BLI_strict_flags.h"
 #include "BLI_task.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /* used for iterative_raycast */
 // #define USE_SKIP_LINKS
 
@@ -61,10 +65,15 @@
  */
 #ifdef DEBUG
 #  define KDOPBVH_THREAD_LEAF_THRESHOLD 0
+#  define KDOPBVH_THREAD_RAY_THRESHOLD 0
 #else
 #  define KDOPBVH_THREAD_LEAF_THRESHOLD 1024
+#  define KDOPBVH_THREAD_RAY_THRESHOLD 256
 #endif
 
+/* number of bins used to estimate the surface area heuristic, see #get_sah_split_axis */
+#define KDOPBVH_SAH_BINS 16
+
 typedef unsigned char axis_t;
 
 typedef struct BVHNode {
@@ -510,6 +519,102 @@ static char get_largest_axis(const float *bv)
 	}
 }
 
+BLI_INLINE float bv_half_area(const float bv[6])
+{
+	const float dx = bv[1] - bv[0];
+	const float dy = bv[3] - bv[2];
+	const float dz = bv[5] - bv[4];
+
+	return dx * dy + dy * dz + dz * dx;
+}
+
+/**
+ * Choose the split axis with the lowest surface area heuristic cost, as alternative to #get_largest_axis.
+ *
+ * The number of leafs of each child is fixed by the implicit tree layout, so only the axis to sort the
+ * leafs along is chosen. Leafs are binned along each of the x, y, z axis, the bounds of every child
+ * are estimated by accumulating bins until the child has its number of leafs.
+ *
+ * \param nth  Leaf partitions of the children, as passed to #split_leafs.
+ */
+static char get_sah_split_axis(
+        const float *bv_parent, BVHNode **leafs_array, const int *nth, const int partitions)
+{
+	const int totleaf = nth[partitions] - nth[0];
+	float cost_best = FLT_MAX;
+	char split_axis = get_largest_axis(bv_parent);
+	int axis;
+
+	/* one leaf per child, the order of children doesn't change their bounds */
+	if (totleaf <= partitions) {
+		return split_axis;
+	}
+
+	for (axis = 0; axis < 3; axis++) {
+		const float key_min = bv_parent[2 * axis];
+		const float key_extent = bv_parent[2 * axis + 1] - key_min;
+		int bin_count[KDOPBVH_SAH_BINS] = {0};
+		float bin_bv[KDOPBVH_SAH_BINS][6];
+		float scale, cost = 0.0f;
+		int i, j, k, bin;
+
+		if (!(key_extent > 0.0f)) {
+			continue;
+		}
+		scale = (float)KDOPBVH_SAH_BINS / key_extent;
+
+		for (bin = 0; bin < KDOPBVH_SAH_BINS; bin++) {
+			for (i = 0; i < 3; i++) {
+				bin_bv[bin][2 * i] = FLT_MAX;
+				bin_bv[bin][2 * i + 1] = -FLT_MAX;
+			}
+		}
+
+		/* leafs are sorted on their maximum, see #split_leafs */
+		for (j = nth[0]; j < nth[partitions]; j++) {
+			const float *bv = leafs_array[j]->bv;
+			bin = (int)((bv[2 * axis + 1] - key_min) * scale);
+			CLAMP(bin, 0, KDOPBVH_SAH_BINS - 1);
+
+			bin_count[bin]++;
+			for (i = 0; i < 3; i++) {
+				bin_bv[bin][2 * i] = min_ff(bin_bv[bin][2 * i], bv[2 * i]);
+				bin_bv[bin][2 * i + 1] = max_ff(bin_bv[bin][2 * i + 1], bv[2 * i + 1]);
+			}
+		}
+
+		/* accumulate bins into children */
+		bin = 0;
+		for (k = 0, j = 0; k < partitions && j < totleaf; k++) {
+			const int child_end = nth[k + 1] - nth[0];
+			float child_bv[6] = {FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
+			int child_count = 0;
+
+			for (; bin < KDOPBVH_SAH_BINS && (j < child_end || k == partitions - 1); bin++) {
+				if (bin_count[bin]) {
+					for (i = 0; i < 3; i++) {
+						child_bv[2 * i] = min_ff(child_bv[2 * i], bin_bv[bin][2 * i]);
+						child_bv[2 * i + 1] = max_ff(child_bv[2 * i + 1], bin_bv[bin][2 * i + 1]);
+					}
+					child_count += bin_count[bin];
+					j += bin_count[bin];
+				}
+			}
+
+			if (child_count) {
+				cost += bv_half_area(child_bv) * (float)child_count;
+			}
+		}
+
+		if (cost < cost_best) {
+			cost_best = cost;
+			split_axis = (char)(2 * axis + 1);
+		}
+	}
+
+	return split_axis;
+}
+
 /**
  * bottom-up update of bvh node BV
  * join the children on the parent BV */
@@ -742,6 +847,7 @@ typedef struct BVHDivNodesData {
 
 	int tree_type;
 	int tree_offset;
+	bool use_sah;
 
 	BVHBuildHelper *data;
 
@@ -763,10 +869,23 @@ static void non_recursive_bvh_div_nodes_task_cb(void *userdata, void *UNUSED(use
 	int parent_leafs_begin = implicit_leafs_index(data->data, data->depth, parent_level_index);
 	int parent_leafs_end   = implicit_leafs_index(data->data, data->depth, parent_level_index + 1);
 
+	nth_positions[0] = parent_leafs_begin;
+	nth_positions[data->tree_type] = parent_leafs_end;
+	for (k = 1; k < data->tree_type; k++) {
+		const int child_index = j * data->tree_type + data->tree_offset + k;
+		const int child_level_index = child_index - data->first_of_next_level; /* child level index */
+		nth_positions[k] = implicit_leafs_index(data->data, data->depth + 1, child_level_index);
+	}
+
 	/* This calculates the bounding box of this branch
-	 * and chooses the largest axis as the axis to divide leafs */
+	 * and chooses the axis to divide leafs (the largest one by default) */
 	refit_kdop_hull(data->tree, parent, parent_leafs_begin, parent_leafs_end);
-	split_axis = get_largest_axis(parent->bv);
+	if (data->use_sah) {
+		split_axis = get_sah_split_axis(parent->bv, data->leafs_array, nth_positions, data->tree_type);
+	}
+	else {
+		split_axis = get_largest_axis(parent->bv);
+	}
 
 	/* Save split axis (this can be used on raytracing to speedup the query time) */
 	parent->main_axis = split_axis / 2;
@@ -775,14 +894,6 @@ static void non_recursive_bvh_div_nodes_task_cb(void *userdata, void *UNUSED(use
 	 * Only to assure that the elements are partitioned on a way that each child takes the elements
 	 * it would take in case the whole array was sorted.
 	 * Split_leafs takes care of that "sort" problem. */
-	nth_positions[0] = parent_leafs_begin;
-	nth_positions[data->tree_type] = parent_leafs_end;
-	for (k = 1; k < data->tree_type; k++) {
-		const int child_index = j * data->tree_type + data->tree_offset + k;
-		const int child_level_index = child_index - data->first_of_next_level; /* child level index */
-		nth_positions[k] = implicit_leafs_index(data->data, data->depth + 1, child_level_index);
-	}
-
 	split_leafs(data->leafs_array, nth_positions, data->tree_type, split_axis);
 
 	/* Setup children and totnode counters
@@ -826,7 +937,8 @@ static void non_recursive_bvh_div_nodes_task_cb(void *userdata, void *UNUSED(use
  * To archive this is necessary to find how much leafs are accessible from a certain branch, BVHBuildHelper
  * implicit_needed_branches and implicit_leafs_index are auxiliary functions to solve that "optimal-split".
  */
-static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array, BVHNode **leafs_array, int num_leafs)
+static void non_recursive_bvh_div_nodes(
+        BVHTree *tree, BVHNode *branches_array, BVHNode **leafs_array, int num_leafs, const bool use_sah)
 {
 	int i;
 
@@ -859,7 +971,7 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 
 	BVHDivNodesData cb_data = {
 		.tree = tree, .branches_array = branches_array, .leafs_array = leafs_array,
-		.tree_type = tree_type, .tree_offset = tree_offset, .data = &data,
+		.tree_type = tree_type, .tree_offset = tree_offset, .use_sah = use_sah, .data = &data,
 		.first_of_next_level = 0, .depth = 0, .i = 0,
 	};
 
@@ -980,8 +1092,13 @@ void BLI_bvhtree_free(BVHTree *tree)
 	}
 }
 
-void BLI_bvhtree_balance(BVHTree *tree)
+/**
+ * \param flag  #BVH_BALANCE_SAH to choose split axes with the surface area heuristic,
+ * slower to build but faster to ray cast. Only used by trees containing the x, y, z axes (not 18-DOP).
+ */
+void BLI_bvhtree_balance_ex(BVHTree *tree, const int flag)
 {
+	const bool use_sah = (flag & BVH_BALANCE_SAH) && (tree->start_axis == 0);
 	int i;
 
 	BVHNode *branches_array = tree->nodearray + tree->totleaf;
@@ -991,7 +1108,7 @@ void BLI_bvhtree_balance(BVHTree *tree)
 	BLI_assert(tree->totbranch == 0);
 
 	/* Build the implicit tree */
-	non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf);
+	non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf, use_sah);
 
 	/* current code expects the branches to be linked to the nodes array
 	 * we perform that linkage here */
@@ -1006,6 +1123,11 @@ void BLI_bvhtree_balance(BVHTree *tree)
 	/* bvhtree_info(tree); */
 }
 
+void BLI_bvhtree_balance(BVHTree *tree)
+{
+	BLI_bvhtree_balance_ex(tree, 0);
+}
+
 void BLI_bvhtree_insert(BVHTree *tree, int index, const float co[3], int numpoints)
 {
 	axis_t axis_iter;
@@ -1055,18 +1177,93 @@ bool BLI_bvhtree_update_node(BVHTree *tree, int index, const float co[3], const
 	return true;
 }
 
+typedef struct BVHUpdateTreeData {
+	BVHTree *tree;
+	BVHTree_LeafPointsCallback callback;
+	void *userdata;
+} BVHUpdateTreeData;
+
+static void bvhtree_update_tree_task_cb(void *userdata, void *UNUSED(userdata_chunk), int j)
+{
+	BVHUpdateTreeData *data = userdata;
+	BVHTree *tree = data->tree;
+
+	/* implicit trees use 1-based indices */
+	node_join(tree, tree->nodes[tree->totleaf + j - 1]);
+}
+
 /* call BLI_bvhtree_update_node() first for every node/point/triangle */
 void BLI_bvhtree_update_tree(BVHTree *tree)
 {
 	/* Update bottom=>top
-	 * TRICKY: the way we build the tree all the childs have an index greater than the parent
-	 * This allows us todo a bottom up update by starting on the bigger numbered branch */
+	 * TRICKY: the way we build the tree all the childs have an index greater than the parent,
+	 * and all branches of a level come before the ones of the next level.
+	 * This allows us todo a bottom up update one level at a time, joining the branches of a level in parallel. */
 
-	BVHNode **root  = tree->nodes + tree->totleaf;
-	BVHNode **index = tree->nodes + tree->totleaf + tree->totbranch - 1;
+	const int tree_type   = tree->tree_type;
+	const int tree_offset = 2 - tree->tree_type;
+	int level_first[32];
+	int i, depth = 0;
 
-	for (; index >= root; index--)
-		node_join(tree, *index);
+	BVHUpdateTreeData data = {.tree = tree};
+
+	for (i = 1; i <= tree->totbranch; i = i * tree_type + tree_offset) {
+		BLI_assert(depth < (int)ARRAY_SIZE(level_first));
+		level_first[depth++] = i;
+	}
+
+	while (depth--) {
+		const int first_of_next_level = level_first[depth] * tree_type + tree_offset;
+		const int end_j = min_ii(first_of_next_level, tree->totbranch + 1);
+
+		BLI_task_parallel_range_ex(
+		            level_first[depth], end_j, &data, NULL, 0, bvhtree_update_tree_task_cb,
+		            tree->totleaf > KDOPBVH_THREAD_LEAF_THRESHOLD, false);
+	}
+}
+
+static void bvhtree_refit_leaf_task_cb(void *userdata, void *UNUSED(userdata_chunk), int i)
+{
+	BVHUpdateTreeData *data = userdata;
+	BVHTree *tree = data->tree;
+	BVHNode *node = tree->nodearray + i;
+	float co[BVH_LEAF_MAX_POINTS][3];
+	const int numpoints = data->callback(data->userdata, node->index, co);
+	axis_t axis_iter;
+
+	BLI_assert(numpoints <= BVH_LEAF_MAX_POINTS);
+
+	create_kdop_hull(tree, node, co[0], numpoints, 0);
+
+	/* inflate the bv with some epsilon */
+	for (axis_iter = tree->start_axis; axis_iter < tree->stop_axis; axis_iter++) {
+		node->bv[(2 * axis_iter)]     -= tree->epsilon; /* minimum */
+		node->bv[(2 * axis_iter) + 1] += tree->epsilon; /* maximum */
+	}
+}
+
+/**
+ * Refit all bounding volumes of a balanced tree to moved elements, keeping the tree structure.
+ * Much faster than building a new tree, but the tree quality degrades when elements move far.
+ *
+ * \param callback  Fills in the points of the element with the given index (as passed to #BLI_bvhtree_insert),
+ * called from multiple threads.
+ */
+void BLI_bvhtree_refit(BVHTree *tree, BVHTree_LeafPointsCallback callback, void *userdata)
+{
+	BVHUpdateTreeData data = {.tree = tree, .callback = callback, .userdata = userdata};
+
+	BLI_assert(tree->totbranch > 0 || tree->totleaf == 0);
+
+	if (tree->totleaf == 0) {
+		return;
+	}
+
+	BLI_task_parallel_range_ex(
+	            0, tree->totleaf, &data, NULL, 0, bvhtree_refit_leaf_task_cb,
+	            tree->totleaf > KDOPBVH_THREAD_LEAF_THRESHOLD, false);
+
+	BLI_bvhtree_update_tree(tree);
 }
 
 float BLI_bvhtree_getepsilon(const BVHTree *tree)
@@ -1086,8 +1283,26 @@ static bool tree_overlap_test(const BVHNode *node1, const BVHNode *node2, axis_t
 	const float *bv1     = node1->bv + (start_axis << 1);
 	const float *bv2     = node2->bv + (start_axis << 1);
 	const float *bv1_end = node1->bv + (stop_axis  << 1);
-	
-	/* test all axis if min + max overlap */
+
+#ifdef __SSE2__
+	{
+		/* test 2 axis at once: (min1, max1) against (max2, min2),
+		 * flipping the sign of the second test makes both a greater than comparison */
+		const __m128 sign = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+
+		for (; bv1_end - bv1 >= 4; bv1 += 4, bv2 += 4) {
+			const __m128 a = _mm_xor_ps(_mm_loadu_ps(bv1), sign);
+			__m128 b = _mm_loadu_ps(bv2);
+			b = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)), sign);
+
+			if (_mm_movemask_ps(_mm_cmpgt_ps(a, b))) {
+				return 0;
+			}
+		}
+	}
+#endif
+
+	/* test all (remaining) axis if min + max overlap */
 	for (; bv1 != bv1_end; bv1 += 2, bv2 += 2) {
 		if ((bv1[0] > bv2[1]) || (bv2[0] > bv1[1])) {
 			return 0;
@@ -1742,6 +1957,58 @@ int BLI_bvhtree_ray_cast(
 	return BLI_bvhtree_ray_cast_ex(tree, co, dir, radius, hit, callback, userdata, BVH_RAYCAST_DEFAULT);
 }
 
+typedef struct BVHRayCastBatchData {
+	BVHTree *tree;
+	const float (*co)[3];
+	const float (*dir)[3];
+	float radius;
+	BVHTreeRayHit *hit;
+	BVHTree_RayCastCallback callback;
+	void *userdata;
+	int flag;
+} BVHRayCastBatchData;
+
+static void bvhtree_ray_cast_batch_task_cb(void *userdata, void *UNUSED(userdata_chunk), int i)
+{
+	const BVHRayCastBatchData *data = userdata;
+
+	BLI_bvhtree_ray_cast_ex(
+	        data->tree, data->co[i], data->dir[i], data->radius, &data->hit[i],
+	        data->callback, data->userdata, data->flag);
+}
+
+/**
+ * Cast many rays at once, using multiple threads for large batches.
+ *
+ * \param hit  Array of \a totray hits, initialized as for #BLI_bvhtree_ray_cast_ex
+ * (index -1 and the maximum distance), the result for every ray is stored there.
+ * \param callback  Must be thread-safe.
+ */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int totray, float radius,
+        BVHTreeRayHit *hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag)
+{
+	BVHRayCastBatchData data;
+
+	if (totray <= 0) {
+		return;
+	}
+
+	data.tree = tree;
+	data.co = co;
+	data.dir = dir;
+	data.radius = radius;
+	data.hit = hit;
+	data.callback = callback;
+	data.userdata = userdata;
+	data.flag = flag;
+
+	BLI_task_parallel_range_ex(
+	            0, totray, &data, NULL, 0, bvhtree_ray_cast_batch_task_cb,
+	            totray > KDOPBVH_THREAD_RAY_THRESHOLD, false);
+}
+
 float BLI_bvhtree_bb_raycast(const float bv[6], const float light_start[3], const float light_end[3], float pos[3])
 {
 	BVHRayCastData data;
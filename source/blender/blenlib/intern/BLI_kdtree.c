@@ -29,6 +29,7 @@
 
 #include "BLI_math.h"
 #include "BLI_kdtree.h"
+#include "BLI_task.h"
 #include "BLI_utildefines.h"
 #include "BLI_strict_flags.h"
 
@@ -49,9 +50,9 @@ struct KDTree {
 	KDTreeNode *nodes;
 	unsigned int totnode;
 	unsigned int root;
+	unsigned int maxsize;   /* max size of the tree */
 #ifdef DEBUG
 	bool is_balanced;  /* ensure we call balance first */
-	unsigned int maxsize;   /* max size of the tree */
 #endif
 };
 
@@ -61,6 +62,9 @@ struct KDTree {
 
 #define KD_NODE_UNSET ((unsigned int)-1)
 
+#define KD_BALANCE_PARALLEL_MIN 8192  /* subtrees with less nodes are balanced by the same task */
+#define KD_BATCH_PARALLEL_MIN 1024    /* batched queries with less points run single threaded */
+
 /**
  * Creates or free a kdtree
  */
@@ -72,10 +76,10 @@ KDTree *BLI_kdtree_new(unsigned int maxsize)
 	tree->nodes = MEM_mallocN(sizeof(KDTreeNode) * maxsize, "KDTreeNode");
 	tree->totnode = 0;
 	tree->root = KD_NODE_UNSET;
+	tree->maxsize = maxsize;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
-	tree->maxsize = maxsize;
 #endif
 
 	return tree;
@@ -96,9 +100,7 @@ void BLI_kdtree_insert(KDTree *tree, int index, const float co[3])
 {
 	KDTreeNode *node = &tree->nodes[tree->totnode++];
 
-#ifdef DEBUG
 	BLI_assert(tree->totnode <= tree->maxsize);
-#endif
 
 	/* note, array isn't calloc'd,
 	 * need to initialize all struct members */
@@ -113,18 +115,15 @@ void BLI_kdtree_insert(KDTree *tree, int index, const float co[3])
 #endif
 }
 
-static unsigned int kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsigned int axis, const unsigned int ofs)
+/**
+ * Quicksort style sorting around the median, nodes before the median are
+ * less or equal on \a axis, nodes after are greater or equal.
+ */
+static unsigned int kdtree_median_partition(KDTreeNode *nodes, unsigned int totnode, const unsigned int axis)
 {
-	KDTreeNode *node;
 	float co;
 	unsigned int left, right, median, i, j;
 
-	if (totnode <= 0)
-		return KD_NODE_UNSET;
-	else if (totnode == 1)
-		return 0 + ofs;
-	
-	/* quicksort style sorting around median */
 	left = 0;
 	right = totnode - 1;
 	median = totnode / 2;
@@ -151,19 +150,112 @@ static unsigned int kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsi
 			left = i + 1;
 	}
 
-	/* set node and sort subnodes */
-	node = &nodes[median];
-	node->d = axis;
-	axis = (axis + 1) % 3;
-	node->left = kdtree_balance(nodes, median, axis, ofs);
-	node->right = kdtree_balance(nodes + median + 1, (totnode - (median + 1)), axis, (median + 1) + ofs);
+	return median;
+}
+
+typedef struct KDTreeBalanceData {
+	KDTreeNode *nodes_src;
+	KDTreeNode *nodes_dst;
+} KDTreeBalanceData;
+
+typedef struct KDTreeBalanceTask {
+	unsigned int ofs, totnode, axis, pos;
+} KDTreeBalanceTask;
+
+static void kdtree_balance_task(TaskPool *__restrict pool, void *taskdata, int threadid);
+
+/**
+ * Balance \a totnode nodes starting at \a ofs of the unbalanced nodes, into \a nodes_dst starting at \a pos.
+ *
+ * Nodes are written in depth first order: the left child directly follows its parent,
+ * and every subtree is a contiguous block of the array, which keeps queries cache friendly.
+ * Subtrees are independent, large ones are balanced by separate tasks when \a pool is given.
+ */
+static void kdtree_balance_recursive(
+        const KDTreeBalanceData *data, TaskPool *pool,
+        unsigned int ofs, unsigned int totnode, unsigned int axis, unsigned int pos)
+{
+	while (totnode) {
+		KDTreeNode *nodes = &data->nodes_src[ofs];
+		KDTreeNode *node = &data->nodes_dst[pos];
+		unsigned int median, totleft, totright;
+
+		median = (totnode > 1) ? kdtree_median_partition(nodes, totnode, axis) : 0;
+		totleft = median;
+		totright = totnode - (median + 1);
+
+		/* set node and sort subnodes */
+		*(KDTreeNode_head *)node = *(KDTreeNode_head *)&nodes[median];
+		node->d = axis;
+		node->left = totleft ? pos + 1 : KD_NODE_UNSET;
+		node->right = totright ? pos + 1 + totleft : KD_NODE_UNSET;
+
+		axis = (axis + 1) % 3;
+
+		if (totright) {
+			if (pool && totright >= KD_BALANCE_PARALLEL_MIN) {
+				KDTreeBalanceTask *task = MEM_mallocN(sizeof(*task), __func__);
+				task->ofs = ofs + median + 1;
+				task->totnode = totright;
+				task->axis = axis;
+				task->pos = node->right;
+				BLI_task_pool_push(pool, kdtree_balance_task, task, true, TASK_PRIORITY_HIGH);
+			}
+			else {
+				kdtree_balance_recursive(data, pool, ofs + median + 1, totright, axis, node->right);
+			}
+		}
+
+		/* continue with the left subtree */
+		totnode = totleft;
+		pos = pos + 1;
+	}
+}
+
+static void kdtree_balance_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	const KDTreeBalanceData *data = BLI_task_pool_userdata(pool);
+	const KDTreeBalanceTask *task = taskdata;
 
-	return median + ofs;
+	kdtree_balance_recursive(data, pool, task->ofs, task->totnode, task->axis, task->pos);
 }
 
+/**
+ * Build the tree from the inserted points, must be called before any query.
+ * Large trees are built using multiple threads.
+ */
 void BLI_kdtree_balance(KDTree *tree)
 {
-	tree->root = kdtree_balance(tree->nodes, tree->totnode, 0, 0);
+	KDTreeBalanceData data;
+
+	if (tree->totnode == 0) {
+		tree->root = KD_NODE_UNSET;
+#ifdef DEBUG
+		tree->is_balanced = true;
+#endif
+		return;
+	}
+
+	data.nodes_src = tree->nodes;
+	/* keep room for inserting more nodes, they are balanced again with the others */
+	data.nodes_dst = MEM_mallocN(sizeof(KDTreeNode) * tree->maxsize, "KDTreeNode");
+
+	if (tree->totnode >= KD_BALANCE_PARALLEL_MIN) {
+		TaskScheduler *scheduler = BLI_task_scheduler_get();
+		TaskPool *pool = BLI_task_pool_create(scheduler, &data);
+
+		kdtree_balance_recursive(&data, pool, 0, tree->totnode, 0, 0);
+
+		BLI_task_pool_work_and_wait(pool);
+		BLI_task_pool_free(pool);
+	}
+	else {
+		kdtree_balance_recursive(&data, NULL, 0, tree->totnode, 0, 0);
+	}
+
+	MEM_freeN(tree->nodes);
+	tree->nodes = data.nodes_dst;
+	tree->root = 0;
 
 #ifdef DEBUG
 	tree->is_balanced = true;
@@ -674,3 +766,74 @@ finally:
 	if (stack != defaultstack)
 		MEM_freeN(stack);
 }
+
+typedef struct KDTreeBatchData {
+	const KDTree *tree;
+	const float (*co)[3];
+	KDTreeNearest *r_nearest;
+	int *r_index;
+	int *r_found;
+	unsigned int n;
+} KDTreeBatchData;
+
+static void kdtree_find_nearest_batch_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	const KDTreeBatchData *data = userdata;
+	KDTreeNearest *r_nearest = data->r_nearest ? &data->r_nearest[iter] : NULL;
+
+	data->r_index[iter] = BLI_kdtree_find_nearest(data->tree, data->co[iter], r_nearest);
+}
+
+static void kdtree_find_nearest_n_batch_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	const KDTreeBatchData *data = userdata;
+	const int found = BLI_kdtree_find_nearest_n(
+	        data->tree, data->co[iter], &data->r_nearest[(size_t)iter * data->n], data->n);
+
+	if (data->r_found) {
+		data->r_found[iter] = found;
+	}
+}
+
+/**
+ * #BLI_kdtree_find_nearest for many points at once, using multiple threads for large batches.
+ *
+ * \param r_nearest  Optional array of nearest, sized at least \a totco.
+ * \param r_index  Array of indices sized at least \a totco, -1 when no node is found.
+ */
+void BLI_kdtree_find_nearest_batch(
+        const KDTree *tree, const float (*co)[3], const unsigned int totco,
+        KDTreeNearest *r_nearest, int *r_index)
+{
+	KDTreeBatchData data = {tree, co, r_nearest, r_index, NULL, 1};
+
+	if (totco == 0) {
+		return;
+	}
+
+	BLI_task_parallel_range_ex(
+	        0, (int)totco, &data, NULL, 0, kdtree_find_nearest_batch_func,
+	        totco >= KD_BATCH_PARALLEL_MIN, false);
+}
+
+/**
+ * #BLI_kdtree_find_nearest_n for many points at once, using multiple threads for large batches.
+ *
+ * \param r_nearest  An array of nearest, sized at least \a totco * \a n,
+ * the results for point i start at i * \a n.
+ * \param r_found  Optional array of the number of points found, sized at least \a totco.
+ */
+void BLI_kdtree_find_nearest_n_batch(
+        const KDTree *tree, const float (*co)[3], const unsigned int totco,
+        KDTreeNearest *r_nearest, int *r_found, const unsigned int n)
+{
+	KDTreeBatchData data = {tree, co, r_nearest, NULL, r_found, n};
+
+	if (totco == 0) {
+		return;
+	}
+
+	BLI_task_parallel_range_ex(
+	        0, (int)totco, &data, NULL, 0, kdtree_find_nearest_n_batch_func,
+	        totco >= KD_BATCH_PARALLEL_MIN, false);
+}
@@ -63,9 +63,25 @@ struct MemArena {
 	bool use_calloc;
 };
 
-MemArena *BLI_memarena_new(const size_t bufsize, const char *name)
+/* for thread-local arenas, avoid false sharing */
+#define MEMARENA_CACHELINE_SIZE 64
+
+/* amt must be power of two */
+#define PADUP(num, amt) (((num) + ((amt) - 1)) & ~((amt) - 1))
+
+static MemArena *memarena_new(const size_t bufsize, const char *name, const bool use_cacheline)
 {
-	MemArena *ma = MEM_callocN(sizeof(*ma), "memarena");
+	MemArena *ma;
+
+	if (use_cacheline) {
+		const size_t size = PADUP(sizeof(*ma), (size_t)MEMARENA_CACHELINE_SIZE);
+		ma = MEM_mallocN_aligned(size, MEMARENA_CACHELINE_SIZE, "memarena");
+		memset(ma, 0, size);
+	}
+	else {
+		ma = MEM_callocN(sizeof(*ma), "memarena");
+	}
+
 	ma->bufsize = bufsize;
 	ma->align = 8;
 	ma->name = name;
@@ -77,6 +93,11 @@ MemArena *BLI_memarena_new(const size_t bufsize, const char *name)
 	return ma;
 }
 
+MemArena *BLI_memarena_new(const size_t bufsize, const char *name)
+{
+	return memarena_new(bufsize, name, false);
+}
+
 void BLI_memarena_use_calloc(MemArena *ma)
 {
 	ma->use_calloc = 1;
@@ -104,9 +125,6 @@ void BLI_memarena_free(MemArena *ma)
 	MEM_freeN(ma);
 }
 
-/* amt must be power of two */
-#define PADUP(num, amt) (((num) + ((amt) - 1)) & ~((amt) - 1))
-
 /* align alloc'ed memory (needed if align > 8) */
 static void memarena_curbuf_align(MemArena *ma)
 {
@@ -196,3 +214,155 @@ void BLI_memarena_clear(MemArena *ma)
 #endif
 
 }
+
+/**
+ * Move all allocations of \a ma_src into \a ma_dst, they are freed with it.
+ * \a ma_src is left empty (it still has to be freed), both must use the same alignment.
+ *
+ * \note Valgrind mempool tracking doesn't follow the moved allocations.
+ */
+void BLI_memarena_merge(MemArena *ma_dst, MemArena *ma_src)
+{
+	BLI_assert(ma_dst->align == ma_src->align);
+
+	if (ma_src->bufs == NULL) {
+		return;
+	}
+
+	if (ma_dst->bufs == NULL) {
+		/* continue allocating from the current buffer of ma_src */
+		ma_dst->bufs = ma_src->bufs;
+		ma_dst->curbuf = ma_src->curbuf;
+		ma_dst->cursize = ma_src->cursize;
+	}
+	else {
+		/* the current buffer has to stay first, see BLI_memarena_clear */
+		LinkNode *bufs_tail = ma_src->bufs;
+		while (bufs_tail->next) {
+			bufs_tail = bufs_tail->next;
+		}
+		bufs_tail->next = ma_dst->bufs->next;
+		ma_dst->bufs->next = ma_src->bufs;
+	}
+
+	ma_src->bufs = NULL;
+	ma_src->curbuf = NULL;
+	ma_src->cursize = 0;
+}
+
+/* -------------------------------------------------------------------- */
+/** \name Thread-Local Arenas
+ *
+ * Parallel code can't share an arena without a lock, instead each thread allocates from its own
+ * arena, created on first use. Once the parallel region is done all allocations are merged into
+ * one arena, or freed together.
+ * \{ */
+
+struct MemArenaThreaded {
+	const char *name;
+	size_t bufsize, align;
+	bool use_calloc;
+
+	int num_threads;
+	MemArena **arenas;
+};
+
+/**
+ * \param num_threads  Number of threads, see #BLI_task_scheduler_num_threads.
+ */
+MemArenaThreaded *BLI_memarena_threaded_new(const size_t bufsize, const char *name, const int num_threads)
+{
+	MemArenaThreaded *mat = MEM_mallocN(sizeof(*mat), "memarena threaded");
+
+	mat->name = name;
+	mat->bufsize = bufsize;
+	mat->align = 8;
+	mat->use_calloc = false;
+	mat->num_threads = num_threads;
+	mat->arenas = MEM_callocN(sizeof(*mat->arenas) * (size_t)num_threads, "memarena threaded arenas");
+
+	return mat;
+}
+
+void BLI_memarena_threaded_use_calloc(MemArenaThreaded *mat)
+{
+	mat->use_calloc = true;
+}
+
+void BLI_memarena_threaded_use_align(MemArenaThreaded *mat, const size_t align)
+{
+	/* align should be a power of two */
+	mat->align = align;
+}
+
+/**
+ * Arena of thread \a thread_id, only that thread may use it during the parallel region.
+ */
+MemArena *BLI_memarena_threaded_get(MemArenaThreaded *mat, const int thread_id)
+{
+	MemArena **ma_p = &mat->arenas[thread_id];
+
+	BLI_assert(thread_id >= 0 && thread_id < mat->num_threads);
+
+	if (UNLIKELY(*ma_p == NULL)) {
+		MemArena *ma = memarena_new(mat->bufsize, mat->name, true);
+		ma->align = mat->align;
+		ma->use_calloc = mat->use_calloc;
+		*ma_p = ma;
+	}
+
+	return *ma_p;
+}
+
+/**
+ * Merge the allocations of all threads into one arena and free \a mat.
+ *
+ * \return The arena owning all allocations, to be freed with #BLI_memarena_free.
+ */
+MemArena *BLI_memarena_threaded_merge(MemArenaThreaded *mat)
+{
+	MemArena *ma = NULL;
+	int i;
+
+	for (i = 0; i < mat->num_threads; i++) {
+		if (mat->arenas[i]) {
+			if (ma == NULL) {
+				ma = mat->arenas[i];
+			}
+			else {
+				BLI_memarena_merge(ma, mat->arenas[i]);
+				BLI_memarena_free(mat->arenas[i]);
+			}
+			mat->arenas[i] = NULL;
+		}
+	}
+
+	if (ma == NULL) {
+		ma = memarena_new(mat->bufsize, mat->name, false);
+		ma->align = mat->align;
+		ma->use_calloc = mat->use_calloc;
+	}
+
+	BLI_memarena_threaded_free(mat);
+
+	return ma;
+}
+
+/**
+ * Free all thread arenas and their allocations.
+ */
+void BLI_memarena_threaded_free(MemArenaThreaded *mat)
+{
+	int i;
+
+	for (i = 0; i < mat->num_threads; i++) {
+		if (mat->arenas[i]) {
+			BLI_memarena_free(mat->arenas[i]);
+		}
+	}
+
+	MEM_freeN(mat->arenas);
+	MEM_freeN(mat);
+}
+
+/** \} */
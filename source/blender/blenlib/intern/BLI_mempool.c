@@ -47,6 +47,8 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "atomic_ops.h"
+
 #include "BLI_strict_flags.h"  /* keep last */
 
 #ifdef WITH_MEM_VALGRIND
@@ -126,6 +128,11 @@ struct BLI_mempool {
 
 #define MEMPOOL_ELEM_SIZE_MIN (sizeof(void *) * 2)
 
+/* for thread-local pools, avoid false sharing */
+#define MEMPOOL_CACHELINE_SIZE 64
+/* amt must be power of two */
+#define PADUP(num, amt) (((num) + ((amt) - 1)) & ~((amt) - 1))
+
 #ifdef USE_DATA_PTR
 #  define CHUNK_DATA(chunk) (chunk)->_data
 #else
@@ -272,15 +279,26 @@ static void mempool_chunk_free_all(BLI_mempool_chunk *mpchunk)
 	}
 }
 
-BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
-                                unsigned int pchunk, unsigned int flag)
+/**
+ * \param use_cacheline  Give the pool structure its own cache lines,
+ * for pools allocating from different threads at the same time.
+ */
+static BLI_mempool *mempool_create(unsigned int esize, unsigned int totelem,
+                                   unsigned int pchunk, unsigned int flag,
+                                   const bool use_cacheline)
 {
 	BLI_mempool *pool;
 	BLI_freenode *lasttail = NULL;
 	unsigned int i, maxchunks;
 
 	/* allocate the pool structure */
-	pool = MEM_mallocN(sizeof(BLI_mempool), "memory pool");
+	if (use_cacheline) {
+		pool = MEM_mallocN_aligned(PADUP(sizeof(BLI_mempool), (size_t)MEMPOOL_CACHELINE_SIZE),
+		                           MEMPOOL_CACHELINE_SIZE, "memory pool");
+	}
+	else {
+		pool = MEM_mallocN(sizeof(BLI_mempool), "memory pool");
+	}
 
 	/* set the elem size */
 	if (esize < (int)MEMPOOL_ELEM_SIZE_MIN) {
@@ -333,6 +351,12 @@ BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
 	return pool;
 }
 
+BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
+                                unsigned int pchunk, unsigned int flag)
+{
+	return mempool_create(esize, totelem, pchunk, flag, false);
+}
+
 void *BLI_mempool_alloc(BLI_mempool *pool)
 {
 	BLI_freenode *free_pop;
@@ -460,6 +484,58 @@ int BLI_mempool_count(BLI_mempool *pool)
 	return (int)pool->totused;
 }
 
+/**
+ * Move all elements of \a pool_src into \a pool, elements keep their address and can be freed
+ * with \a pool afterwards. \a pool_src is left empty (it still has to be destroyed).
+ *
+ * Both pools must have been created with the same element size, chunk size and flags.
+ * Iteration visits the elements of \a pool before the elements of \a pool_src.
+ *
+ * \note Valgrind mempool tracking doesn't follow the moved elements.
+ */
+void BLI_mempool_merge(BLI_mempool *pool, BLI_mempool *pool_src)
+{
+	BLI_assert(pool->esize == pool_src->esize);
+	BLI_assert(pool->csize == pool_src->csize);
+	BLI_assert(pool->flag == pool_src->flag);
+
+	if (pool_src->chunks == NULL) {
+		return;
+	}
+
+	/* append chunks */
+	if (pool->chunk_tail) {
+		pool->chunk_tail->next = pool_src->chunks;
+	}
+	else {
+		pool->chunks = pool_src->chunks;
+	}
+	pool->chunk_tail = pool_src->chunk_tail;
+
+	/* prepend free elements */
+	if (pool_src->free) {
+		BLI_freenode *free_tail = pool_src->free;
+		while (free_tail->next) {
+			free_tail = free_tail->next;
+		}
+		free_tail->next = pool->free;
+		pool->free = pool_src->free;
+	}
+
+	pool->totused += pool_src->totused;
+#ifdef USE_TOTALLOC
+	pool->totalloc += pool_src->totalloc;
+#endif
+
+	pool_src->chunks = NULL;
+	pool_src->chunk_tail = NULL;
+	pool_src->free = NULL;
+	pool_src->totused = 0;
+#ifdef USE_TOTALLOC
+	pool_src->totalloc = 0;
+#endif
+}
+
 void *BLI_mempool_findelem(BLI_mempool *pool, unsigned int index)
 {
 	BLI_assert(pool->flag & BLI_MEMPOOL_ALLOW_ITER);
@@ -545,6 +621,87 @@ void BLI_mempool_iternew(BLI_mempool *pool, BLI_mempool_iter *iter)
 	iter->pool = pool;
 	iter->curchunk = pool->chunks;
 	iter->curindex = 0;
+
+	iter->curchunk_threadsafe = NULL;
+}
+
+/* Take the next chunk nobody iterates over yet. */
+static BLI_mempool_chunk *mempool_iter_threadsafe_chunk_claim(BLI_mempool_chunk **curchunk_threadsafe)
+{
+	BLI_mempool_chunk *chunk;
+
+	do {
+		chunk = *curchunk_threadsafe;
+		if (chunk == NULL) {
+			return NULL;
+		}
+	} while (atomic_cas_ptr((void **)curchunk_threadsafe, chunk, chunk->next) != chunk);
+
+	return chunk;
+}
+
+/**
+ * Initialize an array of mempool iterators, which can be used from different threads at the same time
+ * with #BLI_mempool_iterstep_threadsafe. Each chunk of the pool is visited by only one of them,
+ * so all elements are visited exactly once.
+ *
+ * \note The pool must not be modified while iterating.
+ */
+BLI_mempool_iter *BLI_mempool_iter_threadsafe_create(BLI_mempool *pool, const size_t num_iter)
+{
+	BLI_mempool_iter *iter_arr = MEM_mallocN(sizeof(*iter_arr) * num_iter, __func__);
+	BLI_mempool_chunk **curchunk_threadsafe = MEM_mallocN(sizeof(*curchunk_threadsafe), __func__);
+	size_t i;
+
+	BLI_assert(pool->flag & BLI_MEMPOOL_ALLOW_ITER);
+
+	*curchunk_threadsafe = pool->chunks;
+
+	for (i = 0; i < num_iter; i++) {
+		iter_arr[i].pool = pool;
+		/* chunks are claimed on the first step, iterators may be used by another thread */
+		iter_arr[i].curchunk = NULL;
+		iter_arr[i].curindex = 0;
+		iter_arr[i].curchunk_threadsafe = curchunk_threadsafe;
+	}
+
+	return iter_arr;
+}
+
+void BLI_mempool_iter_threadsafe_free(BLI_mempool_iter *iter_arr)
+{
+	BLI_assert(iter_arr->curchunk_threadsafe != NULL);
+
+	MEM_freeN(iter_arr->curchunk_threadsafe);
+	MEM_freeN(iter_arr);
+}
+
+/**
+ * Step over an iterator from #BLI_mempool_iter_threadsafe_create, returning the mempool item or NULL.
+ */
+void *BLI_mempool_iterstep_threadsafe(BLI_mempool_iter *iter)
+{
+	BLI_freenode *ret;
+
+	BLI_assert(iter->curchunk_threadsafe != NULL);
+
+	do {
+		if (UNLIKELY(iter->curchunk == NULL)) {
+			iter->curchunk = mempool_iter_threadsafe_chunk_claim(iter->curchunk_threadsafe);
+			if (iter->curchunk == NULL) {
+				return NULL;
+			}
+		}
+
+		ret = (BLI_freenode *)(((char *)CHUNK_DATA(iter->curchunk)) + (iter->pool->esize * iter->curindex));
+
+		if (UNLIKELY(++iter->curindex == iter->pool->pchunk)) {
+			iter->curindex = 0;
+			iter->curchunk = NULL;
+		}
+	} while (ret->freeword == FREEWORD);
+
+	return ret;
 }
 
 #if 0
@@ -689,6 +846,92 @@ void BLI_mempool_destroy(BLI_mempool *pool)
 	MEM_freeN(pool);
 }
 
+/* -------------------------------------------------------------------- */
+/** \name Thread-Local Pools
+ *
+ * Parallel code can't share a mempool without a lock, instead each thread allocates from its own
+ * pool, created on first use. Once the parallel region is done the elements of all pools are
+ * merged into one pool (e.g. the pool of the data being built), or freed together.
+ * \{ */
+
+struct BLI_mempool_threaded {
+	unsigned int esize, totelem, pchunk, flag;
+	int num_threads;
+	BLI_mempool **pools;
+};
+
+/**
+ * \param totelem  Number of elements to reserve in each thread's pool.
+ * \param num_threads  Number of threads, see #BLI_task_scheduler_num_threads.
+ */
+BLI_mempool_threaded *BLI_mempool_threaded_create(unsigned int esize, unsigned int totelem,
+                                                  unsigned int pchunk, unsigned int flag,
+                                                  const int num_threads)
+{
+	BLI_mempool_threaded *tpool = MEM_mallocN(sizeof(*tpool), __func__);
+
+	tpool->esize = esize;
+	tpool->totelem = totelem;
+	tpool->pchunk = pchunk;
+	tpool->flag = flag;
+	tpool->num_threads = num_threads;
+	tpool->pools = MEM_callocN(sizeof(*tpool->pools) * (size_t)num_threads, __func__);
+
+	return tpool;
+}
+
+/**
+ * Pool of thread \a thread_id, only that thread may use it during the parallel region.
+ */
+BLI_mempool *BLI_mempool_threaded_get(BLI_mempool_threaded *tpool, const int thread_id)
+{
+	BLI_mempool **pool_p = &tpool->pools[thread_id];
+
+	BLI_assert(thread_id >= 0 && thread_id < tpool->num_threads);
+
+	if (UNLIKELY(*pool_p == NULL)) {
+		*pool_p = mempool_create(tpool->esize, tpool->totelem, tpool->pchunk, tpool->flag, true);
+	}
+
+	return *pool_p;
+}
+
+/**
+ * Move the elements of all thread pools into \a pool and destroy \a tpool.
+ * \a pool has to be created with the same element size, chunk size and flags.
+ */
+void BLI_mempool_threaded_merge(BLI_mempool_threaded *tpool, BLI_mempool *pool)
+{
+	int i;
+
+	for (i = 0; i < tpool->num_threads; i++) {
+		if (tpool->pools[i]) {
+			BLI_mempool_merge(pool, tpool->pools[i]);
+		}
+	}
+
+	BLI_mempool_threaded_destroy(tpool);
+}
+
+/**
+ * Destroy all thread pools and their elements.
+ */
+void BLI_mempool_threaded_destroy(BLI_mempool_threaded *tpool)
+{
+	int i;
+
+	for (i = 0; i < tpool->num_threads; i++) {
+		if (tpool->pools[i]) {
+			BLI_mempool_destroy(tpool->pools[i]);
+		}
+	}
+
+	MEM_freeN(tpool->pools);
+	MEM_freeN(tpool);
+}
+
+/** \} */
+
 #ifndef NDEBUG
 void BLI_mempool_set_memory_debug(void)
 {
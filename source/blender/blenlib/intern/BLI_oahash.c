@@ -0,0 +1,664 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/BLI_oahash.c
+ *  \ingroup bli
+ *
+ * An open addressing (pointer -> pointer) hash table, using Robin Hood hashing with linear probing.
+ *
+ * Entries (key, value and hash) are stored in a single power of two sized array. On insertion, entries
+ * further away from their ideal slot take the place of entries closer to theirs, which keeps probe
+ * sequences short and lets lookups of missing keys stop early. Removal shifts the following entries
+ * back, so there are no tombstones.
+ *
+ * The hash is stored with each entry, so resizing doesn't call the hash function and most mismatches
+ * are rejected without calling the compare function. When created with #BLI_oahash_ptr_new keys are
+ * compared by value and hashing is inlined.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_sys_types.h"  /* for intptr_t support */
+#include "BLI_utildefines.h"
+
+#include "BLI_oahash.h"
+#include "BLI_strict_flags.h"
+
+#define OAHASH_BUCKET_BIT_MIN 3
+#define OAHASH_BUCKET_BIT_MAX 31
+
+/**
+ * Same max load as GHash, Robin Hood hashing could go higher but with more probing for missing keys.
+ */
+#define OAHASH_LIMIT_GROW(_nbkt) (((_nbkt) * 3) / 4)
+
+/***/
+
+typedef struct OAHashEntry {
+	void *key;
+	void *val;
+	/* never 0 for used entries, 0 marks empty buckets */
+	unsigned int hash;
+} OAHashEntry;
+
+struct OAHash {
+	/* NULL for keys compared by value, see #BLI_oahash_ptr_new */
+	GHashHashFP hashfp;
+	GHashCmpFP cmpfp;
+
+	OAHashEntry *entries;
+	unsigned int bucket_mask;
+	unsigned int limit_grow;
+
+	unsigned int nentries;
+};
+
+/* -------------------------------------------------------------------- */
+/* OAHash API */
+
+/** \name Internal Utility API
+ * \{ */
+
+/**
+ * Fibonacci hashing: the middle bits of the product depend on all bits of the key,
+ * pointers have their lower bits zero because of alignment and integer keys are often sequential.
+ */
+BLI_INLINE unsigned int oahash_ptrhash(const void *key)
+{
+	const uint64_t y = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull;
+	return (unsigned int)(y >> 32);
+}
+
+BLI_INLINE unsigned int oahash_keyhash(const OAHash *oh, const void *key)
+{
+	const unsigned int hash = (oh->hashfp) ? oh->hashfp(key) : oahash_ptrhash(key);
+	/* 0 marks empty buckets */
+	return (hash != 0) ? hash : 1;
+}
+
+/**
+ * Distance of the entry in \a bucket from its ideal bucket.
+ */
+BLI_INLINE unsigned int oahash_probe_distance(const OAHash *oh, const unsigned int bucket, const unsigned int hash)
+{
+	return (bucket - hash) & oh->bucket_mask;
+}
+
+/**
+ * Internal lookup, \a is_ptr_key is a constant in all callers so the compare gets inlined for value keys.
+ */
+BLI_INLINE OAHashEntry *oahash_lookup_entry_ex(
+        const OAHash *oh, const void *key, const unsigned int hash, const bool is_ptr_key)
+{
+	unsigned int bucket = hash & oh->bucket_mask;
+	unsigned int dist;
+
+	for (dist = 0; ; dist++, bucket = (bucket + 1) & oh->bucket_mask) {
+		OAHashEntry *e = &oh->entries[bucket];
+
+		/* entries with a shorter probe distance than ours mean the key would have been placed before */
+		if (e->hash == 0 || oahash_probe_distance(oh, bucket, e->hash) < dist) {
+			return NULL;
+		}
+
+		if (e->hash == hash) {
+			if (is_ptr_key ? (e->key == key) : (oh->cmpfp(key, e->key) == false)) {
+				return e;
+			}
+		}
+	}
+}
+
+BLI_INLINE OAHashEntry *oahash_lookup_entry_hash(const OAHash *oh, const void *key, const unsigned int hash)
+{
+	if (oh->hashfp == NULL) {
+		return oahash_lookup_entry_ex(oh, key, hash, true);
+	}
+	else {
+		return oahash_lookup_entry_ex(oh, key, hash, false);
+	}
+}
+
+BLI_INLINE OAHashEntry *oahash_lookup_entry(const OAHash *oh, const void *key)
+{
+	return oahash_lookup_entry_hash(oh, key, oahash_keyhash(oh, key));
+}
+
+/**
+ * Insert an entry for a key which is not in the table yet, there must be room for it.
+ *
+ * \return The entry of the new key, later entries displaced by the insertion don't move it.
+ */
+static OAHashEntry *oahash_insert_entry(OAHash *oh, void *key, void *val, const unsigned int hash)
+{
+	OAHashEntry e_insert, *e_new = NULL;
+	unsigned int bucket = hash & oh->bucket_mask;
+	unsigned int dist;
+
+	e_insert.key = key;
+	e_insert.val = val;
+	e_insert.hash = hash;
+
+	for (dist = 0; ; dist++, bucket = (bucket + 1) & oh->bucket_mask) {
+		OAHashEntry *e = &oh->entries[bucket];
+		unsigned int e_dist;
+
+		if (e->hash == 0) {
+			*e = e_insert;
+			return (e_new) ? e_new : e;
+		}
+
+		/* take the place of entries closer to their ideal bucket, and continue inserting those */
+		e_dist = oahash_probe_distance(oh, bucket, e->hash);
+		if (e_dist < dist) {
+			SWAP(OAHashEntry, *e, e_insert);
+			if (e_new == NULL) {
+				e_new = e;
+			}
+			dist = e_dist;
+		}
+	}
+}
+
+static void oahash_buckets_resize(OAHash *oh, const unsigned int nbuckets)
+{
+	OAHashEntry *entries_old = oh->entries;
+	const unsigned int nbuckets_old = (entries_old) ? oh->bucket_mask + 1 : 0;
+	unsigned int i;
+
+	BLI_assert((nbuckets & (nbuckets - 1)) == 0);
+	BLI_assert(OAHASH_LIMIT_GROW(nbuckets) >= oh->nentries);
+
+	oh->entries = MEM_callocN(sizeof(*oh->entries) * nbuckets, __func__);
+	oh->bucket_mask = nbuckets - 1;
+	oh->limit_grow = OAHASH_LIMIT_GROW(nbuckets);
+
+	for (i = 0; i < nbuckets_old; i++) {
+		OAHashEntry *e = &entries_old[i];
+
+		if (e->hash != 0) {
+			oahash_insert_entry(oh, e->key, e->val, e->hash);
+		}
+	}
+
+	if (entries_old) {
+		MEM_freeN(entries_old);
+	}
+}
+
+BLI_INLINE unsigned int oahash_buckets_size_for(unsigned int nentries)
+{
+	unsigned int bucket_bit = OAHASH_BUCKET_BIT_MIN;
+
+	while (bucket_bit < OAHASH_BUCKET_BIT_MAX && OAHASH_LIMIT_GROW(1u << bucket_bit) < nentries) {
+		bucket_bit++;
+	}
+
+	return 1u << bucket_bit;
+}
+
+/**
+ * Grow the table if needed to hold \a nentries.
+ */
+BLI_INLINE void oahash_buckets_expand(OAHash *oh, const unsigned int nentries)
+{
+	if (LIKELY(nentries <= oh->limit_grow)) {
+		return;
+	}
+
+	oahash_buckets_resize(oh, oahash_buckets_size_for(nentries));
+}
+
+/**
+ * Remove entry \a e, shifting back the following entries which are not in their ideal bucket.
+ */
+static void oahash_remove_entry(OAHash *oh, OAHashEntry *e)
+{
+	unsigned int bucket = (unsigned int)(e - oh->entries);
+
+	for (;;) {
+		const unsigned int bucket_next = (bucket + 1) & oh->bucket_mask;
+		OAHashEntry *e_next = &oh->entries[bucket_next];
+
+		if (e_next->hash == 0 || oahash_probe_distance(oh, bucket_next, e_next->hash) == 0) {
+			break;
+		}
+
+		oh->entries[bucket] = *e_next;
+		bucket = bucket_next;
+	}
+
+	oh->entries[bucket].key = NULL;
+	oh->entries[bucket].val = NULL;
+	oh->entries[bucket].hash = 0;
+
+	oh->nentries--;
+}
+
+static void oahash_free_cb(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	BLI_assert(keyfreefp || valfreefp);
+
+	for (i = 0; i <= oh->bucket_mask; i++) {
+		OAHashEntry *e = &oh->entries[i];
+
+		if (e->hash != 0) {
+			if (keyfreefp) keyfreefp(e->key);
+			if (valfreefp) valfreefp(e->val);
+		}
+	}
+}
+
+static OAHash *oahash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                          const unsigned int nentries_reserve)
+{
+	OAHash *oh = MEM_mallocN(sizeof(*oh), info);
+
+	oh->hashfp = hashfp;
+	oh->cmpfp = cmpfp;
+	oh->entries = NULL;
+	oh->nentries = 0;
+
+	oahash_buckets_resize(oh, oahash_buckets_size_for(nentries_reserve));
+
+	return oh;
+}
+
+/** \} */
+
+
+/** \name Public API
+ * \{ */
+
+/**
+ * Creates a new, empty OAHash.
+ *
+ * \param hashfp  Hash callback.
+ * \param cmpfp  Comparison callback.
+ * \param info  Identifier string for the OAHash.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ * Use this to avoid resizing buckets if the size is known or can be closely approximated.
+ * \return  An OAHash struct.
+ */
+OAHash *BLI_oahash_new_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                          const unsigned int nentries_reserve)
+{
+	BLI_assert(hashfp != NULL && cmpfp != NULL);
+
+	return oahash_new(hashfp, cmpfp, info, nentries_reserve);
+}
+
+/**
+ * Wraps #BLI_oahash_new_ex with zero entries reserved.
+ */
+OAHash *BLI_oahash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
+{
+	return BLI_oahash_new_ex(hashfp, cmpfp, info, 0);
+}
+
+/**
+ * Creates a new, empty OAHash for pointer (or integer) keys compared by value.
+ * Hashing and comparing keys is inlined, there are no callbacks.
+ */
+OAHash *BLI_oahash_ptr_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return oahash_new(NULL, NULL, info, nentries_reserve);
+}
+
+OAHash *BLI_oahash_ptr_new(const char *info)
+{
+	return BLI_oahash_ptr_new_ex(info, 0);
+}
+
+/**
+ * \return size of the OAHash.
+ */
+unsigned int BLI_oahash_size(const OAHash *oh)
+{
+	return oh->nentries;
+}
+
+/**
+ * Reserve given amount of entries (resize \a oh accordingly if needed).
+ */
+void BLI_oahash_reserve(OAHash *oh, const unsigned int nentries_reserve)
+{
+	oahash_buckets_expand(oh, nentries_reserve);
+}
+
+/**
+ * Insert a key/value pair into the \a oh.
+ *
+ * \note Duplicates are not checked,
+ * the caller is expected to ensure elements are unique.
+ */
+void BLI_oahash_insert(OAHash *oh, void *key, void *val)
+{
+	BLI_assert(oahash_lookup_entry(oh, key) == NULL);
+
+	oahash_buckets_expand(oh, oh->nentries + 1);
+	oahash_insert_entry(oh, key, val, oahash_keyhash(oh, key));
+	oh->nentries++;
+}
+
+/**
+ * Inserts a new value to a key that may already be in oahash.
+ *
+ * Avoids #BLI_oahash_remove, #BLI_oahash_insert calls (double lookups)
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_oahash_reinsert(OAHash *oh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const unsigned int hash = oahash_keyhash(oh, key);
+	OAHashEntry *e = oahash_lookup_entry_hash(oh, key, hash);
+
+	if (e) {
+		if (keyfreefp) keyfreefp(e->key);
+		if (valfreefp) valfreefp(e->val);
+		e->key = key;
+		e->val = val;
+		return false;
+	}
+
+	oahash_buckets_expand(oh, oh->nentries + 1);
+	oahash_insert_entry(oh, key, val, hash);
+	oh->nentries++;
+	return true;
+}
+
+/**
+ * Lookup the value of \a key in \a oh.
+ *
+ * \param key  The key to lookup.
+ * \returns the value for \a key or NULL.
+ *
+ * \note When NULL is a valid value, use #BLI_oahash_lookup_p to differentiate a missing key
+ * from a key with a NULL value. (Avoids calling #BLI_oahash_haskey before #BLI_oahash_lookup)
+ */
+void *BLI_oahash_lookup(const OAHash *oh, const void *key)
+{
+	OAHashEntry *e = oahash_lookup_entry(oh, key);
+	return e ? e->val : NULL;
+}
+
+/**
+ * A version of #BLI_oahash_lookup which accepts a fallback argument.
+ */
+void *BLI_oahash_lookup_default(const OAHash *oh, const void *key, void *val_default)
+{
+	OAHashEntry *e = oahash_lookup_entry(oh, key);
+	return e ? e->val : val_default;
+}
+
+/**
+ * Lookup a pointer to the value of \a key in \a oh.
+ *
+ * \param key  The key to lookup.
+ * \returns the pointer to value for \a key or NULL.
+ *
+ * \note This has 2 main benefits over #BLI_oahash_lookup.
+ * - A NULL return always means that \a key isn't in \a oh.
+ * - The value can be modified in-place without further function calls (faster).
+ *
+ * \warning The pointer is only valid until the next insertion or removal.
+ */
+void **BLI_oahash_lookup_p(OAHash *oh, const void *key)
+{
+	OAHashEntry *e = oahash_lookup_entry(oh, key);
+	return e ? &e->val : NULL;
+}
+
+/**
+ * Ensure \a key is exists in \a oh.
+ *
+ * This handles the common situation where the caller needs ensure a key is added to \a oh,
+ * constructing a new value in the case the key isn't found.
+ * Otherwise use the existing value.
+ *
+ * Such situations typically incur multiple lookups, however this function
+ * avoids them by ensuring the key is added,
+ * returning a pointer to the value so it can be used or initialized by the caller.
+ *
+ * \returns true when the value didn't need to be added.
+ * (when false, the caller _must_ initialize the value).
+ */
+bool BLI_oahash_ensure_p(OAHash *oh, void *key, void ***r_val)
+{
+	const unsigned int hash = oahash_keyhash(oh, key);
+	OAHashEntry *e = oahash_lookup_entry_hash(oh, key, hash);
+	const bool haskey = (e != NULL);
+
+	if (!haskey) {
+		oahash_buckets_expand(oh, oh->nentries + 1);
+		e = oahash_insert_entry(oh, key, NULL, hash);
+		oh->nentries++;
+	}
+
+	*r_val = &e->val;
+	return haskey;
+}
+
+/**
+ * Remove \a key from \a oh, or return false if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \return true if \a key was removed from \a oh.
+ */
+bool BLI_oahash_remove(OAHash *oh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	OAHashEntry *e = oahash_lookup_entry(oh, key);
+
+	if (e) {
+		if (keyfreefp) keyfreefp(e->key);
+		if (valfreefp) valfreefp(e->val);
+		oahash_remove_entry(oh, e);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Remove \a key from \a oh, returning the value or NULL if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \return the value of \a key int \a oh or NULL.
+ */
+void *BLI_oahash_popkey(OAHash *oh, const void *key, GHashKeyFreeFP keyfreefp)
+{
+	OAHashEntry *e = oahash_lookup_entry(oh, key);
+
+	if (e) {
+		void *val = e->val;
+		if (keyfreefp) keyfreefp(e->key);
+		oahash_remove_entry(oh, e);
+		return val;
+	}
+
+	return NULL;
+}
+
+/**
+ * \return true if the \a key is in \a oh.
+ */
+bool BLI_oahash_haskey(const OAHash *oh, const void *key)
+{
+	return (oahash_lookup_entry(oh, key) != NULL);
+}
+
+/**
+ * Reset \a oh clearing all entries.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ */
+void BLI_oahash_clear_ex(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp,
+                         const unsigned int nentries_reserve)
+{
+	if (keyfreefp || valfreefp)
+		oahash_free_cb(oh, keyfreefp, valfreefp);
+
+	MEM_freeN(oh->entries);
+	oh->entries = NULL;
+	oh->nentries = 0;
+
+	oahash_buckets_resize(oh, oahash_buckets_size_for(nentries_reserve));
+}
+
+/**
+ * Wraps #BLI_oahash_clear_ex with zero entries reserved.
+ */
+void BLI_oahash_clear(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	BLI_oahash_clear_ex(oh, keyfreefp, valfreefp, 0);
+}
+
+/**
+ * Frees the OAHash and its members.
+ *
+ * \param oh  The OAHash to free.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_oahash_free(OAHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	if (keyfreefp || valfreefp)
+		oahash_free_cb(oh, keyfreefp, valfreefp);
+
+	MEM_freeN(oh->entries);
+	MEM_freeN(oh);
+}
+
+/** \} */
+
+
+/** \name OAHash Iterator API
+ * \{ */
+
+BLI_INLINE void oahash_iterator_skip_empty(OAHashIterator *ohi)
+{
+	const OAHash *oh = ohi->oh;
+
+	while (ohi->index <= oh->bucket_mask && oh->entries[ohi->index].hash == 0) {
+		ohi->index++;
+	}
+}
+
+/**
+ * Init an already allocated OAHashIterator. The hash table must not be mutated
+ * while the iterator is in use, and the iterator will step exactly
+ * BLI_oahash_size(oh) times before becoming done.
+ *
+ * \param ohi The OAHashIterator to initialize.
+ * \param oh The OAHash to iterate over.
+ */
+void BLI_oahashIterator_init(OAHashIterator *ohi, OAHash *oh)
+{
+	ohi->oh = oh;
+	ohi->index = 0;
+	oahash_iterator_skip_empty(ohi);
+}
+
+/**
+ * Steps the iterator to the next index.
+ *
+ * \param ohi The iterator.
+ */
+void BLI_oahashIterator_step(OAHashIterator *ohi)
+{
+	ohi->index++;
+	oahash_iterator_skip_empty(ohi);
+}
+
+void *BLI_oahashIterator_getKey(OAHashIterator *ohi)
+{
+	return ohi->oh->entries[ohi->index].key;
+}
+
+void *BLI_oahashIterator_getValue(OAHashIterator *ohi)
+{
+	return ohi->oh->entries[ohi->index].val;
+}
+
+void **BLI_oahashIterator_getValue_p(OAHashIterator *ohi)
+{
+	return &ohi->oh->entries[ohi->index].val;
+}
+
+bool BLI_oahashIterator_done(OAHashIterator *ohi)
+{
+	return ohi->index > ohi->oh->bucket_mask;
+}
+
+/** \} */
+
+
+/** \name Debugging & Introspection
+ * \{ */
+
+/**
+ * Measure how well the hash function performs, the average probe distance of all entries
+ * (0.0 is perfect, every entry is in its ideal bucket).
+ *
+ * \param r_load The load factor of the table.
+ * \param r_probe_max The longest probe distance.
+ */
+double BLI_oahash_calc_quality_ex(OAHash *oh, double *r_load, unsigned int *r_probe_max)
+{
+	uint64_t sum = 0;
+	unsigned int probe_max = 0;
+	unsigned int i;
+
+	for (i = 0; i <= oh->bucket_mask; i++) {
+		const OAHashEntry *e = &oh->entries[i];
+
+		if (e->hash != 0) {
+			const unsigned int dist = oahash_probe_distance(oh, i, e->hash);
+			sum += dist;
+			probe_max = MAX2(probe_max, dist);
+		}
+	}
+
+	if (r_load) {
+		*r_load = (double)oh->nentries / (double)(oh->bucket_mask + 1);
+	}
+	if (r_probe_max) {
+		*r_probe_max = probe_max;
+	}
+
+	return (oh->nentries) ? (double)sum / (double)oh->nentries : 0.0;
+}
+
+double BLI_oahash_calc_quality(OAHash *oh)
+{
+	return BLI_oahash_calc_quality_ex(oh, NULL, NULL);
+}
+
+/** \} */
@@ -30,6 +30,8 @@
 
 #include "BLI_listbase.h"
 #include "BLI_math.h"
+#include "BLI_mempool.h"
+#include "BLI_sort.h"
 #include "BLI_task.h"
 #include "BLI_threads.h"
 
@@ -57,6 +59,19 @@ struct TaskPool {
 	ThreadMutex num_mutex;
 	ThreadCondition num_cond;
 
+	/* Pool of the task which created this pool, NULL when not created from a task. Threads waiting
+	 * for a pool also run tasks of its nested pools, these have to finish before the pool can.
+	 * Nested pools must be freed before their parent, within the task that created them. */
+	TaskPool *parent;
+#ifndef NDEBUG
+	/* Number of nested pools which are not freed yet. */
+	size_t num_nested_pools;
+#endif
+	/* Number of threads in BLI_task_pool_work_and_wait for this pool, and a counter incremented
+	 * when tasks for it or its nested pools get pushed while there are waiting threads. */
+	size_t num_waiting_threads;
+	size_t push_generation;
+
 	void *userdata;
 	ThreadMutex user_mutex;
 
@@ -67,15 +82,37 @@ struct TaskPool {
 	bool run_in_background;
 };
 
+/* Queue of tasks owned by a single thread. The owner pushes and pops tasks at its own queue,
+ * threads running out of work steal tasks from the queues of other threads. The lock is only
+ * contended while stealing. */
+typedef struct TaskQueue {
+	ListBase tasks;
+	SpinLock lock;
+
+	/* avoid false sharing of the locks of different threads */
+	char pad[64 - sizeof(ListBase) - sizeof(SpinLock)];
+} TaskQueue;
+
 struct TaskScheduler {
 	pthread_t *threads;
 	struct TaskThread *task_threads;
 	int num_threads;
 	bool background_thread_only;
 
-	ListBase queue;
+	/* Queue 0 is shared by all threads which are not a worker thread of this scheduler (main thread, jobs),
+	 * queue i is owned by worker thread i. */
+	TaskQueue *queues;
+	int num_queues;
+
+	/* Worker threads without any work sleep on queue_cond. */
 	ThreadMutex queue_mutex;
 	ThreadCondition queue_cond;
+	size_t num_sleeping_threads;
+
+	/* TaskThread of the calling worker thread, NULL for other threads. */
+	pthread_key_t thread_key;
+	/* Pool of the task the calling thread is running, NULL when not running a task. */
+	pthread_key_t pool_key;
 
 	volatile bool do_exit;
 };
@@ -107,7 +144,6 @@ static void task_pool_num_decrease(TaskPool *pool, size_t done)
 	BLI_assert(pool->num >= done);
 
 	pool->num -= done;
-	atomic_sub_z(&pool->currently_running_tasks, done);
 	pool->done += done;
 
 	if (pool->num == 0)
@@ -121,64 +157,167 @@ static void task_pool_num_increase(TaskPool *pool)
 	BLI_mutex_lock(&pool->num_mutex);
 
 	pool->num++;
-	BLI_condition_notify_all(&pool->num_cond);
 
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+/* Wake up threads waiting for the pool or one of its parents after a task got pushed, so they can help with it. */
+static void task_pool_notify_waiting_threads(TaskPool *pool)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	for (; pool; pool = pool->parent) {
+		if (atomic_add_z(&pool->num_waiting_threads, 0) != 0) {
+			BLI_mutex_lock(&pool->num_mutex);
+
+			pool->push_generation++;
+			BLI_condition_notify_all(&pool->num_cond);
 
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-
-	do {
-		Task *current_task;
-
-		/* Assuming we can only have a void queue in 'exit' case here seems logical (we should only be here after
-		 * our worker thread has been woken up from a condition_wait(), which only happens after a new task was
-		 * added to the queue), but it is wrong.
-		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups), and some
-		 * race condition may also empty the queue **after** condition has been signaled, but **before** awoken thread
-		 * reaches this point...
-		 * See http://stackoverflow.com/questions/8594591
-		 *
-		 * So we only abort here if do_exit is set.
-		 */
-		if (scheduler->do_exit) {
-			BLI_mutex_unlock(&scheduler->queue_mutex);
-			return false;
+			BLI_mutex_unlock(&pool->num_mutex);
 		}
+	}
+}
+
+static bool task_pool_is_nested(TaskPool *pool, TaskPool *parent)
+{
+	for (; pool; pool = pool->parent) {
+		if (pool == parent) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Reserve a running task for the pool, fails when the pool already runs as many tasks as it is allowed threads. */
+static bool task_pool_thread_reserve(TaskPool *pool)
+{
+	if (atomic_add_z(&pool->currently_running_tasks, 1) <= pool->num_threads || pool->num_threads == 0) {
+		return true;
+	}
+
+	atomic_sub_z(&pool->currently_running_tasks, 1);
+	return false;
+}
+
+static void task_pool_thread_release(TaskPool *pool)
+{
+	atomic_sub_z(&pool->currently_running_tasks, 1);
+}
+
+/* Index of the queue owned by the calling thread. */
+static int task_scheduler_thread_queue_index(TaskScheduler *scheduler)
+{
+	TaskThread *thread = pthread_getspecific(scheduler->thread_key);
 
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
-		{
-			TaskPool *pool = current_task->pool;
+	return (thread) ? thread->id : 0;
+}
+
+/* Remove the first task from the queue which can be run now. When pool is given only
+ * tasks from that pool and pools nested in it are considered. */
+static Task *task_queue_pop(TaskScheduler *scheduler, TaskQueue *queue, TaskPool *pool)
+{
+	Task *task;
 
-			if (scheduler->background_thread_only && !pool->run_in_background) {
+	/* unlocked check to skip empty queues quickly, pushing a task is followed by a wakeup */
+	if (queue->tasks.first == NULL) {
+		return NULL;
+	}
+
+	BLI_spin_lock(&queue->lock);
+
+	for (task = queue->tasks.first; task; task = task->next) {
+		TaskPool *task_pool = task->pool;
+
+		if (pool) {
+			if (!task_pool_is_nested(task_pool, pool)) {
 				continue;
 			}
+		}
+		else if (scheduler->background_thread_only && !task_pool->run_in_background) {
+			continue;
+		}
+
+		if (task_pool_thread_reserve(task_pool)) {
+			BLI_remlink(&queue->tasks, task);
+			break;
+		}
+	}
+
+	BLI_spin_unlock(&queue->lock);
+
+	return task;
+}
+
+/* Find a task, first in the queue of the calling thread, then stealing from the other queues.
+ * Each thread starts stealing from its neighbor so they don't all contend on the same queue. */
+static Task *task_scheduler_find_task(TaskScheduler *scheduler, const int queue_index, TaskPool *pool)
+{
+	int i;
+
+	for (i = 0; i < scheduler->num_queues; i++) {
+		TaskQueue *queue = &scheduler->queues[(queue_index + i) % scheduler->num_queues];
+		Task *task = task_queue_pop(scheduler, queue, pool);
+
+		if (task) {
+			return task;
+		}
+	}
+
+	return NULL;
+}
 
-			if (pool->num_threads == 0 ||
-			    pool->currently_running_tasks < pool->num_threads)
-			{
-				*task = current_task;
-				found_task = true;
-				atomic_add_z(&pool->currently_running_tasks, 1);
-				BLI_remlink(&scheduler->queue, *task);
-				break;
+static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, const int queue_index, Task **task)
+{
+	*task = NULL;
+
+	while (!scheduler->do_exit) {
+		*task = task_scheduler_find_task(scheduler, queue_index, NULL);
+		if (*task) {
+			return true;
+		}
+
+		/* No work, sleep until a task is pushed. The queues are checked again after registering
+		 * as sleeping thread, so a task pushed concurrently either is found here or its push sees
+		 * the sleeping thread and notifies it. Spurious wake-ups just go through the loop again. */
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		atomic_add_z(&scheduler->num_sleeping_threads, 1);
+
+		if (!scheduler->do_exit) {
+			*task = task_scheduler_find_task(scheduler, queue_index, NULL);
+			if (*task == NULL) {
+				BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
 			}
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		atomic_sub_z(&scheduler->num_sleeping_threads, 1);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
 
-	return true;
+		if (*task) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void task_scheduler_run_task(Task *task, const int thread_id)
+{
+	TaskPool *pool = task->pool;
+	TaskScheduler *scheduler = pool->scheduler;
+	/* tasks can be run while waiting for another pool, so restore the previous pool after */
+	void *prev_pool = pthread_getspecific(scheduler->pool_key);
+
+	/* run task, pools created by it become nested pools */
+	pthread_setspecific(scheduler->pool_key, pool);
+	task->run(pool, task->taskdata, thread_id);
+	pthread_setspecific(scheduler->pool_key, prev_pool);
+
+	/* delete task */
+	task_data_free(task, thread_id);
+	MEM_freeN(task);
+
+	/* notify pool task was done */
+	task_pool_thread_release(pool);
+	task_pool_num_decrease(pool, 1);
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
@@ -188,19 +327,11 @@ static void *task_scheduler_thread_run(void *thread_p)
 	int thread_id = thread->id;
 	Task *task;
 
-	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
-		TaskPool *pool = task->pool;
-
-		/* run task */
-		task->run(pool, task->taskdata, thread_id);
-
-		/* delete task */
-		task_data_free(task, thread_id);
-		MEM_freeN(task);
+	pthread_setspecific(scheduler->thread_key, thread);
 
-		/* notify pool task was done */
-		task_pool_num_decrease(pool, 1);
+	/* keep popping off tasks */
+	while (task_scheduler_thread_wait_pop(scheduler, thread_id, &task)) {
+		task_scheduler_run_task(task, thread_id);
 	}
 
 	return NULL;
@@ -209,14 +340,21 @@ static void *task_scheduler_thread_run(void *thread_p)
 TaskScheduler *BLI_task_scheduler_create(int num_threads)
 {
 	TaskScheduler *scheduler = MEM_callocN(sizeof(TaskScheduler), "TaskScheduler");
+	int i;
 
 	/* multiple places can use this task scheduler, sharing the same
 	 * threads, so we keep track of the number of users. */
 	scheduler->do_exit = false;
 
-	BLI_listbase_clear(&scheduler->queue);
 	BLI_mutex_init(&scheduler->queue_mutex);
 	BLI_condition_init(&scheduler->queue_cond);
+	scheduler->num_sleeping_threads = 0;
+
+	if (pthread_key_create(&scheduler->thread_key, NULL) != 0 ||
+	    pthread_key_create(&scheduler->pool_key, NULL) != 0)
+	{
+		fprintf(stderr, "TaskScheduler failed to create thread keys\n");
+	}
 
 	if (num_threads == 0) {
 		/* automatic number of threads will be main thread + num cores */
@@ -232,10 +370,17 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	    num_threads = 1;
 	}
 
+	/* one queue per worker thread and one shared by all other threads */
+	scheduler->num_queues = num_threads + 1;
+	scheduler->queues = MEM_callocN(sizeof(TaskQueue) * scheduler->num_queues, "TaskScheduler queues");
+
+	for (i = 0; i < scheduler->num_queues; i++) {
+		BLI_listbase_clear(&scheduler->queues[i].tasks);
+		BLI_spin_init(&scheduler->queues[i].lock);
+	}
+
 	/* launch threads that will be waiting for work */
 	if (num_threads > 0) {
-		int i;
-
 		scheduler->num_threads = num_threads;
 		scheduler->threads = MEM_callocN(sizeof(pthread_t) * num_threads, "TaskScheduler threads");
 		scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * num_threads, "TaskScheduler task threads");
@@ -257,6 +402,7 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 void BLI_task_scheduler_free(TaskScheduler *scheduler)
 {
 	Task *task;
+	int i;
 
 	/* stop all waiting threads */
 	BLI_mutex_lock(&scheduler->queue_mutex);
@@ -266,8 +412,6 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 
 	/* delete threads */
 	if (scheduler->threads) {
-		int i;
-
 		for (i = 0; i < scheduler->num_threads; i++) {
 			if (pthread_join(scheduler->threads[i], NULL) != 0)
 				fprintf(stderr, "TaskScheduler failed to join thread %d/%d\n", i, scheduler->num_threads);
@@ -282,10 +426,20 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 	}
 
 	/* delete leftover tasks */
-	for (task = scheduler->queue.first; task; task = task->next) {
-		task_data_free(task, 0);
+	for (i = 0; i < scheduler->num_queues; i++) {
+		TaskQueue *queue = &scheduler->queues[i];
+
+		for (task = queue->tasks.first; task; task = task->next) {
+			task_data_free(task, 0);
+		}
+		BLI_freelistN(&queue->tasks);
+
+		BLI_spin_end(&queue->lock);
 	}
-	BLI_freelistN(&scheduler->queue);
+	MEM_freeN(scheduler->queues);
+
+	pthread_key_delete(scheduler->thread_key);
+	pthread_key_delete(scheduler->pool_key);
 
 	/* delete mutex/condition */
 	BLI_mutex_end(&scheduler->queue_mutex);
@@ -299,42 +453,68 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
+int BLI_task_scheduler_thread_id(TaskScheduler *scheduler)
+{
+	return task_scheduler_thread_queue_index(scheduler);
+}
+
 static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
 {
+	TaskQueue *queue = &scheduler->queues[task_scheduler_thread_queue_index(scheduler)];
+
 	task_pool_num_increase(task->pool);
 
-	/* add task to queue */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	/* add task to the queue of the calling thread */
+	BLI_spin_lock(&queue->lock);
 
 	if (priority == TASK_PRIORITY_HIGH)
-		BLI_addhead(&scheduler->queue, task);
+		BLI_addhead(&queue->tasks, task);
 	else
-		BLI_addtail(&scheduler->queue, task);
+		BLI_addtail(&queue->tasks, task);
 
-	BLI_condition_notify_one(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	BLI_spin_unlock(&queue->lock);
+
+	/* threads waiting for the pool can run the task too */
+	task_pool_notify_waiting_threads(task->pool);
+
+	/* wake up a thread to take (or steal) the task, see task_scheduler_thread_wait_pop.
+	 * The background thread can't run tasks from regular pools, no need to wake it up for those. */
+	if (scheduler->background_thread_only && !task->pool->run_in_background) {
+		return;
+	}
+
+	if (atomic_add_z(&scheduler->num_sleeping_threads, 0) != 0) {
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		BLI_condition_notify_one(&scheduler->queue_cond);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
+	}
 }
 
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 {
 	Task *task, *nexttask;
 	size_t done = 0;
+	int i;
 
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	/* free all tasks from this pool from the queues */
+	for (i = 0; i < scheduler->num_queues; i++) {
+		TaskQueue *queue = &scheduler->queues[i];
 
-	/* free all tasks from this pool from the queue */
-	for (task = scheduler->queue.first; task; task = nexttask) {
-		nexttask = task->next;
+		BLI_spin_lock(&queue->lock);
 
-		if (task->pool == pool) {
-			task_data_free(task, 0);
-			BLI_freelinkN(&scheduler->queue, task);
+		for (task = queue->tasks.first; task; task = nexttask) {
+			nexttask = task->next;
+
+			if (task->pool == pool) {
+				task_data_free(task, 0);
+				BLI_freelinkN(&queue->tasks, task);
 
-			done++;
+				done++;
+			}
 		}
-	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		BLI_spin_unlock(&queue->lock);
+	}
 
 	/* notify done */
 	task_pool_num_decrease(pool, done);
@@ -364,6 +544,15 @@ static TaskPool *task_pool_create_ex(TaskScheduler *scheduler, void *userdata, c
 	pool->currently_running_tasks = 0;
 	pool->do_cancel = false;
 	pool->run_in_background = is_background;
+	pool->parent = (is_background) ? NULL : pthread_getspecific(scheduler->pool_key);
+	pool->num_waiting_threads = 0;
+#ifndef NDEBUG
+	pool->num_nested_pools = 0;
+	if (pool->parent) {
+		atomic_add_z(&pool->parent->num_nested_pools, 1);
+	}
+#endif
+	pool->push_generation = 0;
 
 	BLI_mutex_init(&pool->num_mutex);
 	BLI_condition_init(&pool->num_cond);
@@ -386,6 +575,9 @@ static TaskPool *task_pool_create_ex(TaskScheduler *scheduler, void *userdata, c
  * Create a normal task pool.
  * This means that in single-threaded context, it will not be executed at all until you call
  * \a BLI_task_pool_work_and_wait() on it.
+ *
+ * \note When created from a task, the pool is nested in the pool of that task
+ *       and has to be freed before the task finishes.
  */
 TaskPool *BLI_task_pool_create(TaskScheduler *scheduler, void *userdata)
 {
@@ -411,6 +603,14 @@ void BLI_task_pool_free(TaskPool *pool)
 {
 	BLI_task_pool_stop(pool);
 
+#ifndef NDEBUG
+	/* nested pools point to their parent */
+	BLI_assert(pool->num_nested_pools == 0);
+	if (pool->parent) {
+		atomic_sub_z(&pool->parent->num_nested_pools, 1);
+	}
+#endif
+
 	BLI_mutex_end(&pool->num_mutex);
 	BLI_condition_end(&pool->num_cond);
 
@@ -445,58 +645,41 @@ void BLI_task_pool_push(
 void BLI_task_pool_work_and_wait(TaskPool *pool)
 {
 	TaskScheduler *scheduler = pool->scheduler;
+	const int queue_index = task_scheduler_thread_queue_index(scheduler);
+
+	/* registered before looking for tasks, so pushes from other threads either
+	 * are found or bump the generation, see task_pool_notify_waiting_threads */
+	atomic_add_z(&pool->num_waiting_threads, 1);
 
 	BLI_mutex_lock(&pool->num_mutex);
 
 	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
-		bool found_task = false;
+		const size_t push_generation = pool->push_generation;
+		Task *work_task;
 
 		BLI_mutex_unlock(&pool->num_mutex);
 
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
-		/* find task from this pool. if we get a task from another pool,
+		/* find task from this pool or pools nested in it, the tasks of nested pools have to
+		 * finish before the task which created them can. if we get a task from another pool,
 		 * we can get into deadlock */
+		work_task = task_scheduler_find_task(scheduler, queue_index, pool);
 
-		if (pool->num_threads == 0 ||
-		    pool->currently_running_tasks < pool->num_threads)
-		{
-			for (task = scheduler->queue.first; task; task = task->next) {
-				if (task->pool == pool) {
-					work_task = task;
-					found_task = true;
-					BLI_remlink(&scheduler->queue, task);
-					break;
-				}
-			}
-		}
-
-		BLI_mutex_unlock(&scheduler->queue_mutex);
-
-		/* if found task, do it, otherwise wait until other tasks are done */
-		if (found_task) {
-			/* run task */
-			atomic_add_z(&pool->currently_running_tasks, 1);
-			work_task->run(pool, work_task->taskdata, 0);
-
-			/* delete task */
-			task_data_free(task, 0);
-			MEM_freeN(work_task);
-
-			/* notify pool task was done */
-			task_pool_num_decrease(pool, 1);
+		/* if found task, do it, otherwise wait until other tasks are done or new tasks are pushed */
+		if (work_task) {
+			task_scheduler_run_task(work_task, queue_index);
 		}
 
 		BLI_mutex_lock(&pool->num_mutex);
 		if (pool->num == 0)
 			break;
 
-		if (!found_task)
+		if (!work_task && push_generation == pool->push_generation)
 			BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
 	}
 
 	BLI_mutex_unlock(&pool->num_mutex);
+
+	atomic_sub_z(&pool->num_waiting_threads, 1);
 }
 
 int BLI_pool_get_num_threads(TaskPool *pool)
@@ -563,12 +746,15 @@ size_t BLI_task_pool_tasks_done(TaskPool *pool)
  *
  * Main functions:
  * - #BLI_task_parallel_range
+ * - #BLI_task_parallel_reduce
+ * - #BLI_task_parallel_prefix_sum_i
+ * - #BLI_task_parallel_sort, #BLI_task_parallel_partition
+ * - #BLI_task_parallel_listbase (#ListBase - double linked list)
+ * - #BLI_task_parallel_mempool (#BLI_mempool - iterate over mempools)
  *
  * TODO:
- * - #BLI_task_parallel_foreach_listbase (#ListBase - double linked list)
  * - #BLI_task_parallel_foreach_link (#Link - single linked list)
  * - #BLI_task_parallel_foreach_ghash/gset (#GHash/#GSet - hash & set)
- * - #BLI_task_parallel_foreach_mempool (#BLI_mempool - iterate over mempools)
  *
  * Possible improvements:
  *
@@ -736,6 +922,604 @@ void BLI_task_parallel_range(
 	BLI_task_parallel_range_ex(start, stop, userdata, NULL, 0, func, (stop - start) > 64, false);
 }
 
+/* Block based routines
+ *
+ * Reduction, prefix sum, sort and partition split the array in a fixed number of contiguous blocks,
+ * processed in parallel, and then combine the per block results in block order. Results only depend
+ * on the number of blocks, which follows the number of threads of the scheduler. So e.g. float reductions
+ * give the same result on every run with the same number of threads, but not with a different one. */
+
+/* Minimum number of items per block, avoids scheduling overhead for tiny blocks. */
+#define PARALLEL_BLOCK_SIZE_MIN 1024
+
+static int parallel_num_blocks_get(const size_t num, const bool use_threading)
+{
+	size_t num_blocks = 1;
+
+	if (use_threading) {
+		num_blocks = (size_t)BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) * 2;
+		num_blocks = MIN2(num_blocks, num / PARALLEL_BLOCK_SIZE_MIN);
+		num_blocks = MAX2(num_blocks, 1);
+	}
+
+	return (int)num_blocks;
+}
+
+BLI_INLINE void parallel_block_range_get(
+        const size_t num, const int num_blocks, const int block,
+        size_t *r_start, size_t *r_stop)
+{
+	*r_start = (num * (size_t)block) / (size_t)num_blocks;
+	*r_stop = (num * (size_t)(block + 1)) / (size_t)num_blocks;
+}
+
+/* Run func for every block, blocks are the iterations of a parallel range. */
+static void parallel_blocks_run(const int num_blocks, void *userdata, TaskParallelRangeFunc func)
+{
+	BLI_task_parallel_range_ex(0, num_blocks, userdata, NULL, 0, func, num_blocks > 1, false);
+}
+
+typedef struct ParallelReduceState {
+	int start, stop;
+	int num_blocks;
+	void *userdata;
+	char *chunks;
+	size_t userdata_chunk_size;
+	TaskParallelRangeFunc func;
+} ParallelReduceState;
+
+static void parallel_reduce_block_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelReduceState *state = userdata;
+	void *chunk = state->chunks + state->userdata_chunk_size * (size_t)block;
+	size_t start, stop, i;
+
+	parallel_block_range_get((size_t)(state->stop - state->start), state->num_blocks, block, &start, &stop);
+
+	for (i = start; i < stop; i++) {
+		state->func(state->userdata, chunk, state->start + (int)i);
+	}
+}
+
+/**
+ * Parallel reduction over a range, \a func accumulates iterations into its \a userdata_chunk,
+ * \a reduce then combines those in order.
+ *
+ * \param userdata_chunk Identity value of the reduction (e.g. zero for a sum, or an empty bounding box),
+ *                       each block starts from a copy of it. Receives the combined result.
+ * \param reduce Combines \a chunk into \a chunk_join, \a chunk_join is \a userdata_chunk itself.
+ */
+void BLI_task_parallel_reduce(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeFunc func,
+        TaskParallelReduceFunc reduce,
+        const bool use_threading)
+{
+	ParallelReduceState state;
+	int i;
+
+	BLI_assert(start < stop);
+	BLI_assert(userdata_chunk != NULL && userdata_chunk_size != 0);
+
+	state.num_blocks = parallel_num_blocks_get((size_t)(stop - start), use_threading);
+
+	if (state.num_blocks == 1) {
+		for (i = start; i < stop; i++) {
+			func(userdata, userdata_chunk, i);
+		}
+		return;
+	}
+
+	state.start = start;
+	state.stop = stop;
+	state.userdata = userdata;
+	state.userdata_chunk_size = userdata_chunk_size;
+	state.func = func;
+	state.chunks = MEM_mallocN(userdata_chunk_size * (size_t)state.num_blocks, __func__);
+
+	for (i = 0; i < state.num_blocks; i++) {
+		memcpy(state.chunks + userdata_chunk_size * (size_t)i, userdata_chunk, userdata_chunk_size);
+	}
+
+	parallel_blocks_run(state.num_blocks, &state, parallel_reduce_block_func);
+
+	for (i = 0; i < state.num_blocks; i++) {
+		reduce(userdata, userdata_chunk, state.chunks + userdata_chunk_size * (size_t)i);
+	}
+
+	MEM_freeN(state.chunks);
+}
+
+typedef struct ParallelPrefixSumState {
+	int *data;
+	int num;
+	int num_blocks;
+	int *block_sums;
+} ParallelPrefixSumState;
+
+static void parallel_prefix_sum_block_sum_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelPrefixSumState *state = userdata;
+	size_t start, stop, i;
+	int sum = 0;
+
+	parallel_block_range_get((size_t)state->num, state->num_blocks, block, &start, &stop);
+
+	for (i = start; i < stop; i++) {
+		sum += state->data[i];
+	}
+
+	state->block_sums[block] = sum;
+}
+
+static void parallel_prefix_sum_block_scan_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelPrefixSumState *state = userdata;
+	size_t start, stop, i;
+	int sum = state->block_sums[block];
+
+	parallel_block_range_get((size_t)state->num, state->num_blocks, block, &start, &stop);
+
+	for (i = start; i < stop; i++) {
+		const int value = state->data[i];
+		state->data[i] = sum;
+		sum += value;
+	}
+}
+
+/**
+ * Replace each item by the sum of all items before it (exclusive prefix sum),
+ * typically used to turn counts into offsets.
+ *
+ * \return The sum of all items.
+ */
+int BLI_task_parallel_prefix_sum_i(int *data, const int num, const bool use_threading)
+{
+	ParallelPrefixSumState state;
+	int total = 0;
+	int i;
+
+	state.data = data;
+	state.num = num;
+	state.num_blocks = parallel_num_blocks_get((size_t)num, use_threading);
+
+	if (state.num_blocks == 1) {
+		for (i = 0; i < num; i++) {
+			const int value = data[i];
+			data[i] = total;
+			total += value;
+		}
+		return total;
+	}
+
+	state.block_sums = MEM_mallocN(sizeof(*state.block_sums) * (size_t)state.num_blocks, __func__);
+
+	/* sum of each block, then offsets of the blocks, then the sums within the blocks */
+	parallel_blocks_run(state.num_blocks, &state, parallel_prefix_sum_block_sum_func);
+
+	for (i = 0; i < state.num_blocks; i++) {
+		const int value = state.block_sums[i];
+		state.block_sums[i] = total;
+		total += value;
+	}
+
+	parallel_blocks_run(state.num_blocks, &state, parallel_prefix_sum_block_scan_func);
+
+	MEM_freeN(state.block_sums);
+
+	return total;
+}
+
+typedef struct ParallelSortState {
+	char *array;
+	char *buffer;
+	size_t num, size;
+	int num_blocks;
+	BLI_sort_cmp_t cmp;
+	void *thunk;
+
+	/* merge pass: merge runs of 'width' blocks from src into dst */
+	const char *src;
+	char *dst;
+	int width;
+} ParallelSortState;
+
+static void parallel_sort_block_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelSortState *state = userdata;
+	size_t start, stop;
+
+	parallel_block_range_get(state->num, state->num_blocks, block, &start, &stop);
+
+	BLI_qsort_r(state->array + start * state->size, stop - start, state->size, state->cmp, state->thunk);
+}
+
+static void parallel_sort_merge_func(void *userdata, void *UNUSED(userdata_chunk), int merge)
+{
+	ParallelSortState *state = userdata;
+	const size_t size = state->size;
+	const int block_a = merge * state->width * 2;
+	const int block_b = min_ii(block_a + state->width, state->num_blocks);
+	const int block_end = min_ii(block_b + state->width, state->num_blocks);
+	size_t a, a_end, b, b_end, dummy;
+	char *dst;
+
+	parallel_block_range_get(state->num, state->num_blocks, block_a, &a, &dummy);
+	parallel_block_range_get(state->num, state->num_blocks, block_b, &b, &dummy);
+	parallel_block_range_get(state->num, state->num_blocks, block_end - 1, &dummy, &b_end);
+	a_end = b;
+
+	if (block_b == state->num_blocks) {
+		/* odd run out, nothing to merge with */
+		b = b_end;
+	}
+
+	dst = state->dst + a * size;
+
+	/* taking from the first run when equal keeps the merge stable */
+	while (a < a_end && b < b_end) {
+		if (state->cmp(state->src + b * size, state->src + a * size, state->thunk) < 0) {
+			memcpy(dst, state->src + b * size, size);
+			b++;
+		}
+		else {
+			memcpy(dst, state->src + a * size, size);
+			a++;
+		}
+		dst += size;
+	}
+
+	if (a < a_end) {
+		memcpy(dst, state->src + a * size, (a_end - a) * size);
+		dst += (a_end - a) * size;
+	}
+	if (b < b_end) {
+		memcpy(dst, state->src + b * size, (b_end - b) * size);
+	}
+}
+
+/**
+ * Sort an array, blocks are sorted in parallel with #BLI_qsort_r and then merged pairwise in parallel.
+ * Like qsort the order of equal items is not preserved.
+ */
+void BLI_task_parallel_sort(
+        void *array, const size_t num, const size_t size,
+        BLI_sort_cmp_t cmp, void *thunk,
+        const bool use_threading)
+{
+	ParallelSortState state;
+
+	state.num_blocks = parallel_num_blocks_get(num, use_threading);
+
+	if (state.num_blocks == 1) {
+		if (num > 1) {
+			BLI_qsort_r(array, num, size, cmp, thunk);
+		}
+		return;
+	}
+
+	state.array = array;
+	state.num = num;
+	state.size = size;
+	state.cmp = cmp;
+	state.thunk = thunk;
+	state.buffer = MEM_mallocN(num * size, __func__);
+
+	parallel_blocks_run(state.num_blocks, &state, parallel_sort_block_func);
+
+	state.src = state.array;
+	state.dst = state.buffer;
+
+	for (state.width = 1; state.width < state.num_blocks; state.width *= 2) {
+		const int num_merges = (state.num_blocks + state.width * 2 - 1) / (state.width * 2);
+		char *tmp;
+
+		parallel_blocks_run(num_merges, &state, parallel_sort_merge_func);
+
+		tmp = state.dst;
+		state.dst = (char *)state.src;
+		state.src = tmp;
+	}
+
+	if (state.src != state.array) {
+		memcpy(state.array, state.src, num * size);
+	}
+
+	MEM_freeN(state.buffer);
+}
+
+typedef struct ParallelPartitionState {
+	char *array;
+	char *buffer;
+	size_t num, size;
+	int num_blocks;
+	TaskParallelPredicateFunc pred;
+	void *userdata;
+
+	bool *is_true;
+	size_t *block_true, *block_false;
+} ParallelPartitionState;
+
+static void parallel_partition_count_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelPartitionState *state = userdata;
+	size_t start, stop, i, num_true = 0;
+
+	parallel_block_range_get(state->num, state->num_blocks, block, &start, &stop);
+
+	for (i = start; i < stop; i++) {
+		state->is_true[i] = state->pred(state->array + i * state->size, state->userdata);
+		if (state->is_true[i]) {
+			num_true++;
+		}
+	}
+
+	state->block_true[block] = num_true;
+	state->block_false[block] = (stop - start) - num_true;
+}
+
+static void parallel_partition_scatter_func(void *userdata, void *UNUSED(userdata_chunk), int block)
+{
+	ParallelPartitionState *state = userdata;
+	size_t start, stop, i;
+	size_t index_true = state->block_true[block];
+	size_t index_false = state->block_false[block];
+
+	parallel_block_range_get(state->num, state->num_blocks, block, &start, &stop);
+
+	for (i = start; i < stop; i++) {
+		const size_t index = (state->is_true[i]) ? index_true++ : index_false++;
+		memcpy(state->buffer + index * state->size, state->array + i * state->size, state->size);
+	}
+}
+
+/**
+ * Move all items for which \a pred is true before the other items,
+ * keeping the order of items within both groups (stable partition).
+ *
+ * \return The number of items for which \a pred is true.
+ */
+size_t BLI_task_parallel_partition(
+        void *array, const size_t num, const size_t size,
+        TaskParallelPredicateFunc pred, void *userdata,
+        const bool use_threading)
+{
+	ParallelPartitionState state;
+	size_t total_true = 0, total_false = 0;
+	int i;
+
+	if (num == 0) {
+		return 0;
+	}
+
+	state.array = array;
+	state.num = num;
+	state.size = size;
+	state.pred = pred;
+	state.userdata = userdata;
+	state.num_blocks = parallel_num_blocks_get(num, use_threading);
+
+	state.buffer = MEM_mallocN(num * size, __func__);
+	state.is_true = MEM_mallocN(sizeof(*state.is_true) * num, __func__);
+	state.block_true = MEM_mallocN(sizeof(*state.block_true) * (size_t)state.num_blocks, __func__);
+	state.block_false = MEM_mallocN(sizeof(*state.block_false) * (size_t)state.num_blocks, __func__);
+
+	parallel_blocks_run(state.num_blocks, &state, parallel_partition_count_func);
+
+	/* offsets of each block in the true and false parts */
+	for (i = 0; i < state.num_blocks; i++) {
+		const size_t num_true = state.block_true[i];
+		state.block_true[i] = total_true;
+		total_true += num_true;
+	}
+	for (i = 0; i < state.num_blocks; i++) {
+		const size_t num_false = state.block_false[i];
+		state.block_false[i] = total_true + total_false;
+		total_false += num_false;
+	}
+
+	parallel_blocks_run(state.num_blocks, &state, parallel_partition_scatter_func);
+
+	memcpy(array, state.buffer, num * size);
+
+	MEM_freeN(state.buffer);
+	MEM_freeN(state.is_true);
+	MEM_freeN(state.block_true);
+	MEM_freeN(state.block_false);
+
+	return total_true;
+}
+
+#undef PARALLEL_BLOCK_SIZE_MIN
+
+/* ListBase and mempool iteration */
+
+typedef struct ParallelListState {
+	void *userdata;
+	TaskParallelListbaseFunc func;
+
+	int index;
+	Link *link;
+	SpinLock lock;
+} ParallelListState;
+
+/* Number of links handed to a task at once. */
+#define PARALLEL_LISTBASE_CHUNK_SIZE 32
+
+BLI_INLINE Link *parallel_listbase_next_iter_get(
+        ParallelListState * __restrict state,
+        int * __restrict index, int * __restrict count)
+{
+	Link *result;
+	int n = 0;
+
+	BLI_spin_lock(&state->lock);
+	result = state->link;
+	*index = state->index;
+	while (state->link != NULL && n < PARALLEL_LISTBASE_CHUNK_SIZE) {
+		state->link = state->link->next;
+		n++;
+	}
+	state->index += n;
+	BLI_spin_unlock(&state->lock);
+
+	*count = n;
+	return result;
+}
+
+static void parallel_listbase_func(
+        TaskPool * __restrict pool,
+        void *UNUSED(taskdata),
+        int UNUSED(threadid))
+{
+	ParallelListState * __restrict state = BLI_task_pool_userdata(pool);
+	Link *link;
+	int index, count;
+
+	while ((link = parallel_listbase_next_iter_get(state, &index, &count)) != NULL) {
+		int i;
+
+		for (i = 0; i < count; i++, link = link->next) {
+			state->func(state->userdata, link, index + i);
+		}
+	}
+}
+
+/**
+ * This function allows to parallelize for loops over ListBase items.
+ *
+ * \param listbase The double linked list to loop over.
+ * \param userdata Common userdata passed to all instances of \a func.
+ * \param func Callback function, gets the link and its index in the list.
+ * \param use_threading If \a true, actually split-execute loop in threads, else just do a sequential forloop.
+ *
+ * \note The list must not be modified while looping, and links are handed out in small chunks,
+ * so this is only worth it when \a func does a fair amount of work per item.
+ */
+void BLI_task_parallel_listbase(
+        ListBase *listbase,
+        void *userdata,
+        TaskParallelListbaseFunc func,
+        const bool use_threading)
+{
+	TaskScheduler *task_scheduler;
+	TaskPool *task_pool;
+	ParallelListState state;
+	int i, num_threads;
+
+	if (BLI_listbase_is_empty(listbase)) {
+		return;
+	}
+
+	if (!use_threading) {
+		Link *link;
+
+		for (i = 0, link = listbase->first; link; i++, link = link->next) {
+			func(userdata, link, i);
+		}
+		return;
+	}
+
+	task_scheduler = BLI_task_scheduler_get();
+	task_pool = BLI_task_pool_create(task_scheduler, &state);
+	num_threads = BLI_task_scheduler_num_threads(task_scheduler);
+
+	state.userdata = userdata;
+	state.func = func;
+	state.index = 0;
+	state.link = listbase->first;
+	BLI_spin_init(&state.lock);
+
+	for (i = 0; i < num_threads; i++) {
+		BLI_task_pool_push(task_pool, parallel_listbase_func, NULL, false, TASK_PRIORITY_HIGH);
+	}
+
+	BLI_task_pool_work_and_wait(task_pool);
+	BLI_task_pool_free(task_pool);
+
+	BLI_spin_end(&state.lock);
+}
+
+#undef PARALLEL_LISTBASE_CHUNK_SIZE
+
+typedef struct ParallelMempoolState {
+	void *userdata;
+	TaskParallelMempoolFunc func;
+} ParallelMempoolState;
+
+static void parallel_mempool_func(
+        TaskPool * __restrict pool,
+        void *taskdata,
+        int UNUSED(threadid))
+{
+	ParallelMempoolState * __restrict state = BLI_task_pool_userdata(pool);
+	BLI_mempool_iter *iter = taskdata;
+	MempoolIterData *item;
+
+	while ((item = BLI_mempool_iterstep_threadsafe(iter)) != NULL) {
+		state->func(state->userdata, item);
+	}
+}
+
+/**
+ * This function allows to parallelize for loops over Mempool items, each task handles whole chunks of the pool.
+ *
+ * \param mempool The iterable BLI_mempool to loop over.
+ * \param userdata Common userdata passed to all instances of \a func.
+ * \param func Callback function.
+ * \param use_threading If \a true, actually split-execute loop in threads, else just do a sequential forloop.
+ *
+ * \note There is no static scheduling here, and the order of items is undefined.
+ */
+void BLI_task_parallel_mempool(
+        BLI_mempool *mempool,
+        void *userdata,
+        TaskParallelMempoolFunc func,
+        const bool use_threading)
+{
+	TaskScheduler *task_scheduler;
+	TaskPool *task_pool;
+	ParallelMempoolState state;
+	BLI_mempool_iter *iter_arr;
+	int i, num_threads;
+
+	if (BLI_mempool_count(mempool) == 0) {
+		return;
+	}
+
+	if (!use_threading) {
+		BLI_mempool_iter iter;
+		MempoolIterData *item;
+
+		BLI_mempool_iternew(mempool, &iter);
+		while ((item = BLI_mempool_iterstep(&iter)) != NULL) {
+			func(userdata, item);
+		}
+		return;
+	}
+
+	task_scheduler = BLI_task_scheduler_get();
+	task_pool = BLI_task_pool_create(task_scheduler, &state);
+	num_threads = BLI_task_scheduler_num_threads(task_scheduler);
+
+	state.userdata = userdata;
+	state.func = func;
+
+	iter_arr = BLI_mempool_iter_threadsafe_create(mempool, (size_t)num_threads);
+
+	for (i = 0; i < num_threads; i++) {
+		BLI_task_pool_push(task_pool, parallel_mempool_func, &iter_arr[i], false, TASK_PRIORITY_HIGH);
+	}
+
+	BLI_task_pool_work_and_wait(task_pool);
+	BLI_task_pool_free(task_pool);
+
+	BLI_mempool_iter_threadsafe_free(iter_arr);
+}
+
 #undef MALLOCA
 #undef MALLOCA_FREE
 
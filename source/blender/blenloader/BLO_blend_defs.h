@@ -77,4 +77,16 @@ enum {
 
 #define BLEN_THUMB_MEMSIZE_FILE(_x, _y) (sizeof(int) * (size_t)(2 + (_x) * (_y)))
 
+/**
+ * Compressed files are a series of independent gzip members, so they can be compressed and
+ * decompressed on multiple threads and are still read by any gzip reader.
+ *
+ * Every member holds up to #BLEN_GZIP_BLOCK_SIZE bytes of the file and has a header
+ * of #BLEN_GZIP_BLOCK_HEADER_SIZE bytes, with an extra field containing a single 'BL' subfield:
+ * the size of the whole member as 32 bit little endian integer.
+ */
+#define BLEN_GZIP_BLOCK_SIZE (1 << 20)
+#define BLEN_GZIP_BLOCK_HEADER_SIZE 20
+#define BLEN_GZIP_BLOCK_TRAILER_SIZE 8
+
 #endif  /* __BLO_BLEND_DEFS_H__ */
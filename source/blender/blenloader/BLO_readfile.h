@@ -75,7 +75,7 @@ BlendFileData *BLO_read_from_file(const char *filepath, struct ReportList *repor
 BlendFileData *BLO_read_from_memory(const void *mem, int memsize, struct ReportList *reports);
 BlendFileData *BLO_read_from_memfile(
         struct Main *oldmain, const char *filename, struct MemFile *memfile,
-        struct ReportList *reports);
+        struct MemFile *oldmain_memfile, struct ReportList *reports);
 
 void BLO_blendfiledata_free(BlendFileData *bfd);
 
@@ -33,25 +33,49 @@
  *  \ingroup blenloader
  */
 
-typedef struct {
+struct GHash;
+
+typedef struct MemFileChunk {
 	void *next, *prev;
 	
-	char *buf;
-	unsigned int ident, size;
+	/* reference counted, may be shared with chunks of other undo steps */
+	const char *buf;
+	unsigned int size;
+	/* hash of the contents of buf, see #memfile_chunk_add (zero for snapshots, see #memfile_chunk_add_unhashed) */
+	unsigned int hash;
+	/* the chunk uses the same buffer as a chunk of the reference memfile */
+	bool is_identical;
+	/* the chunk starts with the #BHead of a block that isn't DATA (an ID for instance),
+	 * all DATA blocks that follow it are in the chunks up to the next block start */
+	bool is_block_start;
 	
 } MemFileChunk;
 
 typedef struct MemFile {
 	ListBase chunks;
-	unsigned int size;
+	/* memory used by this undo step: its chunks and the buffers it doesn't share with previous steps */
+	size_t size;
 } MemFile;
 
+typedef struct MemFileWriteData {
+	MemFile *written_memfile;
+	MemFile *reference_memfile;
+	/* chunks of the reference memfile by contents (NULL when there is no reference) */
+	struct GHash *chunk_hash;
+	/* the next chunk is a block start, see #MemFileChunk.is_block_start */
+	bool next_is_block_start;
+} MemFileWriteData;
+
 /* actually only used writefile.c */
-extern void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsigned int size);
+extern void memfile_write_init(MemFileWriteData *mem_data, MemFile *written_memfile, MemFile *reference_memfile);
+extern void memfile_write_finalize(MemFileWriteData *mem_data);
+extern void memfile_chunk_add(MemFileWriteData *mem_data, const char *buf, unsigned int size);
+extern void memfile_chunk_add_unhashed(MemFile *memfile, const char *buf, unsigned int size);
 
 /* exports */
 extern void BLO_memfile_free(MemFile *memfile);
 extern void BLO_memfile_merge(MemFile *first, MemFile *second);
+extern bool BLO_memfile_chunk_equal(const MemFileChunk *chunk_a, const MemFileChunk *chunk_b);
 
 #endif
 
@@ -42,5 +42,14 @@ extern int BLO_write_file(struct Main *mainvar, const char *filepath, int write_
         struct ReportList *reports, const struct BlendThumbnail *thumb);
 extern int BLO_write_file_mem(struct Main *mainvar, struct MemFile *compare, struct MemFile *current, int write_flags);
 
+/* writing in two steps, so the slow part can run in a background thread */
+typedef struct BlendWriteSnapshot BlendWriteSnapshot;
+
+extern BlendWriteSnapshot *BLO_write_snapshot_create(
+        struct Main *mainvar, const char *filepath, int write_flags,
+        struct ReportList *reports, const struct BlendThumbnail *thumb);
+extern int BLO_write_snapshot_flush(BlendWriteSnapshot *snapshot, struct ReportList *reports, float *r_progress);
+extern void BLO_write_snapshot_free(BlendWriteSnapshot *snapshot);
+
 #endif
 
@@ -83,7 +83,7 @@ BlendHandle *BLO_blendhandle_from_file(const char *filepath, ReportList *reports
 {
 	BlendHandle *bh;
 
-	bh = (BlendHandle *)blo_openblenderfile(filepath, reports);
+	bh = (BlendHandle *)blo_openblenderlibrary(filepath, reports);
 
 	return bh;
 }
@@ -210,11 +210,11 @@ LinkNode *BLO_blendhandle_get_previews(BlendHandle *bh, int ofblocktype, int *to
 					if (prv) {
 						memcpy(new_prv, prv, sizeof(PreviewImage));
 						if (prv->rect[0] && prv->w[0] && prv->h[0]) {
-							unsigned int *rect = NULL;
+							const unsigned int *rect = NULL;
 							size_t len = new_prv->w[0] * new_prv->h[0] * sizeof(unsigned int);
 							new_prv->rect[0] = MEM_callocN(len, __func__);
 							bhead = blo_nextbhead(fd, bhead);
-							rect = (unsigned int *)(bhead + 1);
+							rect = (const unsigned int *)blo_bhead_data(fd, bhead);
 							BLI_assert(len == bhead->len);
 							memcpy(new_prv->rect[0], rect, len);
 						}
@@ -227,11 +227,11 @@ LinkNode *BLO_blendhandle_get_previews(BlendHandle *bh, int ofblocktype, int *to
 						}
 						
 						if (prv->rect[1] && prv->w[1] && prv->h[1]) {
-							unsigned int *rect = NULL;
+							const unsigned int *rect = NULL;
 							size_t len = new_prv->w[1] * new_prv->h[1] * sizeof(unsigned int);
 							new_prv->rect[1] = MEM_callocN(len, __func__);
 							bhead = blo_nextbhead(fd, bhead);
-							rect = (unsigned int *)(bhead + 1);
+							rect = (const unsigned int *)blo_bhead_data(fd, bhead);
 							BLI_assert(len == bhead->len);
 							memcpy(new_prv->rect[1], rect, len);
 						}
@@ -363,7 +363,13 @@ BlendFileData *BLO_read_from_memory(const void *mem, int memsize, ReportList *re
  * \param oldmain old main, from which we will keep libraries and other datablocks that should not have changed.
  * \param filename current file, only for retrieving library data.
  */
-BlendFileData *BLO_read_from_memfile(Main *oldmain, const char *filename, MemFile *memfile, ReportList *reports)
+/**
+ * \param oldmain_memfile: Optional, \a oldmain written with \a memfile as reference,
+ * the local ID's that didn't change are moved from \a oldmain to the new main instead of being read.
+ */
+BlendFileData *BLO_read_from_memfile(
+        Main *oldmain, const char *filename, MemFile *memfile, MemFile *oldmain_memfile,
+        ReportList *reports)
 {
 	BlendFileData *bfd = NULL;
 	FileData *fd;
@@ -381,6 +387,11 @@ BlendFileData *BLO_read_from_memfile(Main *oldmain, const char *filename, MemFil
 		blo_split_main(&old_mainlist, oldmain);
 		/* add the library pointers in oldmap lookup */
 		blo_add_library_pointer_map(&old_mainlist, fd);
+
+		/* makes lookup of the local ID's that can be kept */
+		if (oldmain_memfile) {
+			blo_make_undo_reuse_map(fd, oldmain, oldmain_memfile);
+		}
 		
 		/* makes lookup of existing images in old main */
 		blo_make_image_pointer_map(fd, oldmain);
@@ -394,6 +405,8 @@ BlendFileData *BLO_read_from_memfile(Main *oldmain, const char *filename, MemFil
 		/* removed packed data from this trick - it's internal data that needs saves */
 		
 		bfd = blo_read_file_internal(fd, filename);
+
+		blo_end_undo_reuse_map(fd);
 		
 		/* ensures relinked images are not freed */
 		blo_end_image_pointer_map(fd, oldmain);
@@ -45,6 +45,8 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h> // for read close
+#  include <sys/mman.h> // for mmap
+#  include <sys/stat.h> // for fstat
 #else
 #  include <io.h> // for open close read
 #  include "winsock2.h"
@@ -80,6 +82,7 @@
 #include "DNA_nla_types.h"
 #include "DNA_node_types.h"
 #include "DNA_object_fluidsim.h" // NT
+#include "DNA_object_force.h"
 #include "DNA_object_types.h"
 #include "DNA_packedFile_types.h"
 #include "DNA_particle_types.h"
@@ -104,14 +107,17 @@
 #include "MEM_guardedalloc.h"
 
 #include "BLI_endian_switch.h"
+#include "BLI_hash_md5.h"
 #include "BLI_blenlib.h"
 #include "BLI_math.h"
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 
 #include "BLT_translation.h"
 
 #include "BKE_action.h"
+#include "BKE_animsys.h"
 #include "BKE_armature.h"
 #include "BKE_brush.h"
 #include "BKE_cloth.h"
@@ -211,20 +217,106 @@
 /* use GHash for BHead name-based lookups (speeds up linking) */
 #define USE_GHASH_BHEAD
 
+/* read uncompressed files through a memory mapping,
+ * when the file has the same endianness and pointer size, block data is used in place
+ * instead of being copied into a separate allocation per block.
+ * Compressed files written in blocks (see #BLEN_GZIP_BLOCK_SIZE) are decompressed in parallel,
+ * a window of blocks at a time, see #GzipBlocksReader.
+ * Without it (Windows) compressed files are read with gzread in a single thread */
+#ifndef WIN32
+#  define USE_BHEAD_MMAP
+#endif
+
+/* when linking from a library, use an index of its blocks cached in the user's cache directory,
+ * so only the blocks of the linked ID's are read instead of all block headers of the file.
+ * Only used for files of which the blocks are used in place, see #USE_BHEAD_MMAP */
+#ifdef USE_BHEAD_MMAP
+#  define USE_BHEAD_INDEX
+#endif
+
+/* link the direct data of some ID types in parallel, after all blocks of the file are read.
+ * Each ID has its own map for the data blocks following it, only types whose direct linking
+ * doesn't touch anything outside the ID and the FileData are handled this way */
+#define USE_PARALLEL_DIRECT_LINK
+
 /***/
 
+#ifdef USE_BHEAD_INDEX
+
+#define BHEAD_INDEX_ID "BLENIDX"
+#define BHEAD_INDEX_VERSION 3
+#define BHEAD_INDEX_EXT ".idx"
+#define BHEAD_INDEX_DIR "blender/blend_index"
+
+/**
+ * Index of all blocks of a library file, stored in the user's cache directory, see #bhead_index_filepath.
+ * It has what linking needs to find blocks, so the mapped file is only read where the linked ID's are.
+ *
+ * The index file is the #BHeadIndexHeader, an entry per block and the names of the linkable ID's.
+ * The library file is identified by its size and time of modification (in nanoseconds),
+ * an index that doesn't match is written again. A file saved again with the same size and time
+ * would still match, so lookups of old addresses and names are checked against the file,
+ * see #bhead_index_maps_from_file.
+ */
+typedef struct BHeadIndexHeader {
+	char id[8];
+	int version;
+	int pointer_size;  /* also tells the endianness, it doesn't match when it's switched */
+	int64_t file_size;
+	int64_t file_mtime;
+	int file_mtime_nsec;
+	int blocks_len;
+	int names_len;
+	int dna_block;
+} BHeadIndexHeader;
+
+/* the block header is stored whole, so the headers don't have to be read from the file */
+typedef struct BHeadIndexEntry {
+	uint64_t offset;
+	uint64_t old;
+	int code;
+	int len;
+	int SDNAnr;
+	int nr;
+	int name_offset;  /* in the names, -1 for blocks of ID's that can't be linked and other blocks */
+	int pad;
+} BHeadIndexEntry;
+
+typedef struct BHeadIndex {
+	BHeadIndexHeader header;
+	BHeadIndexEntry *entries;  /* NULL when the index is written after reading the headers */
+	char *names;
+	char filepath[FILE_MAX];
+	/* old addresses and names are looked up in the block headers of the file, not in the index */
+	bool use_file;
+	/* headers made from an outdated index, kept until the file is closed since they can still be in use */
+	struct BHead *bheads_outdated;
+	const char **bheads_data_outdated;
+} BHeadIndex;
+
+#endif
+
 typedef struct OldNew {
 	void *old, *newp;
 	int nr;
 } OldNew;
 
+/* Lookups are not read-only: they move lasthit, increase the user count of entries and build
+ * the hash on demand, so a map must never be accessed from multiple threads at once
+ * (parallel reading gives each task its own data map). */
 typedef struct OldNewMap {
 	OldNew *entries;
 	int nentries, entriessize;
-	int sorted;
 	int lasthit;
+	/* open addressing hash of entry indices by old address (-1 for free slots),
+	 * only built for maps which are looked up out of order, see oldnewmap_lookup_entry */
+	int *map;
+	int map_exp;
 } OldNewMap;
 
+/* below this size a linear search is as fast as building the hash */
+#define OLDNEWMAP_HASH_MIN 32
+
 
 /* local prototypes */
 static void *read_struct(FileData *fd, BHead *bh, const char *blockname);
@@ -275,20 +367,44 @@ static OldNewMap *oldnewmap_new(void)
 	return onm;
 }
 
-static int verg_oldnewmap(const void *v1, const void *v2)
+/* fibonacci hashing, old addresses are aligned so the low bits are useless */
+BLI_INLINE unsigned int oldnewmap_hash(const void *addr, const int map_exp)
 {
-	const struct OldNew *x1=v1, *x2=v2;
-	
-	if (x1->old > x2->old) return 1;
-	else if (x1->old < x2->old) return -1;
-	return 0;
+	return (unsigned int)(((uint64_t)(uintptr_t)addr * 0x9E3779B97F4A7C15ull) >> (64 - map_exp));
 }
 
+/* adds entry \a index to the hash, replacing an older entry with the same address */
+static void oldnewmap_map_insert(OldNewMap *onm, int index)
+{
+	const void *addr = onm->entries[index].old;
+	const unsigned int mask = (1u << onm->map_exp) - 1;
+	unsigned int slot = oldnewmap_hash(addr, onm->map_exp);
+
+	while (onm->map[slot] != -1 && onm->entries[onm->map[slot]].old != addr) {
+		slot = (slot + 1) & mask;
+	}
+	onm->map[slot] = index;
+}
 
-static void oldnewmap_sort(FileData *fd) 
+/* (re)builds the hash, with at least twice as many slots as the entries array */
+static void oldnewmap_map_build(OldNewMap *onm)
 {
-	qsort(fd->libmap->entries, fd->libmap->nentries, sizeof(OldNew), verg_oldnewmap);
-	fd->libmap->sorted = 1;
+	int i;
+
+	onm->map_exp = 1;
+	while ((1 << onm->map_exp) < onm->entriessize * 2) {
+		onm->map_exp++;
+	}
+
+	if (onm->map) {
+		MEM_freeN(onm->map);
+	}
+	onm->map = MEM_mallocN(sizeof(*onm->map) << onm->map_exp, "OldNewMap.map");
+	memset(onm->map, 0xff, sizeof(*onm->map) << onm->map_exp);
+
+	for (i = 0; i < onm->nentries; i++) {
+		oldnewmap_map_insert(onm, i);
+	}
 }
 
 /* nr is zero for data, and ID code for libdata */
@@ -307,6 +423,15 @@ static void oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int n
 	entry->old = oldaddr;
 	entry->newp = newaddr;
 	entry->nr = nr;
+
+	if (onm->map) {
+		if ((1 << onm->map_exp) < onm->entriessize * 2) {
+			oldnewmap_map_build(onm);
+		}
+		else {
+			oldnewmap_map_insert(onm, onm->nentries - 1);
+		}
+	}
 }
 
 void blo_do_versions_oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int nr)
@@ -315,48 +440,31 @@ void blo_do_versions_oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newad
 }
 
 /**
- * Do a full search (no state).
- *
- * \param lasthit: Use as a reference position to avoid a full search
- * from either end of the array, giving more efficient lookups.
- *
- * \note This would seem an ideal case for hash or btree lookups.
- * However the data is written in-order, using the \a lasthit will normally avoid calling this function.
- * Creating a btree/hash structure adds overhead for the common-case to optimize the corner-case
- * (since most entries will never be retrieved).
- * So just keep full lookups as a fall-back.
+ * Full lookup, when the entry isn't the one after \a lasthit (the common case, since data is written in-order).
+ * Small maps are searched backwards, larger ones get a hash on the first lookup.
+ * With multiple entries for the same address the last one is returned.
  */
-static int oldnewmap_lookup_entry_full(const OldNewMap *onm, const void *addr, int lasthit)
+static int oldnewmap_lookup_entry(OldNewMap *onm, const void *addr)
 {
-	const int nentries = onm->nentries;
-	const OldNew *entries = onm->entries;
-	int i;
-
-	/* search relative to lasthit where possible */
-	if (lasthit >= 0 && lasthit < nentries) {
-
-		/* search forwards */
-		i = lasthit;
-		while (++i != nentries) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-
-		/* search backwards */
-		i = lasthit + 1;
+	if (onm->nentries < OLDNEWMAP_HASH_MIN) {
+		int i = onm->nentries;
 		while (i--) {
-			if (entries[i].old == addr) {
+			if (onm->entries[i].old == addr) {
 				return i;
 			}
 		}
 	}
 	else {
-		/* search backwards (full) */
-		i = nentries;
-		while (i--) {
-			if (entries[i].old == addr) {
-				return i;
+		unsigned int mask, slot;
+
+		if (onm->map == NULL) {
+			oldnewmap_map_build(onm);
+		}
+
+		mask = (1u << onm->map_exp) - 1;
+		for (slot = oldnewmap_hash(addr, onm->map_exp); onm->map[slot] != -1; slot = (slot + 1) & mask) {
+			if (onm->entries[onm->map[slot]].old == addr) {
+				return onm->map[slot];
 			}
 		}
 	}
@@ -380,7 +488,7 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr, bool increase_
 		}
 	}
 	
-	i = oldnewmap_lookup_entry_full(onm, addr, onm->lasthit);
+	i = oldnewmap_lookup_entry(onm, addr);
 	if (i != -1) {
 		OldNew *entry = &onm->entries[i];
 		BLI_assert(entry->old == addr);
@@ -396,35 +504,19 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr, bool increase_
 /* for libdata, nr has ID code, no increment */
 static void *oldnewmap_liblookup(OldNewMap *onm, void *addr, void *lib)
 {
+	int i;
+
 	if (addr == NULL) {
 		return NULL;
 	}
 
-	/* lasthit works fine for non-libdata, linking there is done in same sequence as writing */
-	if (onm->sorted) {
-		OldNew entry_s, *entry;
-
-		entry_s.old = addr;
-
-		entry = bsearch(&entry_s, onm->entries, onm->nentries, sizeof(OldNew), verg_oldnewmap);
-		if (entry) {
-			ID *id = entry->newp;
-
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
-		}
-	}
-	else {
-		/* note, this can be a bottle neck when loading some files */
-		const int i = oldnewmap_lookup_entry_full(onm, addr, -1);
-		if (i != -1) {
-			OldNew *entry = &onm->entries[i];
-			ID *id = entry->newp;
-			BLI_assert(entry->old == addr);
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
+	i = oldnewmap_lookup_entry(onm, addr);
+	if (i != -1) {
+		OldNew *entry = &onm->entries[i];
+		ID *id = entry->newp;
+		BLI_assert(entry->old == addr);
+		if (id && (!lib || id->lib)) {
+			return id;
 		}
 	}
 
@@ -448,10 +540,19 @@ static void oldnewmap_clear(OldNewMap *onm)
 {
 	onm->nentries = 0;
 	onm->lasthit = 0;
+
+	/* the data map is cleared for every ID, only few need a hash */
+	if (onm->map) {
+		MEM_freeN(onm->map);
+		onm->map = NULL;
+	}
 }
 
 static void oldnewmap_free(OldNewMap *onm) 
 {
+	if (onm->map) {
+		MEM_freeN(onm->map);
+	}
 	MEM_freeN(onm->entries);
 	MEM_freeN(onm);
 }
@@ -548,13 +649,35 @@ static void read_file_version(FileData *fd, Main *main)
 				main->minsubversionfile= fg->minsubversion;
 				MEM_freeN(fg);
 			}
-			else if (bhead->code == ENDB)
-				break;
+			/* written at the start of the file, no need to read all other block headers */
+			break;
 		}
+		else if (bhead->code == ENDB)
+			break;
 	}
 }
 
 #ifdef USE_GHASH_BHEAD
+#ifdef USE_BHEAD_INDEX
+static void read_file_bhead_idname_map_create_from_index(FileData *fd)
+{
+	const BHeadIndex *index = fd->bhead_index;
+	const BHeadIndexEntry *entry;
+	int i;
+
+	BLI_assert(fd->bhead_idname_hash == NULL);
+
+	fd->bhead_idname_hash = BLI_ghash_str_new_ex(__func__, (unsigned int)index->header.names_len / 16);
+
+	/* the names in the index are the same as in the file, the keys are not freed */
+	for (i = 0, entry = index->entries; i < index->header.blocks_len; i++, entry++) {
+		if (entry->name_offset != -1) {
+			BLI_ghash_insert(fd->bhead_idname_hash, index->names + entry->name_offset, &fd->mmap_bheads[i]);
+		}
+	}
+}
+#endif
+
 static void read_file_bhead_idname_map_create(FileData *fd)
 {
 	BHead *bhead;
@@ -564,6 +687,14 @@ static void read_file_bhead_idname_map_create(FileData *fd)
 	int code_prev = ENDB;
 	unsigned int reserve = 0;
 
+#ifdef USE_BHEAD_INDEX
+	if (fd->bhead_index && fd->bhead_index->entries && !fd->bhead_index->use_file) {
+		/* see #bhead_index_maps_from_file */
+		read_file_bhead_idname_map_create_from_index(fd);
+		return;
+	}
+#endif
+
 	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
 		if (code_prev != bhead->code) {
 			code_prev = bhead->code;
@@ -806,6 +937,12 @@ BHead *blo_firstbhead(FileData *fd)
 	BHeadN *new_bhead;
 	BHead *bhead = NULL;
 	
+#ifdef USE_BHEAD_MMAP
+	if (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) {
+		return fd->mmap_bheads_len ? &fd->mmap_bheads[0] : NULL;
+	}
+#endif
+
 	/* Rewind the file
 	 * Read in a new block if necessary
 	 */
@@ -821,10 +958,20 @@ BHead *blo_firstbhead(FileData *fd)
 	return(bhead);
 }
 
-BHead *blo_prevbhead(FileData *UNUSED(fd), BHead *thisblock)
+BHead *blo_prevbhead(FileData *fd, BHead *thisblock)
 {
-	BHeadN *bheadn = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
-	BHeadN *prev = bheadn->prev;
+	BHeadN *bheadn, *prev;
+
+#ifdef USE_BHEAD_MMAP
+	if (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) {
+		return (thisblock != &fd->mmap_bheads[0]) ? thisblock - 1 : NULL;
+	}
+#else
+	UNUSED_VARS(fd);
+#endif
+
+	bheadn = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
+	prev = bheadn->prev;
 	
 	return (prev) ? &prev->bhead : NULL;
 }
@@ -833,6 +980,15 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 {
 	BHeadN *new_bhead = NULL;
 	BHead *bhead = NULL;
+
+#ifdef USE_BHEAD_MMAP
+	if (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) {
+		if (thisblock && thisblock != &fd->mmap_bheads[fd->mmap_bheads_len - 1]) {
+			bhead = thisblock + 1;
+		}
+		return bhead;
+	}
+#endif
 	
 	if (thisblock) {
 		/* bhead is actually a sub part of BHeadN
@@ -855,10 +1011,27 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	return(bhead);
 }
 
+/**
+ * The data of a block, following its header in the file.
+ * With #FD_FLAGS_BHEAD_IN_PLACE the header is a copy and the data is only 4 byte aligned.
+ */
+const void *blo_bhead_data(const FileData *fd, const BHead *bhead)
+{
+#ifdef USE_BHEAD_MMAP
+	if (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) {
+		return fd->mmap_bheads_data[bhead - fd->mmap_bheads];
+	}
+#else
+	UNUSED_VARS(fd);
+#endif
+
+	return bhead + 1;
+}
+
 /* Warning! Caller's responsability to ensure given bhead **is** and ID one! */
 const char *bhead_id_name(const FileData *fd, const BHead *bhead)
 {
-	return (const char *)POINTER_OFFSET(bhead, sizeof(*bhead) + fd->id_name_offs);
+	return (const char *)POINTER_OFFSET(blo_bhead_data(fd, bhead), fd->id_name_offs);
 }
 
 static void decode_blender_header(FileData *fd)
@@ -905,16 +1078,25 @@ static void decode_blender_header(FileData *fd)
 
 static int read_file_dna(FileData *fd)
 {
-	BHead *bhead;
+	BHead *bhead = blo_firstbhead(fd);
+
+#ifdef USE_BHEAD_INDEX
+	if (fd->bhead_index && fd->bhead_index->entries) {
+		bhead = &fd->mmap_bheads[fd->bhead_index->header.dna_block];
+	}
+#endif
 	
-	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
+	for (; bhead; bhead = blo_nextbhead(fd, bhead)) {
 		if (bhead->code == DNA1) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
 			
-			fd->filesdna = DNA_sdna_from_data(&bhead[1], bhead->len, do_endian_swap);
+			fd->filesdna = DNA_sdna_from_data(blo_bhead_data(fd, bhead), bhead->len, do_endian_swap);
 			if (fd->filesdna) {
 				fd->compflags = DNA_struct_get_compareflags(fd->filesdna, fd->memsdna);
-				/* used to retrieve ID names from (bhead+1) */
+				if (fd->compflags) {
+					fd->reconstruct_info = DNA_reconstruct_info_create(fd->filesdna, fd->memsdna, fd->compflags);
+				}
+				/* used to retrieve ID names from the data of ID blocks */
 				fd->id_name_offs = DNA_elem_offset(fd->filesdna, "ID", "char", "name[]");
 			}
 			
@@ -935,7 +1117,8 @@ static int *read_file_thumbnail(FileData *fd)
 	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
 		if (bhead->code == TEST) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
-			int *data = (int *)(bhead + 1);
+			/* only switched in place when the block was read (copied), see #mmap_bheads_init */
+			int *data = (int *)blo_bhead_data(fd, bhead);
 
 			if (bhead->len < (2 * sizeof(int))) {
 				break;
@@ -1060,137 +1243,800 @@ static int fd_read_from_memfile(FileData *filedata, void *buffer, unsigned int s
 	return 0;
 }
 
-static FileData *filedata_new(void)
+#ifdef USE_BHEAD_MMAP
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
 {
-	FileData *fd = MEM_callocN(sizeof(FileData), "FileData");
-	
-	fd->filedes = -1;
-	fd->gzfiledes = NULL;
-	
-	/* XXX, this doesn't need to be done all the time,
-	 * but it keeps us re-entrant,  remove once we have
-	 * a lib that provides a nice lock. - zr
-	 */
-	fd->memsdna = DNA_sdna_from_data(DNAstr, DNAlen, false);
-	
-	fd->datamap = oldnewmap_new();
-	fd->globmap = oldnewmap_new();
-	fd->libmap = oldnewmap_new();
-	
-	return fd;
+	/* don't read more bytes then there are available in the mapping */
+	const size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+
+	memcpy(buffer, filedata->mmap_buffer + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+
+	return (int)readsize;
 }
 
-static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
+static unsigned int gzip_block_read_u32(const unsigned char *buf)
 {
-	decode_blender_header(fd);
-	
-	if (fd->flags & FD_FLAGS_FILE_OK) {
-		if (!read_file_dna(fd)) {
-			BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', incomplete", fd->relabase);
-			blo_freefiledata(fd);
-			fd = NULL;
-		}
-	}
-	else {
-		BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', not a blend file", fd->relabase);
-		blo_freefiledata(fd);
-		fd = NULL;
+	return (unsigned int)buf[0] | ((unsigned int)buf[1] << 8) | ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+typedef struct GzipBlock {
+	const unsigned char *in;
+	unsigned int in_len;
+	size_t out_ofs;  /* in the window */
+	unsigned int out_len;
+	bool ok;
+} GzipBlock;
+
+/**
+ * Reads a file written as gzip blocks. The blocks are decompressed in parallel, but only a window of
+ * them at a time (a few per thread), then they're read like a stream. So the memory used is the same
+ * as for reading with gzread: the blocks read from the file, plus the window and the mapped file.
+ */
+typedef struct GzipBlocksReader {
+	const unsigned char *map;
+	size_t map_size;
+	GzipBlock *blocks;
+	int blocks_len;
+	int blocks_next;  /* first block that isn't decompressed yet */
+	unsigned char *window;
+	int window_blocks;
+	size_t window_len, window_pos;
+} GzipBlocksReader;
+
+#define GZIP_BLOCKS_WINDOW_PER_THREAD 4
+
+static void gzip_blocks_decompress_task_cb(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	GzipBlocksReader *reader = userdata;
+	GzipBlock *block = &reader->blocks[reader->blocks_next + iter];
+	const unsigned char *trailer = block->in + block->in_len - BLEN_GZIP_BLOCK_TRAILER_SIZE;
+	unsigned char *out = reader->window + block->out_ofs;
+	z_stream strm = {NULL};
+
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+		return;
 	}
-	
-	return fd;
+	strm.next_in = (Bytef *)block->in + BLEN_GZIP_BLOCK_HEADER_SIZE;
+	strm.avail_in = block->in_len - BLEN_GZIP_BLOCK_HEADER_SIZE - BLEN_GZIP_BLOCK_TRAILER_SIZE;
+	strm.next_out = out;
+	strm.avail_out = block->out_len;
+
+	block->ok = (inflate(&strm, Z_FINISH) == Z_STREAM_END) &&
+	            (strm.total_out == block->out_len) &&
+	            (crc32(0L, out, block->out_len) == gzip_block_read_u32(trailer));
+
+	inflateEnd(&strm);
 }
 
-/* cannot be called with relative paths anymore! */
-/* on each new library added, it now checks for the current FileData and expands relativeness */
-FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
+/* decompresses the next blocks into the window, false when there are none or one is invalid */
+static bool gzip_blocks_window_fill(GzipBlocksReader *reader)
 {
-	gzFile gzfile;
-	errno = 0;
-	gzfile = BLI_gzopen(filepath, "rb");
-	
-	if (gzfile == (gzFile)Z_NULL) {
-		BKE_reportf(reports, RPT_WARNING, "Unable to open '%s': %s",
-		            filepath, errno ? strerror(errno) : TIP_("unknown error reading file"));
-		return NULL;
+	const int window_blocks = min_ii(reader->window_blocks, reader->blocks_len - reader->blocks_next);
+	size_t window_len = 0;
+	bool ok = true;
+	int i;
+
+	if (window_blocks == 0) {
+		return false;
 	}
-	else {
-		FileData *fd = filedata_new();
-		fd->gzfiledes = gzfile;
-		fd->read = fd_read_gzip_from_file;
-		
-		/* needed for library_append and read_libraries */
-		BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
-		
-		return blo_decode_and_check(fd, reports);
+
+	for (i = 0; i < window_blocks; i++) {
+		GzipBlock *block = &reader->blocks[reader->blocks_next + i];
+		block->out_ofs = window_len;
+		window_len += block->out_len;
+	}
+
+	BLI_task_parallel_range_ex(
+	        0, window_blocks, reader, NULL, 0, gzip_blocks_decompress_task_cb,
+	        window_blocks > 1, true);
+
+	for (i = 0; i < window_blocks; i++) {
+		ok &= reader->blocks[reader->blocks_next + i].ok;
 	}
+
+	reader->blocks_next += window_blocks;
+	reader->window_len = ok ? window_len : 0;
+	reader->window_pos = 0;
+
+	if (!ok) {
+		/* the rest of the file is not read, like a truncated file */
+		printf("%s: invalid gzip block\n", __func__);
+		reader->blocks_next = reader->blocks_len;
+	}
+
+	return ok;
 }
 
-/**
- * Same as blo_openblenderfile(), but does not reads DNA data, only header. Use it for light access
- * (e.g. thumbnail reading).
- */
-static FileData *blo_openblenderfile_minimal(const char *filepath)
+static int fd_read_gzip_blocks(FileData *filedata, void *buffer, unsigned int size)
 {
-	gzFile gzfile;
-	errno = 0;
-	gzfile = BLI_gzopen(filepath, "rb");
-
-	if (gzfile != (gzFile)Z_NULL) {
-		FileData *fd = filedata_new();
-		fd->gzfiledes = gzfile;
-		fd->read = fd_read_gzip_from_file;
+	GzipBlocksReader *reader = filedata->gzip_blocks;
+	char *out = buffer;
+	unsigned int readsize = 0;
 
-		decode_blender_header(fd);
+	while (readsize != size) {
+		size_t len;
 
-		if (fd->flags & FD_FLAGS_FILE_OK) {
-			return fd;
+		if (reader->window_pos == reader->window_len && !gzip_blocks_window_fill(reader)) {
+			break;
 		}
 
-		blo_freefiledata(fd);
+		len = MIN2((size_t)(size - readsize), reader->window_len - reader->window_pos);
+		memcpy(out + readsize, reader->window + reader->window_pos, len);
+		reader->window_pos += len;
+		readsize += (unsigned int)len;
 	}
 
-	return NULL;
+	return (int)readsize;
 }
 
-static int fd_read_gzip_from_memory(FileData *filedata, void *buffer, unsigned int size)
+static void gzip_blocks_reader_free(GzipBlocksReader *reader)
 {
-	int err;
+	munmap((void *)reader->map, reader->map_size);
+	MEM_SAFE_FREE(reader->blocks);
+	MEM_SAFE_FREE(reader->window);
+	MEM_freeN(reader);
+}
 
-	filedata->strm.next_out = (Bytef *) buffer;
-	filedata->strm.avail_out = size;
+/**
+ * Reader of the mapped file \a map when it's written as gzip blocks, see #BLEN_GZIP_BLOCK_SIZE.
+ * Returns NULL for other gzip files, invalid members and when there is not enough memory,
+ * these are read with zlib as a stream, which reports problems of the file as usual.
+ * The reader owns the mapping otherwise.
+ */
+static GzipBlocksReader *gzip_blocks_reader_new(const unsigned char *map, const size_t size)
+{
+	const unsigned char header[BLEN_GZIP_BLOCK_HEADER_SIZE - 4] = {
+	    0x1f, 0x8b, Z_DEFLATED, 0x04, 0, 0, 0, 0, 0, 0, 8, 0, 'B', 'L', 4, 0};
+	GzipBlocksReader *reader;
+	GzipBlock *blocks = NULL;
+	int blocks_len = 0, blocks_alloc = 0;
+	size_t ofs = 0;
+	bool ok = true;
+
+	/* index of the blocks, the size of each one is in its header */
+	while (ofs != size) {
+		const unsigned char *member = map + ofs;
+		unsigned int member_len, out_len;
+
+		/* modification time, flags and OS are not checked */
+		if ((size - ofs < BLEN_GZIP_BLOCK_HEADER_SIZE + BLEN_GZIP_BLOCK_TRAILER_SIZE) ||
+		    memcmp(member, header, 4) != 0 ||
+		    memcmp(member + 10, header + 10, sizeof(header) - 10) != 0)
+		{
+			ok = false;
+			break;
+		}
 
-	// Inflate another chunk.
-	err = inflate (&filedata->strm, Z_SYNC_FLUSH);
+		member_len = gzip_block_read_u32(member + sizeof(header));
+		if ((member_len < BLEN_GZIP_BLOCK_HEADER_SIZE + BLEN_GZIP_BLOCK_TRAILER_SIZE) || (member_len > size - ofs)) {
+			ok = false;
+			break;
+		}
 
-	if (err == Z_STREAM_END) {
-		return 0;
+		/* the size in the trailer can't be trusted, blocks are never written larger */
+		out_len = gzip_block_read_u32(member + member_len - 4);
+		if (out_len > BLEN_GZIP_BLOCK_SIZE) {
+			ok = false;
+			break;
+		}
+
+		if (blocks_len == blocks_alloc) {
+			blocks_alloc = blocks_alloc ? blocks_alloc * 2 : 64;
+			blocks = MEM_reallocN_id(blocks, sizeof(*blocks) * (size_t)blocks_alloc, __func__);
+		}
+
+		blocks[blocks_len].in = member;
+		blocks[blocks_len].in_len = member_len;
+		blocks[blocks_len].out_ofs = 0;
+		blocks[blocks_len].out_len = out_len;
+		blocks[blocks_len].ok = false;
+		blocks_len++;
+
+		ofs += member_len;
 	}
-	else if (err != Z_OK) {
-		printf("fd_read_gzip_from_memory: zlib error\n");
-		return 0;
+
+	if (!ok || blocks_len == 0) {
+		MEM_SAFE_FREE(blocks);
+		return NULL;
 	}
 
-	filedata->seek += size;
+	reader = MEM_callocN(sizeof(*reader), __func__);
+	reader->map = map;
+	reader->map_size = size;
+	reader->blocks = blocks;
+	reader->blocks_len = blocks_len;
+	reader->window_blocks = min_ii(blocks_len, BLI_system_thread_count() * GZIP_BLOCKS_WINDOW_PER_THREAD);
+	reader->window = MEM_mallocN((size_t)reader->window_blocks * BLEN_GZIP_BLOCK_SIZE, __func__);
+	if (reader->window == NULL) {
+		MEM_freeN(blocks);
+		MEM_freeN(reader);
+		return NULL;
+	}
 
-	return (size);
+	return reader;
 }
 
-static int fd_read_gzip_from_memory_init(FileData *fd)
+/**
+ * Collects the headers of all blocks of a mapped file, so their data can be used in place
+ * (see #FD_FLAGS_BHEAD_IN_PLACE). Only done when no conversion of the headers and data is needed.
+ * All headers are validated here, on any problem the blocks are read (copied) as usual.
+ *
+ * Blocks are only written 4 byte aligned while headers contain a pointer ('old'),
+ * so the headers are copied into an array, the data is used where it is in the file.
+ */
+static void mmap_bheads_init(FileData *fd)
 {
+	BHead *bheads;
+	const char **bheads_data;
+	int bheads_len = 0, bheads_alloc = 1024;
+	size_t ofs = fd->mmap_seek;
 
-	fd->strm.next_in = (Bytef *) fd->buffer;
-	fd->strm.avail_in = fd->buffersize;
-	fd->strm.total_out = 0;
-	fd->strm.zalloc = Z_NULL;
-	fd->strm.zfree = Z_NULL;
-	
-	if (inflateInit2(&fd->strm, (16+MAX_WBITS)) != Z_OK)
-		return 0;
+	if (fd->flags & (FD_FLAGS_SWITCH_ENDIAN | FD_FLAGS_POINTSIZE_DIFFERS)) {
+		return;
+	}
 
-	fd->read = fd_read_gzip_from_memory;
-	
-	return 1;
-}
+	bheads = MEM_mallocN(sizeof(*bheads) * (size_t)bheads_alloc, __func__);
+	bheads_data = MEM_mallocN(sizeof(*bheads_data) * (size_t)bheads_alloc, __func__);
+
+	while (ofs != fd->mmap_size) {
+		BHead *bhead;
+
+		if ((fd->mmap_size - ofs < sizeof(BHead)) || (ofs & 3)) {
+			break;
+		}
+
+		if (bheads_len == bheads_alloc) {
+			bheads_alloc *= 2;
+			bheads = MEM_reallocN(bheads, sizeof(*bheads) * (size_t)bheads_alloc);
+			bheads_data = MEM_reallocN(bheads_data, sizeof(*bheads_data) * (size_t)bheads_alloc);
+		}
+
+		bhead = &bheads[bheads_len];
+		memcpy(bhead, fd->mmap_buffer + ofs, sizeof(BHead));
+		if ((bhead->len < 0) || ((size_t)bhead->len > fd->mmap_size - ofs - sizeof(BHead))) {
+			break;
+		}
+		bheads_data[bheads_len++] = fd->mmap_buffer + ofs + sizeof(BHead);
+
+		if (bhead->code == ENDB) {
+			fd->mmap_bheads = bheads;
+			fd->mmap_bheads_data = bheads_data;
+			fd->mmap_bheads_len = bheads_len;
+			fd->flags |= FD_FLAGS_BHEAD_IN_PLACE;
+			return;
+		}
+		ofs += sizeof(BHead) + (size_t)bhead->len;
+	}
+
+	/* truncated or invalid file, read it block by block to get the usual errors */
+	MEM_freeN(bheads);
+	MEM_freeN(bheads_data);
+}
+#endif
+
+#ifdef USE_BHEAD_INDEX
+static void bhead_index_free(BHeadIndex *index)
+{
+	MEM_SAFE_FREE(index->entries);
+	MEM_SAFE_FREE(index->names);
+	MEM_SAFE_FREE(index->bheads_outdated);
+	MEM_SAFE_FREE(index->bheads_data_outdated);
+	MEM_freeN(index);
+}
+
+static bool bhead_index_header_check(const BHeadIndexHeader *header, const BHeadIndexHeader *header_file)
+{
+	return (STREQLEN(header_file->id, header->id, sizeof(header->id)) &&
+	        (header_file->version == header->version) &&
+	        (header_file->pointer_size == header->pointer_size) &&
+	        (header_file->file_size == header->file_size) &&
+	        (header_file->file_mtime == header->file_mtime) &&
+	        (header_file->file_mtime_nsec == header->file_mtime_nsec) &&
+	        (header_file->blocks_len > 0) &&
+	        (header_file->names_len >= 0) &&
+	        (header_file->dna_block >= 0) && (header_file->dna_block < header_file->blocks_len));
+}
+
+/**
+ * '$XDG_CACHE_HOME/blender/blend_index' or '$HOME/.cache/blender/blend_index', the index file is named
+ * after the hash of the library path. Libraries are also opened to list their ID's when browsing
+ * and for thumbnails, the index mustn't be written next to them (into asset or shared folders).
+ */
+static bool bhead_index_filepath(const char *filepath, char r_filepath[FILE_MAX])
+{
+	const char *home_cache = getenv("XDG_CACHE_HOME");
+	const char *home = home_cache ? home_cache : getenv("HOME");
+	char digest[16], hexdigest[33];
+
+	if (home == NULL || home[0] == '\0') {
+		return false;
+	}
+
+	BLI_hash_md5_buffer(filepath, strlen(filepath), digest);
+	BLI_hash_md5_to_hexdigest(digest, hexdigest);
+
+	BLI_snprintf(r_filepath, FILE_MAX, "%s%s/" BHEAD_INDEX_DIR "/%s" BHEAD_INDEX_EXT,
+	             home, home_cache ? "" : "/.cache", hexdigest);
+	return true;
+}
+
+/**
+ * Index of the library \a filepath, read from its index file when it's there and up to date.
+ * Otherwise the blocks are not set, the index is written by #bhead_index_create after reading the headers.
+ * NULL when there is no cache directory.
+ */
+static BHeadIndex *bhead_index_read(const char *filepath, const struct stat *st)
+{
+	BHeadIndex *index;
+	BHeadIndexHeader header_file;
+	char index_filepath[FILE_MAX];
+	FILE *file;
+
+	if (!bhead_index_filepath(filepath, index_filepath)) {
+		return NULL;
+	}
+
+	index = MEM_callocN(sizeof(BHeadIndex), __func__);
+	BLI_strncpy(index->filepath, index_filepath, sizeof(index->filepath));
+
+	BLI_strncpy(index->header.id, BHEAD_INDEX_ID, sizeof(index->header.id));
+	index->header.version = BHEAD_INDEX_VERSION;
+	index->header.pointer_size = (int)sizeof(void *);
+	index->header.file_size = (int64_t)st->st_size;
+	index->header.file_mtime = (int64_t)st->st_mtime;
+#ifdef __APPLE__
+	index->header.file_mtime_nsec = (int)st->st_mtimespec.tv_nsec;
+#else
+	index->header.file_mtime_nsec = (int)st->st_mtim.tv_nsec;
+#endif
+
+	file = BLI_fopen(index->filepath, "rb");
+	if (file == NULL) {
+		return index;
+	}
+
+	if ((fread(&header_file, sizeof(header_file), 1, file) == 1) &&
+	    bhead_index_header_check(&index->header, &header_file))
+	{
+		const size_t entries_size = sizeof(*index->entries) * (size_t)header_file.blocks_len;
+		const size_t names_size = (size_t)header_file.names_len;
+
+		index->entries = MEM_mallocN(entries_size, __func__);
+		index->names = MEM_mallocN(names_size + 1, __func__);
+		index->names[names_size] = '\0';
+
+		if ((fread(index->entries, entries_size, 1, file) == 1) &&
+		    (names_size == 0 || fread(index->names, names_size, 1, file) == 1))
+		{
+			index->header = header_file;
+		}
+		else {
+			MEM_SAFE_FREE(index->entries);
+			MEM_SAFE_FREE(index->names);
+		}
+	}
+
+	fclose(file);
+
+	return index;
+}
+
+/**
+ * Uses the blocks of the index for the mapped file, without reading their headers.
+ * Returns false when the index doesn't fit the file, it's written again then.
+ */
+static bool bhead_index_bheads_init(FileData *fd)
+{
+	BHeadIndex *index = fd->bhead_index;
+	const BHeadIndexEntry *entry;
+	BHead bhead_dna, bhead_end;
+	uint64_t offset_next = 0;
+	int i;
+
+	if (index->entries == NULL || (fd->flags & (FD_FLAGS_SWITCH_ENDIAN | FD_FLAGS_POINTSIZE_DIFFERS))) {
+		return false;
+	}
+
+	/* only checking the index itself here, the headers of the file are read when they are used */
+	for (i = 0, entry = index->entries; i < index->header.blocks_len; i++, entry++) {
+		if ((entry->offset < (uint64_t)fd->mmap_seek) || (entry->offset & 3) ||
+		    (entry->offset < offset_next) || (entry->len < 0) ||
+		    (entry->offset + sizeof(BHead) + (uint64_t)entry->len > (uint64_t)fd->mmap_size) ||
+		    (entry->name_offset < -1) || (entry->name_offset >= index->header.names_len))
+		{
+			break;
+		}
+		offset_next = entry->offset + sizeof(BHead) + (uint64_t)entry->len;
+	}
+
+	if (i == index->header.blocks_len) {
+		memcpy(&bhead_dna, fd->mmap_buffer + index->entries[index->header.dna_block].offset, sizeof(BHead));
+		memcpy(&bhead_end, fd->mmap_buffer + index->entries[index->header.blocks_len - 1].offset, sizeof(BHead));
+
+		/* the file was not saved again since the index was written (with the same size and time) */
+		if ((bhead_dna.code == DNA1) && (bhead_dna.len == index->entries[index->header.dna_block].len) &&
+		    (bhead_end.code == ENDB))
+		{
+			fd->mmap_bheads = MEM_mallocN(sizeof(*fd->mmap_bheads) * (size_t)index->header.blocks_len, __func__);
+			fd->mmap_bheads_data = MEM_mallocN(
+			        sizeof(*fd->mmap_bheads_data) * (size_t)index->header.blocks_len, __func__);
+			fd->mmap_bheads_len = index->header.blocks_len;
+			for (i = 0, entry = index->entries; i < index->header.blocks_len; i++, entry++) {
+				BHead *bhead = &fd->mmap_bheads[i];
+
+				bhead->code = entry->code;
+				bhead->len = entry->len;
+				bhead->old = (void *)(uintptr_t)entry->old;
+				bhead->SDNAnr = entry->SDNAnr;
+				bhead->nr = entry->nr;
+				fd->mmap_bheads_data[i] = fd->mmap_buffer + entry->offset + sizeof(BHead);
+			}
+			fd->flags |= FD_FLAGS_BHEAD_IN_PLACE;
+
+			return true;
+		}
+	}
+
+	MEM_SAFE_FREE(index->entries);
+	MEM_SAFE_FREE(index->names);
+
+	return false;
+}
+
+static bool bhead_index_write(const BHeadIndex *index)
+{
+	char dirpath[FILE_MAX], filepath_tmp[FILE_MAX];
+	FILE *file;
+	bool ok;
+
+	BLI_split_dir_part(index->filepath, dirpath, sizeof(dirpath));
+	if (!BLI_dir_create_recursive(dirpath)) {
+		return false;
+	}
+
+	/* written to a temporary file first, other processes may read the index meanwhile */
+	BLI_snprintf(filepath_tmp, sizeof(filepath_tmp), "%s@", index->filepath);
+
+	file = BLI_fopen(filepath_tmp, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	ok = ((fwrite(&index->header, sizeof(index->header), 1, file) == 1) &&
+	      (fwrite(index->entries, sizeof(*index->entries) * (size_t)index->header.blocks_len, 1, file) == 1) &&
+	      (index->header.names_len == 0 || fwrite(index->names, (size_t)index->header.names_len, 1, file) == 1));
+
+	if (fclose(file) != 0) {
+		ok = false;
+	}
+
+	if (!ok || BLI_rename(filepath_tmp, index->filepath) != 0) {
+		BLI_delete(filepath_tmp, false, false);
+		return false;
+	}
+
+	return true;
+}
+
+/* Creates the index from the block headers of the file, and writes it for the next time the library is used. */
+static void bhead_index_create(FileData *fd)
+{
+	BHeadIndex *index = fd->bhead_index;
+	BHeadIndexEntry *entry;
+	int names_len = 0, i;
+
+	if (!(fd->flags & FD_FLAGS_BHEAD_IN_PLACE)) {
+		bhead_index_free(index);
+		fd->bhead_index = NULL;
+		return;
+	}
+
+	for (i = 0; i < fd->mmap_bheads_len; i++) {
+		const int code = fd->mmap_bheads[i].code;
+
+		if (BKE_idcode_is_valid(code) && BKE_idcode_is_linkable(code)) {
+			names_len += MAX_ID_NAME;
+		}
+	}
+
+	index->header.blocks_len = fd->mmap_bheads_len;
+	index->header.dna_block = -1;
+	index->entries = MEM_mallocN(sizeof(*index->entries) * (size_t)fd->mmap_bheads_len, __func__);
+	index->names = MEM_mallocN((size_t)names_len + 1, __func__);
+	names_len = 0;
+
+	for (i = 0, entry = index->entries; i < fd->mmap_bheads_len; i++, entry++) {
+		const BHead *bhead = &fd->mmap_bheads[i];
+
+		entry->offset = (uint64_t)(fd->mmap_bheads_data[i] - sizeof(BHead) - fd->mmap_buffer);
+		entry->old = (uint64_t)(uintptr_t)bhead->old;
+		entry->code = bhead->code;
+		entry->len = bhead->len;
+		entry->SDNAnr = bhead->SDNAnr;
+		entry->nr = bhead->nr;
+		entry->name_offset = -1;
+		entry->pad = 0;
+
+		if (BKE_idcode_is_valid(bhead->code) && BKE_idcode_is_linkable(bhead->code)) {
+			entry->name_offset = names_len;
+			names_len += (int)BLI_strncpy_rlen(index->names + names_len, bhead_id_name(fd, bhead), MAX_ID_NAME) + 1;
+		}
+		else if (bhead->code == DNA1) {
+			index->header.dna_block = i;
+		}
+	}
+
+	index->header.names_len = names_len;
+	index->names[names_len] = '\0';
+
+	if (index->header.dna_block != -1 && fd->mmap_bheads[fd->mmap_bheads_len - 1].code == ENDB) {
+		bhead_index_write(index);
+	}
+}
+#endif
+
+static FileData *filedata_new(void)
+{
+	FileData *fd = MEM_callocN(sizeof(FileData), "FileData");
+	
+	fd->filedes = -1;
+	fd->gzfiledes = NULL;
+	
+	/* XXX, this doesn't need to be done all the time,
+	 * but it keeps us re-entrant,  remove once we have
+	 * a lib that provides a nice lock. - zr
+	 */
+	fd->memsdna = DNA_sdna_from_data(DNAstr, DNAlen, false);
+	
+	fd->datamap = oldnewmap_new();
+	fd->globmap = oldnewmap_new();
+	fd->libmap = oldnewmap_new();
+	
+	return fd;
+}
+
+static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
+{
+	decode_blender_header(fd);
+	
+	if (fd->flags & FD_FLAGS_FILE_OK) {
+#ifdef USE_BHEAD_MMAP
+		if (fd->mmap_buffer) {
+#ifdef USE_BHEAD_INDEX
+			if (!(fd->bhead_index && bhead_index_bheads_init(fd)))
+#endif
+			{
+				mmap_bheads_init(fd);
+			}
+		}
+#endif
+
+		if (!read_file_dna(fd)) {
+			BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', incomplete", fd->relabase);
+			blo_freefiledata(fd);
+			fd = NULL;
+		}
+#ifdef USE_BHEAD_INDEX
+		else if (fd->bhead_index && fd->bhead_index->entries == NULL) {
+			bhead_index_create(fd);
+		}
+#endif
+	}
+	else {
+		BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', not a blend file", fd->relabase);
+		blo_freefiledata(fd);
+		fd = NULL;
+	}
+	
+	return fd;
+}
+
+#ifdef USE_BHEAD_MMAP
+/**
+ * Maps an uncompressed file into memory, or maps a file written as gzip blocks to decompress it
+ * in parallel while it's read (see #GzipBlocksReader).
+ * Returns NULL for other compressed files or when mapping fails (the file is read with zlib then).
+ *
+ * \note When another process truncates the file while it's mapped,
+ * reading past its new end raises SIGBUS.
+ *
+ * \param use_index: Use the index of the blocks of an uncompressed file, see #USE_BHEAD_INDEX.
+ */
+static FileData *blo_openblenderfile_mmap(const char *filepath, const bool use_index)
+{
+	FileData *fd;
+	struct stat st;
+	size_t size;
+	void *map;
+	int file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+
+	if (file == -1) {
+		return NULL;
+	}
+
+	if (fstat(file, &st) != 0 || st.st_size < SIZEOFBLENDERHEADER || (uint64_t)st.st_size > SIZE_MAX) {
+		close(file);
+		return NULL;
+	}
+	size = (size_t)st.st_size;
+
+	/* private and writable: the few places changing block headers get their own copy of the page */
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* test if gzip */
+	if (((const unsigned char *)map)[0] == 0x1f && ((const unsigned char *)map)[1] == 0x8b) {
+		GzipBlocksReader *reader;
+
+		posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+		reader = gzip_blocks_reader_new(map, size);
+
+		if (reader == NULL) {
+			munmap(map, size);
+			return NULL;
+		}
+
+		fd = filedata_new();
+		fd->gzip_blocks = reader;
+		fd->read = fd_read_gzip_blocks;
+
+		return fd;
+	}
+
+	fd = filedata_new();
+	fd->mmap_buffer = map;
+	fd->mmap_size = size;
+	fd->read = fd_read_from_mmap;
+
+#ifdef USE_BHEAD_INDEX
+	if (use_index) {
+		fd->bhead_index = bhead_index_read(filepath, &st);
+	}
+
+	/* with an index only some blocks are read */
+	posix_madvise(map, size, (fd->bhead_index && fd->bhead_index->entries) ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+#else
+	UNUSED_VARS(use_index);
+	posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	return fd;
+}
+#endif
+
+/* cannot be called with relative paths anymore! */
+/* on each new library added, it now checks for the current FileData and expands relativeness */
+static FileData *blo_openblenderfile_ex(const char *filepath, const bool use_index, ReportList *reports)
+{
+	gzFile gzfile;
+
+#ifdef USE_BHEAD_MMAP
+	{
+		FileData *fd = blo_openblenderfile_mmap(filepath, use_index);
+		if (fd) {
+			/* needed for library_append and read_libraries */
+			BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+
+			return blo_decode_and_check(fd, reports);
+		}
+	}
+#endif
+
+	errno = 0;
+	gzfile = BLI_gzopen(filepath, "rb");
+	
+	if (gzfile == (gzFile)Z_NULL) {
+		BKE_reportf(reports, RPT_WARNING, "Unable to open '%s': %s",
+		            filepath, errno ? strerror(errno) : TIP_("unknown error reading file"));
+		return NULL;
+	}
+	else {
+		FileData *fd = filedata_new();
+		fd->gzfiledes = gzfile;
+		fd->read = fd_read_gzip_from_file;
+		
+		/* needed for library_append and read_libraries */
+		BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+		
+		return blo_decode_and_check(fd, reports);
+	}
+}
+
+FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
+{
+	return blo_openblenderfile_ex(filepath, false, reports);
+}
+
+/**
+ * Same as blo_openblenderfile(), for files only some ID's are read from (linking from libraries),
+ * the blocks are found through their index, which is created when it isn't there.
+ */
+FileData *blo_openblenderlibrary(const char *filepath, ReportList *reports)
+{
+	return blo_openblenderfile_ex(filepath, true, reports);
+}
+
+/**
+ * Same as blo_openblenderfile(), but does not reads DNA data, only header. Use it for light access
+ * (e.g. thumbnail reading).
+ */
+static FileData *blo_openblenderfile_minimal(const char *filepath)
+{
+	gzFile gzfile;
+	errno = 0;
+	gzfile = BLI_gzopen(filepath, "rb");
+
+	if (gzfile != (gzFile)Z_NULL) {
+		FileData *fd = filedata_new();
+		fd->gzfiledes = gzfile;
+		fd->read = fd_read_gzip_from_file;
+
+		decode_blender_header(fd);
+
+		if (fd->flags & FD_FLAGS_FILE_OK) {
+			return fd;
+		}
+
+		blo_freefiledata(fd);
+	}
+
+	return NULL;
+}
+
+static int fd_read_gzip_from_memory(FileData *filedata, void *buffer, unsigned int size)
+{
+	int err;
+
+	filedata->strm.next_out = (Bytef *) buffer;
+	filedata->strm.avail_out = size;
+
+	// Inflate another chunk.
+	err = inflate (&filedata->strm, Z_SYNC_FLUSH);
+
+	/* compressed files consist of multiple gzip members, see BLEN_GZIP_BLOCK_SIZE */
+	while (err == Z_STREAM_END && filedata->strm.avail_out != 0 && filedata->strm.avail_in != 0) {
+		err = inflateReset(&filedata->strm);
+		if (err == Z_OK) {
+			err = inflate(&filedata->strm, Z_SYNC_FLUSH);
+		}
+	}
+
+	if (err == Z_STREAM_END) {
+		if (filedata->strm.avail_out != 0) {
+			return 0;
+		}
+	}
+	else if (err != Z_OK) {
+		printf("fd_read_gzip_from_memory: zlib error\n");
+		return 0;
+	}
+
+	filedata->seek += size;
+
+	return (size);
+}
+
+static int fd_read_gzip_from_memory_init(FileData *fd)
+{
+
+	fd->strm.next_in = (Bytef *) fd->buffer;
+	fd->strm.avail_in = fd->buffersize;
+	fd->strm.total_out = 0;
+	fd->strm.zalloc = Z_NULL;
+	fd->strm.zfree = Z_NULL;
+	
+	if (inflateInit2(&fd->strm, (16+MAX_WBITS)) != Z_OK)
+		return 0;
+
+	fd->read = fd_read_gzip_from_memory;
+	
+	return 1;
+}
 
 FileData *blo_openblendermemory(const void *mem, int memsize, ReportList *reports)
 {
@@ -1260,6 +2106,24 @@ void blo_freefiledata(FileData *fd)
 			MEM_freeN((void *)fd->buffer);
 			fd->buffer = NULL;
 		}
+
+#ifdef USE_BHEAD_MMAP
+		if (fd->mmap_buffer) {
+			munmap((void *)fd->mmap_buffer, fd->mmap_size);
+		}
+		if (fd->gzip_blocks) {
+			gzip_blocks_reader_free(fd->gzip_blocks);
+		}
+		if (fd->mmap_bheads) {
+			MEM_freeN(fd->mmap_bheads);
+			MEM_freeN((void *)fd->mmap_bheads_data);
+		}
+#endif
+#ifdef USE_BHEAD_INDEX
+		if (fd->bhead_index) {
+			bhead_index_free(fd->bhead_index);
+		}
+#endif
 		
 		// Free all BHeadN data blocks
 		BLI_freelistN(&fd->listbase);
@@ -1270,6 +2134,8 @@ void blo_freefiledata(FileData *fd)
 			DNA_sdna_free(fd->filesdna);
 		if (fd->compflags)
 			MEM_freeN(fd->compflags);
+		if (fd->reconstruct_info)
+			DNA_reconstruct_info_free(fd->reconstruct_info);
 		
 		if (fd->datamap)
 			oldnewmap_free(fd->datamap);
@@ -1721,101 +2587,454 @@ void blo_end_sound_pointer_map(FileData *fd, Main *oldmain)
 	}
 }
 
-/* XXX disabled this feature - packed files also belong in temp saves and quit.blend, to make restore work */
+/* XXX disabled this feature - packed files also belong in temp saves and quit.blend, to make restore work */
+
+static void insert_packedmap(FileData *fd, PackedFile *pf)
+{
+	oldnewmap_insert(fd->packedmap, pf, pf, 0);
+	oldnewmap_insert(fd->packedmap, pf->data, pf->data, 0);
+}
+
+void blo_make_packed_pointer_map(FileData *fd, Main *oldmain)
+{
+	Image *ima;
+	VFont *vfont;
+	bSound *sound;
+	Library *lib;
+	
+	fd->packedmap = oldnewmap_new();
+	
+	for (ima = oldmain->image.first; ima; ima = ima->id.next) {
+		ImagePackedFile *imapf;
+
+		if (ima->packedfile)
+			insert_packedmap(fd, ima->packedfile);
+
+		for (imapf = ima->packedfiles.first; imapf; imapf = imapf->next)
+			if (imapf->packedfile)
+				insert_packedmap(fd, imapf->packedfile);
+	}
+			
+	for (vfont = oldmain->vfont.first; vfont; vfont = vfont->id.next)
+		if (vfont->packedfile)
+			insert_packedmap(fd, vfont->packedfile);
+	
+	for (sound = oldmain->sound.first; sound; sound = sound->id.next)
+		if (sound->packedfile)
+			insert_packedmap(fd, sound->packedfile);
+	
+	for (lib = oldmain->library.first; lib; lib = lib->id.next)
+		if (lib->packedfile)
+			insert_packedmap(fd, lib->packedfile);
+
+}
+
+/* set old main packed data to zero if it has been restored */
+/* this works because freeing old main only happens after this call */
+void blo_end_packed_pointer_map(FileData *fd, Main *oldmain)
+{
+	Image *ima;
+	VFont *vfont;
+	bSound *sound;
+	Library *lib;
+	OldNew *entry = fd->packedmap->entries;
+	int i;
+	
+	/* used entries were restored, so we put them to zero */
+	for (i=0; i < fd->packedmap->nentries; i++, entry++) {
+		if (entry->nr > 0)
+			entry->newp = NULL;
+	}
+	
+	for (ima = oldmain->image.first; ima; ima = ima->id.next) {
+		ImagePackedFile *imapf;
+
+		ima->packedfile = newpackedadr(fd, ima->packedfile);
+
+		for (imapf = ima->packedfiles.first; imapf; imapf = imapf->next)
+			imapf->packedfile = newpackedadr(fd, imapf->packedfile);
+	}
+	
+	for (vfont = oldmain->vfont.first; vfont; vfont = vfont->id.next)
+		vfont->packedfile = newpackedadr(fd, vfont->packedfile);
+
+	for (sound = oldmain->sound.first; sound; sound = sound->id.next)
+		sound->packedfile = newpackedadr(fd, sound->packedfile);
+		
+	for (lib = oldmain->library.first; lib; lib = lib->id.next)
+		lib->packedfile = newpackedadr(fd, lib->packedfile);
+}
+
+
+/* undo file support: add all library pointers in lookup */
+void blo_add_library_pointer_map(ListBase *old_mainlist, FileData *fd)
+{
+	Main *ptr = old_mainlist->first;
+	ListBase *lbarray[MAX_LIBARRAY];
+	
+	for (ptr = ptr->next; ptr; ptr = ptr->next) {
+		int i = set_listbasepointers(ptr, lbarray);
+		while (i--) {
+			ID *id;
+			for (id = lbarray[i]->first; id; id = id->next)
+				oldnewmap_insert(fd->libmap, id, id, GS(id->name));
+		}
+	}
+
+	fd->old_mainlist = old_mainlist;
+}
+
+/* undo file support: keep the ID's of the old main that are the same in the undo step */
+
+/* ID types that can be kept, all the data of their runtime caches is owned by them
+ * or by the ID's they use (so those have to be kept as well, see blo_make_undo_reuse_map) */
+static bool undo_reuse_idcode_supported(const short idcode)
+{
+	switch (idcode) {
+		case ID_OB:
+		case ID_ME:
+		case ID_CU:
+		case ID_MB:
+		case ID_LT:
+		case ID_KE:
+		case ID_AR:
+		case ID_MA:
+		case ID_TE:
+		case ID_IM:
+		case ID_LA:
+		case ID_CA:
+		case ID_WO:
+		case ID_TXT:
+		case ID_VF:
+		case ID_AC:
+		case ID_GR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void undo_reuse_foreach_nla_strips(ListBase *strips, LibraryIDLinkCallback callback, void *user_data)
+{
+	NlaStrip *strip;
+
+	for (strip = strips->first; strip; strip = strip->next) {
+		callback(user_data, (ID **)&strip->act, IDWALK_USER);
+		undo_reuse_foreach_nla_strips(&strip->strips, callback, user_data);
+	}
+}
+
+typedef struct UndoReuseForeachData {
+	LibraryIDLinkCallback callback;
+	void *user_data;
+	ID *embedded_id;
+} UndoReuseForeachData;
+
+static bool undo_reuse_foreach_skip_embedded_cb(void *user_data, ID **id_pointer, int cb_flag)
+{
+	UndoReuseForeachData *data = user_data;
+
+	if (*id_pointer == data->embedded_id) {
+		return true;
+	}
+
+	return data->callback(data->user_data, id_pointer, cb_flag);
+}
+
+/* like BKE_library_foreach_ID_link, including the ID's it doesn't loop over but lib_link functions do.
+ * Node trees of materials, lamps, worlds and textures are data of their ID (written and read with it),
+ * instead of the tree the ID's used by its nodes are passed to the callback. */
+static void undo_reuse_foreach_ID_link(ID *id, LibraryIDLinkCallback callback, void *user_data)
+{
+	AnimData *adt = BKE_animdata_from_id(id);
+	bNodeTree *ntree = ntreeFromID(id);
+
+	if (ntree) {
+		UndoReuseForeachData data;
+
+		data.callback = callback;
+		data.user_data = user_data;
+		data.embedded_id = &ntree->id;
+		BKE_library_foreach_ID_link(id, undo_reuse_foreach_skip_embedded_cb, &data, IDWALK_NOP);
+
+		undo_reuse_foreach_ID_link(&ntree->id, callback, user_data);
+	}
+	else {
+		BKE_library_foreach_ID_link(id, callback, user_data, IDWALK_NOP);
+	}
+
+	if (adt) {
+		NlaTrack *nlt;
+
+		callback(user_data, (ID **)&adt->action, IDWALK_USER);
+		callback(user_data, (ID **)&adt->tmpact, IDWALK_USER);
+		for (nlt = adt->nla_tracks.first; nlt; nlt = nlt->next) {
+			undo_reuse_foreach_nla_strips(&nlt->strips, callback, user_data);
+		}
+	}
+
+	if (GS(id->name) == ID_OB) {
+		Object *ob = (Object *)id;
+
+		if (ob->soft && ob->soft->effector_weights) {
+			callback(user_data, (ID **)&ob->soft->effector_weights->group, IDWALK_NOP);
+		}
+	}
+}
+
+typedef struct UndoReuseCheckData {
+	GHash *reuse_map;
+	ID *id;
+	bool is_reusable;
+} UndoReuseCheckData;
+
+static bool undo_reuse_check_cb(void *user_data, ID **id_pointer, int UNUSED(cb_flag))
+{
+	UndoReuseCheckData *data = user_data;
+	ID *id = *id_pointer;
+
+	/* linked ID's are always kept */
+	if (id && (id != data->id) && (id->lib == NULL) && !BLI_ghash_haskey(data->reuse_map, id)) {
+		data->is_reusable = false;
+	}
+
+	return data->is_reusable;
+}
+
+/* members of ID structs that are not compared: runtime data that is reset when reading the ID
+ * (so it changes whenever caches are rebuilt), and the ID list pointers,
+ * those change whenever an ID is added or removed next to it but aren't used by reading.
+ * Ranges of a type are in order of their offset, after the ID list pointers.
+ * Runtime data that isn't listed here (or is in data blocks of the ID) still makes the ID read again
+ * after it changed. */
+typedef struct UndoReuseIgnoredRange {
+	short idcode;
+	size_t offset, size;
+} UndoReuseIgnoredRange;
+
+#define UNDO_REUSE_RANGE(idcode, type, member_first, member_next) \
+	{idcode, offsetof(type, member_first), offsetof(type, member_next) - offsetof(type, member_first)}
+#define UNDO_REUSE_MEMBER(idcode, type, member) \
+	{idcode, offsetof(type, member), sizeof(((type *)NULL)->member)}
+
+static const UndoReuseIgnoredRange undo_reuse_ignored_ranges[] = {
+	UNDO_REUSE_RANGE(0, ID, next, newid),
+	UNDO_REUSE_MEMBER(ID_OB, Object, bb),
+	/* curve_cache, derivedDeform, derivedFinal, lastDataMask and customdata_mask */
+	UNDO_REUSE_RANGE(ID_OB, Object, curve_cache, state),
+	UNDO_REUSE_MEMBER(ID_ME, Mesh, bb),
+	UNDO_REUSE_MEMBER(ID_CU, Curve, bb),
+	/* cache and gputexture, image buffers are loaded and freed while drawing */
+	UNDO_REUSE_RANGE(ID_IM, Image, cache, anims),
+};
+
+#undef UNDO_REUSE_RANGE
+#undef UNDO_REUSE_MEMBER
+
+/* the chunks starting with the ID block are the same, except for the ignored ranges of the ID */
+static bool undo_reuse_block_start_equal(const MemFileChunk *chunk_a, const MemFileChunk *chunk_b)
+{
+	const short idcode = (short)((const BHead *)chunk_a->buf)->code;
+	size_t offset = 0;
+	unsigned int i;
+
+	if (BLO_memfile_chunk_equal(chunk_a, chunk_b)) {
+		return true;
+	}
+
+	if (chunk_a->size != chunk_b->size) {
+		return false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(undo_reuse_ignored_ranges); i++) {
+		const UndoReuseIgnoredRange *range = &undo_reuse_ignored_ranges[i];
+		const size_t range_offset = sizeof(BHead) + range->offset;
+
+		if (range->idcode != 0 && range->idcode != idcode) {
+			continue;
+		}
+		if ((range_offset + range->size > chunk_a->size) ||
+		    (memcmp(chunk_a->buf + offset, chunk_b->buf + offset, range_offset - offset) != 0))
+		{
+			return false;
+		}
+		offset = range_offset + range->size;
+	}
+
+	return (memcmp(chunk_a->buf + offset, chunk_b->buf + offset, chunk_a->size - offset) == 0);
+}
+
+/* all blocks of the ID start at 'chunk_a' and 'chunk_b' are the same */
+static bool undo_reuse_blocks_equal(const MemFileChunk *chunk_a, const MemFileChunk *chunk_b)
+{
+	if (!undo_reuse_block_start_equal(chunk_a, chunk_b)) {
+		return false;
+	}
+
+	for (chunk_a = chunk_a->next, chunk_b = chunk_b->next;
+	     chunk_a && chunk_b && !chunk_a->is_block_start && !chunk_b->is_block_start;
+	     chunk_a = chunk_a->next, chunk_b = chunk_b->next)
+	{
+		if (!BLO_memfile_chunk_equal(chunk_a, chunk_b)) {
+			return false;
+		}
+	}
+
+	return ((chunk_a == NULL || chunk_a->is_block_start) &&
+	        (chunk_b == NULL || chunk_b->is_block_start));
+}
+
+static GHash *undo_reuse_blocks_by_address(MemFile *memfile)
+{
+	GHash *blocks = BLI_ghash_ptr_new(__func__);
+	MemFileChunk *chunk;
+
+	for (chunk = memfile->chunks.first; chunk; chunk = chunk->next) {
+		if (chunk->is_block_start) {
+			const BHead *bhead = (const BHead *)chunk->buf;
+
+			if (BKE_idcode_is_valid(bhead->code)) {
+				BLI_ghash_insert(blocks, bhead->old, chunk);
+			}
+		}
+	}
+
+	return blocks;
+}
+
+/**
+ * Finds the local ID's of \a oldmain that can be kept as is by reading \a fd:
+ * those with the same blocks in \a oldmain_memfile (\a oldmain written with the memfile of \a fd as reference),
+ * that only use other ID's that are kept.
+ *
+ * Since the memfiles are written from memory, the address of an ID is the same in both of them
+ * and in \a oldmain, read_libblock moves those ID's to the new main instead of reading them.
+ */
+void blo_make_undo_reuse_map(FileData *fd, Main *oldmain, MemFile *oldmain_memfile)
+{
+	ListBase *lbarray[MAX_LIBARRAY];
+	GHash *new_blocks = undo_reuse_blocks_by_address(fd->memfile);
+	GHash *old_blocks = undo_reuse_blocks_by_address(oldmain_memfile);
+	GHash *reuse_map = BLI_ghash_ptr_new(__func__);
+	UndoReuseCheckData check_data;
+	ID **reuse_ids;
+	int reuse_ids_len = 0, i;
+	bool changed;
+
+	i = set_listbasepointers(oldmain, lbarray);
+	while (i--) {
+		reuse_ids_len += BLI_listbase_count(lbarray[i]);
+	}
+	reuse_ids = MEM_mallocN(sizeof(*reuse_ids) * (size_t)max_ii(reuse_ids_len, 1), __func__);
+	reuse_ids_len = 0;
+
+	i = set_listbasepointers(oldmain, lbarray);
+	while (i--) {
+		ID *id;
+
+		for (id = lbarray[i]->first; id; id = id->next) {
+			const short idcode = GS(id->name);
+			const MemFileChunk *chunk_new, *chunk_old;
+
+			if (!undo_reuse_idcode_supported(idcode) ||
+			    !(chunk_new = BLI_ghash_lookup(new_blocks, id)) ||
+			    !(chunk_old = BLI_ghash_lookup(old_blocks, id)) ||
+			    (((const BHead *)chunk_new->buf)->code != idcode) ||
+			    !undo_reuse_blocks_equal(chunk_new, chunk_old))
+			{
+				continue;
+			}
+
+			BLI_ghash_insert(reuse_map, id, id);
+			reuse_ids[reuse_ids_len++] = id;
+		}
+	}
+
+	BLI_ghash_free(new_blocks, NULL, NULL);
+	BLI_ghash_free(old_blocks, NULL, NULL);
 
-static void insert_packedmap(FileData *fd, PackedFile *pf)
-{
-	oldnewmap_insert(fd->packedmap, pf, pf, 0);
-	oldnewmap_insert(fd->packedmap, pf->data, pf->data, 0);
+	/* ID's using an ID that is read again are read again too */
+	check_data.reuse_map = reuse_map;
+	do {
+		changed = false;
+		for (i = 0; i < reuse_ids_len; i++) {
+			if (reuse_ids[i]) {
+				check_data.id = reuse_ids[i];
+				check_data.is_reusable = true;
+				undo_reuse_foreach_ID_link(reuse_ids[i], undo_reuse_check_cb, &check_data);
+
+				if (!check_data.is_reusable) {
+					BLI_ghash_remove(reuse_map, reuse_ids[i], NULL, NULL);
+					reuse_ids[i] = NULL;
+					changed = true;
+				}
+			}
+		}
+	} while (changed);
+
+	MEM_freeN(reuse_ids);
+
+	fd->undo_reuse_map = reuse_map;
 }
 
-void blo_make_packed_pointer_map(FileData *fd, Main *oldmain)
+void blo_end_undo_reuse_map(FileData *fd)
 {
-	Image *ima;
-	VFont *vfont;
-	bSound *sound;
-	Library *lib;
-	
-	fd->packedmap = oldnewmap_new();
-	
-	for (ima = oldmain->image.first; ima; ima = ima->id.next) {
-		ImagePackedFile *imapf;
+	if (fd->undo_reuse_map) {
+		BLI_ghash_free(fd->undo_reuse_map, NULL, NULL);
+		fd->undo_reuse_map = NULL;
+	}
+}
 
-		if (ima->packedfile)
-			insert_packedmap(fd, ima->packedfile);
+static bool undo_reuse_users_cb(void *UNUSED(user_data), ID **id_pointer, int cb_flag)
+{
+	ID *id = *id_pointer;
 
-		for (imapf = ima->packedfiles.first; imapf; imapf = imapf->next)
-			if (imapf->packedfile)
-				insert_packedmap(fd, imapf->packedfile);
+	if (id) {
+		/* same as newlibadr_us */
+		if (cb_flag & IDWALK_USER) {
+			id->us++;
+		}
+		else if (cb_flag & IDWALK_USER_ONE) {
+			id_us_ensure_real(id);
+		}
 	}
-			
-	for (vfont = oldmain->vfont.first; vfont; vfont = vfont->id.next)
-		if (vfont->packedfile)
-			insert_packedmap(fd, vfont->packedfile);
-	
-	for (sound = oldmain->sound.first; sound; sound = sound->id.next)
-		if (sound->packedfile)
-			insert_packedmap(fd, sound->packedfile);
-	
-	for (lib = oldmain->library.first; lib; lib = lib->id.next)
-		if (lib->packedfile)
-			insert_packedmap(fd, lib->packedfile);
 
+	return true;
 }
 
-/* set old main packed data to zero if it has been restored */
-/* this works because freeing old main only happens after this call */
-void blo_end_packed_pointer_map(FileData *fd, Main *oldmain)
+/* the kept ID's are not linked, but the users they add to other ID's have to be counted again */
+static void lib_link_undo_reused(FileData *fd)
 {
-	Image *ima;
-	VFont *vfont;
-	bSound *sound;
-	Library *lib;
-	OldNew *entry = fd->packedmap->entries;
-	int i;
-	
-	/* used entries were restored, so we put them to zero */
-	for (i=0; i < fd->packedmap->nentries; i++, entry++) {
-		if (entry->nr > 0)
-			entry->newp = NULL;
-	}
-	
-	for (ima = oldmain->image.first; ima; ima = ima->id.next) {
-		ImagePackedFile *imapf;
+	GHashIterator gh_iter;
 
-		ima->packedfile = newpackedadr(fd, ima->packedfile);
+	GHASH_ITER (gh_iter, fd->undo_reuse_map) {
+		ID *id = BLI_ghashIterator_getValue(&gh_iter);
 
-		for (imapf = ima->packedfiles.first; imapf; imapf = imapf->next)
-			imapf->packedfile = newpackedadr(fd, imapf->packedfile);
-	}
-	
-	for (vfont = oldmain->vfont.first; vfont; vfont = vfont->id.next)
-		vfont->packedfile = newpackedadr(fd, vfont->packedfile);
+		undo_reuse_foreach_ID_link(id, undo_reuse_users_cb, NULL);
 
-	for (sound = oldmain->sound.first; sound; sound = sound->id.next)
-		sound->packedfile = newpackedadr(fd, sound->packedfile);
-		
-	for (lib = oldmain->library.first; lib; lib = lib->id.next)
-		lib->packedfile = newpackedadr(fd, lib->packedfile);
-}
+		switch (GS(id->name)) {
+			case ID_OB:
+			{
+				Object *ob = (Object *)id;
 
+				/* see lib_link_object, cleared by blo_clear_proxy_pointers_from_lib */
+				if (ob->proxy) {
+					ob->proxy->proxy_from = ob;
+				}
+				break;
+			}
+			case ID_GR:
+			{
+				Group *group = (Group *)id;
 
-/* undo file support: add all library pointers in lookup */
-void blo_add_library_pointer_map(ListBase *old_mainlist, FileData *fd)
-{
-	Main *ptr = old_mainlist->first;
-	ListBase *lbarray[MAX_LIBARRAY];
-	
-	for (ptr = ptr->next; ptr; ptr = ptr->next) {
-		int i = set_listbasepointers(ptr, lbarray);
-		while (i--) {
-			ID *id;
-			for (id = lbarray[i]->first; id; id = id->next)
-				oldnewmap_insert(fd->libmap, id, id, GS(id->name));
+				/* see lib_link_group */
+				if (group->gobject.first) {
+					id_us_ensure_real(&group->id);
+				}
+				break;
+			}
 		}
 	}
-
-	fd->old_mainlist = old_mainlist;
 }
 
 
@@ -1848,12 +3067,23 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 			switch_endian_structs(fd->filesdna, bh);
 		
 		if (fd->compflags[bh->SDNAnr]) {	/* flag==0: doesn't exist anymore */
+			const void *data = blo_bhead_data(fd, bh);
+
 			if (fd->compflags[bh->SDNAnr] == 2) {
-				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				/* reconstructing reads the members with their types, data in place can be unaligned */
+				if ((uintptr_t)data % sizeof(void *)) {
+					void *data_aligned = MEM_mallocN(bh->len, __func__);
+					memcpy(data_aligned, data, bh->len);
+					temp = DNA_struct_reconstruct(fd->reconstruct_info, bh->SDNAnr, bh->nr, data_aligned);
+					MEM_freeN(data_aligned);
+				}
+				else {
+					temp = DNA_struct_reconstruct(fd->reconstruct_info, bh->SDNAnr, bh->nr, data);
+				}
 			}
 			else {
 				temp = MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, data, bh->len);
 			}
 		}
 	}
@@ -2989,6 +4219,11 @@ static void direct_link_nodetree(FileData *fd, bNodeTree *ntree)
 	for (node = ntree->nodes.first; node; node = node->next) {
 		node->typeinfo = NULL;
 		
+		/* compositor profiling statistics are only valid for the current session */
+		node->exec_chunks = 0;
+		node->exec_time = 0.0f;
+		node->exec_memory = 0;
+		
 		link_list(fd, &node->inputs);
 		link_list(fd, &node->outputs);
 		
@@ -7805,37 +9040,240 @@ static const char *dataname(short id_code)
 		case ID_MSK: return "Data from MSK";
 		case ID_LS: return "Data from LS";
 	}
-	return "Data from Lib Block";
-	
+	return "Data from Lib Block";
+	
+}
+
+static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *allocname)
+{
+	bhead = blo_nextbhead(fd, bhead);
+	
+	while (bhead && bhead->code==DATA) {
+		void *data;
+#if 0
+		/* XXX DUMB DEBUGGING OPTION TO GIVE NAMES for guarded malloc errors */
+		short *sp = fd->filesdna->structs[bhead->SDNAnr];
+		char *tmp = malloc(100);
+		allocname = fd->filesdna->types[ sp[0] ];
+		strcpy(tmp, allocname);
+		data = read_struct(fd, bhead, tmp);
+#else
+		data = read_struct(fd, bhead, allocname);
+#endif
+		
+		if (data) {
+			oldnewmap_insert(fd->datamap, bhead->old, data, 0);
+		}
+		
+		bhead = blo_nextbhead(fd, bhead);
+	}
+	
+	return bhead;
+}
+
+/* links the direct data of an ID, read into fd->datamap. Returns true when the ID has to be freed */
+static bool direct_link_id_data(FileData *fd, Main *main, ID *id)
+{
+	bool wrong_id = false;
+
+	/* init pointers direct data */
+	direct_link_id(fd, id);
+	
+	switch (GS(id->name)) {
+		case ID_WM:
+			direct_link_windowmanager(fd, (wmWindowManager *)id);
+			break;
+		case ID_SCR:
+			wrong_id = direct_link_screen(fd, (bScreen *)id);
+			break;
+		case ID_SCE:
+			direct_link_scene(fd, (Scene *)id);
+			break;
+		case ID_OB:
+			direct_link_object(fd, (Object *)id);
+			break;
+		case ID_ME:
+			direct_link_mesh(fd, (Mesh *)id);
+			break;
+		case ID_CU:
+			direct_link_curve(fd, (Curve *)id);
+			break;
+		case ID_MB:
+			direct_link_mball(fd, (MetaBall *)id);
+			break;
+		case ID_MA:
+			direct_link_material(fd, (Material *)id);
+			break;
+		case ID_TE:
+			direct_link_texture(fd, (Tex *)id);
+			break;
+		case ID_IM:
+			direct_link_image(fd, (Image *)id);
+			break;
+		case ID_LA:
+			direct_link_lamp(fd, (Lamp *)id);
+			break;
+		case ID_VF:
+			direct_link_vfont(fd, (VFont *)id);
+			break;
+		case ID_TXT:
+			direct_link_text(fd, (Text *)id);
+			break;
+		case ID_IP:
+			direct_link_ipo(fd, (Ipo *)id);
+			break;
+		case ID_KE:
+			direct_link_key(fd, (Key *)id);
+			break;
+		case ID_LT:
+			direct_link_latt(fd, (Lattice *)id);
+			break;
+		case ID_WO:
+			direct_link_world(fd, (World *)id);
+			break;
+		case ID_LI:
+			direct_link_library(fd, (Library *)id, main);
+			break;
+		case ID_CA:
+			direct_link_camera(fd, (Camera *)id);
+			break;
+		case ID_SPK:
+			direct_link_speaker(fd, (Speaker *)id);
+			break;
+		case ID_SO:
+			direct_link_sound(fd, (bSound *)id);
+			break;
+		case ID_GR:
+			direct_link_group(fd, (Group *)id);
+			break;
+		case ID_AR:
+			direct_link_armature(fd, (bArmature*)id);
+			break;
+		case ID_AC:
+			direct_link_action(fd, (bAction*)id);
+			break;
+		case ID_NT:
+			direct_link_nodetree(fd, (bNodeTree*)id);
+			break;
+		case ID_BR:
+			direct_link_brush(fd, (Brush*)id);
+			break;
+		case ID_PA:
+			direct_link_particlesettings(fd, (ParticleSettings*)id);
+			break;
+		case ID_GD:
+			direct_link_gpencil(fd, (bGPdata *)id);
+			break;
+		case ID_MC:
+			direct_link_movieclip(fd, (MovieClip *)id);
+			break;
+		case ID_MSK:
+			direct_link_mask(fd, (Mask *)id);
+			break;
+		case ID_LS:
+			direct_link_linestyle(fd, (FreestyleLineStyle *)id);
+			break;
+		case ID_PAL:
+			direct_link_palette(fd, (Palette *)id);
+			break;
+		case ID_PC:
+			direct_link_paint_curve(fd, (PaintCurve *)id);
+			break;
+	}
+
+	return wrong_id;
+}
+
+#ifdef USE_PARALLEL_DIRECT_LINK
+
+typedef struct DirectLinkDeferred {
+	ID *id;
+	BHead *bhead;  /* the ID block, its data blocks follow it */
+	const char *allocname;
+} DirectLinkDeferred;
+
+/* direct linking of these types only uses the data of the ID itself */
+static bool direct_link_is_threadsafe(const short idcode)
+{
+	return ELEM(idcode, ID_ME, ID_CU, ID_LT, ID_KE, ID_AC, ID_AR);
+}
+
+static void direct_link_deferred_add(FileData *fd, ID *id, BHead *bhead, const char *allocname)
+{
+	DirectLinkDeferred *item;
+
+	if (UNLIKELY(fd->direct_link_deferred_len == fd->direct_link_deferred_alloc)) {
+		fd->direct_link_deferred_alloc *= 2;
+		fd->direct_link_deferred = MEM_reallocN(
+		        fd->direct_link_deferred, sizeof(*fd->direct_link_deferred) * fd->direct_link_deferred_alloc);
+	}
+
+	item = &fd->direct_link_deferred[fd->direct_link_deferred_len++];
+	item->id = id;
+	item->bhead = bhead;
+	item->allocname = allocname;
 }
 
-static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *allocname)
+static void direct_link_deferred_task_cb(void *userdata, void *UNUSED(userdata_chunk), int i)
 {
-	bhead = blo_nextbhead(fd, bhead);
-	
-	while (bhead && bhead->code==DATA) {
-		void *data;
-#if 0
-		/* XXX DUMB DEBUGGING OPTION TO GIVE NAMES for guarded malloc errors */
-		short *sp = fd->filesdna->structs[bhead->SDNAnr];
-		char *tmp = malloc(100);
-		allocname = fd->filesdna->types[ sp[0] ];
-		strcpy(tmp, allocname);
-		data = read_struct(fd, bhead, tmp);
-#else
-		data = read_struct(fd, bhead, allocname);
-#endif
-		
-		if (data) {
-			oldnewmap_insert(fd->datamap, bhead->old, data, 0);
-		}
-		
-		bhead = blo_nextbhead(fd, bhead);
+	FileData *fd = userdata;
+	const DirectLinkDeferred *item = &fd->direct_link_deferred[i];
+	bool wrong_id;
+
+	/* all blocks are read at this point, the only state changed while linking is the data map */
+	FileData fd_local = *fd;
+	fd_local.datamap = oldnewmap_new();
+
+	read_data_into_oldnewmap(&fd_local, item->bhead, item->allocname);
+	wrong_id = direct_link_id_data(&fd_local, NULL, item->id);
+	BLI_assert(!wrong_id);
+	UNUSED_VARS_NDEBUG(wrong_id);
+
+	oldnewmap_free_unused(fd_local.datamap);
+	oldnewmap_free(fd_local.datamap);
+}
+
+/**
+ * The tasks may only read blocks that are in memory already and must not change state of the file,
+ * so linking is only deferred when all headers are known (a mapped or decompressed file).
+ * Structs of older files are reconstructed with the precomputed #FileData.reconstruct_info,
+ * which only reads the SDNA of the file. Otherwise all ID's are linked while reading the blocks.
+ */
+static bool direct_link_deferred_supported(const FileData *fd)
+{
+	return (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) != 0;
+}
+
+static void direct_link_deferred_begin(FileData *fd)
+{
+	if (!direct_link_deferred_supported(fd)) {
+		return;
 	}
-	
-	return bhead;
+
+	fd->direct_link_deferred_alloc = 256;
+	fd->direct_link_deferred_len = 0;
+	fd->direct_link_deferred = MEM_mallocN(
+	        sizeof(*fd->direct_link_deferred) * fd->direct_link_deferred_alloc, __func__);
+}
+
+/* reads the data and links the ID's collected by read_libblock, in parallel */
+static void direct_link_deferred_end(FileData *fd)
+{
+	if (fd->direct_link_deferred == NULL) {
+		return;
+	}
+
+	BLI_task_parallel_range_ex(
+	            0, fd->direct_link_deferred_len, fd, NULL, 0, direct_link_deferred_task_cb,
+	            fd->direct_link_deferred_len > 1, true);
+
+	MEM_freeN(fd->direct_link_deferred);
+	fd->direct_link_deferred = NULL;
+	fd->direct_link_deferred_len = fd->direct_link_deferred_alloc = 0;
 }
 
+#endif  /* USE_PARALLEL_DIRECT_LINK */
+
 static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID **r_id)
 {
 	/* this routine reads a libblock and its direct data. Use link functions to connect it all
@@ -7898,6 +9336,32 @@ static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID
 		}
 	}
 
+	/* In undo case, ID's that are the same in the snapshot being read are kept as is (with their runtime data),
+	 * see blo_make_undo_reuse_map. */
+	if (fd->undo_reuse_map && (id = BLI_ghash_lookup(fd->undo_reuse_map, bhead->old))) {
+		Main *oldmain = fd->old_mainlist->first;
+		const short idcode = GS(id->name);
+
+		BLI_remlink(which_libbase(oldmain, idcode), id);
+		BLI_addtail(which_libbase(main, idcode), id);
+		oldnewmap_insert(fd->libmap, bhead->old, id, bhead->code);
+
+		/* no LIB_TAG_NEED_LINK, users are counted again in lib_link_undo_reused */
+		id->tag = flag | LIB_TAG_UNDO_OLD_ID_REUSED;
+		id->us = ID_FAKE_USERS(id);
+
+		if (r_id) {
+			*r_id = id;
+		}
+
+		/* skip the direct data */
+		do {
+			bhead = blo_nextbhead(fd, bhead);
+		} while (bhead && bhead->code == DATA);
+
+		return bhead;
+	}
+
 	/* read libblock */
 	id = read_struct(fd, bhead, "lib block");
 
@@ -7935,113 +9399,23 @@ static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID
 	/* need a name for the mallocN, just for debugging and sane prints on leaks */
 	allocname = dataname(GS(id->name));
 	
+#ifdef USE_PARALLEL_DIRECT_LINK
+	if (fd->direct_link_deferred && direct_link_is_threadsafe(GS(id->name))) {
+		direct_link_deferred_add(fd, id, bhead, allocname);
+
+		/* skip the data, it is read by direct_link_deferred_end */
+		do {
+			bhead = blo_nextbhead(fd, bhead);
+		} while (bhead && bhead->code == DATA);
+
+		return bhead;
+	}
+#endif
+
 	/* read all data into fd->datamap */
 	bhead = read_data_into_oldnewmap(fd, bhead, allocname);
 	
-	/* init pointers direct data */
-	direct_link_id(fd, id);
-	
-	switch (GS(id->name)) {
-		case ID_WM:
-			direct_link_windowmanager(fd, (wmWindowManager *)id);
-			break;
-		case ID_SCR:
-			wrong_id = direct_link_screen(fd, (bScreen *)id);
-			break;
-		case ID_SCE:
-			direct_link_scene(fd, (Scene *)id);
-			break;
-		case ID_OB:
-			direct_link_object(fd, (Object *)id);
-			break;
-		case ID_ME:
-			direct_link_mesh(fd, (Mesh *)id);
-			break;
-		case ID_CU:
-			direct_link_curve(fd, (Curve *)id);
-			break;
-		case ID_MB:
-			direct_link_mball(fd, (MetaBall *)id);
-			break;
-		case ID_MA:
-			direct_link_material(fd, (Material *)id);
-			break;
-		case ID_TE:
-			direct_link_texture(fd, (Tex *)id);
-			break;
-		case ID_IM:
-			direct_link_image(fd, (Image *)id);
-			break;
-		case ID_LA:
-			direct_link_lamp(fd, (Lamp *)id);
-			break;
-		case ID_VF:
-			direct_link_vfont(fd, (VFont *)id);
-			break;
-		case ID_TXT:
-			direct_link_text(fd, (Text *)id);
-			break;
-		case ID_IP:
-			direct_link_ipo(fd, (Ipo *)id);
-			break;
-		case ID_KE:
-			direct_link_key(fd, (Key *)id);
-			break;
-		case ID_LT:
-			direct_link_latt(fd, (Lattice *)id);
-			break;
-		case ID_WO:
-			direct_link_world(fd, (World *)id);
-			break;
-		case ID_LI:
-			direct_link_library(fd, (Library *)id, main);
-			break;
-		case ID_CA:
-			direct_link_camera(fd, (Camera *)id);
-			break;
-		case ID_SPK:
-			direct_link_speaker(fd, (Speaker *)id);
-			break;
-		case ID_SO:
-			direct_link_sound(fd, (bSound *)id);
-			break;
-		case ID_GR:
-			direct_link_group(fd, (Group *)id);
-			break;
-		case ID_AR:
-			direct_link_armature(fd, (bArmature*)id);
-			break;
-		case ID_AC:
-			direct_link_action(fd, (bAction*)id);
-			break;
-		case ID_NT:
-			direct_link_nodetree(fd, (bNodeTree*)id);
-			break;
-		case ID_BR:
-			direct_link_brush(fd, (Brush*)id);
-			break;
-		case ID_PA:
-			direct_link_particlesettings(fd, (ParticleSettings*)id);
-			break;
-		case ID_GD:
-			direct_link_gpencil(fd, (bGPdata *)id);
-			break;
-		case ID_MC:
-			direct_link_movieclip(fd, (MovieClip *)id);
-			break;
-		case ID_MSK:
-			direct_link_mask(fd, (Mask *)id);
-			break;
-		case ID_LS:
-			direct_link_linestyle(fd, (FreestyleLineStyle *)id);
-			break;
-		case ID_PAL:
-			direct_link_palette(fd, (Palette *)id);
-			break;
-		case ID_PC:
-			direct_link_paint_curve(fd, (PaintCurve *)id);
-			break;
-	}
+	wrong_id = direct_link_id_data(fd, main, id);
 	
 	oldnewmap_free_unused(fd->datamap);
 	oldnewmap_clear(fd->datamap);
@@ -8197,8 +9571,6 @@ static void do_versions_after_linking(FileData *fd, Library *lib, Main *main)
 
 static void lib_link_all(FileData *fd, Main *main)
 {
-	oldnewmap_sort(fd);
-	
 	/* No load UI for undo memfiles */
 	if (fd->memfile == NULL) {
 		lib_link_windowmanager(fd, main);
@@ -8349,6 +9721,10 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 		}
 	}
 
+#ifdef USE_PARALLEL_DIRECT_LINK
+	direct_link_deferred_begin(fd);
+#endif
+
 	while (bhead) {
 		switch (bhead->code) {
 		case DATA:
@@ -8381,6 +9757,10 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 			bhead = read_libblock(fd, bfd->main, bhead, LIB_TAG_LOCAL, NULL);
 		}
 	}
+
+#ifdef USE_PARALLEL_DIRECT_LINK
+	direct_link_deferred_end(fd);
+#endif
 	
 	/* do before read_libraries, but skip undo case */
 	if (fd->memfile == NULL) {
@@ -8393,6 +9773,9 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 	blo_join_main(&mainlist);
 	
 	lib_link_all(fd, bfd->main);
+	if (fd->undo_reuse_map) {
+		lib_link_undo_reused(fd);
+	}
 	//do_versions_after_linking(fd, NULL, bfd->main); // XXX: not here (or even in this function at all)! this causes crashes on many files - Aligorith (July 04, 2010)
 	lib_verify_nodetree(bfd->main, true);
 	fix_relpaths_library(fd->relabase, bfd->main); /* make all relative paths, relative to the open blend file */
@@ -8425,6 +9808,36 @@ static void sort_bhead_old_map(FileData *fd)
 	BHead *bhead;
 	struct BHeadSort *bhs;
 	int tot = 0;
+
+#ifdef USE_BHEAD_INDEX
+	if (fd->bhead_index && fd->bhead_index->entries && !fd->bhead_index->use_file) {
+		const BHeadIndexEntry *entry = fd->bhead_index->entries;
+		int i;
+
+		/* only ID's are looked up (see expand_doit_library), leave out the many data blocks */
+		for (i = 0; i < fd->bhead_index->header.blocks_len; i++, entry++) {
+			if (entry->code != DATA) {
+				tot++;
+			}
+		}
+
+		fd->tot_bheadmap = tot;
+		if (tot == 0) return;
+
+		bhs = fd->bheadmap = MEM_mallocN(tot * sizeof(struct BHeadSort), "BHeadSort");
+
+		for (i = 0, entry = fd->bhead_index->entries; i < fd->bhead_index->header.blocks_len; i++, entry++) {
+			if (entry->code != DATA) {
+				bhs->bhead = &fd->mmap_bheads[i];
+				bhs->old = (void *)(uintptr_t)entry->old;
+				bhs++;
+			}
+		}
+
+		qsort(fd->bheadmap, tot, sizeof(struct BHeadSort), verg_bheadsort);
+		return;
+	}
+#endif
 	
 	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead))
 		tot++;
@@ -8456,6 +9869,129 @@ static BHead *find_previous_lib(FileData *fd, BHead *bhead)
 	return bhead;
 }
 
+#ifdef USE_BHEAD_INDEX
+/**
+ * The maps of old addresses and ID names can be made from an index that matches the file
+ * but is outdated (the file was saved again with the same size and time).
+ * When a lookup fails or finds blocks that don't match the file, the maps are made from the block headers
+ * of the file instead and the lookup is repeated, the index is removed when that finds the block.
+ */
+static bool bhead_index_maps_use_index(const FileData *fd)
+{
+	return (fd->bhead_index && fd->bhead_index->entries && !fd->bhead_index->use_file);
+}
+
+/* replaces the block headers made from the index by the ones in the file */
+static void bhead_index_bheads_from_file(FileData *fd)
+{
+	BHeadIndex *index = fd->bhead_index;
+	BHead *bheads = fd->mmap_bheads;
+	const char **bheads_data = fd->mmap_bheads_data;
+	const int bheads_len = fd->mmap_bheads_len;
+	size_t ofs = fd->mmap_seek;
+	int i;
+
+	/* with the same layout the headers are updated in place */
+	for (i = 0; i < bheads_len; i++) {
+		BHead bhead;
+
+		if ((fd->mmap_size - ofs < sizeof(BHead)) || (bheads_data[i] != fd->mmap_buffer + ofs + sizeof(BHead))) {
+			break;
+		}
+		memcpy(&bhead, fd->mmap_buffer + ofs, sizeof(BHead));
+		if ((bhead.len != bheads[i].len) || ((i == bheads_len - 1) != (bhead.code == ENDB))) {
+			break;
+		}
+		bheads[i] = bhead;
+		ofs += sizeof(BHead) + (size_t)bhead.len;
+	}
+
+	if (i != bheads_len) {
+		fd->mmap_bheads = NULL;
+		fd->mmap_bheads_data = NULL;
+		fd->flags &= ~FD_FLAGS_BHEAD_IN_PLACE;
+		mmap_bheads_init(fd);
+
+		if (fd->flags & FD_FLAGS_BHEAD_IN_PLACE) {
+			index->bheads_outdated = bheads;
+			index->bheads_data_outdated = bheads_data;
+		}
+		else {
+			/* invalid file, keep using the index */
+			fd->mmap_bheads = bheads;
+			fd->mmap_bheads_data = bheads_data;
+			fd->mmap_bheads_len = bheads_len;
+			fd->flags |= FD_FLAGS_BHEAD_IN_PLACE;
+		}
+	}
+}
+
+static void bhead_index_maps_from_file(FileData *fd)
+{
+	fd->bhead_index->use_file = true;
+	bhead_index_bheads_from_file(fd);
+
+	if (fd->bheadmap) {
+		MEM_freeN(fd->bheadmap);
+		fd->bheadmap = NULL;
+		fd->tot_bheadmap = 0;
+	}
+#ifdef USE_GHASH_BHEAD
+	if (fd->bhead_idname_hash) {
+		BLI_ghash_free(fd->bhead_idname_hash, NULL, NULL);
+		fd->bhead_idname_hash = NULL;
+		read_file_bhead_idname_map_create(fd);
+	}
+#endif
+}
+
+/* the block was only found in the block headers of the file, so the index is outdated */
+static void bhead_index_remove(FileData *fd)
+{
+	if (G.debug & G_DEBUG) {
+		printf("%s: outdated block index '%s', removing it\n", __func__, fd->bhead_index->filepath);
+	}
+	BLI_delete(fd->bhead_index->filepath, false, false);
+}
+
+/**
+ * Compares the headers made from the index for \a bhead and the data blocks following it
+ * with the ones in the file, addresses of an outdated index can match other blocks of the file.
+ * Only the headers of blocks that are read anyway are accessed.
+ */
+static bool bhead_index_blocks_check(const FileData *fd, const BHead *bhead)
+{
+	int i;
+
+	for (i = (int)(bhead - fd->mmap_bheads); i < fd->mmap_bheads_len; i++) {
+		const BHead *bhead_index = &fd->mmap_bheads[i];
+		BHead bhead_file;
+
+		memcpy(&bhead_file, fd->mmap_bheads_data[i] - sizeof(BHead), sizeof(BHead));
+		if ((bhead_file.code != bhead_index->code) || (bhead_file.len != bhead_index->len) ||
+		    (bhead_file.old != bhead_index->old) ||
+		    (bhead_file.SDNAnr != bhead_index->SDNAnr) || (bhead_file.nr != bhead_index->nr))
+		{
+			return false;
+		}
+		if ((bhead_index != bhead) && (bhead_index->code != DATA)) {
+			break;
+		}
+	}
+
+	return true;
+}
+
+static bool bhead_idname_check(FileData *fd, const BHead *bhead, const char *idname)
+{
+	/* blocks in place, the name can be past the end of the mapped file with an outdated index */
+	return ((bhead->len >= 0) &&
+	        ((size_t)bhead->len >= (size_t)fd->id_name_offs + MAX_ID_NAME) &&
+	        ((const char *)blo_bhead_data(fd, bhead) + (size_t)bhead->len <= fd->mmap_buffer + fd->mmap_size) &&
+	        STREQLEN(bhead_id_name(fd, bhead), idname, MAX_ID_NAME));
+}
+#endif
+
 static BHead *find_bhead(FileData *fd, void *old)
 {
 #if 0
@@ -8472,6 +10008,17 @@ static BHead *find_bhead(FileData *fd, void *old)
 	bhs_s.old = old;
 	bhs = bsearch(&bhs_s, fd->bheadmap, fd->tot_bheadmap, sizeof(struct BHeadSort), verg_bheadsort);
 
+#ifdef USE_BHEAD_INDEX
+	if (bhead_index_maps_use_index(fd) && (bhs == NULL || !bhead_index_blocks_check(fd, bhs->bhead))) {
+		bhead_index_maps_from_file(fd);
+		sort_bhead_old_map(fd);
+		bhs = bsearch(&bhs_s, fd->bheadmap, fd->tot_bheadmap, sizeof(struct BHeadSort), verg_bheadsort);
+		if (bhs) {
+			bhead_index_remove(fd);
+		}
+	}
+#endif
+
 	if (bhs)
 		return bhs->bhead;
 	
@@ -8494,7 +10041,7 @@ static BHead *find_bhead_from_code_name(FileData *fd, const short idcode, const
 	*((short *)idname_full) = idcode;
 	BLI_strncpy(idname_full + 2, name, sizeof(idname_full) - 2);
 
-	return BLI_ghash_lookup(fd->bhead_idname_hash, idname_full);
+	return find_bhead_from_idname(fd, idname_full);
 
 #else
 	BHead *bhead;
@@ -8518,7 +10065,21 @@ static BHead *find_bhead_from_code_name(FileData *fd, const short idcode, const
 static BHead *find_bhead_from_idname(FileData *fd, const char *idname)
 {
 #ifdef USE_GHASH_BHEAD
-	return BLI_ghash_lookup(fd->bhead_idname_hash, idname);
+	BHead *bhead = BLI_ghash_lookup(fd->bhead_idname_hash, idname);
+
+#ifdef USE_BHEAD_INDEX
+	if (bhead_index_maps_use_index(fd) &&
+	    (bhead == NULL || !bhead_idname_check(fd, bhead, idname) || !bhead_index_blocks_check(fd, bhead)))
+	{
+		bhead_index_maps_from_file(fd);
+		bhead = BLI_ghash_lookup(fd->bhead_idname_hash, idname);
+		if (bhead) {
+			bhead_index_remove(fd);
+		}
+	}
+#endif
+
+	return bhead;
 #else
 	return find_bhead_from_code_name(fd, GS(idname), idname + 2);
 #endif
@@ -9995,7 +11556,7 @@ static void read_libraries(FileData *basefd, ListBase *mainlist)
 						        mainptr->curlib->filepath,
 						        mainptr->curlib->name,
 						        library_parent_filepath(mainptr->curlib));
-						fd = blo_openblenderfile(mainptr->curlib->filepath, basefd->reports);
+						fd = blo_openblenderlibrary(mainptr->curlib->filepath, basefd->reports);
 					}
 					/* allow typing in a new lib path */
 					if (G.debug_value == -666) {
@@ -10012,7 +11573,7 @@ static void read_libraries(FileData *basefd, ListBase *mainlist)
 								BLI_strncpy(mainptr->curlib->filepath, newlib_path, sizeof(mainptr->curlib->filepath));
 								BLI_cleanup_path(G.main->name, mainptr->curlib->filepath);
 								
-								fd = blo_openblenderfile(mainptr->curlib->filepath, basefd->reports);
+								fd = blo_openblenderlibrary(mainptr->curlib->filepath, basefd->reports);
 
 								if (fd) {
 									fd->mainlist = mainlist;
@@ -62,6 +62,20 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from a memory mapped file, see USE_BHEAD_MMAP
+	const char *mmap_buffer;
+	size_t mmap_size;
+	size_t mmap_seek;
+	// copies of all block headers of the mapped file and their data in it, with FD_FLAGS_BHEAD_IN_PLACE
+	// (headers in the file are only 4 byte aligned, they contain a pointer)
+	struct BHead *mmap_bheads;
+	const char **mmap_bheads_data;
+	int mmap_bheads_len;
+	// reader of a mapped file written as gzip blocks, see USE_BHEAD_MMAP
+	struct GzipBlocksReader *gzip_blocks;
+	// index of the blocks of a library, read from or written to the user cache, see USE_BHEAD_INDEX
+	struct BHeadIndex *bhead_index;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -76,6 +90,7 @@ typedef struct FileData {
 	struct SDNA *filesdna;
 	struct SDNA *memsdna;
 	char *compflags;
+	struct DNA_ReconstructInfo *reconstruct_info;  /* conversion of the structs that differ in memsdna */
 	
 	int fileversion;
 	int id_name_offs;       /* used to retrieve ID names from (bhead+1) */
@@ -92,11 +107,17 @@ typedef struct FileData {
 	struct BHeadSort *bheadmap;
 	int tot_bheadmap;
 
+	/* ID's of which the direct data is linked after all blocks are read, see USE_PARALLEL_DIRECT_LINK */
+	struct DirectLinkDeferred *direct_link_deferred;
+	int direct_link_deferred_len, direct_link_deferred_alloc;
+
 	/* see: USE_GHASH_BHEAD */
 	struct GHash *bhead_idname_hash;
 	
 	ListBase *mainlist;
 	ListBase *old_mainlist;  /* Used for undo. */
+	/* Undo: ID's of the old main kept as is, by their address in the memfile, see blo_make_undo_reuse_map. */
+	struct GHash *undo_reuse_map;
 
 	/* ick ick, used to return
 	 * data through streamglue.
@@ -117,6 +138,7 @@ typedef struct BHeadN {
 #define FD_FLAGS_FILE_OK                   (1 << 3)
 #define FD_FLAGS_NOT_MY_BUFFER             (1 << 4)
 #define FD_FLAGS_NOT_MY_LIBMAP             (1 << 5)
+#define FD_FLAGS_BHEAD_IN_PLACE            (1 << 6)
 
 #define SIZEOFBLENDERHEADER 12
 
@@ -128,6 +150,7 @@ void blo_split_main(ListBase *mainlist, struct Main *main);
 BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath);
 
 FileData *blo_openblenderfile(const char *filepath, struct ReportList *reports);
+FileData *blo_openblenderlibrary(const char *filepath, struct ReportList *reports);
 FileData *blo_openblendermemory(const void *buffer, int buffersize, struct ReportList *reports);
 FileData *blo_openblendermemfile(struct MemFile *memfile, struct ReportList *reports);
 
@@ -141,6 +164,8 @@ void blo_end_sound_pointer_map(FileData *fd, Main *oldmain);
 void blo_make_packed_pointer_map(FileData *fd, Main *oldmain);
 void blo_end_packed_pointer_map(FileData *fd, Main *oldmain);
 void blo_add_library_pointer_map(ListBase *old_mainlist, FileData *fd);
+void blo_make_undo_reuse_map(FileData *fd, Main *oldmain, struct MemFile *oldmain_memfile);
+void blo_end_undo_reuse_map(FileData *fd);
 
 void blo_freefiledata(FileData *fd);
 
@@ -148,6 +173,7 @@ BHead *blo_firstbhead(FileData *fd);
 BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
 
+const void *blo_bhead_data(const FileData *fd, const BHead *bhead);
 const char *bhead_id_name(const FileData *fd, const BHead *bhead);
 
 /* do versions stuff */
@@ -40,19 +40,47 @@
 #include "DNA_listBase.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
 
 #include "BLO_undofile.h"
 
 /* **************** support for memory-write, for undo buffers *************** */
 
+/**
+ * Chunk buffers are reference counted, so unchanged data can be shared by any number of undo steps,
+ * even when it moved within the file. The buffer header stores the number of users
+ * and the memfile that accounts for its memory.
+ */
+typedef struct MemFileBuffer {
+	const MemFile *owner;
+	unsigned int users;
+	unsigned int _pad;
+} MemFileBuffer;
+
+#define MEMFILE_BUFFER(_buf) ((MemFileBuffer *)(_buf) - 1)
+
+static const char *memfile_buffer_new(const MemFile *owner, const char *buf, unsigned int size)
+{
+	MemFileBuffer *buffer = MEM_mallocN(sizeof(MemFileBuffer) + size, "Chunk buffer");
+
+	buffer->owner = owner;
+	buffer->users = 1;
+	memcpy(buffer + 1, buf, size);
+
+	return (const char *)(buffer + 1);
+}
+
 /* not memfile itself */
 void BLO_memfile_free(MemFile *memfile)
 {
 	MemFileChunk *chunk;
 	
 	while ((chunk = BLI_pophead(&memfile->chunks))) {
-		if (chunk->ident == 0)
-			MEM_freeN(chunk->buf);
+		MemFileBuffer *buffer = MEMFILE_BUFFER(chunk->buf);
+
+		if (--buffer->users == 0)
+			MEM_freeN(buffer);
 		MEM_freeN(chunk);
 	}
 	memfile->size = 0;
@@ -62,75 +90,126 @@ void BLO_memfile_free(MemFile *memfile)
 /* result is that 'first' is being freed */
 void BLO_memfile_merge(MemFile *first, MemFile *second)
 {
-	MemFileChunk *fc, *sc;
-	
-	fc = first->chunks.first;
-	sc = second->chunks.first;
-	while (fc || sc) {
-		if (fc && sc) {
-			if (sc->ident) {
-				sc->ident = 0;
-				fc->ident = 1;
-			}
+	MemFileChunk *chunk;
+
+	/* buffers still used by 'second' are accounted there from now on */
+	for (chunk = second->chunks.first; chunk; chunk = chunk->next) {
+		MemFileBuffer *buffer = MEMFILE_BUFFER(chunk->buf);
+
+		if (buffer->owner == first) {
+			buffer->owner = second;
+			second->size += chunk->size;
 		}
-		if (fc) fc = fc->next;
-		if (sc) sc = sc->next;
 	}
-	
+
 	BLO_memfile_free(first);
 }
 
-static int my_memcmp(const int *mem1, const int *mem2, const int len)
+static unsigned int memfile_chunk_hash(const void *key)
 {
-	register int a = len;
-	register const int *mema = mem1;
-	register const int *memb = mem2;
-	
-	while (a--) {
-		if (*mema != *memb) return 1;
-		mema++;
-		memb++;
+	const MemFileChunk *chunk = key;
+	return chunk->hash;
+}
+
+static bool memfile_chunk_cmp(const void *a, const void *b)
+{
+	return !BLO_memfile_chunk_equal(a, b);
+}
+
+/* chunks of any two memfiles have the same contents (shared buffers are compared quickly) */
+bool BLO_memfile_chunk_equal(const MemFileChunk *chunk_a, const MemFileChunk *chunk_b)
+{
+	if (chunk_a->buf == chunk_b->buf) {
+		return (chunk_a->size == chunk_b->size);
 	}
-	return 0;
+	return ((chunk_a->hash == chunk_b->hash) &&
+	        (chunk_a->size == chunk_b->size) &&
+	        (memcmp(chunk_a->buf, chunk_b->buf, chunk_a->size) == 0));
 }
 
-void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsigned int size)
+/**
+ * Start writing \a written_memfile, sharing the buffers of all chunks it has in common
+ * with \a reference_memfile (can be NULL), regardless of their position in the file.
+ */
+void memfile_write_init(MemFileWriteData *mem_data, MemFile *written_memfile, MemFile *reference_memfile)
 {
-	static MemFileChunk *compchunk = NULL;
-	MemFileChunk *curchunk;
-	
-	/* this function inits when compare != NULL or when current == NULL  */
-	if (compare) {
-		compchunk = compare->chunks.first;
-		return;
+	mem_data->written_memfile = written_memfile;
+	mem_data->reference_memfile = reference_memfile;
+	mem_data->chunk_hash = NULL;
+	mem_data->next_is_block_start = false;
+
+	if (reference_memfile) {
+		MemFileChunk *chunk;
+
+		mem_data->chunk_hash = BLI_ghash_new_ex(
+		        memfile_chunk_hash, memfile_chunk_cmp, __func__,
+		        (unsigned int)BLI_listbase_count(&reference_memfile->chunks));
+
+		for (chunk = reference_memfile->chunks.first; chunk; chunk = chunk->next) {
+			void **val_p;
+
+			/* for identical chunks within the reference, any of their buffers will do */
+			if (!BLI_ghash_ensure_p(mem_data->chunk_hash, chunk, &val_p)) {
+				*val_p = chunk;
+			}
+		}
 	}
-	if (current == NULL) {
-		compchunk = NULL;
-		return;
+}
+
+void memfile_write_finalize(MemFileWriteData *mem_data)
+{
+	if (mem_data->chunk_hash) {
+		BLI_ghash_free(mem_data->chunk_hash, NULL, NULL);
+		mem_data->chunk_hash = NULL;
 	}
+}
+
+/**
+ * Adds a chunk to a memfile that is never used as reference for other memfiles,
+ * so its contents don't need to be hashed (the hash is zero), see #BLO_write_snapshot_create.
+ */
+void memfile_chunk_add_unhashed(MemFile *memfile, const char *buf, unsigned int size)
+{
+	MemFileChunk *curchunk;
+
+	curchunk = MEM_mallocN(sizeof(MemFileChunk), "MemFileChunk");
+	curchunk->buf = memfile_buffer_new(memfile, buf, size);
+	curchunk->size = size;
+	curchunk->hash = 0;
+	curchunk->is_identical = false;
+	curchunk->is_block_start = false;
+	BLI_addtail(&memfile->chunks, curchunk);
+	memfile->size += sizeof(MemFileChunk) + size;
+}
+
+void memfile_chunk_add(MemFileWriteData *mem_data, const char *buf, unsigned int size)
+{
+	MemFile *memfile = mem_data->written_memfile;
+	MemFileChunk *curchunk;
 	
 	curchunk = MEM_mallocN(sizeof(MemFileChunk), "MemFileChunk");
+	curchunk->buf = buf;
 	curchunk->size = size;
-	curchunk->buf = NULL;
-	curchunk->ident = 0;
-	BLI_addtail(&current->chunks, curchunk);
+	curchunk->hash = BLI_hash_mm2((const unsigned char *)buf, size, 0);
+	curchunk->is_identical = false;
+	curchunk->is_block_start = mem_data->next_is_block_start;
+	mem_data->next_is_block_start = false;
+	BLI_addtail(&memfile->chunks, curchunk);
+	memfile->size += sizeof(MemFileChunk);
 	
-	/* we compare compchunk with buf */
-	if (compchunk) {
-		if (compchunk->size == curchunk->size) {
-			if (my_memcmp((int *)compchunk->buf, (const int *)buf, size / 4) == 0) {
-				curchunk->buf = compchunk->buf;
-				curchunk->ident = 1;
-			}
+	/* look for the same contents anywhere in the reference */
+	if (mem_data->chunk_hash) {
+		MemFileChunk *refchunk = BLI_ghash_lookup(mem_data->chunk_hash, curchunk);
+
+		if (refchunk) {
+			curchunk->buf = refchunk->buf;
+			curchunk->is_identical = true;
+			MEMFILE_BUFFER(curchunk->buf)->users++;
+			return;
 		}
-		compchunk = compchunk->next;
 	}
 	
 	/* not equal... */
-	if (curchunk->buf == NULL) {
-		curchunk->buf = MEM_mallocN(size, "Chunk buffer");
-		memcpy(curchunk->buf, buf, size);
-		current->size += size;
-	}
+	curchunk->buf = memfile_buffer_new(memfile, buf, size);
+	memfile->size += size;
 }
-
@@ -143,6 +143,7 @@
 #include "BLI_blenlib.h"
 #include "BLI_linklist.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 
 #include "BKE_action.h"
 #include "BKE_blender.h"
@@ -189,6 +190,7 @@
 typedef enum {
 	WW_WRAP_NONE = 1,
 	WW_WRAP_ZLIB,
+	WW_WRAP_MEMFILE,
 } eWriteWrapType;
 
 typedef struct WriteWrap WriteWrap;
@@ -201,7 +203,8 @@ struct WriteWrap {
 	/* internal */
 	union {
 		int file_handle;
-		gzFile gz_handle;
+		struct WriteWrapGzip *gz_handle;
+		MemFile *memfile;
 	} _user_data;
 };
 
@@ -233,31 +236,198 @@ static size_t ww_write_none(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
-/* zlib */
+/* zlib, see BLEN_GZIP_BLOCK_SIZE */
+typedef struct WriteWrapGzipBlock {
+	unsigned char *in;
+	unsigned char *out;
+	unsigned int in_len, out_len;
+} WriteWrapGzipBlock;
+
+typedef struct WriteWrapGzip {
+	int file_handle;
+	TaskPool *pool;
+	/* blocks compressed at once, the last one is being filled */
+	WriteWrapGzipBlock *blocks;
+	int blocks_len, blocks_used;
+	bool error;
+} WriteWrapGzip;
+
 #define FILE_HANDLE(ww) \
 	(ww)->_user_data.gz_handle
 
-static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+static void ww_gzip_write_u32(unsigned char *buf, const unsigned int value)
 {
-	gzFile file;
+	buf[0] = (unsigned char)(value & 0xff);
+	buf[1] = (unsigned char)((value >> 8) & 0xff);
+	buf[2] = (unsigned char)((value >> 16) & 0xff);
+	buf[3] = (unsigned char)((value >> 24) & 0xff);
+}
 
-	file = BLI_gzopen(filepath, "wb1");
+static void ww_gzip_block_compress(TaskPool *__restrict UNUSED(pool), void *taskdata, int UNUSED(threadid))
+{
+	WriteWrapGzipBlock *block = taskdata;
+	const unsigned char header[BLEN_GZIP_BLOCK_HEADER_SIZE - 4] = {
+	    0x1f, 0x8b, Z_DEFLATED, 0x04 /* FEXTRA */,
+	    0, 0, 0, 0 /* no modification time */,
+	    0x04 /* fastest compression */, 0xff /* unknown OS */,
+	    8, 0 /* extra field length */,
+	    'B', 'L', 4, 0 /* subfield with the member size */,
+	};
+	unsigned char *out = block->out;
+	z_stream strm = {NULL};
+
+	block->out_len = 0;
+
+	/* raw deflate, header and trailer are written here */
+	if (deflateInit2(&strm, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return;
+	}
+	strm.next_in = block->in;
+	strm.avail_in = block->in_len;
+	strm.next_out = out + BLEN_GZIP_BLOCK_HEADER_SIZE;
+	strm.avail_out = (unsigned int)compressBound(BLEN_GZIP_BLOCK_SIZE);
+
+	if (deflate(&strm, Z_FINISH) == Z_STREAM_END) {
+		const unsigned int member_len =
+		        BLEN_GZIP_BLOCK_HEADER_SIZE + (unsigned int)strm.total_out + BLEN_GZIP_BLOCK_TRAILER_SIZE;
+		unsigned char *trailer = out + BLEN_GZIP_BLOCK_HEADER_SIZE + strm.total_out;
+
+		memcpy(out, header, sizeof(header));
+		ww_gzip_write_u32(out + sizeof(header), member_len);
+		ww_gzip_write_u32(trailer, (unsigned int)crc32(0L, block->in, block->in_len));
+		ww_gzip_write_u32(trailer + 4, block->in_len);
+
+		block->out_len = member_len;
+	}
 
-	if (file != Z_NULL) {
-		FILE_HANDLE(ww) = file;
-		return true;
+	deflateEnd(&strm);
+}
+
+/* compress the filled blocks and write them in order */
+static void ww_gzip_blocks_flush(WriteWrapGzip *gz, const bool include_last)
+{
+	int i, blocks_done = gz->blocks_used;
+
+	if (include_last && gz->blocks[gz->blocks_used].in_len) {
+		BLI_task_pool_push(gz->pool, ww_gzip_block_compress, &gz->blocks[gz->blocks_used], false, TASK_PRIORITY_HIGH);
+		blocks_done++;
 	}
-	else {
+
+	BLI_task_pool_work_and_wait(gz->pool);
+
+	for (i = 0; i < blocks_done; i++) {
+		WriteWrapGzipBlock *block = &gz->blocks[i];
+
+		if (!gz->error) {
+			if (block->out_len == 0 ||
+			    write(gz->file_handle, block->out, block->out_len) != (ssize_t)block->out_len)
+			{
+				gz->error = true;
+			}
+		}
+		block->in_len = 0;
+	}
+
+	gz->blocks_used = 0;
+}
+
+static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+{
+	WriteWrapGzip *gz;
+	TaskScheduler *scheduler;
+	int file, i;
+
+	file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+	if (file == -1) {
 		return false;
 	}
+
+	scheduler = BLI_task_scheduler_get();
+
+	gz = MEM_callocN(sizeof(*gz), __func__);
+	gz->file_handle = file;
+	gz->pool = BLI_task_pool_create(scheduler, NULL);
+	/* enough blocks to keep all threads busy while the next ones are filled */
+	gz->blocks_len = BLI_task_scheduler_num_threads(scheduler) * 2 + 1;
+	gz->blocks = MEM_callocN(sizeof(*gz->blocks) * (size_t)gz->blocks_len, __func__);
+
+	for (i = 0; i < gz->blocks_len; i++) {
+		gz->blocks[i].in = MEM_mallocN(BLEN_GZIP_BLOCK_SIZE, __func__);
+		gz->blocks[i].out = MEM_mallocN(
+		        BLEN_GZIP_BLOCK_HEADER_SIZE + compressBound(BLEN_GZIP_BLOCK_SIZE) + BLEN_GZIP_BLOCK_TRAILER_SIZE,
+		        __func__);
+	}
+
+	FILE_HANDLE(ww) = gz;
+	return true;
 }
 static bool ww_close_zlib(WriteWrap *ww)
 {
-	return (gzclose(FILE_HANDLE(ww)) == Z_OK);
+	WriteWrapGzip *gz = FILE_HANDLE(ww);
+	bool ok;
+	int i;
+
+	ww_gzip_blocks_flush(gz, true);
+
+	ok = !gz->error && (close(gz->file_handle) != -1);
+
+	BLI_task_pool_free(gz->pool);
+	for (i = 0; i < gz->blocks_len; i++) {
+		MEM_freeN(gz->blocks[i].in);
+		MEM_freeN(gz->blocks[i].out);
+	}
+	MEM_freeN(gz->blocks);
+	MEM_freeN(gz);
+
+	return ok;
 }
 static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 {
-	return gzwrite(FILE_HANDLE(ww), buf, buf_len);
+	WriteWrapGzip *gz = FILE_HANDLE(ww);
+	size_t written = 0;
+
+	while (written != buf_len) {
+		WriteWrapGzipBlock *block = &gz->blocks[gz->blocks_used];
+		const size_t len = MIN2(buf_len - written, (size_t)(BLEN_GZIP_BLOCK_SIZE - block->in_len));
+
+		memcpy(block->in + block->in_len, buf + written, len);
+		block->in_len += (unsigned int)len;
+		written += len;
+
+		if (block->in_len == BLEN_GZIP_BLOCK_SIZE) {
+			/* compression starts right away, while the next block is filled */
+			BLI_task_pool_push(gz->pool, ww_gzip_block_compress, block, false, TASK_PRIORITY_HIGH);
+			gz->blocks_used++;
+
+			if (gz->blocks_used == gz->blocks_len - 1) {
+				ww_gzip_blocks_flush(gz, false);
+			}
+		}
+	}
+
+	return gz->error ? 0 : buf_len;
+}
+#undef FILE_HANDLE
+
+/* memfile, keeps all data in memory, see BLO_write_snapshot_create */
+#define FILE_HANDLE(ww) \
+	(ww)->_user_data.memfile
+
+static bool ww_open_memfile(WriteWrap *UNUSED(ww), const char *UNUSED(filepath))
+{
+	return true;
+}
+static bool ww_close_memfile(WriteWrap *UNUSED(ww))
+{
+	return true;
+}
+static size_t ww_write_memfile(WriteWrap *ww, const char *buf, size_t buf_len)
+{
+	/* hashing the chunks would only slow down creating the snapshot, which blocks the UI */
+	memfile_chunk_add_unhashed(FILE_HANDLE(ww), buf, (unsigned int)buf_len);
+
+	return buf_len;
 }
 #undef FILE_HANDLE
 
@@ -275,6 +445,13 @@ static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
 			r_ww->write = ww_write_zlib;
 			break;
 		}
+		case WW_WRAP_MEMFILE:
+		{
+			r_ww->open  = ww_open_memfile;
+			r_ww->close = ww_close_memfile;
+			r_ww->write = ww_write_memfile;
+			break;
+		}
 		default:
 		{
 			r_ww->open  = ww_open_none;
@@ -293,7 +470,9 @@ typedef struct {
 	struct SDNA *sdna;
 
 	unsigned char *buf;
-	MemFile *compare, *current;
+	MemFileWriteData mem;
+	/* Not NULL when writing undo data, same as mem.written_memfile. */
+	MemFile *current;
 	
 	int tot, count, error;
 
@@ -333,7 +512,7 @@ static void writedata_do_write(WriteData *wd, const void *mem, int memlen)
 
 	/* memory based save */
 	if (wd->current) {
-		memfile_chunk_add(NULL, wd->current, mem, memlen);
+		memfile_chunk_add(&wd->mem, mem, memlen);
 	}
 	else {
 		if (wd->ww->write(wd->ww, mem, memlen) != memlen) {
@@ -418,10 +597,10 @@ static WriteData *bgnwrite(WriteWrap *ww, MemFile *compare, MemFile *current)
 
 	if (wd == NULL) return NULL;
 
-	wd->compare= compare;
 	wd->current= current;
-	/* this inits comparing */
-	memfile_chunk_add(compare, NULL, NULL, 0);
+	if (current) {
+		memfile_write_init(&wd->mem, current, compare);
+	}
 	
 	return wd;
 }
@@ -442,6 +621,9 @@ static int endwrite(WriteData *wd)
 	}
 	
 	err= wd->error;
+	if (wd->current) {
+		memfile_write_finalize(&wd->mem);
+	}
 	writedata_free(wd);
 
 	return err;
@@ -449,6 +631,16 @@ static int endwrite(WriteData *wd)
 
 /* ********** WRITE FILE ****************** */
 
+/* start undo chunks at ID blocks, so unchanged ID's can be shared with the previous
+ * undo step wherever they end up in the file, and can be found when reading it */
+static void writeblock_begin(WriteData *wd, int filecode)
+{
+	if (wd->current && filecode != DATA) {
+		mywrite(wd, MYWRITE_FLUSH, 0);
+		wd->mem.next_is_block_start = true;
+	}
+}
+
 static void writestruct_at_address(WriteData *wd, int filecode, const char *structname, int nr, void *adr, void *data)
 {
 	BHead bh;
@@ -472,6 +664,8 @@ static void writestruct_at_address(WriteData *wd, int filecode, const char *stru
 
 	if (bh.len==0) return;
 
+	writeblock_begin(wd, filecode);
+
 	mywrite(wd, &bh, sizeof(BHead));
 	mywrite(wd, data, bh.len);
 }
@@ -498,6 +692,8 @@ static void writedata(WriteData *wd, int filecode, int len, const void *adr)  /*
 	bh.SDNAnr = 0;
 	bh.len    = len;
 
+	writeblock_begin(wd, filecode);
+
 	mywrite(wd, &bh, sizeof(BHead));
 	mywrite(wd, adr, len);
 }
@@ -3779,6 +3975,7 @@ static int write_file_handle(
 	/* end of file */
 	memset(&bhead, 0, sizeof(BHead));
 	bhead.code= ENDB;
+	writeblock_begin(wd, ENDB);
 	mywrite(wd, &bhead, sizeof(BHead));
 
 	blo_join_main(&mainlist);
@@ -3821,36 +4018,16 @@ static bool do_history(const char *name, ReportList *reports)
 	return 0;
 }
 
-/* return: success (1) */
-int BLO_write_file(
-        Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const BlendThumbnail *thumb)
+/* return: success (0), failure (1) */
+static int write_file_main(
+        Main *mainvar, WriteWrap *ww, const char *filepath, int write_flags, const BlendThumbnail *thumb)
 {
-	char tempname[FILE_MAX+1];
 	int err, write_user_block;
-	eWriteWrapType ww_type;
-	WriteWrap ww;
 
 	/* path backup/restore */
 	void     *path_list_backup = NULL;
 	const int path_list_flag = (BKE_BPATH_TRAVERSE_SKIP_LIBRARY | BKE_BPATH_TRAVERSE_SKIP_MULTIFILE);
 
-	/* open temporary file, so we preserve the original in case we crash */
-	BLI_snprintf(tempname, sizeof(tempname), "%s@", filepath);
-
-	if (write_flags & G_FILE_COMPRESS) {
-		ww_type = WW_WRAP_ZLIB;
-	}
-	else {
-		ww_type = WW_WRAP_NONE;
-	}
-
-	ww_handle_init(ww_type, &ww);
-
-	if (ww.open(&ww, tempname) == false) {
-		BKE_reportf(reports, RPT_ERROR, "Cannot open file %s for writing: %s", tempname, strerror(errno));
-		return 0;
-	}
-
 	/* check if we need to backup and restore paths */
 	if (UNLIKELY((write_flags & G_FILE_RELATIVE_REMAP) && (G_FILE_SAVE_COPY & write_flags))) {
 		path_list_backup = BKE_bpath_list_backup(mainvar, path_list_flag);
@@ -3887,22 +4064,19 @@ int BLO_write_file(
 		BKE_bpath_relative_convert(mainvar, filepath, NULL); /* note, making relative to something OTHER then G.main->name */
 
 	/* actual file writing */
-	err = write_file_handle(mainvar, &ww, NULL, NULL, write_user_block, write_flags, thumb);
-
-	ww.close(&ww);
+	err = write_file_handle(mainvar, ww, NULL, NULL, write_user_block, write_flags, thumb);
 
 	if (UNLIKELY(path_list_backup)) {
 		BKE_bpath_list_restore(mainvar, path_list_flag, path_list_backup);
 		BKE_bpath_list_free(path_list_backup);
 	}
 
-	if (err) {
-		BKE_report(reports, RPT_ERROR, strerror(errno));
-		remove(tempname);
-
-		return 0;
-	}
+	return err;
+}
 
+/* move the completely written temporary file in place, return: success (1) */
+static int write_file_finish(const char *tempname, const char *filepath, int write_flags, ReportList *reports)
+{
 	/* file save to temporary file was successful */
 	/* now do reverse file history (move .blend1 -> .blend2, .blend -> .blend1) */
 	if (write_flags & G_FILE_HISTORY) {
@@ -3921,6 +4095,149 @@ int BLO_write_file(
 	return 1;
 }
 
+/* return: success (1) */
+int BLO_write_file(
+        Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const BlendThumbnail *thumb)
+{
+	char tempname[FILE_MAX+1];
+	int err;
+	eWriteWrapType ww_type;
+	WriteWrap ww;
+
+	/* open temporary file, so we preserve the original in case we crash */
+	BLI_snprintf(tempname, sizeof(tempname), "%s@", filepath);
+
+	if (write_flags & G_FILE_COMPRESS) {
+		ww_type = WW_WRAP_ZLIB;
+	}
+	else {
+		ww_type = WW_WRAP_NONE;
+	}
+
+	ww_handle_init(ww_type, &ww);
+
+	if (ww.open(&ww, tempname) == false) {
+		BKE_reportf(reports, RPT_ERROR, "Cannot open file %s for writing: %s", tempname, strerror(errno));
+		return 0;
+	}
+
+	err = write_file_main(mainvar, &ww, filepath, write_flags, thumb);
+
+	/* compressed data may only be written when closing */
+	if (ww.close(&ww) == false) {
+		err = 1;
+	}
+
+	if (err) {
+		BKE_report(reports, RPT_ERROR, strerror(errno));
+		remove(tempname);
+
+		return 0;
+	}
+
+	return write_file_finish(tempname, filepath, write_flags, reports);
+}
+
+/** \name Writing in two steps
+ *
+ * The file is serialized into memory first, which is fast and has to happen while the data
+ * doesn't change. Compressing it and writing it to disk can then run in a background thread.
+ * \{ */
+
+struct BlendWriteSnapshot {
+	MemFile memfile;
+	char filepath[FILE_MAX];
+	int write_flags;
+};
+
+BlendWriteSnapshot *BLO_write_snapshot_create(
+        Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const BlendThumbnail *thumb)
+{
+	BlendWriteSnapshot *snapshot = MEM_callocN(sizeof(*snapshot), __func__);
+	WriteWrap ww;
+	int err;
+
+	BLI_strncpy(snapshot->filepath, filepath, sizeof(snapshot->filepath));
+	snapshot->write_flags = write_flags;
+
+	ww_handle_init(WW_WRAP_MEMFILE, &ww);
+	ww._user_data.memfile = &snapshot->memfile;
+
+	ww.open(&ww, filepath);
+	err = write_file_main(mainvar, &ww, filepath, write_flags, thumb);
+	ww.close(&ww);
+
+	if (err) {
+		BKE_report(reports, RPT_ERROR, "Cannot write file into memory");
+		BLO_write_snapshot_free(snapshot);
+		return NULL;
+	}
+
+	return snapshot;
+}
+
+/**
+ * Writes the snapshot to its file, does not access any other data so it can run in any thread.
+ * \param r_progress: Optional, updated while writing.
+ * \return success (1)
+ */
+int BLO_write_snapshot_flush(BlendWriteSnapshot *snapshot, ReportList *reports, float *r_progress)
+{
+	const int write_flags = snapshot->write_flags;
+	char tempname[FILE_MAX+1];
+	MemFileChunk *chunk;
+	size_t written = 0, size = 0;
+	int err = 0;
+	WriteWrap ww;
+
+	BLI_snprintf(tempname, sizeof(tempname), "%s@", snapshot->filepath);
+
+	/* MemFile.size is the memory used, including chunk overhead */
+	for (chunk = snapshot->memfile.chunks.first; chunk; chunk = chunk->next) {
+		size += chunk->size;
+	}
+
+	ww_handle_init((write_flags & G_FILE_COMPRESS) ? WW_WRAP_ZLIB : WW_WRAP_NONE, &ww);
+
+	if (ww.open(&ww, tempname) == false) {
+		BKE_reportf(reports, RPT_ERROR, "Cannot open file %s for writing: %s", tempname, strerror(errno));
+		return 0;
+	}
+
+	for (chunk = snapshot->memfile.chunks.first; chunk; chunk = chunk->next) {
+		if (ww.write(&ww, chunk->buf, chunk->size) != chunk->size) {
+			err = 1;
+			break;
+		}
+
+		written += chunk->size;
+		if (r_progress) {
+			*r_progress = (float)((double)written / (double)size);
+		}
+	}
+
+	if (ww.close(&ww) == false) {
+		err = 1;
+	}
+
+	if (err) {
+		BKE_report(reports, RPT_ERROR, strerror(errno));
+		remove(tempname);
+
+		return 0;
+	}
+
+	return write_file_finish(tempname, snapshot->filepath, write_flags, reports);
+}
+
+void BLO_write_snapshot_free(BlendWriteSnapshot *snapshot)
+{
+	BLO_memfile_free(&snapshot->memfile);
+	MEM_freeN(snapshot);
+}
+
+/** \} */
+
 /* return: success (1) */
 int BLO_write_file_mem(Main *mainvar, MemFile *compare, MemFile *current, int write_flags)
 {
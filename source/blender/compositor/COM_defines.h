@@ -50,6 +50,20 @@ typedef enum CompositorQuality {
 	COM_QUALITY_LOW    = 2
 } CompositorQuality;
 
+/**
+ * @brief Possible storage types of a MemoryBuffer
+ * @see MemoryProxy.storage
+ * @ingroup Memory
+ */
+typedef enum MemoryBufferStorage {
+	/** @brief 32 bit float per channel */
+	COM_MB_STORAGE_FLOAT = 0,
+	/** @brief 16 bit half float per channel */
+	COM_MB_STORAGE_HALF  = 1,
+	/** @brief 8 bit per channel, only for data in the 0..1 range */
+	COM_MB_STORAGE_BYTE  = 2
+} MemoryBufferStorage;
+
 /**
  * @brief Possible priority settings
  * @ingroup Execution
@@ -22,16 +22,21 @@
 
 #include "COM_CPUDevice.h"
 
+#include "PIL_time.h"
+
 void CPUDevice::execute(WorkPackage *work)
 {
 	const unsigned int chunkNumber = work->getChunkNumber();
 	ExecutionGroup *executionGroup = work->getExecutionGroup();
 	rcti rect;
+	double start = PIL_check_seconds_timer();
 
 	executionGroup->determineChunkRect(&rect, chunkNumber);
 
 	executionGroup->getOutputOperation()->executeRegion(&rect, chunkNumber);
 
+	executionGroup->addChunkExecutionTime(PIL_check_seconds_timer() - start);
+
 	executionGroup->finalizeChunkExecution(chunkNumber, NULL);
 }
 
@@ -82,6 +82,12 @@ private:
 	 */
 	bool m_fastCalculation;
 
+	/**
+	 * @brief the graph is evaluated at the resolution of the inputs divided by this number.
+	 * Used for the low resolution pass of progressive compositing, 1 for full resolution.
+	 */
+	int m_resolutionDivider;
+
 	/* @brief color management settings */
 	const ColorManagedViewSettings *m_viewSettings;
 	const ColorManagedDisplaySettings *m_displaySettings;
@@ -199,6 +205,8 @@ public:
 	
 	void setFastCalculation(bool fastCalculation) {this->m_fastCalculation = fastCalculation;}
 	bool isFastCalculation() const { return this->m_fastCalculation; }
+	void setResolutionDivider(int resolutionDivider) { this->m_resolutionDivider = resolutionDivider; }
+	int getResolutionDivider() const { return this->m_resolutionDivider; }
 	bool isGroupnodeBufferEnabled() const { return (this->getbNodeTree()->flag & NTREE_COM_GROUPNODE_BUFFER) != 0; }
 };
 
@@ -63,6 +63,7 @@ ExecutionGroup::ExecutionGroup()
 	this->m_chunksFinished = 0;
 	BLI_rcti_init(&this->m_viewerBorder, 0, 0, 0, 0);
 	this->m_executionStartTime = 0;
+	this->m_chunkExecutionTime = 0;
 }
 
 CompositorPriority ExecutionGroup::getRenderPriotrity()
@@ -410,6 +411,11 @@ void ExecutionGroup::finalizeChunkExecution(int chunkNumber, MemoryBuffer **memo
 	}
 }
 
+void ExecutionGroup::addChunkExecutionTime(double time)
+{
+	atomic_add_uint64(&this->m_chunkExecutionTime, (uint64_t)(time * 1e6));
+}
+
 inline void ExecutionGroup::determineChunkRect(rcti *rect, const unsigned int xChunk, const unsigned int yChunk) const
 {
 	const int border_width = BLI_rcti_size_x(&this->m_viewerBorder);
@@ -27,6 +27,7 @@
 #include "COM_NodeOperation.h"
 #include <vector>
 #include "BLI_rect.h"
+#include "BLI_sys_types.h"
 #include "COM_MemoryProxy.h"
 #include "COM_Device.h"
 #include "COM_CompositorContext.h"
@@ -178,6 +179,12 @@ private:
 	 */
 	double m_executionStartTime;
 
+	/**
+	 * @brief summed execution time of the chunks of this ExecutionGroup in microseconds.
+	 * chunks are executed in parallel, so this can be larger than the wall time.
+	 */
+	uint64_t m_chunkExecutionTime;
+
 	// methods
 	/**
 	 * @brief check whether parameter operation can be added to the execution group
@@ -352,6 +359,28 @@ public:
 	 * @param memorybuffers
 	 */
 	void finalizeChunkExecution(int chunkNumber, MemoryBuffer **memoryBuffers);
+
+	/**
+	 * @brief add the time a device spent on executing a chunk of this ExecutionGroup
+	 * @note can be called from multiple threads
+	 * @param time execution time in seconds
+	 */
+	void addChunkExecutionTime(double time);
+
+	/**
+	 * @brief get the summed execution time of all executed chunks in seconds
+	 */
+	double getChunkExecutionTime() const { return this->m_chunkExecutionTime * 1e-6; }
+
+	/**
+	 * @brief get the number of chunks that have been executed
+	 */
+	unsigned int getNumberOfChunksFinished() const { return this->m_chunksFinished; }
+
+	/**
+	 * @brief get the operations of this ExecutionGroup
+	 */
+	const Operations &getOperations() const { return this->m_operations; }
 	
 	/**
 	 * @brief deinitExecution is called just after execution the whole graph.
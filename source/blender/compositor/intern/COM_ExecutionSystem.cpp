@@ -36,6 +36,7 @@ extern "C" {
 #include "COM_ExecutionGroup.h"
 #include "COM_WorkScheduler.h"
 #include "COM_ReadBufferOperation.h"
+#include "COM_WriteBufferOperation.h"
 #include "COM_Debug.h"
 
 #ifdef WITH_CXX_GUARDEDALLOC
@@ -44,13 +45,14 @@ extern "C" {
 
 ExecutionSystem::ExecutionSystem(RenderData *rd, Scene *scene, bNodeTree *editingtree, bool rendering, bool fastcalculation,
                                  const ColorManagedViewSettings *viewSettings, const ColorManagedDisplaySettings *displaySettings,
-                                 const char *viewName)
+                                 const char *viewName, int resolutionDivider)
 {
 	this->m_context.setViewName(viewName);
 	this->m_context.setScene(scene);
 	this->m_context.setbNodeTree(editingtree);
 	this->m_context.setPreviewHash(editingtree->previews);
 	this->m_context.setFastCalculation(fastcalculation);
+	this->m_context.setResolutionDivider(resolutionDivider);
 	/* initialize the CompositorContext */
 	if (rendering) {
 		this->m_context.setQuality((CompositorQuality)editingtree->render_quality);
@@ -185,6 +187,8 @@ void ExecutionSystem::execute()
 	WorkScheduler::finish();
 	WorkScheduler::stop();
 
+	updateNodeStatistics();
+
 	editingtree->stats_draw(editingtree->sdh, IFACE_("Compositing | De-initializing execution"));
 	for (index = 0; index < this->m_operations.size(); index++) {
 		NodeOperation *operation = this->m_operations[index];
@@ -208,6 +212,50 @@ void ExecutionSystem::executeGroups(CompositorPriority priority)
 	}
 }
 
+void ExecutionSystem::updateNodeStatistics()
+{
+	unsigned int index;
+
+	/* clear results of the previous execution, operations can belong to nodes inside node groups */
+	for (bNode *node = (bNode *)this->m_context.getbNodeTree()->nodes.first; node; node = node->next) {
+		node->exec_chunks = 0;
+		node->exec_time = 0.0f;
+		node->exec_memory = 0;
+	}
+	for (index = 0; index < this->m_operations.size(); index++) {
+		bNode *node = this->m_operations[index]->getbNode();
+		if (node) {
+			node->exec_chunks = 0;
+			node->exec_time = 0.0f;
+			node->exec_memory = 0;
+		}
+	}
+
+	/* operations of a group are evaluated together per pixel, so the time spent in a single
+	 * operation can not be measured. The summed thread time of a group is only reported once,
+	 * for the node of its output operation, nodes evaluated inside the groups of other nodes
+	 * have no statistics of their own. Complex operations always are the only one in their group.
+	 */
+	for (index = 0; index < this->m_groups.size(); index++) {
+		ExecutionGroup *group = this->m_groups[index];
+		bNode *node = group->getOutputOperation()->getbNode();
+
+		if (node) {
+			node->exec_time += 1000.0f * group->getChunkExecutionTime();
+			node->exec_chunks += group->getNumberOfChunksFinished();
+		}
+	}
+
+	for (index = 0; index < this->m_operations.size(); index++) {
+		NodeOperation *operation = this->m_operations[index];
+		if (operation->isWriteBufferOperation() && operation->getbNode()) {
+			MemoryBuffer *buffer = ((WriteBufferOperation *)operation)->getMemoryProxy()->getBuffer();
+			if (buffer)
+				operation->getbNode()->exec_memory += buffer->getMemorySize() / 1024;
+		}
+	}
+}
+
 void ExecutionSystem::findOutputExecutionGroup(vector<ExecutionGroup *> *result, CompositorPriority priority) const
 {
 	unsigned int index;
@@ -149,10 +149,11 @@ public:
 	 *
 	 * @param editingtree [bNodeTree *]
 	 * @param rendering [true false]
+	 * @param resolutionDivider evaluate the graph at the input resolution divided by this number
 	 */
 	ExecutionSystem(RenderData *rd, Scene *scene, bNodeTree *editingtree, bool rendering, bool fastcalculation,
 	                const ColorManagedViewSettings *viewSettings, const ColorManagedDisplaySettings *displaySettings,
-	                const char *viewName);
+	                const char *viewName, int resolutionDivider = 1);
 
 	/**
 	 * Destructor
@@ -177,6 +178,13 @@ public:
 private:
 	void executeGroups(CompositorPriority priority);
 
+	/**
+	 * @brief store the execution time, number of chunks and buffer memory of the
+	 * ExecutionGroup's in the bNode's the operations were created for.
+	 * @note needs to be called before the operations are deinitialized
+	 */
+	void updateNodeStatistics();
+
 	/* allow the DebugInfo class to look at internals */
 	friend class DebugInfo;
 
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2015, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor:
+ *		Jeroen Bakker
+ *		Monique Dewanchand
+ */
+
+#include "COM_FFTConvolution.h"
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#  include "BLI_task.h"
+#  include "BLI_threads.h"
+}
+
+#ifdef WITH_FFTW3
+typedef double fREAL;
+#else
+typedef float fREAL;
+#endif
+
+// returns next highest power of 2 of x, as well it's log2 in L2
+static unsigned int nextPow2(unsigned int x, unsigned int *L2)
+{
+	unsigned int pw, x_notpow2 = x & (x - 1);
+	*L2 = 0;
+	while (x >>= 1) ++(*L2);
+	pw = 1 << (*L2);
+	if (x_notpow2) { (*L2)++;  pw <<= 1; }
+	return pw;
+}
+
+#ifndef WITH_FFTW3
+
+/*
+ *  2D Fast Hartley Transform, used for convolution when FFTW is not available
+ */
+
+//------------------------------------------------------------------------------
+
+// from FXT library by Joerg Arndt, faster in order bitreversal
+// use: r = revbin_upd(r, h) where h = N>>1
+static unsigned int revbin_upd(unsigned int r, unsigned int h)
+{
+	while (!((r ^= h) & h)) h >>= 1;
+	return r;
+}
+//------------------------------------------------------------------------------
+static void FHT(fREAL *data, unsigned int M, unsigned int inverse)
+{
+	double tt, fc, dc, fs, ds, a = M_PI;
+	fREAL t1, t2;
+	int n2, bd, bl, istep, k, len = 1 << M, n = 1;
+
+	int i, j = 0;
+	unsigned int Nh = len >> 1;
+	for (i = 1; i < (len - 1); ++i) {
+		j = revbin_upd(j, Nh);
+		if (j > i) {
+			t1 = data[i];
+			data[i] = data[j];
+			data[j] = t1;
+		}
+	}
+
+	do {
+		fREAL *data_n = &data[n];
+
+		istep = n << 1;
+		for (k = 0; k < len; k += istep) {
+			t1 = data_n[k];
+			data_n[k] = data[k] - t1;
+			data[k] += t1;
+		}
+
+		n2 = n >> 1;
+		if (n > 2) {
+			fc = dc = cos(a);
+			fs = ds = sqrt(1.0 - fc * fc); //sin(a);
+			bd = n - 2;
+			for (bl = 1; bl < n2; bl++) {
+				fREAL *data_nbd = &data_n[bd];
+				fREAL *data_bd = &data[bd];
+				for (k = bl; k < len; k += istep) {
+					t1 = fc * (double)data_n[k] + fs * (double)data_nbd[k];
+					t2 = fs * (double)data_n[k] - fc * (double)data_nbd[k];
+					data_n[k] = data[k] - t1;
+					data_nbd[k] = data_bd[k] - t2;
+					data[k] += t1;
+					data_bd[k] += t2;
+				}
+				tt = fc * dc - fs * ds;
+				fs = fs * dc + fc * ds;
+				fc = tt;
+				bd -= 2;
+			}
+		}
+
+		if (n > 1) {
+			for (k = n2; k < len; k += istep) {
+				t1 = data_n[k];
+				data_n[k] = data[k] - t1;
+				data[k] += t1;
+			}
+		}
+
+		n = istep;
+		a *= 0.5;
+	} while (n < len);
+
+	if (inverse) {
+		fREAL sc = (fREAL)1 / (fREAL)len;
+		for (k = 0; k < len; ++k)
+			data[k] *= sc;
+	}
+}
+//------------------------------------------------------------------------------
+/* 2D Fast Hartley Transform, Mx/My -> log2 of width/height,
+ * nzp -> the row where zero pad data starts,
+ * inverse -> see above */
+static void FHT2D(fREAL *data, unsigned int Mx, unsigned int My,
+                  unsigned int nzp, unsigned int inverse)
+{
+	unsigned int i, j, Nx, Ny, maxy;
+	fREAL t;
+
+	Nx = 1 << Mx;
+	Ny = 1 << My;
+
+	// rows (forward transform skips 0 pad data)
+	maxy = inverse ? Ny : nzp;
+	for (j = 0; j < maxy; ++j)
+		FHT(&data[Nx * j], Mx, inverse);
+
+	// transpose data
+	if (Nx == Ny) {  // square
+		for (j = 0; j < Ny; ++j)
+			for (i = j + 1; i < Nx; ++i) {
+				unsigned int op = i + (j << Mx), np = j + (i << My);
+				t = data[op], data[op] = data[np], data[np] = t;
+			}
+	}
+	else {  // rectangular
+		unsigned int k, Nym = Ny - 1, stm = 1 << (Mx + My);
+		for (i = 0; stm > 0; i++) {
+#define PRED(k) (((k & Nym) << Mx) + (k >> My))
+			for (j = PRED(i); j > i; j = PRED(j)) ;
+			if (j < i) continue;
+			for (k = i, j = PRED(i); j != i; k = j, j = PRED(j), stm--) {
+				t = data[j], data[j] = data[k], data[k] = t;
+			}
+#undef PRED
+			stm--;
+		}
+	}
+	// swap Mx/My & Nx/Ny
+	i = Nx, Nx = Ny, Ny = i;
+	i = Mx, Mx = My, My = i;
+
+	// now columns == transposed rows
+	for (j = 0; j < Ny; ++j)
+		FHT(&data[Nx * j], Mx, inverse);
+
+	// finalize
+	for (j = 0; j <= (Ny >> 1); j++) {
+		unsigned int jm = (Ny - j) & (Ny - 1);
+		unsigned int ji = j << Mx;
+		unsigned int jmi = jm << Mx;
+		for (i = 0; i <= (Nx >> 1); i++) {
+			unsigned int im = (Nx - i) & (Nx - 1);
+			fREAL A = data[ji + i];
+			fREAL B = data[jmi + i];
+			fREAL C = data[ji + im];
+			fREAL D = data[jmi + im];
+			fREAL E = (fREAL)0.5 * ((A + D) - (B + C));
+			data[ji + i] = A - E;
+			data[jmi + i] = B + E;
+			data[ji + im] = C + E;
+			data[jmi + im] = D - E;
+		}
+	}
+
+}
+
+//------------------------------------------------------------------------------
+
+/* 2D convolution calc, d1 *= d2, M/N - > log2 of width/height */
+static void fht_convolve(fREAL *d1, fREAL *d2, unsigned int M, unsigned int N)
+{
+	fREAL a, b;
+	unsigned int i, j, k, L, mj, mL;
+	unsigned int m = 1 << M, n = 1 << N;
+	unsigned int m2 = 1 << (M - 1), n2 = 1 << (N - 1);
+	unsigned int mn2 = m << (N - 1);
+
+	d1[0] *= d2[0];
+	d1[mn2] *= d2[mn2];
+	d1[m2] *= d2[m2];
+	d1[m2 + mn2] *= d2[m2 + mn2];
+	for (i = 1; i < m2; i++) {
+		k = m - i;
+		a = d1[i] * d2[i] - d1[k] * d2[k];
+		b = d1[k] * d2[i] + d1[i] * d2[k];
+		d1[i] = (b + a) * (fREAL)0.5;
+		d1[k] = (b - a) * (fREAL)0.5;
+		a = d1[i + mn2] * d2[i + mn2] - d1[k + mn2] * d2[k + mn2];
+		b = d1[k + mn2] * d2[i + mn2] + d1[i + mn2] * d2[k + mn2];
+		d1[i + mn2] = (b + a) * (fREAL)0.5;
+		d1[k + mn2] = (b - a) * (fREAL)0.5;
+	}
+	for (j = 1; j < n2; j++) {
+		L = n - j;
+		mj = j << M;
+		mL = L << M;
+		a = d1[mj] * d2[mj] - d1[mL] * d2[mL];
+		b = d1[mL] * d2[mj] + d1[mj] * d2[mL];
+		d1[mj] = (b + a) * (fREAL)0.5;
+		d1[mL] = (b - a) * (fREAL)0.5;
+		a = d1[m2 + mj] * d2[m2 + mj] - d1[m2 + mL] * d2[m2 + mL];
+		b = d1[m2 + mL] * d2[m2 + mj] + d1[m2 + mj] * d2[m2 + mL];
+		d1[m2 + mj] = (b + a) * (fREAL)0.5;
+		d1[m2 + mL] = (b - a) * (fREAL)0.5;
+	}
+	for (i = 1; i < m2; i++) {
+		k = m - i;
+		for (j = 1; j < n2; j++) {
+			L = n - j;
+			mj = j << M;
+			mL = L << M;
+			a = d1[i + mj] * d2[i + mj] - d1[k + mL] * d2[k + mL];
+			b = d1[k + mL] * d2[i + mj] + d1[i + mj] * d2[k + mL];
+			d1[i + mj] = (b + a) * (fREAL)0.5;
+			d1[k + mL] = (b - a) * (fREAL)0.5;
+			a = d1[i + mL] * d2[i + mL] - d1[k + mj] * d2[k + mj];
+			b = d1[k + mj] * d2[i + mL] + d1[i + mL] * d2[k + mj];
+			d1[i + mL] = (b + a) * (fREAL)0.5;
+			d1[k + mj] = (b - a) * (fREAL)0.5;
+		}
+	}
+}
+
+#endif  /* WITH_FFTW3 */
+
+//------------------------------------------------------------------------------
+
+typedef struct FFTConvolveTaskData {
+	const FFTConvolution *convolution;
+	float *dst;
+	MemoryBuffer *image;
+	/* blocks of one pass have the same parity of their coordinates */
+	int passX;
+	int passY;
+	int numPassBlocksX;
+} FFTConvolveTaskData;
+
+FFTConvolution::FFTConvolution(MemoryBuffer *kernel, int numChannels)
+{
+	const float *kernelBuffer = kernel->getBuffer();
+	unsigned int x, y;
+	int ch;
+
+	BLI_assert(kernel->get_num_channels() == COM_NUM_CHANNELS_COLOR);
+	BLI_assert(numChannels > 0 && numChannels <= COM_NUM_CHANNELS_COLOR);
+
+	this->m_kernelWidth = kernel->getWidth();
+	this->m_kernelHeight = kernel->getHeight();
+	this->m_numChannels = numChannels;
+
+	// convolution result (2 * size - 1) as FFT pow2 required size & log2,
+	// 2 * size gives the same result but is never smaller than 2
+	this->m_width = nextPow2(2 * this->m_kernelWidth, &this->m_log2Width);
+	this->m_height = nextPow2(2 * this->m_kernelHeight, &this->m_log2Height);
+
+	// block add-overlap
+	this->m_blockWidth = (this->m_width + 1) - this->m_kernelWidth;
+	this->m_blockHeight = (this->m_height + 1) - this->m_kernelHeight;
+
+	for (ch = 0; ch < COM_NUM_CHANNELS_COLOR; ch++) {
+		this->m_kernelSpectrum[ch] = NULL;
+	}
+
+#ifdef WITH_FFTW3
+	const unsigned int spectrumSize = this->m_height * (this->m_width / 2 + 1);
+	// fold the scaling of the inverse transform into the kernel
+	const double scale = 1.0 / (double)(this->m_width * this->m_height);
+	fREAL *data = (fREAL *)fftw_malloc(sizeof(fREAL) * this->m_width * this->m_height);
+	fftw_complex *spectrum = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * spectrumSize);
+
+	// planning is not thread safe, executing plans on other (aligned) arrays is
+	BLI_lock_thread(LOCK_FFTW);
+	this->m_forwardPlan = fftw_plan_dft_r2c_2d(this->m_height, this->m_width, data, spectrum, FFTW_ESTIMATE);
+	this->m_inversePlan = fftw_plan_dft_c2r_2d(this->m_height, this->m_width, spectrum, data, FFTW_ESTIMATE);
+	BLI_unlock_thread(LOCK_FFTW);
+
+	for (ch = 0; ch < numChannels; ch++) {
+		memset(data, 0, sizeof(fREAL) * this->m_width * this->m_height);
+		for (y = 0; y < this->m_kernelHeight; y++) {
+			const float *colp = &kernelBuffer[(y * this->m_kernelWidth) * COM_NUM_CHANNELS_COLOR + ch];
+			fREAL *fp = &data[y * this->m_width];
+			for (x = 0; x < this->m_kernelWidth; x++)
+				fp[x] = colp[x * COM_NUM_CHANNELS_COLOR] * scale;
+		}
+		this->m_kernelSpectrum[ch] = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * spectrumSize);
+		fftw_execute_dft_r2c(this->m_forwardPlan, data, this->m_kernelSpectrum[ch]);
+	}
+
+	fftw_free(spectrum);
+	fftw_free(data);
+#else
+	for (ch = 0; ch < numChannels; ch++) {
+		fREAL *data = (fREAL *)MEM_callocN(sizeof(fREAL) * this->m_width * this->m_height,
+		                                   "FFTConvolution kernel spectrum");
+		for (y = 0; y < this->m_kernelHeight; y++) {
+			const float *colp = &kernelBuffer[(y * this->m_kernelWidth) * COM_NUM_CHANNELS_COLOR + ch];
+			fREAL *fp = &data[y * this->m_width];
+			for (x = 0; x < this->m_kernelWidth; x++)
+				fp[x] = colp[x * COM_NUM_CHANNELS_COLOR];
+		}
+		// zero pad data starts after the kernel
+		FHT2D(data, this->m_log2Width, this->m_log2Height, this->m_kernelHeight, 0);
+		this->m_kernelSpectrum[ch] = data;
+	}
+#endif
+}
+
+FFTConvolution::~FFTConvolution()
+{
+	int ch;
+
+	for (ch = 0; ch < this->m_numChannels; ch++) {
+#ifdef WITH_FFTW3
+		fftw_free(this->m_kernelSpectrum[ch]);
+#else
+		MEM_freeN(this->m_kernelSpectrum[ch]);
+#endif
+	}
+
+#ifdef WITH_FFTW3
+	BLI_lock_thread(LOCK_FFTW);
+	fftw_destroy_plan(this->m_forwardPlan);
+	fftw_destroy_plan(this->m_inversePlan);
+	BLI_unlock_thread(LOCK_FFTW);
+#endif
+}
+
+void FFTConvolution::convolveBlock(float *dst, MemoryBuffer *image, int channel, int blockX, int blockY) const
+{
+	const float *imageBuffer = image->getBuffer();
+	const int imageWidth = image->getWidth();
+	const int imageHeight = image->getHeight();
+	const int offsetX = blockX * this->m_blockWidth;
+	const int offsetY = blockY * this->m_blockHeight;
+	const int blockWidth = min_ii(this->m_blockWidth, imageWidth - offsetX);
+	const int blockHeight = min_ii(this->m_blockHeight, imageHeight - offsetY);
+	const int hw = this->m_kernelWidth >> 1;
+	const int hh = this->m_kernelHeight >> 1;
+	fREAL *data, *fp;
+	int x, y;
+
+#ifdef WITH_FFTW3
+	data = (fREAL *)fftw_malloc(sizeof(fREAL) * this->m_width * this->m_height);
+#else
+	data = (fREAL *)MEM_mallocN(sizeof(fREAL) * this->m_width * this->m_height, "FFTConvolution block");
+#endif
+
+	// image block, channel -> data
+	memset(data, 0, sizeof(fREAL) * this->m_width * this->m_height);
+	for (y = 0; y < blockHeight; y++) {
+		const float *colp = &imageBuffer[((offsetY + y) * imageWidth + offsetX) * COM_NUM_CHANNELS_COLOR + channel];
+		fp = &data[y * this->m_width];
+		for (x = 0; x < blockWidth; x++)
+			fp[x] = colp[x * COM_NUM_CHANNELS_COLOR];
+	}
+
+#ifdef WITH_FFTW3
+	const unsigned int spectrumSize = this->m_height * (this->m_width / 2 + 1);
+	const fftw_complex *kernelSpectrum = this->m_kernelSpectrum[channel];
+	fftw_complex *spectrum = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * spectrumSize);
+	unsigned int i;
+
+	fftw_execute_dft_r2c(this->m_forwardPlan, data, spectrum);
+	for (i = 0; i < spectrumSize; i++) {
+		const double re = spectrum[i][0] * kernelSpectrum[i][0] - spectrum[i][1] * kernelSpectrum[i][1];
+		const double im = spectrum[i][0] * kernelSpectrum[i][1] + spectrum[i][1] * kernelSpectrum[i][0];
+		spectrum[i][0] = re;
+		spectrum[i][1] = im;
+	}
+	fftw_execute_dft_c2r(this->m_inversePlan, spectrum, data);
+	fftw_free(spectrum);
+#else
+	// forward FHT, zero pad data starts after the block
+	FHT2D(data, this->m_log2Width, this->m_log2Height, blockHeight, 0);
+
+	// FHT2D transposed data, row/col now swapped
+	// convolve & inverse FHT
+	fht_convolve(data, this->m_kernelSpectrum[channel], this->m_log2Height, this->m_log2Width);
+	FHT2D(data, this->m_log2Height, this->m_log2Width, 0, 1);
+	// data again transposed, so in order again
+#endif
+
+	// overlap-add result
+	for (y = 0; y < (int)this->m_height; y++) {
+		const int yy = offsetY + y - hh;
+		if ((yy < 0) || (yy >= imageHeight)) continue;
+		float *colp = &dst[(yy * imageWidth) * COM_NUM_CHANNELS_COLOR + channel];
+		fp = &data[y * this->m_width];
+		for (x = 0; x < (int)this->m_width; x++) {
+			const int xx = offsetX + x - hw;
+			if ((xx < 0) || (xx >= imageWidth)) continue;
+			colp[xx * COM_NUM_CHANNELS_COLOR] += fp[x];
+		}
+	}
+
+#ifdef WITH_FFTW3
+	fftw_free(data);
+#else
+	MEM_freeN(data);
+#endif
+}
+
+void FFTConvolution::convolveBlockTask(void *userdata, void * /*userdata_chunk*/, int iter)
+{
+	FFTConvolveTaskData *data = (FFTConvolveTaskData *)userdata;
+	const FFTConvolution *convolution = data->convolution;
+	const int channel = iter % convolution->m_numChannels;
+	const int block = iter / convolution->m_numChannels;
+	const int blockX = 2 * (block % data->numPassBlocksX) + data->passX;
+	const int blockY = 2 * (block / data->numPassBlocksX) + data->passY;
+
+	convolution->convolveBlock(data->dst, data->image, channel, blockX, blockY);
+}
+
+void FFTConvolution::convolve(float *dst, MemoryBuffer *image) const
+{
+	const int numBlocksX = (image->getWidth() + this->m_blockWidth - 1) / this->m_blockWidth;
+	const int numBlocksY = (image->getHeight() + this->m_blockHeight - 1) / this->m_blockHeight;
+	FFTConvolveTaskData data;
+
+	BLI_assert(image->get_num_channels() == COM_NUM_CHANNELS_COLOR);
+
+	data.convolution = this;
+	data.dst = dst;
+	data.image = image;
+
+	/* The result of a block spreads into its direct neighbors only (the transform size is at most twice
+	 * the block size), so blocks with the same parity of their coordinates never write to the same pixels
+	 * and can be done in parallel. Channels are independent as well. */
+	for (data.passY = 0; data.passY < 2; data.passY++) {
+		for (data.passX = 0; data.passX < 2; data.passX++) {
+			const int numPassBlocksY = (numBlocksY - data.passY + 1) / 2;
+			const int numTasks = ((numBlocksX - data.passX + 1) / 2) * numPassBlocksY * this->m_numChannels;
+
+			if (numTasks == 0) {
+				continue;
+			}
+
+			data.numPassBlocksX = (numBlocksX - data.passX + 1) / 2;
+			BLI_task_parallel_range_ex(0, numTasks, &data, NULL, 0, convolveBlockTask, numTasks > 1, false);
+		}
+	}
+}
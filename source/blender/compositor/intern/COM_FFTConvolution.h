@@ -0,0 +1,97 @@
+/*
+ * Copyright 2015, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor:
+ *		Jeroen Bakker
+ *		Monique Dewanchand
+ */
+
+#ifndef _COM_FFTConvolution_h
+#define _COM_FFTConvolution_h
+
+#include "COM_MemoryBuffer.h"
+
+#ifdef WITH_FFTW3
+#  include "fftw3.h"
+#endif
+
+/**
+ * @brief Convolution of color buffers with a fixed kernel in the frequency domain.
+ *
+ * The spectrum of the kernel is calculated once when constructing, convolve() then splits the image
+ * in blocks that are transformed, multiplied with the kernel spectrum and transformed back (overlap-add).
+ * Blocks are processed in parallel by the BLI_task scheduler.
+ *
+ * When compiled with FFTW3 the transforms are done by FFTW, otherwise a 2D Fast Hartley Transform is used.
+ * Cost per pixel depends on the log2 of the block size instead of the kernel area,
+ * so this is only worth it for large kernels.
+ */
+class FFTConvolution {
+private:
+	/**
+	 * @brief size of the kernel, the kernel center is at (width / 2, height / 2)
+	 */
+	unsigned int m_kernelWidth;
+	unsigned int m_kernelHeight;
+
+	/**
+	 * @brief size of the transform (power of 2) and its log2
+	 */
+	unsigned int m_width;
+	unsigned int m_height;
+	unsigned int m_log2Width;
+	unsigned int m_log2Height;
+
+	/**
+	 * @brief number of image pixels per block in each direction
+	 */
+	unsigned int m_blockWidth;
+	unsigned int m_blockHeight;
+
+	/**
+	 * @brief number of channels to convolve, starting at the first channel
+	 */
+	int m_numChannels;
+
+#ifdef WITH_FFTW3
+	fftw_complex *m_kernelSpectrum[COM_NUM_CHANNELS_COLOR];
+	fftw_plan m_forwardPlan;
+	fftw_plan m_inversePlan;
+#else
+	float *m_kernelSpectrum[COM_NUM_CHANNELS_COLOR];
+#endif
+
+	static void convolveBlockTask(void *userdata, void *userdata_chunk, int iter);
+	void convolveBlock(float *dst, MemoryBuffer *image, int channel, int blockX, int blockY) const;
+
+public:
+	/**
+	 * @brief create a convolution for the first numChannels channels of a COM_DT_COLOR kernel buffer
+	 * @note the kernel is not normalized, callers have to do this when needed
+	 */
+	FFTConvolution(MemoryBuffer *kernel, int numChannels);
+	~FFTConvolution();
+
+	/**
+	 * @brief convolve a COM_DT_COLOR image
+	 * @param dst: output with the same size as image, the convolved channels are added to it
+	 * so it should be cleared by the caller.
+	 */
+	void convolve(float *dst, MemoryBuffer *image) const;
+};
+
+#endif
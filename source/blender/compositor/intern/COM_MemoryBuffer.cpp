@@ -40,11 +40,103 @@ static unsigned int determine_num_channels(DataType datatype)
 	}
 }
 
+/* half float conversion, rounding to nearest, out of range values become infinite */
+static unsigned short float_to_half(float value)
+{
+	union { float f; unsigned int i; } u;
+	u.f = value;
+	const unsigned int sign = (u.i >> 16) & 0x8000;
+	const unsigned int float_exponent = (u.i >> 23) & 0xff;
+	const int exponent = (int)float_exponent - 127 + 15;
+	unsigned int mantissa = u.i & 0x007fffff;
+
+	if (float_exponent == 0xff) {
+		/* infinity and NaN */
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+	else if (exponent >= 0x1f) {
+		return sign | 0x7c00;
+	}
+	else if (exponent <= 0) {
+		/* denormal or zero */
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x00800000;
+		const int shift = 14 - exponent;
+		unsigned int half_mantissa = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) {
+			half_mantissa++;
+		}
+		return sign | half_mantissa;
+	}
+	else {
+		unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+		/* rounding may carry into the exponent, which is the correct result */
+		if (mantissa & 0x00001000) {
+			half++;
+		}
+		return half;
+	}
+}
+
+static float half_to_float(unsigned short half)
+{
+	union { float f; unsigned int i; } u;
+	const unsigned int sign = (half & 0x8000) << 16;
+	const unsigned int exponent = (half >> 10) & 0x1f;
+	const unsigned int mantissa = half & 0x3ff;
+
+	if (exponent == 0) {
+		/* denormal or zero */
+		u.f = mantissa * (1.0f / 16777216.0f);
+		u.i |= sign;
+	}
+	else if (exponent == 0x1f) {
+		u.i = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else {
+		u.i = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	return u.f;
+}
+
+static size_t determine_storage_size(MemoryBufferStorage storage)
+{
+	switch (storage) {
+		case COM_MB_STORAGE_HALF:
+			return sizeof(unsigned short);
+		case COM_MB_STORAGE_BYTE:
+			return sizeof(unsigned char);
+		case COM_MB_STORAGE_FLOAT:
+		default:
+			return sizeof(float);
+	}
+}
+
 unsigned int MemoryBuffer::determineBufferSize()
 {
 	return getWidth() * getHeight();
 }
 
+void MemoryBuffer::allocateBuffer()
+{
+	const size_t size = determine_storage_size(this->m_storage) * determineBufferSize() * this->m_num_channels;
+	if (this->m_storage == COM_MB_STORAGE_FLOAT) {
+		this->m_buffer = (float *)MEM_mallocN_aligned(size, 16, "COM_MemoryBuffer");
+		this->m_packedBuffer = NULL;
+	}
+	else {
+		this->m_buffer = NULL;
+		this->m_packedBuffer = MEM_mallocN_aligned(size, 16, "COM_MemoryBuffer packed");
+	}
+}
+
+size_t MemoryBuffer::getMemorySize() const
+{
+	return determine_storage_size(this->m_storage) * this->m_width * this->m_height * this->m_num_channels;
+}
+
 int MemoryBuffer::getWidth() const
 {
 	return this->m_width;
@@ -62,7 +154,8 @@ MemoryBuffer::MemoryBuffer(MemoryProxy *memoryProxy, unsigned int chunkNumber, r
 	this->m_memoryProxy = memoryProxy;
 	this->m_chunkNumber = chunkNumber;
 	this->m_num_channels = determine_num_channels(memoryProxy->getDataType());
-	this->m_buffer = (float *)MEM_mallocN_aligned(sizeof(float) * determineBufferSize() * this->m_num_channels, 16, "COM_MemoryBuffer");
+	this->m_storage = memoryProxy->getStorage();
+	allocateBuffer();
 	this->m_state = COM_MB_ALLOCATED;
 	this->m_datatype = memoryProxy->getDataType();
 }
@@ -75,7 +168,8 @@ MemoryBuffer::MemoryBuffer(MemoryProxy *memoryProxy, rcti *rect)
 	this->m_memoryProxy = memoryProxy;
 	this->m_chunkNumber = -1;
 	this->m_num_channels = determine_num_channels(memoryProxy->getDataType());
-	this->m_buffer = (float *)MEM_mallocN_aligned(sizeof(float) * determineBufferSize() * this->m_num_channels, 16, "COM_MemoryBuffer");
+	this->m_storage = COM_MB_STORAGE_FLOAT;
+	allocateBuffer();
 	this->m_state = COM_MB_TEMPORARILY;
 	this->m_datatype = memoryProxy->getDataType();
 }
@@ -88,24 +182,47 @@ MemoryBuffer::MemoryBuffer(DataType dataType, rcti *rect)
 	this->m_memoryProxy = NULL;
 	this->m_chunkNumber = -1;
 	this->m_num_channels = determine_num_channels(dataType);
-	this->m_buffer = (float *)MEM_mallocN_aligned(sizeof(float) * determineBufferSize() * this->m_num_channels, 16, "COM_MemoryBuffer");
+	this->m_storage = COM_MB_STORAGE_FLOAT;
+	allocateBuffer();
 	this->m_state = COM_MB_TEMPORARILY;
 	this->m_datatype = dataType;
 }
 MemoryBuffer *MemoryBuffer::duplicate()
 {
 	MemoryBuffer *result = new MemoryBuffer(this->m_memoryProxy, &this->m_rect);
-	memcpy(result->m_buffer, this->m_buffer, this->determineBufferSize() * this->m_num_channels * sizeof(float));
+	if (this->m_storage == COM_MB_STORAGE_FLOAT) {
+		memcpy(result->m_buffer, this->m_buffer, this->determineBufferSize() * this->m_num_channels * sizeof(float));
+	}
+	else {
+		result->copyContentFrom(this);
+	}
 	return result;
 }
 void MemoryBuffer::clear()
 {
-	memset(this->m_buffer, 0, this->determineBufferSize() * this->m_num_channels * sizeof(float));
+	const size_t size = determine_storage_size(this->m_storage) * this->determineBufferSize() * this->m_num_channels;
+	memset(this->m_buffer ? (void *)this->m_buffer : this->m_packedBuffer, 0, size);
 }
 
 
 float MemoryBuffer::getMaximumValue()
 {
+	if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+		const unsigned int size = this->determineBufferSize();
+		float result, value[4];
+		unsigned int i;
+
+		readPacked(value, 0);
+		result = value[0];
+		for (i = 1; i < size; i++) {
+			readPacked(value, i * this->m_num_channels);
+			if (value[0] > result) {
+				result = value[0];
+			}
+		}
+		return result;
+	}
+
 	float result = this->m_buffer[0];
 	const unsigned int size = this->determineBufferSize();
 	unsigned int i;
@@ -148,6 +265,10 @@ MemoryBuffer::~MemoryBuffer()
 		MEM_freeN(this->m_buffer);
 		this->m_buffer = NULL;
 	}
+	if (this->m_packedBuffer) {
+		MEM_freeN(this->m_packedBuffer);
+		this->m_packedBuffer = NULL;
+	}
 }
 
 void MemoryBuffer::copyContentFrom(MemoryBuffer *otherBuffer)
@@ -168,7 +289,29 @@ void MemoryBuffer::copyContentFrom(MemoryBuffer *otherBuffer)
 	for (otherY = minY; otherY < maxY; otherY++) {
 		otherOffset = ((otherY - otherBuffer->m_rect.ymin) * otherBuffer->m_width + minX - otherBuffer->m_rect.xmin) * this->m_num_channels;
 		offset = ((otherY - this->m_rect.ymin) * this->m_width + minX - this->m_rect.xmin) * this->m_num_channels;
-		memcpy(&this->m_buffer[offset], &otherBuffer->m_buffer[otherOffset], (maxX - minX) * this->m_num_channels * sizeof(float));
+		if (this->m_storage == COM_MB_STORAGE_FLOAT && otherBuffer->m_storage == COM_MB_STORAGE_FLOAT) {
+			memcpy(&this->m_buffer[offset], &otherBuffer->m_buffer[otherOffset], (maxX - minX) * this->m_num_channels * sizeof(float));
+		}
+		else {
+			/* convert pixel by pixel when one of the buffers has reduced precision */
+			float color[4];
+			for (unsigned int x = minX; x < maxX; x++) {
+				if (otherBuffer->m_storage == COM_MB_STORAGE_FLOAT) {
+					memcpy(color, &otherBuffer->m_buffer[otherOffset], this->m_num_channels * sizeof(float));
+				}
+				else {
+					otherBuffer->readPacked(color, otherOffset);
+				}
+				if (this->m_storage == COM_MB_STORAGE_FLOAT) {
+					memcpy(&this->m_buffer[offset], color, this->m_num_channels * sizeof(float));
+				}
+				else {
+					writePacked(offset, color);
+				}
+				offset += this->m_num_channels;
+				otherOffset += this->m_num_channels;
+			}
+		}
 	}
 }
 
@@ -178,6 +321,10 @@ void MemoryBuffer::writePixel(int x, int y, const float color[4])
 	    y >= this->m_rect.ymin && y < this->m_rect.ymax)
 	{
 		const int offset = (this->m_width * (y - this->m_rect.ymin) + x - this->m_rect.xmin) * this->m_num_channels;
+		if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+			writePacked(offset, color);
+			return;
+		}
 		memcpy(&this->m_buffer[offset], color, sizeof(float)*this->m_num_channels);	}
 }
 
@@ -187,6 +334,15 @@ void MemoryBuffer::addPixel(int x, int y, const float color[4])
 	    y >= this->m_rect.ymin && y < this->m_rect.ymax)
 	{
 		const int offset = (this->m_width * (y - this->m_rect.ymin) + x - this->m_rect.xmin) * this->m_num_channels;
+		if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+			float sum[4];
+			readPacked(sum, offset);
+			for (int i = 0; i < this->m_num_channels; i++) {
+				sum[i] += color[i];
+			}
+			writePacked(offset, sum);
+			return;
+		}
 		float *dst = &this->m_buffer[offset];
 		const float *src = color;
 		for (int i = 0; i < this->m_num_channels ; i++, dst++, src++) {
@@ -195,6 +351,78 @@ void MemoryBuffer::addPixel(int x, int y, const float color[4])
 	}
 }
 
+void MemoryBuffer::readPacked(float *result, int offset)
+{
+	unsigned int i;
+
+	if (this->m_storage == COM_MB_STORAGE_HALF) {
+		const unsigned short *src = (unsigned short *)this->m_packedBuffer + offset;
+		for (i = 0; i < this->m_num_channels; i++) {
+			result[i] = half_to_float(src[i]);
+		}
+	}
+	else {
+		const unsigned char *src = (unsigned char *)this->m_packedBuffer + offset;
+		for (i = 0; i < this->m_num_channels; i++) {
+			result[i] = src[i] * (1.0f / 255.0f);
+		}
+	}
+}
+
+void MemoryBuffer::writePacked(int offset, const float *color)
+{
+	unsigned int i;
+
+	if (this->m_storage == COM_MB_STORAGE_HALF) {
+		unsigned short *dst = (unsigned short *)this->m_packedBuffer + offset;
+		for (i = 0; i < this->m_num_channels; i++) {
+			dst[i] = float_to_half(color[i]);
+		}
+	}
+	else {
+		unsigned char *dst = (unsigned char *)this->m_packedBuffer + offset;
+		for (i = 0; i < this->m_num_channels; i++) {
+			dst[i] = FTOCHAR(color[i]);
+		}
+	}
+}
+
+/* same as BLI_bilinear_interpolation_fl, outside of the buffer is black */
+void MemoryBuffer::readBilinearPacked(float *result, float u, float v)
+{
+	const int x1 = (int)floor(u);
+	const int x2 = (int)ceil(u);
+	const int y1 = (int)floor(v);
+	const int y2 = (int)ceil(v);
+	const int w = this->m_width;
+	const int h = this->m_height;
+	float row1[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float row2[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float row3[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float row4[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	unsigned int i;
+
+	/* sample area entirely outside image? */
+	if (x2 < 0 || x1 > w - 1 || y2 < 0 || y1 > h - 1) {
+		memset(result, 0, this->m_num_channels * sizeof(float));
+		return;
+	}
+
+	/* sample including outside of edges of image */
+	if (!(x1 < 0 || y1 < 0)) readPacked(row1, (w * y1 + x1) * this->m_num_channels);
+	if (!(x1 < 0 || y2 > h - 1)) readPacked(row2, (w * y2 + x1) * this->m_num_channels);
+	if (!(x2 > w - 1 || y1 < 0)) readPacked(row3, (w * y1 + x2) * this->m_num_channels);
+	if (!(x2 > w - 1 || y2 > h - 1)) readPacked(row4, (w * y2 + x2) * this->m_num_channels);
+
+	const float a = u - floorf(u);
+	const float b = v - floorf(v);
+	const float a_b = a * b, ma_b = (1.0f - a) * b, a_mb = a * (1.0f - b), ma_mb = (1.0f - a) * (1.0f - b);
+
+	for (i = 0; i < this->m_num_channels; i++) {
+		result[i] = ma_mb * row1[i] + a_mb * row3[i] + ma_b * row2[i] + a_b * row4[i];
+	}
+}
+
 static void read_ewa_pixel_sampled(void *userdata, int x, int y, float result[4])
 {
 	MemoryBuffer *buffer = (MemoryBuffer *) userdata;
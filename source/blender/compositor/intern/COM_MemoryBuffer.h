@@ -89,9 +89,21 @@ private:
 	
 	/**
 	 * @brief the actual float buffer/data
+	 * @note NULL when the storage is not COM_MB_STORAGE_FLOAT
 	 */
 	float *m_buffer;
 
+	/**
+	 * @brief how the data is stored
+	 */
+	MemoryBufferStorage m_storage;
+
+	/**
+	 * @brief the half float or byte buffer/data for reduced precision storage,
+	 * values are converted on read and write
+	 */
+	void *m_packedBuffer;
+
 	/**
 	 * @brief the number of channels of a single value in the buffer.
 	 * For value buffers this is 1, vector 3 and color 4
@@ -132,8 +144,20 @@ public:
 	/**
 	 * @brief get the data of this MemoryBuffer
 	 * @note buffer should already be available in memory
+	 * @note only available for COM_MB_STORAGE_FLOAT buffers
 	 */
-	float *getBuffer() { return this->m_buffer; }
+	float *getBuffer()
+	{
+		BLI_assert(this->m_storage == COM_MB_STORAGE_FLOAT);
+		return this->m_buffer;
+	}
+
+	MemoryBufferStorage getStorage() const { return this->m_storage; }
+
+	/**
+	 * @brief get the number of bytes allocated for the pixels of this buffer
+	 */
+	size_t getMemorySize() const;
 	
 	/**
 	 * @brief after execution the state will be set to available by calling this method
@@ -222,6 +246,10 @@ public:
 			int v = y;
 			this->wrap_pixel(u, v, extend_x, extend_y);
 			const int offset = (this->m_width * y + x) * this->m_num_channels;
+			if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+				readPacked(result, offset);
+				return;
+			}
 			float *buffer = &this->m_buffer[offset];
 			memcpy(result, buffer, sizeof(float) * this->m_num_channels);
 		}
@@ -246,6 +274,10 @@ public:
 		BLI_assert((int)(MEM_allocN_len(this->m_buffer) / sizeof(*this->m_buffer)) ==
 		           (int)(this->determineBufferSize() * COM_NUMBER_OF_CHANNELS));
 #endif
+		if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+			readPacked(result, offset);
+			return;
+		}
 		float *buffer = &this->m_buffer[offset];
 		memcpy(result, buffer, sizeof(float) * this->m_num_channels);
 	}
@@ -259,6 +291,10 @@ public:
 		float u = x;
 		float v = y;
 		this->wrap_pixel(u, v, extend_x, extend_y);
+		if (this->m_storage != COM_MB_STORAGE_FLOAT) {
+			readBilinearPacked(result, u, v);
+			return;
+		}
 		BLI_bilinear_interpolation_fl(this->m_buffer, result, this->m_width, this->m_height, this->m_num_channels, u, v);
 	}
 
@@ -304,6 +340,14 @@ public:
 	float getMaximumValue(rcti *rect);
 private:
 	unsigned int determineBufferSize();
+	void allocateBuffer();
+
+	/**
+	 * @brief conversion of reduced precision storage, offset is in channels (like offsets into m_buffer)
+	 */
+	void readPacked(float *result, int offset);
+	void writePacked(int offset, const float *color);
+	void readBilinearPacked(float *result, float u, float v);
 
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:MemoryBuffer")
@@ -28,6 +28,7 @@ MemoryProxy::MemoryProxy(DataType datatype)
 	this->m_writeBufferOperation = NULL;
 	this->m_executor = NULL;
 	this->m_datatype = datatype;
+	this->m_storage = COM_MB_STORAGE_FLOAT;
 }
 
 void MemoryProxy::allocate(unsigned int width, unsigned int height)
@@ -68,6 +68,11 @@ private:
 	 */
 	DataType m_datatype;
 
+	/**
+	 * @brief how the data of the buffer is stored
+	 */
+	MemoryBufferStorage m_storage;
+
 public:
 	MemoryProxy(DataType type);
 	
@@ -111,6 +116,13 @@ public:
 
 	inline DataType getDataType() { return this->m_datatype; }
 
+	/**
+	 * @brief set the storage of the buffer, reduced precision storage is only allowed when
+	 * no reader accesses the float buffer directly (complex operations)
+	 */
+	void setStorage(MemoryBufferStorage storage) { this->m_storage = storage; }
+	inline MemoryBufferStorage getStorage() { return this->m_storage; }
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:MemoryProxy")
 #endif
@@ -121,6 +121,12 @@ private:
 	 */
 	const bNodeTree *m_btree;
 
+	/**
+	 * @brief the bNode this operation was created for, used to report profiling statistics
+	 * @note NULL for operations that are not related to a single node
+	 */
+	bNode *m_bnode;
+
 	/**
 	 * @brief set to truth when resolution for this operation is set
 	 */
@@ -166,6 +172,8 @@ public:
 	virtual int isSingleThreaded() { return false; }
 
 	void setbNodeTree(const bNodeTree *tree) { this->m_btree = tree; }
+	void setbNode(bNode *node) { this->m_bnode = node; }
+	bNode *getbNode() const { return this->m_bnode; }
 	virtual void initExecution();
 	
 	/**
@@ -245,6 +253,14 @@ public:
 
 	virtual bool isSetOperation() const { return false; }
 
+	/**
+	 * @brief are all output values of this operation in the 0..1 range
+	 *
+	 * Buffers of these operations (mattes, masks) can be stored with 8 bits per channel.
+	 * @see NodeOperationBuilder.determine_buffer_storage
+	 */
+	virtual bool isOutputNormalized() const { return false; }
+
 	/**
 	 * @brief is this operation of type ReadBufferOperation
 	 * @return [true:false]
@@ -274,6 +290,7 @@ public:
 	 * @param index the index to set
 	 */
 	void setResolutionInputSocketIndex(unsigned int index);
+	unsigned int getResolutionInputSocketIndex() const { return this->m_resolutionInputSocketIndex; }
 
 	/**
 	 * @brief get the render priority of this node.
@@ -293,6 +310,7 @@ public:
 	virtual bool isPreviewOperation() const { return false; }
 	virtual bool isFileOutputOperation() const { return false; }
 	virtual bool isProxyOperation() const { return false; }
+	virtual bool isProgressiveDownscaleOperation() const { return false; }
 	
 	virtual bool useDatatypeConversion() const { return true; }
 	
@@ -39,6 +39,7 @@ extern "C" {
 #include "COM_ReadBufferOperation.h"
 #include "COM_WriteBufferOperation.h"
 #include "COM_ViewerOperation.h"
+#include "COM_ProgressiveScaleOperation.h"
 
 #include "COM_NodeOperationBuilder.h" /* own include */
 
@@ -107,11 +108,16 @@ void NodeOperationBuilder::convertToOperations(ExecutionSystem *system)
 	
 	add_datatype_conversions();
 	
+	if (m_context->getResolutionDivider() > 1)
+		add_progressive_scaling();
+	
 	determineResolutions();
 	
 	/* surround complex ops with read/write buffer */
 	add_complex_operation_buffers();
 	
+	determine_buffer_storage();
+	
 	/* links not available from here on */
 	/* XXX make m_links a local variable to avoid confusion! */
 	m_links.clear();
@@ -130,6 +136,8 @@ void NodeOperationBuilder::convertToOperations(ExecutionSystem *system)
 
 void NodeOperationBuilder::addOperation(NodeOperation *operation)
 {
+	if (m_current_node)
+		operation->setbNode(m_current_node->getbNode());
 	m_operations.push_back(operation);
 }
 
@@ -283,6 +291,7 @@ void NodeOperationBuilder::add_datatype_conversions()
 		const Link &link = *it;
 		NodeOperation *converter = Converter::convertDataType(link.from(), link.to());
 		if (converter) {
+			converter->setbNode(link.to()->getOperation().getbNode());
 			addOperation(converter);
 			
 			removeInputLink(link.to());
@@ -390,6 +399,75 @@ void NodeOperationBuilder::resolve_proxies()
 	}
 }
 
+/* operations producing the images of the graph, only constants are connected to their inputs */
+static bool is_source_operation(NodeOperation *op)
+{
+	if (op->isSetOperation() || op->isReadBufferOperation() || op->getNumberOfOutputSockets() == 0)
+		return false;
+	
+	for (unsigned int index = 0; index < op->getNumberOfInputSockets(); index++) {
+		NodeOperationInput *input = op->getInputSocket(index);
+		if (input->isConnected() && !input->getLink()->getOperation().isSetOperation())
+			return false;
+	}
+	return true;
+}
+
+void NodeOperationBuilder::add_progressive_scaling()
+{
+	const int divider = m_context->getResolutionDivider();
+	
+	/* copy operations, the vector is extended while looping */
+	Operations operations = m_operations;
+	
+	for (Operations::const_iterator it = operations.begin(); it != operations.end(); ++it) {
+		NodeOperation *op = *it;
+		
+		if (is_source_operation(op)) {
+			/* reduce the resolution of the images right after they are created,
+			 * so all following operations are calculated at the lower resolution */
+			for (unsigned int index = 0; index < op->getNumberOfOutputSockets(); index++) {
+				NodeOperationOutput *output = op->getOutputSocket(index);
+				OpInputs targets = cache_output_links(output);
+				if (targets.empty())
+					continue;
+				
+				ProgressiveDownscaleOperation *downscale = new ProgressiveDownscaleOperation(output->getDataType());
+				downscale->setDivider(divider);
+				downscale->setbNode(op->getbNode());
+				addOperation(downscale);
+				
+				for (OpInputs::const_iterator it_target = targets.begin(); it_target != targets.end(); ++it_target) {
+					NodeOperationInput *target = *it_target;
+					removeInputLink(target);
+					addLink(downscale->getOutputSocket(), target);
+				}
+				addLink(output, downscale->getInputSocket(0));
+			}
+		}
+		else if (op->isOutputOperation(m_context->isRendering()) &&
+		         !op->isPreviewOperation() && !op->isFileOutputOperation())
+		{
+			/* viewer and composite show the result at the original resolution */
+			for (unsigned int index = 0; index < op->getNumberOfInputSockets(); index++) {
+				NodeOperationInput *input = op->getInputSocket(index);
+				if (!input->isConnected() || input->getLink()->getOperation().isSetOperation())
+					continue;
+				
+				NodeOperationOutput *from = input->getLink();
+				ProgressiveUpscaleOperation *upscale = new ProgressiveUpscaleOperation(input->getDataType());
+				upscale->setDivider(divider);
+				upscale->setbNode(op->getbNode());
+				addOperation(upscale);
+				
+				removeInputLink(input);
+				addLink(from, upscale->getInputSocket(0));
+				addLink(upscale->getOutputSocket(), input);
+			}
+		}
+	}
+}
+
 void NodeOperationBuilder::determineResolutions()
 {
 	/* determine all resolutions of the operations (Width/Height) */
@@ -479,6 +557,7 @@ void NodeOperationBuilder::add_input_buffers(NodeOperation * /*operation*/,
 	if (!writeoperation) {
 		writeoperation = new WriteBufferOperation(output->getDataType());
 		writeoperation->setbNodeTree(m_context->getbNodeTree());
+		writeoperation->setbNode(output->getOperation().getbNode());
 		addOperation(writeoperation);
 		
 		addLink(output, writeoperation->getInputSocket(0));
@@ -522,6 +601,7 @@ void NodeOperationBuilder::add_output_buffers(NodeOperation *operation, NodeOper
 	if (!writeOperation) {
 		writeOperation = new WriteBufferOperation(operation->getOutputSocket()->getDataType());
 		writeOperation->setbNodeTree(m_context->getbNodeTree());
+		writeOperation->setbNode(operation->getbNode());
 		addOperation(writeOperation);
 		
 		addLink(output, writeOperation->getInputSocket(0));
@@ -568,6 +648,54 @@ void NodeOperationBuilder::add_complex_operation_buffers()
 	}
 }
 
+void NodeOperationBuilder::determine_buffer_storage()
+{
+	/* renders always use full float buffers, the quality setting only trades
+	 * precision for memory while editing */
+	if (m_context->isRendering())
+		return;
+	
+	const CompositorQuality quality = m_context->getQuality();
+	if (quality == COM_QUALITY_HIGH)
+		return;
+	
+	/* complex operations access the float buffer of their inputs directly */
+	std::set<MemoryProxy *> float_proxies;
+	for (Operations::const_iterator it = m_operations.begin(); it != m_operations.end(); ++it) {
+		NodeOperation *op = *it;
+		if (!op->isComplex())
+			continue;
+		
+		for (int index = 0; index < op->getNumberOfInputSockets(); index++) {
+			NodeOperationInput *input = op->getInputSocket(index);
+			if (input->isConnected() && input->getLink()->getOperation().isReadBufferOperation()) {
+				ReadBufferOperation *read_op = (ReadBufferOperation *)(&input->getLink()->getOperation());
+				float_proxies.insert(read_op->getMemoryProxy());
+			}
+		}
+	}
+	
+	for (Operations::const_iterator it = m_operations.begin(); it != m_operations.end(); ++it) {
+		NodeOperation *op = *it;
+		if (!op->isWriteBufferOperation())
+			continue;
+		
+		WriteBufferOperation *write_op = (WriteBufferOperation *)op;
+		MemoryProxy *memproxy = write_op->getMemoryProxy();
+		if (float_proxies.find(memproxy) != float_proxies.end())
+			continue;
+		
+		/* mattes fit in 8 bits, colors are stored as half float in medium quality,
+		 * other data (values, vectors) only in low quality */
+		NodeOperationInput *input = write_op->getInputSocket(0);
+		const bool is_normalized = input->isConnected() && input->getLink()->getOperation().isOutputNormalized();
+		if (memproxy->getDataType() == COM_DT_VALUE && is_normalized)
+			memproxy->setStorage(COM_MB_STORAGE_BYTE);
+		else if (memproxy->getDataType() == COM_DT_COLOR || quality == COM_QUALITY_LOW)
+			memproxy->setStorage(COM_MB_STORAGE_HALF);
+	}
+}
+
 typedef std::set<NodeOperation*> Tags;
 
 static void find_reachable_operations_recursive(Tags &reachable, NodeOperation *op)
@@ -137,6 +137,9 @@ protected:
 	/** Replace proxy operations with direct links */
 	void resolve_proxies();
 	
+	/** Evaluate the graph at a lower resolution, for the first pass of progressive compositing */
+	void add_progressive_scaling();
+	
 	/** Calculate resolution for each operation */
 	void determineResolutions();
 	
@@ -148,6 +151,8 @@ protected:
 	void add_complex_operation_buffers();
 	void add_input_buffers(NodeOperation *operation, NodeOperationInput *input);
 	void add_output_buffers(NodeOperation *operation, NodeOperationOutput *output);
+	/** Choose reduced precision storage for buffers in the editor, based on quality and data type */
+	void determine_buffer_storage();
 	
 	/** Remove unreachable operations */
 	void prune_operations();
@@ -23,6 +23,8 @@
 #include "COM_OpenCLDevice.h"
 #include "COM_WorkScheduler.h"
 
+#include "PIL_time.h"
+
 typedef enum COM_VendorID  {NVIDIA = 0x10DE, AMD = 0x1002} COM_VendorID;
 const cl_image_format IMAGE_FORMAT_COLOR = {
 	CL_RGBA,
@@ -65,6 +67,7 @@ void OpenCLDevice::execute(WorkPackage *work)
 	const unsigned int chunkNumber = work->getChunkNumber();
 	ExecutionGroup *executionGroup = work->getExecutionGroup();
 	rcti rect;
+	double start = PIL_check_seconds_timer();
 
 	executionGroup->determineChunkRect(&rect, chunkNumber);
 	MemoryBuffer **inputBuffers = executionGroup->getInputBuffersOpenCL(chunkNumber);
@@ -74,6 +77,8 @@ void OpenCLDevice::execute(WorkPackage *work)
 	                                                              chunkNumber, inputBuffers, outputBuffer);
 
 	delete outputBuffer;
+
+	executionGroup->addChunkExecutionTime(PIL_check_seconds_timer() - start);
 	
 	executionGroup->finalizeChunkExecution(chunkNumber, inputBuffers);
 }
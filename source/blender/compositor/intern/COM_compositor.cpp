@@ -24,6 +24,7 @@
 extern "C" {
 #include "BKE_node.h"
 #include "BLI_threads.h"
+#include "BLI_math_base.h"
 }
 
 #include "BLT_translation.h"
@@ -39,6 +40,15 @@ extern "C" {
 static ThreadMutex s_compositorMutex;
 static bool is_compositorMutex_init = false;
 
+/* resolution divider for the first pass of progressive compositing,
+ * large outputs use a larger divider to keep the first pass interactive */
+static int progressive_resolution_divider(const RenderData *rd)
+{
+	const int width = rd->xsch * rd->size / 100;
+	const int height = rd->ysch * rd->size / 100;
+	return (max_ii(width, height) > 2048) ? 8 : 4;
+}
+
 static void intern_freeCompositorCaches()
 {
 	deintializeDistortionCache();
@@ -82,6 +92,7 @@ void COM_execute(RenderData *rd, Scene *scene, bNodeTree *editingtree, int rende
 	editingtree->stats_draw(editingtree->sdh, IFACE_("Compositing"));
 
 	bool twopass = (editingtree->flag & NTREE_TWO_PASS) > 0 && !rendering;
+	bool progressive = (editingtree->flag & NTREE_COM_PROGRESSIVE) > 0 && !rendering;
 	/* initialize execution system */
 	if (twopass) {
 		ExecutionSystem *system = new ExecutionSystem(rd, scene, editingtree, rendering, twopass, viewSettings, displaySettings, viewName);
@@ -96,6 +107,24 @@ void COM_execute(RenderData *rd, Scene *scene, bNodeTree *editingtree, int rende
 		}
 	}
 
+	if (progressive) {
+		/* show a low resolution result of the whole graph first, the full resolution pass
+		 * below is skipped when the tree is edited again in the meantime. It's cancelled with
+		 * test_break like any compositing, execution groups check it between their chunks.
+		 * WorkScheduler::stop() can't be used for this, it ends the threads and frees the queue
+		 * the running groups wait on */
+		ExecutionSystem *system = new ExecutionSystem(rd, scene, editingtree, rendering, false,
+		                                              viewSettings, displaySettings, viewName,
+		                                              progressive_resolution_divider(rd));
+		system->execute();
+		delete system;
+		
+		if (editingtree->test_break(editingtree->tbh)) {
+			BLI_mutex_unlock(&s_compositorMutex);
+			return;
+		}
+	}
+
 	ExecutionSystem *system = new ExecutionSystem(rd, scene, editingtree, rendering, false,
 	                                              viewSettings, displaySettings, viewName);
 	system->execute();
@@ -42,6 +42,7 @@ void BlurNode::convertToOperations(NodeConverter &converter, const CompositorCon
 {
 	bNode *editorNode = this->getbNode();
 	NodeBlurData *data = (NodeBlurData *)editorNode->storage;
+	NodeBlurData scaled_data;
 	NodeInput *inputSizeSocket = this->getInputSocket(1);
 	bool connectedSizeSocket = inputSizeSocket->isLinked();
 
@@ -50,6 +51,14 @@ void BlurNode::convertToOperations(NodeConverter &converter, const CompositorCon
 	CompositorQuality quality = context.getQuality();
 	NodeOperation *input_operation = NULL, *output_operation = NULL;
 
+	if (context.getResolutionDivider() > 1 && !data->relative) {
+		/* pixel sizes are for the full resolution, operations copy the data */
+		scaled_data = *data;
+		scaled_data.sizex /= context.getResolutionDivider();
+		scaled_data.sizey /= context.getResolutionDivider();
+		data = &scaled_data;
+	}
+
 	if (data->filtertype == R_FILTER_FAST_GAUSS) {
 		FastGaussianBlurOperation *operationfgb = new FastGaussianBlurOperation();
 		operationfgb->setData(data);
@@ -45,14 +45,17 @@ void DefocusNode::convertToOperations(NodeConverter &converter, const Compositor
 	NodeDefocus *data = (NodeDefocus *)node->storage;
 	Scene *scene = node->id ? (Scene *)node->id : context.getScene();
 	Object *camob = scene ? scene->camera : NULL;
+	/* blur sizes are in pixels of the full resolution */
+	const float divider = context.getResolutionDivider();
+	const float maxblur = data->maxblur / divider;
 
 	NodeOperation *radiusOperation;
 	if (data->no_zbuf) {
 		MathMultiplyOperation *multiply = new MathMultiplyOperation();
 		SetValueOperation *multiplier = new SetValueOperation();
-		multiplier->setValue(data->scale);
+		multiplier->setValue(data->scale / divider);
 		SetValueOperation *maxRadius = new SetValueOperation();
-		maxRadius->setValue(data->maxblur);
+		maxRadius->setValue(maxblur);
 		MathMinimumOperation *minimize = new MathMinimumOperation();
 		
 		converter.addOperation(multiply);
@@ -71,7 +74,7 @@ void DefocusNode::convertToOperations(NodeConverter &converter, const Compositor
 		ConvertDepthToRadiusOperation *radius_op = new ConvertDepthToRadiusOperation();
 		radius_op->setCameraObject(camob);
 		radius_op->setfStop(data->fstop);
-		radius_op->setMaxRadius(data->maxblur);
+		radius_op->setMaxRadius(maxblur);
 		converter.addOperation(radius_op);
 		
 		converter.mapInputSocket(getInputSocket(1), radius_op->getInputSocket(0));
@@ -105,7 +108,7 @@ void DefocusNode::convertToOperations(NodeConverter &converter, const Compositor
 	
 #ifdef COM_DEFOCUS_SEARCH
 	InverseSearchRadiusOperation *search = new InverseSearchRadiusOperation();
-	search->setMaxBlur(data->maxblur);
+	search->setMaxBlur(maxblur);
 	converter.addOperation(search);
 	
 	converter.addLink(radiusOperation->getOutputSocket(0), search->getInputSocket(0));
@@ -116,7 +119,7 @@ void DefocusNode::convertToOperations(NodeConverter &converter, const Compositor
 		operation->setQuality(COM_QUALITY_LOW);
 	else
 		operation->setQuality(context.getQuality());
-	operation->setMaxBlur(data->maxblur);
+	operation->setMaxBlur(maxblur);
 	operation->setThreshold(data->bthresh);
 	converter.addOperation(operation);
 	
@@ -43,12 +43,17 @@ void TranslateNode::convertToOperations(NodeConverter &converter, const Composit
 	NodeOutput *outputSocket = this->getOutputSocket(0);
 	
 	TranslateOperation *operation = new TranslateOperation();
+	/* offsets are in pixels of the full resolution */
+	const float divider = context.getResolutionDivider();
 	if (data->relative) {
 		const RenderData *rd = context.getRenderData();
 		float fx = rd->xsch * rd->size / 100.0f;
 		float fy = rd->ysch * rd->size / 100.0f;
 		
-		operation->setFactorXY(fx, fy);
+		operation->setFactorXY(fx / divider, fy / divider);
+	}
+	else if (divider > 1.0f) {
+		operation->setFactorXY(1.0f / divider, 1.0f / divider);
 	}
 	
 	converter.addOperation(operation);
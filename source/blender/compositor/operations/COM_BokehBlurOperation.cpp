@@ -23,11 +23,16 @@
 #include "COM_BokehBlurOperation.h"
 #include "BLI_math.h"
 #include "COM_OpenCLDevice.h"
+#include "COM_FFTConvolution.h"
+#include "MEM_guardedalloc.h"
 
 extern "C" {
 #  include "RE_pipeline.h"
 }
 
+/* blur radius in pixels from where the FFT convolution is faster than gathering */
+#define COM_BOKEH_FFT_MIN_RADIUS 32
+
 BokehBlurOperation::BokehBlurOperation() : NodeOperation()
 {
 	this->addInputSocket(COM_DT_COLOR);
@@ -43,6 +48,8 @@ BokehBlurOperation::BokehBlurOperation() : NodeOperation()
 	this->m_inputProgram = NULL;
 	this->m_inputBokehProgram = NULL;
 	this->m_inputBoundingBoxReader = NULL;
+	this->m_useFFT = false;
+	this->m_fftResult = NULL;
 }
 
 void *BokehBlurOperation::initializeTileData(rcti * /*rect*/)
@@ -52,6 +59,9 @@ void *BokehBlurOperation::initializeTileData(rcti * /*rect*/)
 		updateSize();
 	}
 	void *buffer = getInputOperation(0)->initializeTileData(NULL);
+	if (this->m_useFFT && !this->m_fftResult) {
+		this->m_fftResult = createFFTResult((MemoryBuffer *)buffer);
+	}
 	unlockMutex();
 	return buffer;
 }
@@ -72,6 +82,88 @@ void BokehBlurOperation::initExecution()
 	this->m_bokehMidY = height / 2.0f;
 	this->m_bokehDimension = dimension / 2.0f;
 	QualityStepHelper::initExecution(COM_QH_INCREASE);
+
+	/* only when the size is known up front, the whole input is needed for the FFT */
+	if (this->m_sizeavailable) {
+		const float max_dim = max(this->getWidth(), this->getHeight());
+		const int pixelSize = this->m_size * max_dim / 100.0f;
+		this->m_useFFT = (pixelSize >= COM_BOKEH_FFT_MIN_RADIUS);
+	}
+}
+
+MemoryBuffer *BokehBlurOperation::createFFTResult(MemoryBuffer *inputBuffer)
+{
+	const float max_dim = max(this->getWidth(), this->getHeight());
+	const int pixelSize = this->m_size * max_dim / 100.0f;
+	const float m = this->m_bokehDimension / pixelSize;
+	/* kernel with the center at pixelSize, first row and column stay empty so the
+	 * convolution covers the same [-pixelSize, pixelSize) window as the gather */
+	const int kernelSize = 2 * pixelSize + 1;
+	const int width = inputBuffer->getWidth();
+	const int height = inputBuffer->getHeight();
+	rcti kernelRect;
+	float *kernelBuffer, *resultBuffer;
+	double *table;
+	int x, y, ch;
+
+	BLI_rcti_init(&kernelRect, 0, kernelSize, 0, kernelSize);
+	MemoryBuffer *kernel = new MemoryBuffer(COM_DT_COLOR, &kernelRect);
+	kernelBuffer = kernel->getBuffer();
+	memset(kernelBuffer, 0, sizeof(float) * kernelSize * kernelSize * COM_NUM_CHANNELS_COLOR);
+	for (y = 1; y < kernelSize; y++) {
+		float *row = &kernelBuffer[y * kernelSize * COM_NUM_CHANNELS_COLOR];
+		for (x = 1; x < kernelSize; x++) {
+			float u = this->m_bokehMidX + (x - pixelSize) * m;
+			float v = this->m_bokehMidY + (y - pixelSize) * m;
+			this->m_inputBokehProgram->readSampled(&row[x * COM_NUM_CHANNELS_COLOR], u, v, COM_PS_NEAREST);
+		}
+	}
+
+	MemoryBuffer *result = new MemoryBuffer(COM_DT_COLOR, inputBuffer->getRect());
+	resultBuffer = result->getBuffer();
+	memset(resultBuffer, 0, sizeof(float) * width * height * COM_NUM_CHANNELS_COLOR);
+	FFTConvolution convolution(kernel, COM_NUM_CHANNELS_COLOR);
+	convolution.convolve(resultBuffer, inputBuffer);
+
+	/* Normalize with the bokeh weights inside the image, the same as multiplier_accum of the gather.
+	 * A summed area table of the kernel gives the weight of any clipped window. */
+	table = (double *)MEM_callocN(sizeof(double) * (kernelSize + 1) * (kernelSize + 1) * COM_NUM_CHANNELS_COLOR,
+	                              "bokeh kernel summed area table");
+	for (y = 0; y < kernelSize; y++) {
+		for (x = 0; x < kernelSize; x++) {
+			const float *weight = &kernelBuffer[(y * kernelSize + x) * COM_NUM_CHANNELS_COLOR];
+			double *sum = &table[((y + 1) * (kernelSize + 1) + x + 1) * COM_NUM_CHANNELS_COLOR];
+			const double *left = sum - COM_NUM_CHANNELS_COLOR;
+			const double *up = sum - (kernelSize + 1) * COM_NUM_CHANNELS_COLOR;
+			const double *upLeft = up - COM_NUM_CHANNELS_COLOR;
+			for (ch = 0; ch < COM_NUM_CHANNELS_COLOR; ch++) {
+				sum[ch] = weight[ch] + left[ch] + up[ch] - upLeft[ch];
+			}
+		}
+	}
+
+	for (y = 0; y < height; y++) {
+		/* kernel rows of the pixels inside the image */
+		const int ky0 = max(0, y + pixelSize - (height - 1));
+		const int ky1 = min(kernelSize - 1, y + pixelSize);
+		for (x = 0; x < width; x++) {
+			const int kx0 = max(0, x + pixelSize - (width - 1));
+			const int kx1 = min(kernelSize - 1, x + pixelSize);
+			const double *sum00 = &table[(ky0 * (kernelSize + 1) + kx0) * COM_NUM_CHANNELS_COLOR];
+			const double *sum01 = &table[(ky0 * (kernelSize + 1) + kx1 + 1) * COM_NUM_CHANNELS_COLOR];
+			const double *sum10 = &table[((ky1 + 1) * (kernelSize + 1) + kx0) * COM_NUM_CHANNELS_COLOR];
+			const double *sum11 = &table[((ky1 + 1) * (kernelSize + 1) + kx1 + 1) * COM_NUM_CHANNELS_COLOR];
+			float *output = &resultBuffer[(y * width + x) * COM_NUM_CHANNELS_COLOR];
+			for (ch = 0; ch < COM_NUM_CHANNELS_COLOR; ch++) {
+				const float multiplier = sum11[ch] - sum01[ch] - sum10[ch] + sum00[ch];
+				output[ch] = output[ch] * (1.0f / multiplier);
+			}
+		}
+	}
+
+	MEM_freeN(table);
+	delete kernel;
+	return result;
 }
 
 void BokehBlurOperation::executePixel(float output[4], int x, int y, void *data)
@@ -81,7 +173,10 @@ void BokehBlurOperation::executePixel(float output[4], int x, int y, void *data)
 	float bokeh[4];
 
 	this->m_inputBoundingBoxReader->readSampled(tempBoundingBox, x, y, COM_PS_NEAREST);
-	if (tempBoundingBox[0] > 0.0f) {
+	if (tempBoundingBox[0] > 0.0f && this->m_fftResult) {
+		this->m_fftResult->readNoCheck(output, x, y);
+	}
+	else if (tempBoundingBox[0] > 0.0f) {
 		float multiplier_accum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 		MemoryBuffer *inputBuffer = (MemoryBuffer *)data;
 		float *buffer = inputBuffer->getBuffer();
@@ -137,6 +232,10 @@ void BokehBlurOperation::executePixel(float output[4], int x, int y, void *data)
 void BokehBlurOperation::deinitExecution()
 {
 	deinitMutex();
+	if (this->m_fftResult) {
+		delete this->m_fftResult;
+		this->m_fftResult = NULL;
+	}
 	this->m_inputProgram = NULL;
 	this->m_inputBokehProgram = NULL;
 	this->m_inputBoundingBoxReader = NULL;
@@ -148,7 +247,13 @@ bool BokehBlurOperation::determineDependingAreaOfInterest(rcti *input, ReadBuffe
 	rcti bokehInput;
 	const float max_dim = max(this->getWidth(), this->getHeight());
 
-	if (this->m_sizeavailable) {
+	if (this->m_useFFT) {
+		newInput.xmax = this->getWidth();
+		newInput.xmin = 0;
+		newInput.ymax = this->getHeight();
+		newInput.ymin = 0;
+	}
+	else if (this->m_sizeavailable) {
 		newInput.xmax = input->xmax + (this->m_size * max_dim / 100.0f);
 		newInput.xmin = input->xmin - (this->m_size * max_dim / 100.0f);
 		newInput.ymax = input->ymax + (this->m_size * max_dim / 100.0f);
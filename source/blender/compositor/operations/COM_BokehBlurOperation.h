@@ -37,6 +37,13 @@ private:
 	float m_bokehMidX;
 	float m_bokehMidY;
 	float m_bokehDimension;
+
+	/**
+	 * @brief large kernels are convolved for the whole image at once in the frequency domain
+	 */
+	bool m_useFFT;
+	MemoryBuffer *m_fftResult;
+	MemoryBuffer *createFFTResult(MemoryBuffer *inputBuffer);
 public:
 	BokehBlurOperation();
 
@@ -66,6 +66,7 @@ public:
 	
 	bool determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output);
 
+	bool isOutputNormalized() const { return true; }
 };
 
 class DilateDistanceOperation : public NodeOperation {
@@ -36,5 +36,7 @@ public:
 
 	void setObjectIndex(float objectIndex) { this->m_objectIndex = objectIndex; }
 
+	bool isOutputNormalized() const { return true; }
+
 };
 #endif
@@ -183,6 +183,28 @@ void *OutputOpenExrMultiLayerMultiViewOperation::get_handle(const char *filename
 	return NULL;
 }
 
+/* all views are written to the same file after the last view is calculated,
+ * so the layers are buffered instead of streamed like single view files */
+void OutputOpenExrMultiLayerMultiViewOperation::initExecution()
+{
+	for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
+		if (this->m_layers[i].use_layer) {
+			SocketReader *reader = getInputSocketReader(i);
+			this->m_layers[i].imageInput = reader;
+			this->m_layers[i].outputBuffer = init_buffer(this->getWidth(), this->getHeight(), this->m_layers[i].datatype);
+		}
+	}
+}
+
+void OutputOpenExrMultiLayerMultiViewOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/)
+{
+	for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
+		OutputOpenExrLayer &layer = this->m_layers[i];
+		if (layer.imageInput)
+			write_buffer_rect(rect, this->m_tree, layer.imageInput, layer.outputBuffer, this->getWidth(), layer.datatype);
+	}
+}
+
 void OutputOpenExrMultiLayerMultiViewOperation::deinitExecution()
 {
 	unsigned int width = this->getWidth();
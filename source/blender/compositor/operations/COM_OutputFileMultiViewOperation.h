@@ -54,6 +54,8 @@ public:
 	                                          char exr_codec, bool exr_half_float, const char *viewName);
 
 	void *get_handle(const char *filename);
+	void initExecution();
+	void executeRegion(rcti *rect, unsigned int tileNumber);
 	void deinitExecution();
 };
 
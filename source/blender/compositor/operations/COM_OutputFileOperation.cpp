@@ -24,6 +24,7 @@
 #include "COM_OutputFileOperation.h"
 #include <string.h>
 #include "BLI_listbase.h"
+#include "BLI_math_base.h"
 #include "BLI_path_util.h"
 #include "BLI_string.h"
 #include "BKE_image.h"
@@ -104,7 +105,7 @@ int get_datatype_size(DataType datatype)
 	}
 }
 
-static float *init_buffer(unsigned int width, unsigned int height, DataType datatype)
+float *init_buffer(unsigned int width, unsigned int height, DataType datatype)
 {
 	// When initializing the tree during initial load the width and height can be zero.
 	if (width != 0 && height != 0) {
@@ -115,8 +116,8 @@ static float *init_buffer(unsigned int width, unsigned int height, DataType data
 		return NULL;
 }
 
-static void write_buffer_rect(rcti *rect, const bNodeTree *tree,
-                              SocketReader *reader, float *buffer, unsigned int width, DataType datatype)
+void write_buffer_rect(rcti *rect, const bNodeTree *tree,
+                       SocketReader *reader, float *buffer, unsigned int width, DataType datatype)
 {
 	float color[4];
 	int i, size = get_datatype_size(datatype);
@@ -238,6 +239,9 @@ OutputOpenExrMultiLayerOperation::OutputOpenExrMultiLayerOperation(
 	this->m_exr_codec = exr_codec;
 	this->m_exr_half_float = exr_half_float;
 	this->m_viewName = viewName;
+	
+	this->m_exrhandle = NULL;
+	this->m_tiles = NULL;
 }
 
 void OutputOpenExrMultiLayerOperation::add_layer(const char *name, DataType datatype, bool use_layer)
@@ -248,68 +252,215 @@ void OutputOpenExrMultiLayerOperation::add_layer(const char *name, DataType data
 
 void OutputOpenExrMultiLayerOperation::initExecution()
 {
+	unsigned int width = this->getWidth();
+	unsigned int height = this->getHeight();
+	
+	this->m_exrhandle = NULL;
+	this->m_tiles = NULL;
+	this->m_numberOfChannels = 0;
+	
 	for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
 		if (this->m_layers[i].use_layer) {
 			SocketReader *reader = getInputSocketReader(i);
 			this->m_layers[i].imageInput = reader;
-			this->m_layers[i].outputBuffer = init_buffer(this->getWidth(), this->getHeight(), this->m_layers[i].datatype);
+			this->m_numberOfChannels += get_datatype_size(this->m_layers[i].datatype);
 		}
 	}
+	
+	/* When initializing the tree during initial load the width and height can be zero. */
+	if (width == 0 || height == 0)
+		return;
+	
+	Main *bmain = G.main; /* TODO, have this passed along */
+	char filename[FILE_MAX];
+	const char *suffix;
+	void *exrhandle = IMB_exr_get_handle();
+	
+	suffix = BKE_scene_multiview_view_suffix_get(this->m_rd, this->m_viewName);
+	BKE_image_path_from_imtype(
+	        filename, this->m_path, bmain->name, this->m_rd->cfra, R_IMF_IMTYPE_MULTILAYER,
+	        (this->m_rd->scemode & R_EXTENSION) != 0, true, suffix);
+	BLI_make_existing_file(filename);
+	
+	for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
+		OutputOpenExrLayer &layer = this->m_layers[i];
+		if (!layer.imageInput)
+			continue; /* skip unconnected sockets */
+		
+		add_exr_channels(exrhandle, layer.name, layer.datatype, "", width, this->m_exr_half_float, NULL);
+	}
+	
+	/* use the chunk size for tiles, so most chunks fill tiles completely */
+	this->m_tileSize = max_ii(this->m_tree->chunksize, 16);
+	
+	/* when the filename has no permissions, this can fail */
+	if (IMB_exr_begin_write_tiled(exrhandle, filename, width, height, this->m_tileSize, this->m_tileSize,
+	                              this->m_exr_codec, NULL))
+	{
+		this->m_exrhandle = exrhandle;
+		this->m_numberOfXTiles = (width + this->m_tileSize - 1) / this->m_tileSize;
+		this->m_numberOfYTiles = (height + this->m_tileSize - 1) / this->m_tileSize;
+		this->m_tiles = (OutputOpenExrTile *)MEM_callocN(
+		        sizeof(OutputOpenExrTile) * this->m_numberOfXTiles * this->m_numberOfYTiles, "OutputFile tiles");
+		initMutex();
+	}
+	else {
+		/* TODO, get the error from openexr's exception */
+		/* XXX nice way to do report? */
+		printf("Error Writing Render Result, see console\n");
+		IMB_exr_close(exrhandle);
+	}
 }
 
-void OutputOpenExrMultiLayerOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/)
+void OutputOpenExrMultiLayerOperation::writeTile(unsigned int xTile, unsigned int yTile)
 {
+	OutputOpenExrTile *tile = &this->m_tiles[yTile * this->m_numberOfXTiles + xTile];
+	const unsigned int tileArea = this->m_tileSize * this->m_tileSize;
+	unsigned int offset = 0;
+	
+	if (!tile->buffer) {
+		/* tile that was never calculated, e.g. outside of the viewer border or after a cancel */
+		tile->buffer = (float *)MEM_callocN(tileArea * this->m_numberOfChannels * sizeof(float), "OutputFile tile");
+	}
+	
 	for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
 		OutputOpenExrLayer &layer = this->m_layers[i];
-		if (layer.imageInput)
-			write_buffer_rect(rect, this->m_tree, layer.imageInput, layer.outputBuffer, this->getWidth(), layer.datatype);
+		if (!layer.imageInput)
+			continue;
+		
+		int size = get_datatype_size(layer.datatype);
+		float *buf = tile->buffer + tileArea * offset;
+		/* channels without layer name are added with only the pass name */
+		const char *layerName = layer.name[0] ? layer.name : NULL;
+		
+		switch (layer.datatype) {
+			case COM_DT_VALUE:
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "V", 1, this->m_tileSize, buf);
+				break;
+			case COM_DT_VECTOR:
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "X", 3, 3 * this->m_tileSize, buf);
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "Y", 3, 3 * this->m_tileSize, buf + 1);
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "Z", 3, 3 * this->m_tileSize, buf + 2);
+				break;
+			case COM_DT_COLOR:
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "R", 4, 4 * this->m_tileSize, buf);
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "G", 4, 4 * this->m_tileSize, buf + 1);
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "B", 4, 4 * this->m_tileSize, buf + 2);
+				IMB_exr_set_channel(this->m_exrhandle, layerName, "A", 4, 4 * this->m_tileSize, buf + 3);
+				break;
+			default:
+				break;
+		}
+		offset += size;
 	}
+	
+	IMB_exr_write_tile(this->m_exrhandle, xTile * this->m_tileSize, yTile * this->m_tileSize);
+	
+	MEM_freeN(tile->buffer);
+	tile->buffer = NULL;
+	tile->written = true;
 }
 
-void OutputOpenExrMultiLayerOperation::deinitExecution()
+void OutputOpenExrMultiLayerOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/)
 {
-	unsigned int width = this->getWidth();
-	unsigned int height = this->getHeight();
-	if (width != 0 && height != 0) {
-		Main *bmain = G.main; /* TODO, have this passed along */
-		char filename[FILE_MAX];
-		const char *suffix;
-		void *exrhandle = IMB_exr_get_handle();
-
-		suffix = BKE_scene_multiview_view_suffix_get(this->m_rd, this->m_viewName);
-		BKE_image_path_from_imtype(
-		        filename, this->m_path, bmain->name, this->m_rd->cfra, R_IMF_IMTYPE_MULTILAYER,
-		        (this->m_rd->scemode & R_EXTENSION) != 0, true, suffix);
-		BLI_make_existing_file(filename);
-
-		for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
-			OutputOpenExrLayer &layer = this->m_layers[i];
-			if (!layer.imageInput)
-				continue; /* skip unconnected sockets */
-			
-			add_exr_channels(exrhandle, this->m_layers[i].name, this->m_layers[i].datatype, "", width,
-			                 this->m_exr_half_float, this->m_layers[i].outputBuffer);
+	if (!this->m_exrhandle || BLI_rcti_is_empty(rect))
+		return;
+	
+	const int width = this->getWidth();
+	const int height = this->getHeight();
+	const int tileSize = this->m_tileSize;
+	const unsigned int tileArea = tileSize * tileSize;
+	/* tiles covered by the rect, y is flipped in the file */
+	const int xTileMin = rect->xmin / tileSize;
+	const int xTileMax = (rect->xmax - 1) / tileSize;
+	const int yTileMin = (height - rect->ymax) / tileSize;
+	const int yTileMax = (height - 1 - rect->ymin) / tileSize;
+	int xTile, yTile;
+	
+	lockMutex();
+	for (yTile = yTileMin; yTile <= yTileMax; yTile++) {
+		for (xTile = xTileMin; xTile <= xTileMax; xTile++) {
+			OutputOpenExrTile *tile = &this->m_tiles[yTile * this->m_numberOfXTiles + xTile];
+			if (!tile->buffer && !tile->written) {
+				tile->buffer = (float *)MEM_callocN(tileArea * this->m_numberOfChannels * sizeof(float),
+				                                    "OutputFile tile");
+			}
 		}
+	}
+	unlockMutex();
+	
+	/* regions never overlap, so the pixels can be written to the tiles without locking */
+	unsigned int offset = 0;
+	bool breaked = false;
+	for (unsigned int i = 0; i < this->m_layers.size() && !breaked; ++i) {
+		OutputOpenExrLayer &layer = this->m_layers[i];
+		if (!layer.imageInput)
+			continue;
 		
-		/* when the filename has no permissions, this can fail */
-		if (IMB_exr_begin_write(exrhandle, filename, width, height, this->m_exr_codec, NULL)) {
-			IMB_exr_write_channels(exrhandle);
-		}
-		else {
-			/* TODO, get the error from openexr's exception */
-			/* XXX nice way to do report? */
-			printf("Error Writing Render Result, see console\n");
-		}
+		int size = get_datatype_size(layer.datatype);
+		float color[4];
 		
-		IMB_exr_close(exrhandle);
-		for (unsigned int i = 0; i < this->m_layers.size(); ++i) {
-			if (this->m_layers[i].outputBuffer) {
-				MEM_freeN(this->m_layers[i].outputBuffer);
-				this->m_layers[i].outputBuffer = NULL;
+		for (int y = rect->ymin; y < rect->ymax && !breaked; y++) {
+			const int fileY = height - 1 - y;
+			yTile = fileY / tileSize;
+			for (int x = rect->xmin; x < rect->xmax; x++) {
+				xTile = x / tileSize;
+				OutputOpenExrTile *tile = &this->m_tiles[yTile * this->m_numberOfXTiles + xTile];
+				float *buf = tile->buffer + tileArea * offset +
+				             ((fileY - yTile * tileSize) * tileSize + (x - xTile * tileSize)) * size;
+				
+				layer.imageInput->readSampled(color, x, y, COM_PS_NEAREST);
+				for (int c = 0; c < size; c++)
+					buf[c] = color[c];
 			}
 			
-			this->m_layers[i].imageInput = NULL;
+			if (this->m_tree->test_break && this->m_tree->test_break(this->m_tree->tbh))
+				breaked = true;
+		}
+		offset += size;
+	}
+	
+	/* write all tiles that are complete now */
+	lockMutex();
+	for (yTile = yTileMin; yTile <= yTileMax; yTile++) {
+		/* tile rect converted back from file space */
+		const int ymin = max_ii(height - min_ii((yTile + 1) * tileSize, height), rect->ymin);
+		const int ymax = min_ii(height - yTile * tileSize, rect->ymax);
+		for (xTile = xTileMin; xTile <= xTileMax; xTile++) {
+			const int xmin = max_ii(xTile * tileSize, rect->xmin);
+			const int xmax = min_iii((xTile + 1) * tileSize, width, rect->xmax);
+			OutputOpenExrTile *tile = &this->m_tiles[yTile * this->m_numberOfXTiles + xTile];
+			
+			tile->numberOfPixels += (xmax - xmin) * (ymax - ymin);
+			if (tile->numberOfPixels == (unsigned int)(min_ii(tileSize, width - xTile * tileSize) *
+			                                           min_ii(tileSize, height - yTile * tileSize)))
+			{
+				writeTile(xTile, yTile);
+			}
 		}
 	}
+	unlockMutex();
 }
 
+void OutputOpenExrMultiLayerOperation::deinitExecution()
+{
+	if (this->m_exrhandle) {
+		/* the file is only valid when all tiles are written */
+		for (unsigned int yTile = 0; yTile < this->m_numberOfYTiles; yTile++) {
+			for (unsigned int xTile = 0; xTile < this->m_numberOfXTiles; xTile++) {
+				if (!this->m_tiles[yTile * this->m_numberOfXTiles + xTile].written)
+					writeTile(xTile, yTile);
+			}
+		}
+		
+		IMB_exr_close(this->m_exrhandle);
+		MEM_freeN(this->m_tiles);
+		deinitMutex();
+		
+		this->m_exrhandle = NULL;
+		this->m_tiles = NULL;
+	}
+	
+	for (unsigned int i = 0; i < this->m_layers.size(); ++i)
+		this->m_layers[i].imageInput = NULL;
+}
@@ -75,7 +75,19 @@ struct OutputOpenExrLayer {
 	SocketReader *imageInput;
 };
 
-/* Writes inputs into OpenEXR multilayer channels. */
+/* tile of an OpenEXR file that is being streamed */
+struct OutputOpenExrTile {
+	/* channels of all layers, allocated when the first pixel of the tile is calculated */
+	float *buffer;
+	/* number of calculated pixels in the tile */
+	unsigned int numberOfPixels;
+	/* tile is written to the file and its buffer is freed */
+	bool written;
+};
+
+/* Writes inputs into OpenEXR multilayer channels.
+ * The file is written in tiles as soon as all their pixels are calculated,
+ * so the full image of all layers never needs to be in memory. */
 class OutputOpenExrMultiLayerOperation : public NodeOperation {
 protected:
 	typedef std::vector<OutputOpenExrLayer> LayerList;
@@ -89,6 +101,16 @@ protected:
 	LayerList m_layers;
 	const char *m_viewName;
 	
+	/* streaming state, tiles are in file space where y goes down */
+	void *m_exrhandle;
+	OutputOpenExrTile *m_tiles;
+	unsigned int m_tileSize;
+	unsigned int m_numberOfXTiles;
+	unsigned int m_numberOfYTiles;
+	unsigned int m_numberOfChannels;
+	
+	void writeTile(unsigned int xTile, unsigned int yTile);
+	
 public:
 	OutputOpenExrMultiLayerOperation(const RenderData *rd, const bNodeTree *tree, const char *path,
 	                                 char exr_codec, bool exr_half_float, const char *viewName);
@@ -108,5 +130,8 @@ void add_exr_channels(void *exrhandle, const char *layerName, const DataType dat
                       const size_t width, bool use_half_float, float *buf);
 void free_exr_channels(void *exrhandle, const RenderData *rd, const char *layerName, const DataType datatype);
 int get_datatype_size(DataType datatype);
+float *init_buffer(unsigned int width, unsigned int height, DataType datatype);
+void write_buffer_rect(rcti *rect, const bNodeTree *tree,
+                       SocketReader *reader, float *buffer, unsigned int width, DataType datatype);
 
 #endif
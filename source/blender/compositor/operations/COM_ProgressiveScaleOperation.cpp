@@ -0,0 +1,157 @@
+/*
+ * Copyright 2015, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor:
+ *		Jeroen Bakker
+ *		Monique Dewanchand
+ */
+
+#include "COM_ProgressiveScaleOperation.h"
+#include "BLI_math.h"
+
+ProgressiveDownscaleOperation::ProgressiveDownscaleOperation(DataType datatype) : NodeOperation()
+{
+	this->addInputSocket(datatype, COM_SC_NO_RESIZE);
+	this->addOutputSocket(datatype);
+	this->setResolutionInputSocketIndex(0);
+	this->m_inputOperation = NULL;
+	this->m_divider = 1;
+	this->m_fullResolution[0] = 0;
+	this->m_fullResolution[1] = 0;
+}
+
+void ProgressiveDownscaleOperation::initExecution()
+{
+	this->m_inputOperation = this->getInputSocketReader(0);
+}
+
+void ProgressiveDownscaleOperation::deinitExecution()
+{
+	this->m_inputOperation = NULL;
+}
+
+void ProgressiveDownscaleOperation::executePixelSampled(float output[4], float x, float y, PixelSampler /*sampler*/)
+{
+	/* nearest sample of the center of the input pixels, the last pixels can be partially outside */
+	const float maxX = this->m_inputOperation->getWidth() - 1;
+	const float maxY = this->m_inputOperation->getHeight() - 1;
+	const float inputX = min_ff((x + 0.5f) * this->m_divider - 0.5f, maxX);
+	const float inputY = min_ff((y + 0.5f) * this->m_divider - 0.5f, maxY);
+
+	this->m_inputOperation->readSampled(output, inputX, inputY, COM_PS_NEAREST);
+}
+
+void ProgressiveDownscaleOperation::determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2])
+{
+	unsigned int inputPreferredResolution[2];
+	inputPreferredResolution[0] = preferredResolution[0] * this->m_divider;
+	inputPreferredResolution[1] = preferredResolution[1] * this->m_divider;
+
+	NodeOperation::determineResolution(resolution, inputPreferredResolution);
+	this->m_fullResolution[0] = resolution[0];
+	this->m_fullResolution[1] = resolution[1];
+	resolution[0] = (resolution[0] + this->m_divider - 1) / this->m_divider;
+	resolution[1] = (resolution[1] + this->m_divider - 1) / this->m_divider;
+}
+
+bool ProgressiveDownscaleOperation::determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output)
+{
+	rcti newInput;
+
+	newInput.xmin = input->xmin * this->m_divider;
+	newInput.xmax = input->xmax * this->m_divider;
+	newInput.ymin = input->ymin * this->m_divider;
+	newInput.ymax = input->ymax * this->m_divider;
+
+	return NodeOperation::determineDependingAreaOfInterest(&newInput, readOperation, output);
+}
+
+
+ProgressiveUpscaleOperation::ProgressiveUpscaleOperation(DataType datatype) : NodeOperation()
+{
+	this->addInputSocket(datatype, COM_SC_NO_RESIZE);
+	this->addOutputSocket(datatype);
+	this->setResolutionInputSocketIndex(0);
+	this->setComplex(true);
+	this->m_divider = 1;
+}
+
+void *ProgressiveUpscaleOperation::initializeTileData(rcti * /*rect*/)
+{
+	return getInputOperation(0)->initializeTileData(NULL);
+}
+
+void ProgressiveUpscaleOperation::executePixel(float output[4], int x, int y, void *data)
+{
+	MemoryBuffer *inputBuffer = (MemoryBuffer *)data;
+	inputBuffer->read(output, x / this->m_divider, y / this->m_divider);
+}
+
+void ProgressiveUpscaleOperation::determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2])
+{
+	unsigned int inputPreferredResolution[2];
+	inputPreferredResolution[0] = preferredResolution[0] / this->m_divider;
+	inputPreferredResolution[1] = preferredResolution[1] / this->m_divider;
+
+	NodeOperation::determineResolution(resolution, inputPreferredResolution);
+
+	/* the downscaled resolution is rounded up, so multiplying it can give a larger resolution than the
+	 * original one. Use the resolution before downscaling when the operations in between kept it */
+	const unsigned int *fullResolution = findFullResolution(resolution);
+	if (fullResolution) {
+		resolution[0] = fullResolution[0];
+		resolution[1] = fullResolution[1];
+	}
+	else {
+		resolution[0] *= this->m_divider;
+		resolution[1] *= this->m_divider;
+	}
+}
+
+const unsigned int *ProgressiveUpscaleOperation::findFullResolution(const unsigned int resolution[2])
+{
+	NodeOperation *operation = this->getInputOperation(0);
+
+	/* follow the inputs that determine the resolution up to the downscale of the source */
+	while (operation) {
+		if (operation->getWidth() != resolution[0] || operation->getHeight() != resolution[1]) {
+			return NULL;
+		}
+		if (operation->isProgressiveDownscaleOperation()) {
+			return ((ProgressiveDownscaleOperation *)operation)->getFullResolution();
+		}
+		if (operation->getResolutionInputSocketIndex() >= operation->getNumberOfInputSockets()) {
+			return NULL;
+		}
+		NodeOperationInput *input = operation->getInputSocket(operation->getResolutionInputSocketIndex());
+		operation = (input->isConnected()) ? &input->getLink()->getOperation() : NULL;
+	}
+
+	return NULL;
+}
+
+bool ProgressiveUpscaleOperation::determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output)
+{
+	rcti newInput;
+
+	newInput.xmin = input->xmin / this->m_divider;
+	newInput.xmax = input->xmax / this->m_divider + 1;
+	newInput.ymin = input->ymin / this->m_divider;
+	newInput.ymax = input->ymax / this->m_divider + 1;
+
+	return NodeOperation::determineDependingAreaOfInterest(&newInput, readOperation, output);
+}
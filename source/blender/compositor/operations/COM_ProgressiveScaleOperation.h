@@ -0,0 +1,79 @@
+/*
+ * Copyright 2015, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor:
+ *		Jeroen Bakker
+ *		Monique Dewanchand
+ */
+
+#ifndef _COM_ProgressiveScaleOperation_h_
+#define _COM_ProgressiveScaleOperation_h_
+
+#include "COM_NodeOperation.h"
+
+/**
+ * @brief reduces the resolution of an input by an integer divider.
+ * Added after the input operations when the graph is evaluated at a lower resolution
+ * @see CompositorContext.getResolutionDivider
+ */
+class ProgressiveDownscaleOperation : public NodeOperation {
+private:
+	SocketReader *m_inputOperation;
+	int m_divider;
+	/* resolution of the input, the downscaled resolution is rounded up */
+	unsigned int m_fullResolution[2];
+public:
+	ProgressiveDownscaleOperation(DataType datatype);
+
+	void executePixelSampled(float output[4], float x, float y, PixelSampler sampler);
+	void determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2]);
+	bool determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output);
+
+	void initExecution();
+	void deinitExecution();
+
+	void setDivider(int divider) { this->m_divider = divider; }
+	const unsigned int *getFullResolution() const { return this->m_fullResolution; }
+	bool isProgressiveDownscaleOperation() const { return true; }
+};
+
+/**
+ * @brief enlarges the resolution of a buffered input by an integer divider.
+ * Added before the output operations when the graph is evaluated at a lower resolution,
+ * so the viewer and composite show the result at its original size.
+ * @see CompositorContext.getResolutionDivider
+ */
+class ProgressiveUpscaleOperation : public NodeOperation {
+private:
+	int m_divider;
+
+	/**
+	 * @brief resolution before downscaling of the input, NULL when it is not known
+	 */
+	const unsigned int *findFullResolution(const unsigned int resolution[2]);
+public:
+	ProgressiveUpscaleOperation(DataType datatype);
+
+	void *initializeTileData(rcti *rect);
+	void executePixel(float output[4], int x, int y, void *data);
+	void determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2]);
+	bool determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output);
+
+	void setDivider(int divider) { this->m_divider = divider; }
+};
+
+#endif
@@ -60,8 +60,11 @@ void WriteBufferOperation::deinitExecution()
 void WriteBufferOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/)
 {
 	MemoryBuffer *memoryBuffer = this->m_memoryProxy->getBuffer();
-	float *buffer = memoryBuffer->getBuffer();
+	/* reduced precision buffers are written through a single pixel */
+	const bool is_float = (memoryBuffer->getStorage() == COM_MB_STORAGE_FLOAT);
+	float *buffer = is_float ? memoryBuffer->getBuffer() : NULL;
 	const int num_channels = memoryBuffer->get_num_channels();
+	float color[4];
 	if (this->m_input->isComplex()) {
 		void *data = this->m_input->initializeTileData(rect);
 		int x1 = rect->xmin;
@@ -74,7 +77,13 @@ void WriteBufferOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/
 		for (y = y1; y < y2 && (!breaked); y++) {
 			int offset4 = (y * memoryBuffer->getWidth() + x1) * num_channels;
 			for (x = x1; x < x2; x++) {
-				this->m_input->read(&(buffer[offset4]), x, y, data);
+				if (is_float) {
+					this->m_input->read(&(buffer[offset4]), x, y, data);
+				}
+				else {
+					this->m_input->read(color, x, y, data);
+					memoryBuffer->writePixel(x, y, color);
+				}
 				offset4 += num_channels;
 			}
 			if (isBreaked()) {
@@ -99,7 +108,13 @@ void WriteBufferOperation::executeRegion(rcti *rect, unsigned int /*tileNumber*/
 		for (y = y1; y < y2 && (!breaked); y++) {
 			int offset4 = (y * memoryBuffer->getWidth() + x1) * num_channels;
 			for (x = x1; x < x2; x++) {
-				this->m_input->readSampled(&(buffer[offset4]), x, y, COM_PS_NEAREST);
+				if (is_float) {
+					this->m_input->readSampled(&(buffer[offset4]), x, y, COM_PS_NEAREST);
+				}
+				else {
+					this->m_input->readSampled(color, x, y, COM_PS_NEAREST);
+					memoryBuffer->writePixel(x, y, color);
+				}
 				offset4 += num_channels;
 			}
 			if (isBreaked()) {
@@ -89,6 +89,7 @@ _CRTIMP void __cdecl _invalid_parameter_noinfo(void)
 #include <ImfPixelType.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
+#include <ImfTiledOutputFile.h>
 #include <ImfCompression.h>
 #include <ImfCompressionAttribute.h>
 #include <ImfStringAttribute.h>
@@ -665,6 +666,7 @@ typedef struct ExrHandle {
 	OFileStream *ofile_stream;
 	MultiPartOutputFile *mpofile;
 	OutputFile *ofile;
+	TiledOutputFile *tofile;
 
 	int tilex, tiley;
 	int width, height;
@@ -911,6 +913,60 @@ int IMB_exr_begin_write(void *handle, const char *filename, int width, int heigh
 	return (data->ofile != NULL);
 }
 
+/* used for output files that are written tile by tile while they are calculated
+ * (single and multilayer, no multiview). Tiles can be written in any order */
+int IMB_exr_begin_write_tiled(void *handle, const char *filename, int width, int height, int tilex, int tiley,
+                              int compress, const StampData *stamp)
+{
+	ExrHandle *data = (ExrHandle *)handle;
+	Header header(width, height);
+	ExrChannel *echan;
+
+	data->tilex = tilex;
+	data->tiley = tiley;
+	data->width = width;
+	data->height = height;
+	data->mipmap = 0;
+
+	bool is_singlelayer, is_multilayer, is_multiview;
+
+	for (echan = (ExrChannel *)data->channels.first; echan; echan = echan->next) {
+		header.channels().insert(echan->name,
+		                         Channel(echan->use_half_float ? Imf::HALF : Imf::FLOAT));
+	}
+
+	header.setTileDescription(TileDescription(tilex, tiley, ONE_LEVEL));
+	/* write tiles as soon as they are passed in, instead of buffering them to get increasing y */
+	header.lineOrder() = RANDOM_Y;
+
+	openexr_header_compression(&header, compress);
+	BKE_stamp_info_callback(&header, const_cast<StampData *>(stamp), openexr_header_metadata_callback, false);
+
+	imb_exr_type_by_channels(header.channels(), *data->multiView, &is_singlelayer, &is_multilayer, &is_multiview);
+	BLI_assert(!is_multiview);
+
+	if (is_multilayer)
+		header.insert("BlenderMultiChannel", StringAttribute("Blender V2.55.1 and newer"));
+
+	/* avoid crash/abort when we don't have permission to write here */
+	/* manually create ofstream, so we can handle utf-8 filepaths on windows */
+	try {
+		data->ofile_stream = new OFileStream(filename);
+		data->tofile = new TiledOutputFile(*(data->ofile_stream), header);
+	}
+	catch (const std::exception& exc) {
+		std::cerr << "IMB_exr_begin_write_tiled: ERROR: " << exc.what() << std::endl;
+
+		delete data->tofile;
+		delete data->ofile_stream;
+
+		data->tofile = NULL;
+		data->ofile_stream = NULL;
+	}
+
+	return (data->tofile != NULL);
+}
+
 /* only used for writing temp. render results (not image files)
  * (FSA and Save Buffers) */
 void IMB_exrtile_begin_write(void *handle, const char *filename, int mipmap, int width, int height, int tilex, int tiley)
@@ -1198,6 +1254,57 @@ void IMB_exrtile_write_channels(void *handle, int partx, int party, int level, c
 	}
 }
 
+/* write the tile starting at pixel (partx, party) of a file opened with IMB_exr_begin_write_tiled,
+ * the channel rects point to the first pixel of the tile, rows go down like in the file */
+void IMB_exr_write_tile(void *handle, int partx, int party)
+{
+	ExrHandle *data = (ExrHandle *)handle;
+	FrameBuffer frameBuffer;
+	ExrChannel *echan;
+	const int width = std::min(data->tilex, data->width - partx);
+	const int height = std::min(data->tiley, data->height - party);
+	half *rect_half = NULL, *current_rect_half = NULL;
+
+	/* We allocate teporary storage for half pixels for all the channels of the tile at once. */
+	if (data->num_half_channels != 0) {
+		rect_half = (half *)MEM_mallocN(sizeof(half) * data->num_half_channels * width * height, __func__);
+		current_rect_half = rect_half;
+	}
+
+	for (echan = (ExrChannel *)data->channels.first; echan; echan = echan->next) {
+		if (echan->use_half_float) {
+			half *cur = current_rect_half;
+			for (int y = 0; y < height; y++) {
+				const float *rect = echan->rect + y * echan->ystride;
+				for (int x = 0; x < width; x++, cur++) {
+					*cur = rect[x * echan->xstride];
+				}
+			}
+			half *rect_to_write = current_rect_half - partx - party * width;
+			frameBuffer.insert(echan->name, Slice(Imf::HALF, (char *)rect_to_write,
+			                                      sizeof(half), width * sizeof(half)));
+			current_rect_half += width * height;
+		}
+		else {
+			float *rect = echan->rect - echan->xstride * partx - echan->ystride * party;
+			frameBuffer.insert(echan->name, Slice(Imf::FLOAT, (char *)rect,
+			                                      echan->xstride * sizeof(float), echan->ystride * sizeof(float)));
+		}
+	}
+
+	data->tofile->setFrameBuffer(frameBuffer);
+	try {
+		data->tofile->writeTile(partx / data->tilex, party / data->tiley);
+	}
+	catch (const std::exception& exc) {
+		std::cerr << "OpenEXR-writeTile: ERROR: " << exc.what() << std::endl;
+	}
+
+	if (rect_half != NULL) {
+		MEM_freeN(rect_half);
+	}
+}
+
 /* called only when handle has all views */
 void IMB_exrmultiview_write_channels(void *handle, const char *viewname)
 {
@@ -1409,6 +1516,7 @@ void IMB_exr_close(void *handle)
 	delete data->ifile_stream;
 	delete data->ofile;
 	delete data->mpofile;
+	delete data->tofile;
 	delete data->ofile_stream;
 	delete data->multiView;
 
@@ -1416,6 +1524,7 @@ void IMB_exr_close(void *handle)
 	data->ifile_stream = NULL;
 	data->ofile = NULL;
 	data->mpofile = NULL;
+	data->tofile = NULL;
 	data->ofile_stream = NULL;
 
 	for (chan = (ExrChannel *)data->channels.first; chan; chan = chan->next) {
@@ -41,6 +41,7 @@ void    IMB_exr_add_channel         (void * /*handle*/, const char * /*layname*/
 int     IMB_exr_begin_read          (void * /*handle*/, const char * /*filename*/, int * /*width*/, int * /*height*/) { return 0;}
 int     IMB_exr_begin_write         (void * /*handle*/, const char * /*filename*/, int /*width*/, int /*height*/, int /*compress*/, const struct StampData * /*stamp*/) { return 0;}
 void    IMB_exrtile_begin_write     (void * /*handle*/, const char * /*filename*/, int /*mipmap*/, int /*width*/, int /*height*/, int /*tilex*/, int /*tiley*/) { }
+int     IMB_exr_begin_write_tiled   (void * /*handle*/, const char * /*filename*/, int /*width*/, int /*height*/, int /*tilex*/, int /*tiley*/, int /*compress*/, const struct StampData * /*stamp*/) { return 0;}
 
 void    IMB_exr_set_channel         (void * /*handle*/, const char * /*layname*/, const char * /*passname*/, int /*xstride*/, int /*ystride*/, float * /*rect*/) { }
 float  *IMB_exr_channel_rect        (void * /*handle*/, const char * /*layname*/, const char * /*passname*/, const char * /*view*/) { return NULL; }
@@ -48,6 +49,7 @@ float  *IMB_exr_channel_rect        (void * /*handle*/, const char * /*layname*/
 void    IMB_exr_read_channels       (void * /*handle*/) { }
 void    IMB_exr_write_channels      (void * /*handle*/) { }
 void    IMB_exrtile_write_channels  (void * /*handle*/, int /*partx*/, int /*party*/, int /*level*/, const char * /*viewname*/) { }
+void    IMB_exr_write_tile          (void * /*handle*/, int /*partx*/, int /*party*/) { }
 void    IMB_exrmultiview_write_channels(void * /*handle*/, const char * /*viewname*/) { }
 void    IMB_exr_clear_channels  (void * /*handle*/) { }
 
@@ -326,6 +326,9 @@ enum {
 	LIB_TAG_ID_RECALC_DATA  = 1 << 13,
 	LIB_TAG_ANIM_NO_RECALC  = 1 << 14,
 	LIB_TAG_ID_RECALC_ALL   = (LIB_TAG_ID_RECALC | LIB_TAG_ID_RECALC_DATA),
+
+	/* RESET_AFTER_USE tag datablock kept as is from the old main when reading an undo step. */
+	LIB_TAG_UNDO_OLD_ID_REUSED = 1 << 15,
 };
 
 /* To filter ID types (filter_id) */
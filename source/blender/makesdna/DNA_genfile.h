@@ -34,6 +34,7 @@
 #define __DNA_GENFILE_H__
 
 struct SDNA;
+struct DNA_ReconstructInfo;
 
 /* DNAstr contains the prebuilt SDNA structure defining the layouts of the types
  * used by this version of Blender. It is defined in a file dna.c, which is
@@ -66,7 +67,9 @@ void DNA_sdna_free(struct SDNA *sdna);
 int DNA_struct_find_nr(struct SDNA *sdna, const char *str);
 void DNA_struct_switch_endian(struct SDNA *oldsdna, int oldSDNAnr, char *data);
 char *DNA_struct_get_compareflags(struct SDNA *sdna, struct SDNA *newsdna);
-void *DNA_struct_reconstruct(struct SDNA *newsdna, struct SDNA *oldsdna, char *compflags, int oldSDNAnr, int blocks, void *data);
+struct DNA_ReconstructInfo *DNA_reconstruct_info_create(struct SDNA *oldsdna, struct SDNA *newsdna, const char *compflags);
+void DNA_reconstruct_info_free(struct DNA_ReconstructInfo *reconstruct_info);
+void *DNA_struct_reconstruct(const struct DNA_ReconstructInfo *reconstruct_info, int oldSDNAnr, int blocks, const void *data);
 
 int DNA_elem_array_size(const char *str);
 int DNA_elem_offset(struct SDNA *sdna, const char *stype, const char *vartype, const char *name);
@@ -214,7 +214,9 @@ typedef struct bNode {
 	 * and replacing all uses with per-instance data.
 	 */
 	short preview_xsize, preview_ysize;	/* reserved size of the preview rect */
-	int pad2;
+	int exec_chunks;		/* compositor profiling: number of chunks executed by the execution groups writing this node (runtime) */
+	float exec_time;		/* compositor profiling: summed thread time of the execution groups writing this node in milliseconds (runtime) */
+	int exec_memory;		/* compositor profiling: memory used by buffers of this node in kB (runtime) */
 	struct uiBlock *block;	/* runtime during drawing */
 } bNode;
 
@@ -410,6 +412,7 @@ typedef struct bNodeTree {
 #define NTREE_COM_GROUPNODE_BUFFER	8	/* use groupnode buffers */
 #define NTREE_VIEWER_BORDER			16	/* use a border for viewer nodes */
 #define NTREE_IS_LOCALIZED			32	/* tree is localized copy, free when deleting node groups */
+#define NTREE_COM_PROGRESSIVE		64	/* calculate a low resolution pass first during editing */
 
 /* XXX not nice, but needed as a temporary flags
  * for group updates after library linking.
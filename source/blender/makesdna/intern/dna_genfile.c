@@ -715,36 +715,23 @@ static eSDNA_Type sdna_type_nr(const char *dna_type)
 }
 
 /**
- * Converts a value of one primitive type to another.
+ * Converts values of one primitive type to another.
  * Note there is no optimization for the case where otype and ctype are the same:
  * assumption is that caller will handle this case.
  *
- * \param ctype  Name of type to convert to
- * \param otype  Name of type to convert from
- * \param name  Field name to extract array-size information
+ * \param ctypenr  Type to convert to
+ * \param otypenr  Type to convert from
+ * \param arrlen  Number of values to convert
  * \param curdata  Where to put converted data
  * \param olddata  Data of type otype to convert
  */
 static void cast_elem(
-        const char *ctype, const char *otype, const char *name,
+        const eSDNA_Type ctypenr, const eSDNA_Type otypenr, int arrlen,
         char *curdata, const char *olddata)
 {
 	double val = 0.0;
-	int arrlen, curlen = 1, oldlen = 1;
-
-	eSDNA_Type ctypenr, otypenr;
-
-	arrlen = DNA_elem_array_size(name);
-
-	if ( (otypenr = sdna_type_nr(otype)) == -1 ||
-	     (ctypenr = sdna_type_nr(ctype)) == -1)
-	{
-		return;
-	}
-
-	/* define lengths */
-	oldlen = DNA_elem_type_size(otypenr);
-	curlen = DNA_elem_type_size(ctypenr);
+	const int oldlen = DNA_elem_type_size(otypenr);
+	const int curlen = DNA_elem_type_size(ctypenr);
 
 	while (arrlen > 0) {
 		switch (otypenr) {
@@ -812,16 +799,13 @@ static void cast_elem(
  *
  * \param curlen  Pointer length to conver to
  * \param oldlen  Length of pointers in olddata
- * \param name  Field name to extract array-size information
+ * \param arrlen  Number of pointers to convert
  * \param curdata  Where to put converted data
  * \param olddata  Data to convert
  */
-static void cast_pointer(int curlen, int oldlen, const char *name, char *curdata, const char *olddata)
+static void cast_pointer(int curlen, int oldlen, int arrlen, char *curdata, const char *olddata)
 {
 	int64_t lval;
-	int arrlen;
-	
-	arrlen = DNA_elem_array_size(name);
 	
 	while (arrlen > 0) {
 	
@@ -868,27 +852,25 @@ static int elem_strcmp(const char *name, const char *oname)
 }
 
 /**
- * Returns the address of the data for the specified field within olddata
- * according to the struct format pointed to by old, or NULL if no such
+ * Returns the offset of the data for the specified field within a struct
+ * according to the struct format pointed to by old, or -1 if no such
  * field can be found.
  *
  * \param sdna  Old SDNA
  * \param type  Current field type name
  * \param name  Current field name
  * \param old  Pointer to struct information in sdna
- * \param olddata  Struct data
  * \param sppo  Optional place to return pointer to field info in sdna
- * \return Data address.
+ * \return Data offset.
  */
-static char *find_elem(
+static int find_elem_offset(
         const SDNA *sdna,
         const char *type,
         const char *name,
         const short *old,
-        char *olddata,
         const short **sppo)
 {
-	int a, elemcount, len;
+	int a, elemcount, len, offset = 0;
 	const char *otype, *oname;
 	
 	/* without arraypart, so names can differ: return old namenr and type */
@@ -906,37 +888,144 @@ static char *find_elem(
 		if (elem_strcmp(name, oname) == 0) {  /* name equal */
 			if (strcmp(type, otype) == 0) {   /* type equal */
 				if (sppo) *sppo = old;
-				return olddata;
+				return offset;
 			}
 			
-			return NULL;
+			return -1;
 		}
 		
-		olddata += len;
+		offset += len;
 	}
-	return NULL;
+	return -1;
+}
+
+/**
+ * Returns the address of the data for the specified field within olddata
+ * according to the struct format pointed to by old, or NULL if no such
+ * field can be found.
+ *
+ * \param sdna  Old SDNA
+ * \param type  Current field type name
+ * \param name  Current field name
+ * \param old  Pointer to struct information in sdna
+ * \param olddata  Struct data
+ * \param sppo  Optional place to return pointer to field info in sdna
+ * \return Data address.
+ */
+static char *find_elem(
+        const SDNA *sdna,
+        const char *type,
+        const char *name,
+        const short *old,
+        char *olddata,
+        const short **sppo)
+{
+	const int offset = find_elem_offset(sdna, type, name, old, sppo);
+
+	return (offset != -1) ? olddata + offset : NULL;
 }
 
+/* ******************* RECONSTRUCT ***************** */
+
 /**
- * Converts the contents of a single field of a struct, of a non-struct type,
+ * Converting a struct from oldsdna to newsdna format is done by a list of steps,
+ * made once per struct for all blocks of a file (matching the fields by name is the slow part).
+ * Fields that aren't in the old struct are not written, the new struct is zero initialized.
+ */
+typedef enum eReconstructStepType {
+	RECONSTRUCT_STEP_MEMCPY = 0,
+	RECONSTRUCT_STEP_CAST_ELEM,
+	RECONSTRUCT_STEP_CAST_POINTER,
+	RECONSTRUCT_STEP_SUBSTRUCT,
+	RECONSTRUCT_STEP_ZERO,
+} eReconstructStepType;
+
+typedef struct ReconstructStep {
+	eReconstructStepType type;
+	int old_offset, new_offset;
+	/* bytes for #RECONSTRUCT_STEP_MEMCPY and #RECONSTRUCT_STEP_ZERO, number of elements otherwise */
+	int len;
+
+	/* #RECONSTRUCT_STEP_CAST_ELEM */
+	eSDNA_Type old_type, new_type;
+	/* #RECONSTRUCT_STEP_SUBSTRUCT, reconstructing an array of the struct with its own steps */
+	int old_struct_nr, old_stride, new_stride;
+} ReconstructStep;
+
+typedef struct DNA_ReconstructInfo {
+	const SDNA *oldsdna, *newsdna;
+	const char *compflags;
+
+	/* per struct of oldsdna, the struct of newsdna and the steps when they differ */
+	int *new_struct_nrs;
+	ReconstructStep **steps;
+	int *steps_len;
+} DNA_ReconstructInfo;
+
+static ReconstructStep *reconstruct_step_add(ReconstructStep *steps, int *steps_len, eReconstructStepType type,
+                                             int old_offset, int new_offset, int len)
+{
+	ReconstructStep *step = &steps[(*steps_len)++];
+
+	memset(step, 0, sizeof(*step));
+	step->type = type;
+	step->old_offset = old_offset;
+	step->new_offset = new_offset;
+	step->len = len;
+
+	return step;
+}
+
+static void reconstruct_step_add_pointer(
+        const SDNA *newsdna, const SDNA *oldsdna, ReconstructStep *steps, int *steps_len,
+        int old_offset, int new_offset, int arrlen)
+{
+	if (newsdna->pointerlen == oldsdna->pointerlen) {
+		reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset,
+		                     arrlen * oldsdna->pointerlen);
+	}
+	else {
+		reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_CAST_POINTER, old_offset, new_offset, arrlen);
+	}
+}
+
+static void reconstruct_step_add_cast(
+        ReconstructStep *steps, int *steps_len, const char *type, const char *otype,
+        int old_offset, int new_offset, int arrlen)
+{
+	const eSDNA_Type ctypenr = sdna_type_nr(type);
+	const eSDNA_Type otypenr = sdna_type_nr(otype);
+	ReconstructStep *step;
+
+	if (ctypenr == -1 || otypenr == -1) {
+		return;
+	}
+
+	step = reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_CAST_ELEM, old_offset, new_offset, arrlen);
+	step->old_type = otypenr;
+	step->new_type = ctypenr;
+}
+
+/**
+ * Adds the steps converting a single field of a struct, of a non-struct type,
  * from oldsdna to newsdna format.
  *
  * \param newsdna  SDNA of current Blender
  * \param oldsdna  SDNA of Blender that saved file
  * \param type  current field type name
  * \param name  current field name
- * \param curdata  put field data converted to newsdna here
+ * \param new_offset  offset of the field in the current struct
  * \param old  pointer to struct info in oldsdna
- * \param olddata  struct contents laid out according to oldsdna
  */
-static void reconstruct_elem(
+static void reconstruct_elem_steps(
         const SDNA *newsdna,
         const SDNA *oldsdna,
         const char *type,
         const char *name,
-        char *curdata,
+        const int new_offset,
         const short *old,
-        const char *olddata)
+        ReconstructStep *steps,
+        int *steps_len)
 {
 	/* rules: test for NAME:
 	 *      - name equal:
@@ -947,7 +1036,7 @@ static void reconstruct_elem(
 	 * (nzc 2-4-2001 I want the 'unsigned' bit to be parsed as well. Where
 	 * can I force this?)
 	 */
-	int a, elemcount, len, countpos, oldsize, cursize, mul;
+	int a, elemcount, len, countpos, oldsize, cursize, mul, old_offset = 0;
 	const char *otype, *oname, *cp;
 	
 	/* is 'name' an array? */
@@ -969,13 +1058,15 @@ static void reconstruct_elem(
 		if (strcmp(name, oname) == 0) { /* name equal */
 			
 			if (ispointer(name)) {  /* pointer of functionpointer afhandelen */
-				cast_pointer(newsdna->pointerlen, oldsdna->pointerlen, name, curdata, olddata);
+				reconstruct_step_add_pointer(newsdna, oldsdna, steps, steps_len,
+				                             old_offset, new_offset, DNA_elem_array_size(name));
 			}
 			else if (strcmp(type, otype) == 0) {    /* type equal */
-				memcpy(curdata, olddata, len);
+				reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset, len);
 			}
 			else {
-				cast_elem(type, otype, name, curdata, olddata);
+				reconstruct_step_add_cast(steps, steps_len, type, otype,
+				                          old_offset, new_offset, DNA_elem_array_size(name));
 			}
 
 			return;
@@ -988,76 +1079,55 @@ static void reconstruct_elem(
 				oldsize = DNA_elem_array_size(oname);
 
 				if (ispointer(name)) {  /* handle pointer or functionpointer */
-					cast_pointer(newsdna->pointerlen, oldsdna->pointerlen,
-					             cursize > oldsize ? oname : name,
-					             curdata, olddata);
+					reconstruct_step_add_pointer(newsdna, oldsdna, steps, steps_len,
+					                             old_offset, new_offset, MIN2(cursize, oldsize));
 				}
 				else if (strcmp(type, otype) == 0) {  /* type equal */
 					mul = len / oldsize; /* size of single old array element */
 					mul *= (cursize < oldsize) ? cursize : oldsize; /* smaller of sizes of old and new arrays */
-					memcpy(curdata, olddata, mul);
+					reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset, mul);
 					
 					if (oldsize > cursize && strcmp(type, "char") == 0) {
 						/* string had to be truncated, ensure it's still null-terminated */
-						curdata[mul - 1] = '\0';
+						reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_ZERO, 0, new_offset + mul - 1, 1);
 					}
 				}
 				else {
-					cast_elem(type, otype,
-					          cursize > oldsize ? oname : name,
-					          curdata, olddata);
+					reconstruct_step_add_cast(steps, steps_len, type, otype,
+					                          old_offset, new_offset, MIN2(cursize, oldsize));
 				}
 				return;
 			}
 		}
-		olddata += len;
+		old_offset += len;
 	}
 }
 
 /**
- * Converts the contents of an entire struct from oldsdna to newsdna format.
+ * Makes the steps converting the contents of an entire struct from oldsdna to newsdna format.
  *
- * \param newsdna  SDNA of current Blender
- * \param oldsdna  SDNA of Blender that saved file
- * \param compflags
- *
- * Result from DNA_struct_get_compareflags to avoid needless conversions.
  * \param oldSDNAnr  Index of old struct definition in oldsdna
- * \param data  Struct contents laid out according to oldsdna
  * \param curSDNAnr  Index of current struct definition in newsdna
- * \param cur  Where to put converted struct contents
+ * \param r_steps_len  Number of returned steps
+ * \return The steps, adjacent copies are merged
  */
-static void reconstruct_struct(
+static ReconstructStep *reconstruct_struct_steps(
         SDNA *newsdna,
         SDNA *oldsdna,
         const char *compflags,
-
         int oldSDNAnr,
-        char *data,
         int curSDNAnr,
-        char *cur)
+        int *r_steps_len)
 {
-	/* Recursive!
-	 * Per element from cur_struct, read data from old_struct.
-	 * If element is a struct, call recursive.
+	/* Per element from cur_struct, find the data in old_struct.
+	 * If element is a struct, it's reconstructed with its own steps.
 	 */
-	int a, elemcount, elen, eleno, mul, mulo, firststructtypenr;
+	int a, elemcount, elen, eleno, mul, mulo, firststructtypenr, new_offset, old_offset;
+	int structnr_old, structnr_cur, steps_len = 0;
 	const short *spo, *spc, *sppo;
 	const char *type;
-	char *cpo, *cpc;
 	const char *name, *nameo;
-
-	if (oldSDNAnr == -1) return;
-	if (curSDNAnr == -1) return;
-
-	if (compflags[oldSDNAnr] == 1) {        /* if recursive: test for equal */
-	
-		spo = oldsdna->structs[oldSDNAnr];
-		elen = oldsdna->typelens[spo[0]];
-		memcpy(cur, data, elen);
-		
-		return;
-	}
+	ReconstructStep *steps, *step;
 
 	firststructtypenr = *(newsdna->structs[0]);
 
@@ -1066,8 +1136,11 @@ static void reconstruct_struct(
 
 	elemcount = spc[1];
 
+	/* at most a copy and a zero step per field */
+	steps = MEM_mallocN(sizeof(*steps) * (size_t)MAX2(elemcount * 2, 1), __func__);
+
 	spc += 2;
-	cpc = cur;
+	new_offset = 0;
 	for (a = 0; a < elemcount; a++, spc += 2) {  /* convert each field */
 		type = newsdna->types[spc[0]];
 		name = newsdna->names[spc[1]];
@@ -1078,40 +1151,154 @@ static void reconstruct_struct(
 		if (spc[0] >= firststructtypenr && !ispointer(name)) {
 			/* struct field type */
 			/* where does the old struct data start (and is there an old one?) */
-			cpo = find_elem(oldsdna, type, name, spo, data, &sppo);
+			old_offset = find_elem_offset(oldsdna, type, name, spo, &sppo);
 			
-			if (cpo) {
-				oldSDNAnr = DNA_struct_find_nr(oldsdna, type);
-				curSDNAnr = DNA_struct_find_nr(newsdna, type);
+			if (old_offset != -1) {
+				structnr_old = DNA_struct_find_nr(oldsdna, type);
+				structnr_cur = DNA_struct_find_nr(newsdna, type);
 				
 				/* array! */
 				mul = DNA_elem_array_size(name);
 				nameo = oldsdna->names[sppo[1]];
 				mulo = DNA_elem_array_size(nameo);
 				
-				eleno = elementsize(oldsdna, sppo[0], sppo[1]);
-				
-				elen /= mul;
-				eleno /= mulo;
-				
-				while (mul--) {
-					reconstruct_struct(newsdna, oldsdna, compflags, oldSDNAnr, cpo, curSDNAnr, cpc);
-					cpo += eleno;
-					cpc += elen;
-					
-					/* new struct array larger than old */
-					mulo--;
-					if (mulo <= 0) break;
+				eleno = elementsize(oldsdna, sppo[0], sppo[1]) / mulo;
+
+				if (structnr_old != -1 && structnr_cur != -1) {
+					if (compflags[structnr_old] == 1) {
+						/* same struct, the elements follow each other in both */
+						reconstruct_step_add(&steps[0], &steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset,
+						                     MIN2(mul, mulo) * eleno);
+					}
+					else if (compflags[structnr_old] == 2) {
+						step = reconstruct_step_add(&steps[0], &steps_len, RECONSTRUCT_STEP_SUBSTRUCT,
+						                            old_offset, new_offset, MIN2(mul, mulo));
+						step->old_struct_nr = structnr_old;
+						step->old_stride = eleno;
+						step->new_stride = elen / mul;
+					}
 				}
 			}
-			else {
-				cpc += elen;  /* skip field no longer present */
-			}
 		}
 		else {
 			/* non-struct field type */
-			reconstruct_elem(newsdna, oldsdna, type, name, cpc, spo, data);
-			cpc += elen;
+			reconstruct_elem_steps(newsdna, oldsdna, type, name, new_offset, spo, steps, &steps_len);
+		}
+
+		new_offset += elen;
+	}
+
+	/* merge copies of fields that follow each other in both structs */
+	if (steps_len > 1) {
+		int b = 0;
+
+		for (a = 1; a < steps_len; a++) {
+			if (steps[b].type == RECONSTRUCT_STEP_MEMCPY &&
+			    steps[a].type == RECONSTRUCT_STEP_MEMCPY &&
+			    steps[b].old_offset + steps[b].len == steps[a].old_offset &&
+			    steps[b].new_offset + steps[b].len == steps[a].new_offset)
+			{
+				steps[b].len += steps[a].len;
+			}
+			else {
+				steps[++b] = steps[a];
+			}
+		}
+		steps_len = b + 1;
+	}
+
+	*r_steps_len = steps_len;
+	return steps;
+}
+
+/**
+ * Makes the conversion of all structs that differ between \a oldsdna and \a newsdna,
+ * to be used by #DNA_struct_reconstruct for all blocks of a file.
+ *
+ * \param compflags  Result from #DNA_struct_get_compareflags
+ */
+DNA_ReconstructInfo *DNA_reconstruct_info_create(SDNA *oldsdna, SDNA *newsdna, const char *compflags)
+{
+	DNA_ReconstructInfo *reconstruct_info = MEM_callocN(sizeof(*reconstruct_info), __func__);
+	int a;
+
+	reconstruct_info->oldsdna = oldsdna;
+	reconstruct_info->newsdna = newsdna;
+	reconstruct_info->compflags = compflags;
+	reconstruct_info->new_struct_nrs = MEM_mallocN(sizeof(int) * (size_t)oldsdna->nr_structs, __func__);
+	reconstruct_info->steps = MEM_callocN(sizeof(ReconstructStep *) * (size_t)oldsdna->nr_structs, __func__);
+	reconstruct_info->steps_len = MEM_callocN(sizeof(int) * (size_t)oldsdna->nr_structs, __func__);
+
+	for (a = 0; a < oldsdna->nr_structs; a++) {
+		const short *spo = oldsdna->structs[a];
+		const int curSDNAnr = DNA_struct_find_nr(newsdna, oldsdna->types[spo[0]]);
+
+		reconstruct_info->new_struct_nrs[a] = curSDNAnr;
+
+		if (compflags[a] == 2 && curSDNAnr != -1) {
+			reconstruct_info->steps[a] = reconstruct_struct_steps(
+			        newsdna, oldsdna, compflags, a, curSDNAnr, &reconstruct_info->steps_len[a]);
+		}
+	}
+
+	return reconstruct_info;
+}
+
+void DNA_reconstruct_info_free(DNA_ReconstructInfo *reconstruct_info)
+{
+	int a;
+
+	for (a = 0; a < reconstruct_info->oldsdna->nr_structs; a++) {
+		if (reconstruct_info->steps[a]) {
+			MEM_freeN(reconstruct_info->steps[a]);
+		}
+	}
+
+	MEM_freeN(reconstruct_info->new_struct_nrs);
+	MEM_freeN(reconstruct_info->steps);
+	MEM_freeN(reconstruct_info->steps_len);
+	MEM_freeN(reconstruct_info);
+}
+
+/**
+ * Converts the contents of an entire struct from oldsdna to newsdna format.
+ *
+ * \param oldSDNAnr  Index of old struct definition in oldsdna
+ * \param data  Struct contents laid out according to oldsdna
+ * \param cur  Where to put converted struct contents
+ */
+static void reconstruct_struct(
+        const DNA_ReconstructInfo *reconstruct_info,
+        int oldSDNAnr,
+        const char *data,
+        char *cur)
+{
+	const ReconstructStep *step = reconstruct_info->steps[oldSDNAnr];
+	const int steps_len = reconstruct_info->steps_len[oldSDNAnr];
+	int a, b;
+
+	for (a = 0; a < steps_len; a++, step++) {
+		switch (step->type) {
+			case RECONSTRUCT_STEP_MEMCPY:
+				memcpy(cur + step->new_offset, data + step->old_offset, step->len);
+				break;
+			case RECONSTRUCT_STEP_CAST_ELEM:
+				cast_elem(step->new_type, step->old_type, step->len, cur + step->new_offset, data + step->old_offset);
+				break;
+			case RECONSTRUCT_STEP_CAST_POINTER:
+				cast_pointer(reconstruct_info->newsdna->pointerlen, reconstruct_info->oldsdna->pointerlen, step->len,
+				             cur + step->new_offset, data + step->old_offset);
+				break;
+			case RECONSTRUCT_STEP_SUBSTRUCT:
+				for (b = 0; b < step->len; b++) {
+					reconstruct_struct(reconstruct_info, step->old_struct_nr,
+					                   data + step->old_offset + b * step->old_stride,
+					                   cur + step->new_offset + b * step->new_stride);
+				}
+				break;
+			case RECONSTRUCT_STEP_ZERO:
+				memset(cur + step->new_offset, 0, step->len);
+				break;
 		}
 	}
 }
@@ -1251,28 +1438,25 @@ void DNA_struct_switch_endian(SDNA *oldsdna, int oldSDNAnr, char *data)
 }
 
 /**
- * \param newsdna  SDNA of current Blender
- * \param oldsdna  SDNA of Blender that saved file
- * \param compflags
- *
- * Result from DNA_struct_get_compareflags to avoid needless conversions
+ * \param reconstruct_info  Result from #DNA_reconstruct_info_create
  * \param oldSDNAnr  Index of struct info within oldsdna
  * \param blocks  The number of array elements
  * \param data  Array of struct data
  * \return An allocated reconstructed struct
  */
-void *DNA_struct_reconstruct(SDNA *newsdna, SDNA *oldsdna, char *compflags, int oldSDNAnr, int blocks, void *data)
+void *DNA_struct_reconstruct(const DNA_ReconstructInfo *reconstruct_info, int oldSDNAnr, int blocks, const void *data)
 {
-	int a, curSDNAnr, curlen = 0, oldlen;
+	const SDNA *oldsdna = reconstruct_info->oldsdna;
+	const SDNA *newsdna = reconstruct_info->newsdna;
+	const int curSDNAnr = reconstruct_info->new_struct_nrs[oldSDNAnr];
+	int a, curlen = 0, oldlen;
 	const short *spo, *spc;
-	char *cur, *cpc, *cpo;
-	const char *type;
+	char *cur, *cpc;
+	const char *cpo;
 	
 	/* oldSDNAnr == structnr, we're looking for the corresponding 'cur' number */
 	spo = oldsdna->structs[oldSDNAnr];
-	type = oldsdna->types[spo[0]];
 	oldlen = oldsdna->typelens[spo[0]];
-	curSDNAnr = DNA_struct_find_nr(newsdna, type);
 
 	/* init data and alloc */
 	if (curSDNAnr != -1) {
@@ -1284,10 +1468,16 @@ void *DNA_struct_reconstruct(SDNA *newsdna, SDNA *oldsdna, char *compflags, int
 	}
 
 	cur = MEM_callocN(blocks * curlen, "reconstruct");
+
+	if (reconstruct_info->compflags[oldSDNAnr] == 1) {
+		memcpy(cur, data, (size_t)blocks * oldlen);
+		return cur;
+	}
+
 	cpc = cur;
 	cpo = data;
 	for (a = 0; a < blocks; a++) {
-		reconstruct_struct(newsdna, oldsdna, compflags, oldSDNAnr, cpo, curSDNAnr, cpc);
+		reconstruct_struct(reconstruct_info, oldSDNAnr, cpo, cpc);
 		cpc += curlen;
 		cpo += oldlen;
 	}
@@ -7581,6 +7581,27 @@ static void rna_def_node(BlenderRNA *brna)
 	RNA_def_property_struct_type(prop, "NodeLink");
 	RNA_def_property_ui_text(prop, "Internal Links", "Internal input-to-output connections for muting");
 
+	prop = RNA_def_property(srna, "execution_time", PROP_FLOAT, PROP_NONE);
+	RNA_def_property_float_sdna(prop, NULL, "exec_time");
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_ui_text(prop, "Group Execution Time",
+	                         "Time in milliseconds spent by all threads on the execution groups writing the "
+	                         "result of this node during the last compositing (nodes evaluated per pixel "
+	                         "inside the group of another node have no time of their own)");
+
+	prop = RNA_def_property(srna, "execution_chunks", PROP_INT, PROP_NONE);
+	RNA_def_property_int_sdna(prop, NULL, "exec_chunks");
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_ui_text(prop, "Execution Chunks",
+	                         "Number of chunks executed by the execution groups writing the result of this node "
+	                         "during the last compositing");
+
+	prop = RNA_def_property(srna, "execution_memory", PROP_INT, PROP_NONE);
+	RNA_def_property_int_sdna(prop, NULL, "exec_memory");
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_ui_text(prop, "Execution Memory",
+	                         "Memory in kB used by the buffers of this node during the last compositing");
+
 	prop = RNA_def_property(srna, "parent", PROP_POINTER, PROP_NONE);
 	RNA_def_property_pointer_sdna(prop, NULL, "parent");
 	RNA_def_property_pointer_funcs(prop, NULL, "rna_Node_parent_set", NULL, "rna_Node_parent_poll");
@@ -8124,6 +8145,11 @@ static void rna_def_composite_nodetree(BlenderRNA *brna)
 	RNA_def_property_ui_text(prop, "Two Pass", "Use two pass execution during editing: first calculate fast nodes, "
 	                                           "second pass calculate all nodes");
 
+	prop = RNA_def_property(srna, "use_progressive", PROP_BOOLEAN, PROP_NONE);
+	RNA_def_property_boolean_sdna(prop, NULL, "flag", NTREE_COM_PROGRESSIVE);
+	RNA_def_property_ui_text(prop, "Progressive", "Use progressive execution during editing: first calculate all "
+	                                              "nodes at a lower resolution, then refine to full resolution");
+
 	prop = RNA_def_property(srna, "use_viewer_border", PROP_BOOLEAN, PROP_NONE);
 	RNA_def_property_boolean_sdna(prop, NULL, "flag", NTREE_VIEWER_BORDER);
 	RNA_def_property_ui_text(prop, "Viewer Border", "Use boundaries for viewer nodes and composite backdrop");
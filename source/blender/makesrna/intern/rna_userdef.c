@@ -4635,6 +4635,12 @@ static void rna_def_userdef_filepaths(BlenderRNA *brna)
 	RNA_def_property_boolean_sdna(prop, NULL, "flag", USER_SAVE_PREVIEWS);
 	RNA_def_property_ui_text(prop, "Save Preview Images",
 	                         "Enables automatic saving of preview images in the .blend file");
+
+	prop = RNA_def_property(srna, "use_save_background", PROP_BOOLEAN, PROP_NONE);
+	RNA_def_property_boolean_sdna(prop, NULL, "flag", USER_SAVE_ASYNC);
+	RNA_def_property_ui_text(prop, "Save in Background",
+	                         "Write .blend files to disk in a background thread, "
+	                         "the interface is only blocked while the file is copied into memory");
 }
 
 static void rna_def_userdef_addon_collection(BlenderRNA *brna, PropertyRNA *cprop)
@@ -129,9 +129,24 @@ static void localize(bNodeTree *UNUSED(localtree), bNodeTree *ntree)
 	}
 }
 
+/* copy the compositor profiling statistics back to the original nodes */
+static void local_sync_statistics(bNodeTree *localtree, bNodeTree *ntree)
+{
+	bNode *lnode;
+	
+	for (lnode = localtree->nodes.first; lnode; lnode = lnode->next) {
+		if (ntreeNodeExists(ntree, lnode->new_node)) {
+			lnode->new_node->exec_chunks = lnode->exec_chunks;
+			lnode->new_node->exec_time = lnode->exec_time;
+			lnode->new_node->exec_memory = lnode->exec_memory;
+		}
+	}
+}
+
 static void local_sync(bNodeTree *localtree, bNodeTree *ntree)
 {
 	BKE_node_preview_sync_tree(ntree, localtree);
+	local_sync_statistics(localtree, ntree);
 }
 
 static void local_merge(bNodeTree *localtree, bNodeTree *ntree)
@@ -141,6 +156,7 @@ static void local_merge(bNodeTree *localtree, bNodeTree *ntree)
 	
 	/* move over the compbufs and previews */
 	BKE_node_preview_merge_tree(ntree, localtree, true);
+	local_sync_statistics(localtree, ntree);
 	
 	for (lnode = localtree->nodes.first; lnode; lnode = lnode->next) {
 		if (ntreeNodeExists(ntree, lnode->new_node)) {
@@ -596,24 +596,31 @@ void WM_event_print(const wmEvent *event)
 #endif /* NDEBUG */
 
 /**
- * Show the report in the info header.
+ * Show the report in the info header, also for code running without context (jobs ending).
  */
-void WM_report_banner_show(const bContext *C)
+void wm_report_banner_show(wmWindowManager *wm, wmWindow *win)
 {
-	wmWindowManager *wm = CTX_wm_manager(C);
-	ReportList *wm_reports = CTX_wm_reports(C);
+	ReportList *wm_reports = &wm->reports;
 	ReportTimerInfo *rti;
 
 	/* After adding reports to the global list, reset the report timer. */
 	WM_event_remove_timer(wm, NULL, wm_reports->reporttimer);
 
 	/* Records time since last report was added */
-	wm_reports->reporttimer = WM_event_add_timer(wm, CTX_wm_window(C), TIMERREPORT, 0.05);
+	wm_reports->reporttimer = WM_event_add_timer(wm, win, TIMERREPORT, 0.05);
 
 	rti = MEM_callocN(sizeof(ReportTimerInfo), "ReportTimerInfo");
 	wm_reports->reporttimer->customdata = rti;
 }
 
+/**
+ * Show the report in the info header.
+ */
+void WM_report_banner_show(const bContext *C)
+{
+	wm_report_banner_show(CTX_wm_manager(C), CTX_wm_window(C));
+}
+
 bool WM_event_is_absolute(const wmEvent *event)
 {
 	return (event->tablet_data != NULL);
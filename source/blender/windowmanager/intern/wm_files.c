@@ -991,6 +991,223 @@ bool write_crash_blend(void)
 	}
 }
 
+/* -------------------------------------------------------------------- */
+/** \name Saving in Background
+ *
+ * With #USER_SAVE_ASYNC the file is only copied into memory while the interface is blocked,
+ * compressing and writing it to disk happens in a job.
+ *
+ * Saves are queued in the order they are made: a job drains its queue of snapshots,
+ * and saving while a job runs appends to that queue instead of replacing a pending save.
+ * Snapshots of a queue that never started (jobs killed when loading files or quitting)
+ * are written synchronously when it is freed, so a save that was reported is always completed.
+ * \{ */
+
+typedef struct FileWriteJob {
+	struct FileWriteJob *next, *prev;
+	BlendWriteSnapshot *snapshot;
+	char filepath[FILE_MAX];
+	/* written once the file exists, only for regular saving (not autosave) */
+	ImBuf *ibuf_thumb;
+	bool is_autosave;
+	bool success;
+	ReportList reports;
+} FileWriteJob;
+
+typedef struct FileWriteQueue {
+	wmWindowManager *wm;
+	/* protects the lists and is_finished, the job thread takes snapshots from 'pending' */
+	ThreadMutex mutex;
+	ListBase pending;
+	/* written, reported from the main thread in the endjob callback */
+	ListBase done;
+	/* set by the job when 'pending' was empty, the queue can't be appended to anymore */
+	bool is_finished;
+} FileWriteQueue;
+
+/* run after the file is written */
+static void wm_file_write_post(const char *filepath, ImBuf **ibuf_thumb)
+{
+	BLI_callback_exec(G.main, NULL, BLI_CB_EVT_SAVE_POST);
+
+	/* run this function after because the file cant be written before the blend is */
+	if (*ibuf_thumb) {
+		IMB_thumb_delete(filepath, THB_FAIL); /* without this a failed thumb overrides */
+		*ibuf_thumb = IMB_thumb_create(filepath, THB_LARGE, THB_SOURCE_BLEND, *ibuf_thumb);
+	}
+}
+
+static void wm_file_write_job_startjob(void *customdata, short *UNUSED(stop), short *UNUSED(do_update), float *progress)
+{
+	FileWriteQueue *fwq = customdata;
+	FileWriteJob *fwj;
+
+	/* stopping is not supported, the job only ends once all queued files are written */
+	while (true) {
+		BLI_mutex_lock(&fwq->mutex);
+		fwj = BLI_pophead(&fwq->pending);
+		if (fwj == NULL) {
+			fwq->is_finished = true;
+		}
+		BLI_mutex_unlock(&fwq->mutex);
+
+		if (fwj == NULL) {
+			break;
+		}
+
+		*progress = 0.0f;
+		fwj->success = BLO_write_snapshot_flush(fwj->snapshot, &fwj->reports, progress) != 0;
+
+		BLI_mutex_lock(&fwq->mutex);
+		BLI_addtail(&fwq->done, fwj);
+		BLI_mutex_unlock(&fwq->mutex);
+	}
+}
+
+static void wm_file_write_job_report(wmWindowManager *wm, FileWriteJob *fwj)
+{
+	wmWindow *win;
+
+	if (!fwj->is_autosave) {
+		if (fwj->success) {
+			wm_file_write_post(fwj->filepath, &fwj->ibuf_thumb);
+		}
+		else {
+			wm->file_saved = 0;
+			for (win = wm->windows.first; win; win = win->next) {
+				wm_window_title(wm, win);
+			}
+		}
+	}
+
+	/* add reports to the global list, otherwise they are not seen (autosave doesn't report errors) */
+	if (fwj->reports.list.first && !fwj->is_autosave) {
+		BLI_movelisttolist(&wm->reports.list, &fwj->reports.list);
+
+		win = wm->winactive ? wm->winactive : wm->windows.first;
+		if (win) {
+			wm_report_banner_show(wm, win);
+		}
+	}
+}
+
+static void wm_file_write_job_endjob(void *customdata)
+{
+	FileWriteQueue *fwq = customdata;
+	FileWriteJob *fwj;
+
+	/* the job thread has ended, no locking needed */
+	for (fwj = fwq->done.first; fwj; fwj = fwj->next) {
+		wm_file_write_job_report(fwq->wm, fwj);
+	}
+}
+
+static void wm_file_write_job_item_free(FileWriteJob *fwj)
+{
+	BLO_write_snapshot_free(fwj->snapshot);
+	if (fwj->ibuf_thumb) {
+		IMB_freeImBuf(fwj->ibuf_thumb);
+	}
+	BKE_reports_clear(&fwj->reports);
+	MEM_freeN(fwj);
+}
+
+static void wm_file_write_job_free(void *customdata)
+{
+	FileWriteQueue *fwq = customdata;
+	FileWriteJob *fwj;
+
+	/* a queue that never started, write it now instead of dropping saves that were reported */
+	while ((fwj = BLI_pophead(&fwq->pending))) {
+		fwj->success = BLO_write_snapshot_flush(fwj->snapshot, &fwj->reports, NULL) != 0;
+		wm_file_write_job_report(fwq->wm, fwj);
+		wm_file_write_job_item_free(fwj);
+	}
+
+	while ((fwj = BLI_pophead(&fwq->done))) {
+		wm_file_write_job_item_free(fwj);
+	}
+
+	BLI_mutex_end(&fwq->mutex);
+	MEM_freeN(fwq);
+}
+
+/**
+ * Appends \a fwj to the queue of a job that is still pending or running.
+ * \return false when there is no such queue, or the job is done taking snapshots from it.
+ */
+static bool wm_file_write_queue_append(wmWindowManager *wm, const int job_type, FileWriteJob *fwj)
+{
+	FileWriteQueue *fwq = WM_jobs_customdata_from_type(wm, job_type);
+	bool appended = false;
+
+	if (fwq) {
+		BLI_mutex_lock(&fwq->mutex);
+		if (!fwq->is_finished) {
+			BLI_addtail(&fwq->pending, fwj);
+			appended = true;
+		}
+		BLI_mutex_unlock(&fwq->mutex);
+	}
+
+	return appended;
+}
+
+/**
+ * Copies the file into memory and queues it to be written by a job.
+ * \param ibuf_thumb: Taken over by the job when not NULL.
+ * \return success, also when the file is not written yet.
+ */
+static bool wm_file_write_async(
+        const bContext *C, const char *filepath, int fileflags, ReportList *reports,
+        const BlendThumbnail *thumb, ImBuf **ibuf_thumb, const bool is_autosave)
+{
+	wmWindowManager *wm = CTX_wm_manager(C);
+	const int job_type = is_autosave ? WM_JOB_TYPE_FILE_AUTOSAVE : WM_JOB_TYPE_FILE_SAVE;
+	BlendWriteSnapshot *snapshot;
+	FileWriteQueue *fwq;
+	FileWriteJob *fwj;
+	wmJob *wm_job;
+
+	snapshot = BLO_write_snapshot_create(CTX_data_main(C), filepath, fileflags, reports, thumb);
+	if (snapshot == NULL) {
+		return false;
+	}
+
+	fwj = MEM_callocN(sizeof(*fwj), __func__);
+	fwj->snapshot = snapshot;
+	BLI_strncpy(fwj->filepath, filepath, sizeof(fwj->filepath));
+	if (ibuf_thumb) {
+		fwj->ibuf_thumb = *ibuf_thumb;
+		*ibuf_thumb = NULL;
+	}
+	fwj->is_autosave = is_autosave;
+	BKE_reports_init(&fwj->reports, RPT_STORE);
+
+	/* written after the saves that are already queued */
+	if (wm_file_write_queue_append(wm, job_type, fwj)) {
+		return true;
+	}
+
+	fwq = MEM_callocN(sizeof(*fwq), __func__);
+	fwq->wm = wm;
+	BLI_mutex_init(&fwq->mutex);
+	BLI_addtail(&fwq->pending, fwj);
+
+	/* when the previous job is still ending, this one starts once it is done */
+	wm_job = WM_jobs_get(wm, CTX_wm_window(C), wm, is_autosave ? "Auto Saving" : "Saving", WM_JOB_PROGRESS,
+	                     job_type);
+	WM_jobs_customdata_set(wm_job, fwq, wm_file_write_job_free);
+	WM_jobs_timer(wm_job, 0.1, 0, 0);
+	WM_jobs_callbacks(wm_job, wm_file_write_job_startjob, NULL, NULL, wm_file_write_job_endjob);
+
+	WM_jobs_start(wm, wm_job);
+
+	return true;
+}
+
+/** \} */
+
 /**
  * \see #wm_homefile_write_exec wraps #BLO_write_file in a similar way.
  */
@@ -1001,6 +1218,8 @@ int wm_file_write(bContext *C, const char *filepath, int fileflags, ReportList *
 	int ret = -1;
 	BlendThumbnail *thumb, *main_thumb;
 	ImBuf *ibuf_thumb = NULL;
+	const bool use_async = (U.flag & USER_SAVE_ASYNC) && !G.background;
+	bool success;
 
 	len = strlen(filepath);
 	
@@ -1065,7 +1284,14 @@ int wm_file_write(bContext *C, const char *filepath, int fileflags, ReportList *
 	/* XXX temp solution to solve bug, real fix coming (ton) */
 	G.main->recovered = 0;
 	
-	if (BLO_write_file(CTX_data_main(C), filepath, fileflags, reports, thumb)) {
+	if (use_async) {
+		success = wm_file_write_async(C, filepath, fileflags, reports, thumb, &ibuf_thumb, false);
+	}
+	else {
+		success = BLO_write_file(CTX_data_main(C), filepath, fileflags, reports, thumb) != 0;
+	}
+
+	if (success) {
 		if (!(fileflags & G_FILE_SAVE_COPY)) {
 			G.relbase_valid = 1;
 			BLI_strncpy(G.main->name, filepath, sizeof(G.main->name));  /* is guaranteed current file */
@@ -1081,12 +1307,9 @@ int wm_file_write(bContext *C, const char *filepath, int fileflags, ReportList *
 			wm_history_file_update();
 		}
 
-		BLI_callback_exec(G.main, NULL, BLI_CB_EVT_SAVE_POST);
-
-		/* run this function after because the file cant be written before the blend is */
-		if (ibuf_thumb) {
-			IMB_thumb_delete(filepath, THB_FAIL); /* without this a failed thumb overrides */
-			ibuf_thumb = IMB_thumb_create(filepath, THB_LARGE, THB_SOURCE_BLEND, ibuf_thumb);
+		/* otherwise done by the job */
+		if (!use_async) {
+			wm_file_write_post(filepath, &ibuf_thumb);
 		}
 
 		ret = 0;  /* Success. */
@@ -1244,7 +1467,12 @@ void wm_autosave_timer(const bContext *C, wmWindowManager *wm, wmTimer *UNUSED(w
 		ED_editors_flush_edits(C, false);
 
 		/* no error reporting to console */
-		BLO_write_file(CTX_data_main(C), filepath, fileflags, NULL, NULL);
+		if ((U.flag & USER_SAVE_ASYNC) && !G.background) {
+			wm_file_write_async(C, filepath, fileflags, NULL, NULL, NULL, true);
+		}
+		else {
+			BLO_write_file(CTX_data_main(C), filepath, fileflags, NULL, NULL);
+		}
 	}
 	/* do timer after file write, just in case file write takes a long time */
 	wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE, U.savetime * 60.0);
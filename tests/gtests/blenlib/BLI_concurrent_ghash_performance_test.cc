@@ -0,0 +1,148 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_concurrent_ghash.h"
+#include "BLI_rand.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Cache like workload: every thread looks up random keys in a shared hash, inserting the missing ones.
+ * Compares a GHash protected by a single mutex (what most threaded code does now) with ConcurrentGHash. */
+
+#define NUM_TASKS 64
+
+typedef struct CacheTestData {
+	GHash *gh;
+	ThreadMutex mutex;
+	ConcurrentGHash *cgh;
+
+	const unsigned int *keys;
+	int num_keys_per_task;
+} CacheTestData;
+
+static void *cache_valcreate(const void *key, void *UNUSED(userdata))
+{
+	return (void *)key;
+}
+
+static void cache_ghash_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	CacheTestData *data = (CacheTestData *)BLI_task_pool_userdata(pool);
+	const unsigned int *keys = &data->keys[GET_INT_FROM_POINTER(taskdata) * data->num_keys_per_task];
+
+	for (int i = 0; i < data->num_keys_per_task; i++) {
+		void *key = SET_UINT_IN_POINTER(keys[i]);
+		void **val_p;
+
+		BLI_mutex_lock(&data->mutex);
+		if (!BLI_ghash_ensure_p(data->gh, key, &val_p)) {
+			*val_p = key;
+		}
+		BLI_mutex_unlock(&data->mutex);
+	}
+}
+
+static void cache_cghash_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	CacheTestData *data = (CacheTestData *)BLI_task_pool_userdata(pool);
+	const unsigned int *keys = &data->keys[GET_INT_FROM_POINTER(taskdata) * data->num_keys_per_task];
+
+	for (int i = 0; i < data->num_keys_per_task; i++) {
+		void *key = SET_UINT_IN_POINTER(keys[i]);
+		void *val;
+
+		BLI_concurrent_ghash_ensure(data->cgh, key, NULL, cache_valcreate, NULL, &val);
+	}
+}
+
+static void cache_tests(const char *id, const int num_lookups, const unsigned int num_keys, const int num_threads)
+{
+	BLI_threadapi_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	CacheTestData data;
+	unsigned int *keys = (unsigned int *)MEM_mallocN(sizeof(*keys) * (size_t)num_lookups, __func__);
+
+	{
+		RNG *rng = BLI_rng_new(0);
+		for (int i = 0; i < num_lookups; i++) {
+			keys[i] = BLI_rng_get_uint(rng) % num_keys;
+		}
+		BLI_rng_free(rng);
+	}
+
+	data.keys = keys;
+	data.num_keys_per_task = num_lookups / NUM_TASKS;
+
+	{
+		data.gh = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+		BLI_mutex_init(&data.mutex);
+
+		TaskPool *pool = BLI_task_pool_create(scheduler, &data);
+
+		TIMEIT_START(ghash_mutex);
+		for (int i = 0; i < NUM_TASKS; i++) {
+			BLI_task_pool_push(pool, cache_ghash_task, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+		TIMEIT_END(ghash_mutex);
+
+		BLI_task_pool_free(pool);
+		BLI_mutex_end(&data.mutex);
+
+		printf("%u entries\n", BLI_ghash_size(data.gh));
+		BLI_ghash_free(data.gh, NULL, NULL);
+	}
+
+	{
+		data.cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+		TaskPool *pool = BLI_task_pool_create(scheduler, &data);
+
+		TIMEIT_START(concurrent_ghash);
+		for (int i = 0; i < NUM_TASKS; i++) {
+			BLI_task_pool_push(pool, cache_cghash_task, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+		TIMEIT_END(concurrent_ghash);
+
+		BLI_task_pool_free(pool);
+
+		printf("%u entries\n", BLI_concurrent_ghash_size(data.cgh));
+		BLI_concurrent_ghash_free(data.cgh, NULL, NULL);
+	}
+
+	MEM_freeN(keys);
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(concurrent_ghash, Cache1Thread)
+{
+	cache_tests("Cache - 10M lookups, 100000 keys - 1 thread", 10000000, 100000, 1);
+}
+
+TEST(concurrent_ghash, Cache4Threads)
+{
+	cache_tests("Cache - 10M lookups, 100000 keys - 4 threads", 10000000, 100000, 4);
+}
+
+TEST(concurrent_ghash, Cache16Threads)
+{
+	cache_tests("Cache - 10M lookups, 100000 keys - 16 threads", 10000000, 100000, 16);
+}
+
+TEST(concurrent_ghash, CacheFewKeys16Threads)
+{
+	cache_tests("Cache - 10M lookups, 100 keys - 16 threads", 10000000, 100, 16);
+}
@@ -0,0 +1,132 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_concurrent_ghash.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+
+#include "atomic_ops.h"
+}
+
+#include "BLI_task_testing.h"
+
+#define TESTCASE_SIZE 100000
+
+static void cghash_insert_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	ConcurrentGHash *cgh = (ConcurrentGHash *)userdata;
+
+	BLI_concurrent_ghash_insert(cgh, SET_INT_IN_POINTER(iter), SET_INT_IN_POINTER(iter * 2));
+}
+
+static void cghash_lookup_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	ConcurrentGHash *cgh = (ConcurrentGHash *)userdata;
+
+	EXPECT_EQ(iter * 2, GET_INT_FROM_POINTER(BLI_concurrent_ghash_lookup(cgh, SET_INT_IN_POINTER(iter))));
+}
+
+static void cghash_remove_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	ConcurrentGHash *cgh = (ConcurrentGHash *)userdata;
+
+	if (iter % 2) {
+		EXPECT_TRUE(BLI_concurrent_ghash_remove(cgh, SET_INT_IN_POINTER(iter), NULL, NULL));
+	}
+}
+
+/* Insert, lookup and remove from multiple threads at once. */
+TEST(concurrent_ghash, InsertLookupRemove)
+{
+	task_testing_init();
+
+	ConcurrentGHash *cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, cgh, cghash_insert_func);
+	EXPECT_EQ(TESTCASE_SIZE, BLI_concurrent_ghash_size(cgh));
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, cgh, cghash_lookup_func);
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, cgh, cghash_remove_func);
+	EXPECT_EQ(TESTCASE_SIZE / 2, BLI_concurrent_ghash_size(cgh));
+
+	for (int i = 0; i < TESTCASE_SIZE; i++) {
+		EXPECT_EQ((i % 2) == 0, BLI_concurrent_ghash_haskey(cgh, SET_INT_IN_POINTER(i)));
+	}
+
+	BLI_concurrent_ghash_free(cgh, NULL, NULL);
+}
+
+typedef struct EnsureData {
+	ConcurrentGHash *cgh;
+	size_t num_created;
+} EnsureData;
+
+static void *cghash_valcreate(const void *key, void *userdata)
+{
+	EnsureData *data = (EnsureData *)userdata;
+
+	atomic_add_z(&data->num_created, 1);
+
+	int *val = (int *)MEM_mallocN(sizeof(int), __func__);
+	*val = GET_INT_FROM_POINTER(key);
+	return val;
+}
+
+static void cghash_ensure_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	EnsureData *data = (EnsureData *)userdata;
+	/* every key is ensured by 4 iterations, possibly from different threads */
+	const int key = iter / 4;
+	void *val;
+
+	BLI_concurrent_ghash_ensure(data->cgh, SET_INT_IN_POINTER(key), NULL, cghash_valcreate, data, &val);
+	EXPECT_EQ(key, *(int *)val);
+}
+
+static bool cghash_check_odd(void *key, void *UNUSED(val), void *UNUSED(userdata))
+{
+	return (GET_INT_FROM_POINTER(key) % 2) != 0;
+}
+
+static void cghash_sum_func(void *UNUSED(key), void *val, void *userdata)
+{
+	*(size_t *)userdata += (size_t)*(int *)val;
+}
+
+/* Values are created exactly once per key, even when several threads ensure the same key. */
+TEST(concurrent_ghash, Ensure)
+{
+	/* creates the global task scheduler first, it stays allocated */
+	task_testing_init();
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+
+	EnsureData data;
+	data.cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	data.num_created = 0;
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE * 4, &data, cghash_ensure_func);
+
+	EXPECT_EQ(TESTCASE_SIZE, data.num_created);
+	EXPECT_EQ(TESTCASE_SIZE, BLI_concurrent_ghash_size(data.cgh));
+
+	EXPECT_EQ(TESTCASE_SIZE / 2,
+	          BLI_concurrent_ghash_remove_if(data.cgh, cghash_check_odd, NULL, NULL, MEM_freeN));
+
+	size_t sum = 0;
+	BLI_concurrent_ghash_foreach(data.cgh, cghash_sum_func, &sum);
+	/* sum of the even numbers below TESTCASE_SIZE */
+	EXPECT_EQ((size_t)(TESTCASE_SIZE / 2) * (size_t)(TESTCASE_SIZE / 2 - 1), sum);
+
+	EXPECT_FALSE(BLI_concurrent_ghash_add(data.cgh, SET_INT_IN_POINTER(0), NULL));
+	EXPECT_TRUE(BLI_concurrent_ghash_add(data.cgh, SET_INT_IN_POINTER(1), MEM_mallocN(sizeof(int), __func__)));
+
+	BLI_concurrent_ghash_free(data.cgh, NULL, MEM_freeN);
+
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+}
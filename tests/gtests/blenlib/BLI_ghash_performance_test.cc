@@ -9,6 +9,7 @@ extern "C" {
 #include "MEM_guardedalloc.h"
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_oahash.h"
 #include "BLI_rand.h"
 #include "BLI_string.h"
 #include "PIL_time_utildefines.h"
@@ -32,6 +33,16 @@ extern "C" {
 	       BLI_ghash_size(_gh), q, var, lf, pempty * 100.0, poverloaded * 100.0, bigb); \
 } void (0)
 
+#define PRINTF_OAHASH_STATS(_oh) \
+{ \
+	double q, lf; \
+	unsigned int probe_max; \
+	q = BLI_oahash_calc_quality_ex((_oh), &lf, &probe_max); \
+	printf("OAHash stats (%u entries):\n\t" \
+	       "Average probe distance (the lower the better): %f\n\tLoad: %f\n\tLongest probe distance: %u\n", \
+	       BLI_oahash_size(_oh), q, lf, probe_max); \
+} void (0)
+
 
 /* Str: whole text, lines and words from a 'corpus' text. */
 
@@ -413,3 +424,230 @@ TEST(ghash, Int4Murmur2a20000000)
 
 	int4_ghash_tests(ghash, "Int4GHash - Murmur - 20000000", 20000000);
 }
+
+
+/* OAHash: same tests as above with the open addressing table, to compare with GHash. */
+
+static void int_oahash_tests(OAHash *oh, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_insert);
+
+#ifdef GHASH_RESERVE
+		BLI_oahash_reserve(oh, nbr);
+#endif
+
+		while (i--) {
+			BLI_oahash_insert(oh, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
+		}
+
+		TIMEIT_END(int_insert);
+	}
+
+	PRINTF_OAHASH_STATS(oh);
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_lookup);
+
+		while (i--) {
+			void *v = BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(i));
+			EXPECT_EQ(i, GET_UINT_FROM_POINTER(v));
+		}
+
+		TIMEIT_END(int_lookup);
+	}
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_lookup_missing);
+
+		while (i--) {
+			void *v = BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(i + nbr));
+			EXPECT_EQ(NULL, v);
+		}
+
+		TIMEIT_END(int_lookup_missing);
+	}
+
+	BLI_oahash_free(oh, NULL, NULL);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(oahash, IntOAHash12000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_oahash_tests(oh, "IntOAHash - GHash hash - 12000", 12000);
+}
+
+TEST(oahash, IntOAHash100000000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_oahash_tests(oh, "IntOAHash - GHash hash - 100000000", 100000000);
+}
+
+TEST(oahash, IntOAHashInline12000)
+{
+	OAHash *oh = BLI_oahash_int_new(__func__);
+
+	int_oahash_tests(oh, "IntOAHash - Inline - 12000", 12000);
+}
+
+TEST(oahash, IntOAHashInline100000000)
+{
+	OAHash *oh = BLI_oahash_int_new(__func__);
+
+	int_oahash_tests(oh, "IntOAHash - Inline - 100000000", 100000000);
+}
+
+static void randint_oahash_tests(OAHash *oh, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	unsigned int *data = (unsigned int *)MEM_mallocN(sizeof(*data) * (size_t)nbr, __func__);
+	unsigned int *dt;
+	unsigned int i;
+
+	{
+		RNG *rng = BLI_rng_new(0);
+		for (i = nbr, dt = data; i--; dt++) {
+			*dt = BLI_rng_get_uint(rng);
+		}
+		BLI_rng_free(rng);
+	}
+
+	{
+		TIMEIT_START(int_insert);
+
+#ifdef GHASH_RESERVE
+		BLI_oahash_reserve(oh, nbr);
+#endif
+
+		/* random data may contain duplicates, GHash tests don't care but OAHash asserts on them */
+		for (i = nbr, dt = data; i--; dt++) {
+			BLI_oahash_reinsert(oh, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt), NULL, NULL);
+		}
+
+		TIMEIT_END(int_insert);
+	}
+
+	PRINTF_OAHASH_STATS(oh);
+
+	{
+		TIMEIT_START(int_lookup);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			void *v = BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(*dt));
+			EXPECT_EQ(*dt, GET_UINT_FROM_POINTER(v));
+		}
+
+		TIMEIT_END(int_lookup);
+	}
+
+	BLI_oahash_free(oh, NULL, NULL);
+	MEM_freeN(data);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(oahash, IntRandOAHash12000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_oahash_tests(oh, "RandIntOAHash - GHash hash - 12000", 12000);
+}
+
+TEST(oahash, IntRandOAHash50000000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_oahash_tests(oh, "RandIntOAHash - GHash hash - 50000000", 50000000);
+}
+
+TEST(oahash, IntRandOAHashInline12000)
+{
+	OAHash *oh = BLI_oahash_int_new(__func__);
+
+	randint_oahash_tests(oh, "RandIntOAHash - Inline - 12000", 12000);
+}
+
+TEST(oahash, IntRandOAHashInline50000000)
+{
+	OAHash *oh = BLI_oahash_int_new(__func__);
+
+	randint_oahash_tests(oh, "RandIntOAHash - Inline - 50000000", 50000000);
+}
+
+static void int4_oahash_tests(OAHash *oh, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	unsigned int (*data)[4] = (unsigned int (*)[4])MEM_mallocN(sizeof(*data) * (size_t)nbr, __func__);
+	unsigned int (*dt)[4];
+	unsigned int i, j;
+
+	{
+		RNG *rng = BLI_rng_new(0);
+		for (i = nbr, dt = data; i--; dt++) {
+			for (j = 4; j--; ) {
+				(*dt)[j] = BLI_rng_get_uint(rng);
+			}
+		}
+		BLI_rng_free(rng);
+	}
+
+	{
+		TIMEIT_START(int_v4_insert);
+
+#ifdef GHASH_RESERVE
+		BLI_oahash_reserve(oh, nbr);
+#endif
+
+		for (i = nbr, dt = data; i--; dt++) {
+			BLI_oahash_insert(oh, *dt, SET_UINT_IN_POINTER(i));
+		}
+
+		TIMEIT_END(int_v4_insert);
+	}
+
+	PRINTF_OAHASH_STATS(oh);
+
+	{
+		TIMEIT_START(int_v4_lookup);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			void *v = BLI_oahash_lookup(oh, (void *)(*dt));
+			EXPECT_EQ(i, GET_UINT_FROM_POINTER(v));
+		}
+
+		TIMEIT_END(int_v4_lookup);
+	}
+
+	BLI_oahash_free(oh, NULL, NULL);
+	MEM_freeN(data);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(oahash, Int4OAHash2000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__);
+
+	int4_oahash_tests(oh, "Int4OAHash - GHash hash - 2000", 2000);
+}
+
+TEST(oahash, Int4OAHash20000000)
+{
+	OAHash *oh = BLI_oahash_new(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__);
+
+	int4_oahash_tests(oh, "Int4OAHash - GHash hash - 20000000", 20000000);
+}
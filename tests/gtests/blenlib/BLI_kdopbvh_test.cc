@@ -0,0 +1,257 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+#include "BLI_task_testing.h"
+
+#define TREE_SIZE 3000
+#define NUM_RAYS 2000
+
+/* small random triangles in a unit cube */
+static float (*tris_random(const int tot, const unsigned int seed))[3][3]
+{
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * (size_t)tot, __func__);
+	RNG *rng = BLI_rng_new(seed);
+
+	for (int i = 0; i < tot; i++) {
+		float center[3];
+		BLI_rng_get_float_unit_v3(rng, center);
+		mul_v3_fl(center, BLI_rng_get_float(rng));
+
+		for (int j = 0; j < 3; j++) {
+			float ofs[3];
+			BLI_rng_get_float_unit_v3(rng, ofs);
+			madd_v3_v3v3fl(tris[i][j], center, ofs, 0.03f);
+		}
+	}
+	BLI_rng_free(rng);
+
+	return tris;
+}
+
+static BVHTree *bvhtree_from_tris(
+        const float (*tris)[3][3], const int tot, const char tree_type, const char axis, const int flag)
+{
+	BVHTree *tree = BLI_bvhtree_new(tot, 0.0f, tree_type, axis);
+
+	for (int i = 0; i < tot; i++) {
+		BLI_bvhtree_insert(tree, i, &tris[i][0][0], 3);
+	}
+	BLI_bvhtree_balance_ex(tree, flag);
+
+	return tree;
+}
+
+static int overlap_cmp(const void *a_v, const void *b_v)
+{
+	const BVHTreeOverlap *a = (const BVHTreeOverlap *)a_v, *b = (const BVHTreeOverlap *)b_v;
+	if (a->indexA != b->indexA) {
+		return (a->indexA < b->indexA) ? -1 : 1;
+	}
+	if (a->indexB != b->indexB) {
+		return (a->indexB < b->indexB) ? -1 : 1;
+	}
+	return 0;
+}
+
+static void overlap_test(const char tree_type, const char axis)
+{
+	task_testing_init();
+
+	float (*tris_a)[3][3] = tris_random(TREE_SIZE, 0);
+	float (*tris_b)[3][3] = tris_random(TREE_SIZE, 1);
+
+	BVHTree *tree_a = bvhtree_from_tris(tris_a, TREE_SIZE, tree_type, axis, 0);
+	BVHTree *tree_b = bvhtree_from_tris(tris_b, TREE_SIZE, tree_type, axis, 0);
+	BVHTree *tree_b_sah = bvhtree_from_tris(tris_b, TREE_SIZE, tree_type, axis, BVH_BALANCE_SAH);
+
+	unsigned int overlap_tot, overlap_sah_tot;
+	BVHTreeOverlap *overlap = BLI_bvhtree_overlap(tree_a, tree_b, &overlap_tot, NULL, NULL);
+	BVHTreeOverlap *overlap_sah = BLI_bvhtree_overlap(tree_a, tree_b_sah, &overlap_sah_tot, NULL, NULL);
+
+	/* the leaf pairs don't depend on the tree structure */
+	ASSERT_EQ(overlap_tot, overlap_sah_tot);
+	EXPECT_LT(0, overlap_tot);
+	qsort(overlap, overlap_tot, sizeof(*overlap), overlap_cmp);
+	qsort(overlap_sah, overlap_sah_tot, sizeof(*overlap_sah), overlap_cmp);
+	for (unsigned int i = 0; i < overlap_tot; i++) {
+		EXPECT_EQ(overlap[i].indexA, overlap_sah[i].indexA);
+		EXPECT_EQ(overlap[i].indexB, overlap_sah[i].indexB);
+	}
+
+	/* all pairs of overlapping bounding boxes are found */
+	if (axis == 6) {
+		unsigned int overlap_brute_force_tot = 0;
+		for (int i = 0; i < TREE_SIZE; i++) {
+			float min_a[3], max_a[3];
+			INIT_MINMAX(min_a, max_a);
+			for (int k = 0; k < 3; k++) {
+				minmax_v3v3_v3(min_a, max_a, tris_a[i][k]);
+			}
+			for (int j = 0; j < TREE_SIZE; j++) {
+				float min_b[3], max_b[3];
+				INIT_MINMAX(min_b, max_b);
+				for (int k = 0; k < 3; k++) {
+					minmax_v3v3_v3(min_b, max_b, tris_b[j][k]);
+				}
+				if (isect_aabb_aabb_v3(min_a, max_a, min_b, max_b)) {
+					overlap_brute_force_tot++;
+				}
+			}
+		}
+		/* tree bounds include an epsilon */
+		EXPECT_LE(overlap_brute_force_tot, overlap_tot);
+	}
+
+	MEM_freeN(overlap);
+	MEM_freeN(overlap_sah);
+	BLI_bvhtree_free(tree_a);
+	BLI_bvhtree_free(tree_b);
+	BLI_bvhtree_free(tree_b_sah);
+	MEM_freeN(tris_a);
+	MEM_freeN(tris_b);
+}
+
+TEST(kdopbvh, Overlap6DOP)  { overlap_test(4, 6); }
+TEST(kdopbvh, Overlap8DOP)  { overlap_test(8, 8); }
+TEST(kdopbvh, Overlap14DOP) { overlap_test(2, 14); }
+TEST(kdopbvh, Overlap18DOP) { overlap_test(4, 18); }
+TEST(kdopbvh, Overlap26DOP) { overlap_test(4, 26); }
+
+static void raycast_tri_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const float (*tris)[3][3] = (const float (*)[3][3])userdata;
+	float dist;
+
+	if (isect_ray_tri_v3(ray->origin, ray->direction, tris[index][0], tris[index][1], tris[index][2], &dist, NULL) &&
+	    dist < hit->dist)
+	{
+		hit->index = index;
+		hit->dist = dist;
+	}
+}
+
+/* Batched ray casts and trees built with the surface area heuristic find the same hits. */
+TEST(kdopbvh, RayCastBatch)
+{
+	task_testing_init();
+
+	float (*tris)[3][3] = tris_random(TREE_SIZE, 2);
+	BVHTree *tree = bvhtree_from_tris(tris, TREE_SIZE, 4, 6, 0);
+	BVHTree *tree_sah = bvhtree_from_tris(tris, TREE_SIZE, 4, 6, BVH_BALANCE_SAH);
+
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * NUM_RAYS, __func__);
+	float (*dir)[3] = (float (*)[3])MEM_mallocN(sizeof(*dir) * NUM_RAYS, __func__);
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * NUM_RAYS, __func__);
+
+	RNG *rng = BLI_rng_new(3);
+	for (int i = 0; i < NUM_RAYS; i++) {
+		BLI_rng_get_float_unit_v3(rng, co[i]);
+		mul_v3_fl(co[i], 2.0f);
+		/* aim around the center */
+		BLI_rng_get_float_unit_v3(rng, dir[i]);
+		mul_v3_fl(dir[i], 0.3f);
+		sub_v3_v3(dir[i], co[i]);
+		normalize_v3(dir[i]);
+
+		hit[i].index = -1;
+		hit[i].dist = FLT_MAX;
+	}
+	BLI_rng_free(rng);
+
+	BLI_bvhtree_ray_cast_batch(tree, co, dir, NUM_RAYS, 0.0f, hit, raycast_tri_cb, tris, BVH_RAYCAST_DEFAULT);
+
+	int tot_hit = 0;
+	for (int i = 0; i < NUM_RAYS; i++) {
+		BVHTreeRayHit hit_single, hit_sah;
+		hit_single.index = hit_sah.index = -1;
+		hit_single.dist = hit_sah.dist = FLT_MAX;
+
+		BLI_bvhtree_ray_cast(tree, co[i], dir[i], 0.0f, &hit_single, raycast_tri_cb, tris);
+		BLI_bvhtree_ray_cast(tree_sah, co[i], dir[i], 0.0f, &hit_sah, raycast_tri_cb, tris);
+
+		EXPECT_EQ(hit_single.index, hit[i].index);
+		EXPECT_EQ(hit_single.dist, hit[i].dist);
+		EXPECT_EQ(hit_single.dist, hit_sah.dist);
+		if (hit[i].index != -1) {
+			tot_hit++;
+		}
+	}
+	EXPECT_LT(NUM_RAYS / 4, tot_hit);
+
+	MEM_freeN(co);
+	MEM_freeN(dir);
+	MEM_freeN(hit);
+	BLI_bvhtree_free(tree);
+	BLI_bvhtree_free(tree_sah);
+	MEM_freeN(tris);
+}
+
+static int refit_tri_cb(void *userdata, int index, float r_co[][3])
+{
+	const float (*tris)[3][3] = (const float (*)[3][3])userdata;
+
+	copy_v3_v3(r_co[0], tris[index][0]);
+	copy_v3_v3(r_co[1], tris[index][1]);
+	copy_v3_v3(r_co[2], tris[index][2]);
+	return 3;
+}
+
+/* A tree refit to moved triangles finds the same overlaps as a tree built for them. */
+static void refit_test(const char tree_type, const char axis)
+{
+	task_testing_init();
+
+	float (*tris_a)[3][3] = tris_random(TREE_SIZE, 4);
+	float (*tris_b)[3][3] = tris_random(TREE_SIZE, 5);
+	float (*tris_other)[3][3] = tris_random(TREE_SIZE, 6);
+
+	BVHTree *tree_refit = bvhtree_from_tris(tris_a, TREE_SIZE, tree_type, axis, 0);
+	BVHTree *tree_b = bvhtree_from_tris(tris_b, TREE_SIZE, tree_type, axis, 0);
+	BVHTree *tree_other = bvhtree_from_tris(tris_other, TREE_SIZE, tree_type, axis, 0);
+
+	BLI_bvhtree_refit(tree_refit, refit_tri_cb, tris_b);
+
+	unsigned int overlap_tot, overlap_refit_tot;
+	BVHTreeOverlap *overlap = BLI_bvhtree_overlap(tree_b, tree_other, &overlap_tot, NULL, NULL);
+	BVHTreeOverlap *overlap_refit = BLI_bvhtree_overlap(tree_refit, tree_other, &overlap_refit_tot, NULL, NULL);
+
+	ASSERT_EQ(overlap_tot, overlap_refit_tot);
+	EXPECT_LT(0, overlap_tot);
+	qsort(overlap, overlap_tot, sizeof(*overlap), overlap_cmp);
+	qsort(overlap_refit, overlap_refit_tot, sizeof(*overlap_refit), overlap_cmp);
+	for (unsigned int i = 0; i < overlap_tot; i++) {
+		EXPECT_EQ(overlap[i].indexA, overlap_refit[i].indexA);
+		EXPECT_EQ(overlap[i].indexB, overlap_refit[i].indexB);
+	}
+
+	MEM_freeN(overlap);
+	MEM_freeN(overlap_refit);
+	BLI_bvhtree_free(tree_refit);
+	BLI_bvhtree_free(tree_b);
+	BLI_bvhtree_free(tree_other);
+	MEM_freeN(tris_a);
+	MEM_freeN(tris_b);
+	MEM_freeN(tris_other);
+}
+
+TEST(kdopbvh, Refit2Tree) { refit_test(2, 6); }
+TEST(kdopbvh, Refit4Tree) { refit_test(4, 6); }
+TEST(kdopbvh, Refit8Tree) { refit_test(8, 18); }
+
+TEST(kdopbvh, RefitEmpty)
+{
+	BVHTree *tree = BLI_bvhtree_new(0, 0.0, 8, 18);
+	BLI_bvhtree_balance(tree);
+	BLI_bvhtree_refit(tree, refit_tri_cb, NULL);
+	BLI_bvhtree_free(tree);
+}
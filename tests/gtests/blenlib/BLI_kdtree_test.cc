@@ -0,0 +1,183 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdtree.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+#include "BLI_task_testing.h"
+
+/* large enough to balance and query with multiple threads */
+#define TREE_SIZE 50000
+#define QUERY_SIZE 2000
+#define NEAREST_N 8
+
+static void points_random(float (*co)[3], const int tot, const unsigned int seed)
+{
+	RNG *rng = BLI_rng_new(seed);
+	for (int i = 0; i < tot; i++) {
+		co[i][0] = BLI_rng_get_float(rng);
+		co[i][1] = BLI_rng_get_float(rng);
+		/* many equal values on one axis */
+		co[i][2] = (float)(BLI_rng_get_uint(rng) % 16);
+	}
+	BLI_rng_free(rng);
+}
+
+static KDTree *kdtree_from_points(const float (*co)[3], const int tot)
+{
+	KDTree *tree = BLI_kdtree_new((unsigned int)tot);
+	for (int i = 0; i < tot; i++) {
+		BLI_kdtree_insert(tree, i, co[i]);
+	}
+	BLI_kdtree_balance(tree);
+	return tree;
+}
+
+static float dist_nearest_brute_force(const float (*co)[3], const int tot, const float co_test[3])
+{
+	float dist_sq_min = FLT_MAX;
+	for (int i = 0; i < tot; i++) {
+		dist_sq_min = min_ff(dist_sq_min, len_squared_v3v3(co[i], co_test));
+	}
+	return sqrtf(dist_sq_min);
+}
+
+/* Nearest point of the tree matches a brute force search, also for batched queries. */
+TEST(kdtree, FindNearest)
+{
+	task_testing_init();
+
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * TREE_SIZE, __func__);
+	float (*co_query)[3] = (float (*)[3])MEM_mallocN(sizeof(*co_query) * QUERY_SIZE, __func__);
+	points_random(co, TREE_SIZE, 0);
+	points_random(co_query, QUERY_SIZE, 1);
+
+	KDTree *tree = kdtree_from_points(co, TREE_SIZE);
+
+	KDTreeNearest *nearest = (KDTreeNearest *)MEM_mallocN(sizeof(*nearest) * QUERY_SIZE, __func__);
+	int *index = (int *)MEM_mallocN(sizeof(*index) * QUERY_SIZE, __func__);
+	BLI_kdtree_find_nearest_batch(tree, co_query, QUERY_SIZE, nearest, index);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		KDTreeNearest nearest_single;
+		const float dist = dist_nearest_brute_force(co, TREE_SIZE, co_query[i]);
+
+		EXPECT_EQ(index[i], BLI_kdtree_find_nearest(tree, co_query[i], &nearest_single));
+		EXPECT_EQ(index[i], nearest[i].index);
+		EXPECT_FLOAT_EQ(dist, nearest[i].dist);
+		EXPECT_FLOAT_EQ(dist, len_v3v3(co[index[i]], co_query[i]));
+	}
+
+	MEM_freeN(nearest);
+	MEM_freeN(index);
+	BLI_kdtree_free(tree);
+	MEM_freeN(co);
+	MEM_freeN(co_query);
+}
+
+/* The n nearest points are sorted and each point of the tree is found once. */
+TEST(kdtree, FindNearestN)
+{
+	task_testing_init();
+
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * TREE_SIZE, __func__);
+	float (*co_query)[3] = (float (*)[3])MEM_mallocN(sizeof(*co_query) * QUERY_SIZE, __func__);
+	points_random(co, TREE_SIZE, 2);
+	points_random(co_query, QUERY_SIZE, 3);
+
+	KDTree *tree = kdtree_from_points(co, TREE_SIZE);
+
+	KDTreeNearest *nearest = (KDTreeNearest *)MEM_mallocN(
+	        sizeof(*nearest) * QUERY_SIZE * NEAREST_N, __func__);
+	int *found = (int *)MEM_mallocN(sizeof(*found) * QUERY_SIZE, __func__);
+	BLI_kdtree_find_nearest_n_batch(tree, co_query, QUERY_SIZE, nearest, found, NEAREST_N);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		const KDTreeNearest *nearest_query = &nearest[i * NEAREST_N];
+		KDTreeNearest nearest_single[NEAREST_N];
+
+		ASSERT_EQ(NEAREST_N, found[i]);
+		EXPECT_EQ(NEAREST_N, BLI_kdtree_find_nearest_n(tree, co_query[i], nearest_single, NEAREST_N));
+		EXPECT_FLOAT_EQ(dist_nearest_brute_force(co, TREE_SIZE, co_query[i]), nearest_query[0].dist);
+
+		for (int j = 0; j < NEAREST_N; j++) {
+			EXPECT_EQ(nearest_single[j].dist, nearest_query[j].dist);
+			if (j > 0) {
+				EXPECT_LE(nearest_query[j - 1].dist, nearest_query[j].dist);
+				EXPECT_NE(nearest_query[j - 1].index, nearest_query[j].index);
+			}
+		}
+	}
+
+	/* every point is its own nearest */
+	for (int i = 0; i < TREE_SIZE; i += 97) {
+		KDTreeNearest nearest_single;
+		BLI_kdtree_find_nearest(tree, co[i], &nearest_single);
+		EXPECT_EQ(0.0f, nearest_single.dist);
+	}
+
+	MEM_freeN(nearest);
+	MEM_freeN(found);
+	BLI_kdtree_free(tree);
+	MEM_freeN(co);
+	MEM_freeN(co_query);
+}
+
+/* Range search finds the same points as a brute force search. */
+TEST(kdtree, RangeSearch)
+{
+	task_testing_init();
+
+	const float range = 0.05f;
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * TREE_SIZE, __func__);
+	points_random(co, TREE_SIZE, 4);
+
+	KDTree *tree = kdtree_from_points(co, TREE_SIZE);
+
+	for (int i = 0; i < TREE_SIZE; i += 997) {
+		KDTreeNearest *nearest;
+		int found_brute_force = 0;
+
+		for (int j = 0; j < TREE_SIZE; j++) {
+			if (len_squared_v3v3(co[i], co[j]) <= range * range) {
+				found_brute_force++;
+			}
+		}
+
+		const int found = BLI_kdtree_range_search(tree, co[i], &nearest, range);
+		EXPECT_EQ(found_brute_force, found);
+		if (nearest) {
+			MEM_freeN(nearest);
+		}
+	}
+
+	BLI_kdtree_free(tree);
+	MEM_freeN(co);
+}
+
+/* Empty and single point trees. */
+TEST(kdtree, Small)
+{
+	const float co[3] = {1.0f, 2.0f, 3.0f};
+	KDTreeNearest nearest;
+	int index;
+
+	KDTree *tree = BLI_kdtree_new(1);
+	BLI_kdtree_balance(tree);
+	EXPECT_EQ(-1, BLI_kdtree_find_nearest(tree, co, &nearest));
+	BLI_kdtree_find_nearest_batch(tree, &co, 1, NULL, &index);
+	EXPECT_EQ(-1, index);
+
+	BLI_kdtree_insert(tree, 7, co);
+	BLI_kdtree_balance(tree);
+	EXPECT_EQ(7, BLI_kdtree_find_nearest(tree, co, &nearest));
+	EXPECT_EQ(0.0f, nearest.dist);
+	BLI_kdtree_free(tree);
+}
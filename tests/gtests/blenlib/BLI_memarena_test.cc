@@ -0,0 +1,90 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_memarena.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+}
+
+#include "BLI_task_testing.h"
+
+#define TESTCASE_SIZE 100000
+
+typedef struct ArenaTestData {
+	MemArenaThreaded *mat;
+	int **elems;
+} ArenaTestData;
+
+static void memarena_threaded_alloc_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	ArenaTestData *data = (ArenaTestData *)userdata;
+	MemArena *ma = BLI_memarena_threaded_get(data->mat, BLI_task_scheduler_thread_id(BLI_task_scheduler_get()));
+
+	/* vary the size so buffers fill up at different times */
+	int *elem = (int *)BLI_memarena_alloc(ma, sizeof(int) * (size_t)(1 + iter % 16));
+	elem[0] = iter;
+	data->elems[iter] = elem;
+}
+
+/* Allocations made from several threads stay valid in the merged arena. */
+TEST(memarena, ThreadedMerge)
+{
+	/* creates the global task scheduler first, it stays allocated */
+	task_testing_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+
+	ArenaTestData data;
+	data.mat = BLI_memarena_threaded_new(4096, __func__, BLI_task_scheduler_num_threads(scheduler));
+	data.elems = (int **)MEM_mallocN(sizeof(*data.elems) * TESTCASE_SIZE, __func__);
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, &data, memarena_threaded_alloc_func);
+	MemArena *ma = BLI_memarena_threaded_merge(data.mat);
+
+	for (int i = 0; i < TESTCASE_SIZE; i++) {
+		EXPECT_EQ(i, data.elems[i][0]);
+	}
+
+	/* the merged arena can still be used */
+	int *elem = (int *)BLI_memarena_alloc(ma, sizeof(int));
+	*elem = -1;
+
+	MEM_freeN(data.elems);
+	BLI_memarena_free(ma);
+
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+}
+
+/* Merging keeps allocating from the current buffer of the destination. */
+TEST(memarena, Merge)
+{
+	MemArena *ma_a = BLI_memarena_new(256, __func__);
+	MemArena *ma_b = BLI_memarena_new(256, __func__);
+	MemArena *ma_c = BLI_memarena_new(256, __func__);
+
+	char *a = (char *)BLI_memarena_alloc(ma_a, 8);
+	for (int i = 0; i < 100; i++) {
+		char *b = (char *)BLI_memarena_alloc(ma_b, 8);
+		b[0] = 'b';
+	}
+
+	BLI_memarena_merge(ma_a, ma_b);
+	char *a_next = (char *)BLI_memarena_alloc(ma_a, 8);
+	EXPECT_EQ(a + 8, a_next);
+
+	/* merge into an empty arena */
+	BLI_memarena_merge(ma_c, ma_a);
+	BLI_memarena_merge(ma_c, ma_b);
+	a_next = (char *)BLI_memarena_alloc(ma_c, 8);
+	EXPECT_EQ(a + 16, a_next);
+
+	BLI_memarena_clear(ma_c);
+
+	BLI_memarena_free(ma_a);
+	BLI_memarena_free(ma_b);
+	BLI_memarena_free(ma_c);
+}
@@ -0,0 +1,189 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_memarena.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Parallel allocation of many small elements, as done when building BMesh or tree nodes from threads.
+ * Compares a shared pool/arena protected by a mutex, the guarded allocator, and thread-local pools/arenas
+ * merged at the end of the parallel region. */
+
+#define NUM_TASKS 256
+#define ELEM_SIZE 32
+
+typedef struct AllocTestData {
+	TaskScheduler *scheduler;
+	int num_elems_per_task;
+
+	ThreadMutex mutex;
+	BLI_mempool *pool;
+	BLI_mempool_threaded *tpool;
+	MemArena *arena;
+	MemArenaThreaded *tarena;
+
+	void **elems;
+} AllocTestData;
+
+static void alloc_mempool_mutex_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	AllocTestData *data = (AllocTestData *)BLI_task_pool_userdata(pool);
+	void **elems = &data->elems[GET_INT_FROM_POINTER(taskdata) * data->num_elems_per_task];
+
+	for (int i = 0; i < data->num_elems_per_task; i++) {
+		BLI_mutex_lock(&data->mutex);
+		elems[i] = BLI_mempool_alloc(data->pool);
+		BLI_mutex_unlock(&data->mutex);
+	}
+}
+
+static void alloc_mempool_threaded_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	AllocTestData *data = (AllocTestData *)BLI_task_pool_userdata(pool);
+	void **elems = &data->elems[GET_INT_FROM_POINTER(taskdata) * data->num_elems_per_task];
+	BLI_mempool *mempool = BLI_mempool_threaded_get(data->tpool, BLI_task_scheduler_thread_id(data->scheduler));
+
+	for (int i = 0; i < data->num_elems_per_task; i++) {
+		elems[i] = BLI_mempool_alloc(mempool);
+	}
+}
+
+static void alloc_guardedalloc_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	AllocTestData *data = (AllocTestData *)BLI_task_pool_userdata(pool);
+	void **elems = &data->elems[GET_INT_FROM_POINTER(taskdata) * data->num_elems_per_task];
+
+	for (int i = 0; i < data->num_elems_per_task; i++) {
+		elems[i] = MEM_mallocN(ELEM_SIZE, __func__);
+	}
+}
+
+static void alloc_memarena_mutex_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	AllocTestData *data = (AllocTestData *)BLI_task_pool_userdata(pool);
+	void **elems = &data->elems[GET_INT_FROM_POINTER(taskdata) * data->num_elems_per_task];
+
+	for (int i = 0; i < data->num_elems_per_task; i++) {
+		BLI_mutex_lock(&data->mutex);
+		elems[i] = BLI_memarena_alloc(data->arena, ELEM_SIZE);
+		BLI_mutex_unlock(&data->mutex);
+	}
+}
+
+static void alloc_memarena_threaded_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	AllocTestData *data = (AllocTestData *)BLI_task_pool_userdata(pool);
+	void **elems = &data->elems[GET_INT_FROM_POINTER(taskdata) * data->num_elems_per_task];
+	MemArena *arena = BLI_memarena_threaded_get(data->tarena, BLI_task_scheduler_thread_id(data->scheduler));
+
+	for (int i = 0; i < data->num_elems_per_task; i++) {
+		elems[i] = BLI_memarena_alloc(arena, ELEM_SIZE);
+	}
+}
+
+static void alloc_run(AllocTestData *data, TaskRunFunction run)
+{
+	TaskPool *pool = BLI_task_pool_create(data->scheduler, data);
+
+	for (int i = 0; i < NUM_TASKS; i++) {
+		BLI_task_pool_push(pool, run, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+}
+
+static void alloc_tests(const char *id, const int num_elems, const int num_threads)
+{
+	BLI_threadapi_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	AllocTestData data;
+	data.scheduler = BLI_task_scheduler_create(num_threads);
+	data.num_elems_per_task = num_elems / NUM_TASKS;
+	data.elems = (void **)MEM_mallocN(sizeof(*data.elems) * (size_t)num_elems, __func__);
+	BLI_mutex_init(&data.mutex);
+
+	const int num_threads_total = BLI_task_scheduler_num_threads(data.scheduler);
+
+	{
+		data.pool = BLI_mempool_create(ELEM_SIZE, 0, 512, BLI_MEMPOOL_NOP);
+
+		TIMEIT_START(mempool_mutex);
+		alloc_run(&data, alloc_mempool_mutex_task);
+		TIMEIT_END(mempool_mutex);
+
+		BLI_mempool_destroy(data.pool);
+	}
+
+	{
+		data.pool = BLI_mempool_create(ELEM_SIZE, 0, 512, BLI_MEMPOOL_NOP);
+		data.tpool = BLI_mempool_threaded_create(ELEM_SIZE, 0, 512, BLI_MEMPOOL_NOP, num_threads_total);
+
+		TIMEIT_START(mempool_threaded);
+		alloc_run(&data, alloc_mempool_threaded_task);
+		BLI_mempool_threaded_merge(data.tpool, data.pool);
+		TIMEIT_END(mempool_threaded);
+
+		BLI_mempool_destroy(data.pool);
+	}
+
+	{
+		TIMEIT_START(guardedalloc);
+		alloc_run(&data, alloc_guardedalloc_task);
+		TIMEIT_END(guardedalloc);
+
+		for (int i = 0; i < data.num_elems_per_task * NUM_TASKS; i++) {
+			MEM_freeN(data.elems[i]);
+		}
+	}
+
+	{
+		data.arena = BLI_memarena_new(BLI_MEMARENA_STD_BUFSIZE, __func__);
+
+		TIMEIT_START(memarena_mutex);
+		alloc_run(&data, alloc_memarena_mutex_task);
+		TIMEIT_END(memarena_mutex);
+
+		BLI_memarena_free(data.arena);
+	}
+
+	{
+		data.tarena = BLI_memarena_threaded_new(BLI_MEMARENA_STD_BUFSIZE, __func__, num_threads_total);
+
+		TIMEIT_START(memarena_threaded);
+		alloc_run(&data, alloc_memarena_threaded_task);
+		data.arena = BLI_memarena_threaded_merge(data.tarena);
+		TIMEIT_END(memarena_threaded);
+
+		BLI_memarena_free(data.arena);
+	}
+
+	BLI_mutex_end(&data.mutex);
+	MEM_freeN(data.elems);
+	BLI_task_scheduler_free(data.scheduler);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(mempool, Alloc1Thread)
+{
+	alloc_tests("Alloc - 10M elements - 1 thread", 10000000, 1);
+}
+
+TEST(mempool, Alloc4Threads)
+{
+	alloc_tests("Alloc - 10M elements - 4 threads", 10000000, 4);
+}
+
+TEST(mempool, Alloc16Threads)
+{
+	alloc_tests("Alloc - 10M elements - 16 threads", 10000000, 16);
+}
@@ -0,0 +1,106 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+}
+
+#include "BLI_task_testing.h"
+
+#define TESTCASE_SIZE 100000
+
+typedef struct PoolTestData {
+	BLI_mempool_threaded *tpool;
+	int **elems;
+} PoolTestData;
+
+static void mempool_threaded_alloc_func(void *userdata, void *UNUSED(userdata_chunk), int iter)
+{
+	PoolTestData *data = (PoolTestData *)userdata;
+	BLI_mempool *pool = BLI_mempool_threaded_get(data->tpool, BLI_task_scheduler_thread_id(BLI_task_scheduler_get()));
+
+	/* keep the element pointer, stores to elements nothing points to may be optimized away */
+	int *elem = (int *)BLI_mempool_alloc(pool);
+	*elem = iter;
+	data->elems[iter] = elem;
+}
+
+/* Elements allocated from several threads all end up in the merged pool. */
+TEST(mempool, ThreadedMerge)
+{
+	/* creates the global task scheduler first, it stays allocated */
+	task_testing_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+
+	PoolTestData data;
+	BLI_mempool *pool = BLI_mempool_create(sizeof(int), 0, 512, BLI_MEMPOOL_ALLOW_ITER);
+	data.tpool = BLI_mempool_threaded_create(
+	        sizeof(int), 0, 512, BLI_MEMPOOL_ALLOW_ITER, BLI_task_scheduler_num_threads(scheduler));
+	data.elems = (int **)MEM_mallocN(sizeof(*data.elems) * (TESTCASE_SIZE + 1), __func__);
+
+	/* elements already in the destination pool are kept */
+	data.elems[TESTCASE_SIZE] = (int *)BLI_mempool_alloc(pool);
+	*data.elems[TESTCASE_SIZE] = TESTCASE_SIZE;
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, &data, mempool_threaded_alloc_func);
+	BLI_mempool_threaded_merge(data.tpool, pool);
+
+	EXPECT_EQ(TESTCASE_SIZE + 1, BLI_mempool_count(pool));
+
+	bool *found = (bool *)MEM_callocN(sizeof(*found) * (TESTCASE_SIZE + 1), __func__);
+	BLI_mempool_iter iter;
+	int *elem;
+	BLI_mempool_iternew(pool, &iter);
+	while ((elem = (int *)BLI_mempool_iterstep(&iter))) {
+		ASSERT_TRUE(*elem >= 0 && *elem <= TESTCASE_SIZE);
+		EXPECT_EQ(data.elems[*elem], elem);
+		EXPECT_FALSE(found[*elem]);
+		found[*elem] = true;
+	}
+	MEM_freeN(found);
+	MEM_freeN(data.elems);
+
+	/* merged elements can be freed and reused */
+	BLI_mempool_iternew(pool, &iter);
+	while ((elem = (int *)BLI_mempool_iterstep(&iter))) {
+		if (*elem % 2) {
+			BLI_mempool_free(pool, elem);
+		}
+	}
+	EXPECT_EQ(TESTCASE_SIZE / 2 + 1, BLI_mempool_count(pool));
+	for (int i = 0; i < TESTCASE_SIZE / 2; i++) {
+		*(int *)BLI_mempool_alloc(pool) = -1;
+	}
+	EXPECT_EQ(TESTCASE_SIZE + 1, BLI_mempool_count(pool));
+
+	BLI_mempool_destroy(pool);
+
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+}
+
+/* Thread-local pools can also be freed without merging. */
+TEST(mempool, ThreadedDestroy)
+{
+	task_testing_init();
+
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+
+	PoolTestData data;
+	data.tpool = BLI_mempool_threaded_create(
+	        sizeof(int), 0, 512, BLI_MEMPOOL_NOP, BLI_task_scheduler_num_threads(scheduler));
+	data.elems = (int **)MEM_mallocN(sizeof(*data.elems) * TESTCASE_SIZE, __func__);
+
+	BLI_task_parallel_range(0, TESTCASE_SIZE, &data, mempool_threaded_alloc_func);
+	BLI_mempool_threaded_destroy(data.tpool);
+
+	MEM_freeN(data.elems);
+
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+}
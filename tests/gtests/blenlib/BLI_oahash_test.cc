@@ -0,0 +1,217 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_oahash.h"
+#include "BLI_rand.h"
+}
+
+#define TESTCASE_SIZE 10000
+
+/* Unique random keys, never 0 so the tests can use 0 as a 'missing' marker. */
+static void init_keys(unsigned int keys[TESTCASE_SIZE], const int seed)
+{
+	GSet *gset = BLI_gset_new_ex(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__, TESTCASE_SIZE);
+	RNG *rng = BLI_rng_new(seed);
+	int i = 0;
+
+	while (i < TESTCASE_SIZE) {
+		const unsigned int t = BLI_rng_get_uint(rng);
+		if (t != 0 && BLI_gset_add(gset, SET_UINT_IN_POINTER(t))) {
+			keys[i++] = t;
+		}
+	}
+
+	BLI_rng_free(rng);
+	BLI_gset_free(gset, NULL);
+}
+
+static void oahash_insert_lookup_test(OAHash *oh)
+{
+	unsigned int keys[TESTCASE_SIZE], keys_missing[TESTCASE_SIZE];
+	GSet *gset = BLI_gset_new_ex(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__, TESTCASE_SIZE);
+	int i, num_missing = 0;
+
+	init_keys(keys, 0);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_oahash_insert(oh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_oahash_size(oh));
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void *v = BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(keys[i]));
+		EXPECT_EQ(keys[i], GET_UINT_FROM_POINTER(v));
+	}
+
+	/* keys from another seed that were not inserted */
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_gset_add(gset, SET_UINT_IN_POINTER(keys[i]));
+	}
+	init_keys(keys_missing, 1);
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		if (!BLI_gset_haskey(gset, SET_UINT_IN_POINTER(keys_missing[i]))) {
+			EXPECT_FALSE(BLI_oahash_haskey(oh, SET_UINT_IN_POINTER(keys_missing[i])));
+			EXPECT_EQ(NULL, BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(keys_missing[i])));
+			num_missing++;
+		}
+	}
+	EXPECT_GT(num_missing, TESTCASE_SIZE / 2);
+
+	BLI_gset_free(gset, NULL);
+	BLI_oahash_free(oh, NULL, NULL);
+}
+
+TEST(oahash, InsertLookup)
+{
+	oahash_insert_lookup_test(BLI_oahash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__));
+}
+
+TEST(oahash, InsertLookupPtr)
+{
+	oahash_insert_lookup_test(BLI_oahash_ptr_new(__func__));
+}
+
+/* Low quality hash, to get long probe sequences with many equal hashes. */
+static unsigned int oahash_tests_badhash_p(const void *p)
+{
+	return GET_UINT_FROM_POINTER(p) & 0xf;
+}
+
+TEST(oahash, InsertLookupCollisions)
+{
+	oahash_insert_lookup_test(BLI_oahash_new(oahash_tests_badhash_p, BLI_ghashutil_intcmp, __func__));
+}
+
+/* Insert all keys, then remove them in a different order, checking remaining keys are still found. */
+TEST(oahash, InsertRemove)
+{
+	OAHash *oh = BLI_oahash_new(oahash_tests_badhash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE];
+	int i, j;
+
+	init_keys(keys, 0);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_oahash_insert(oh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]));
+	}
+
+	for (i = 0; i < TESTCASE_SIZE; i += 2) {
+		void *v = BLI_oahash_popkey(oh, SET_UINT_IN_POINTER(keys[i]), NULL);
+		EXPECT_EQ(keys[i], GET_UINT_FROM_POINTER(v));
+		EXPECT_FALSE(BLI_oahash_remove(oh, SET_UINT_IN_POINTER(keys[i]), NULL, NULL));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE / 2, BLI_oahash_size(oh));
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void *v = BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(keys[i]));
+		EXPECT_EQ((i % 2) ? keys[i] : 0, GET_UINT_FROM_POINTER(v));
+	}
+
+	for (j = TESTCASE_SIZE - 1; j >= 0; j--) {
+		if (j % 2) {
+			EXPECT_TRUE(BLI_oahash_remove(oh, SET_UINT_IN_POINTER(keys[j]), NULL, NULL));
+		}
+	}
+
+	EXPECT_EQ(0, BLI_oahash_size(oh));
+
+	BLI_oahash_free(oh, NULL, NULL);
+}
+
+TEST(oahash, EnsureReinsert)
+{
+	OAHash *oh = BLI_oahash_ptr_new(__func__);
+	unsigned int keys[TESTCASE_SIZE];
+	int i;
+
+	init_keys(keys, 0);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p;
+		EXPECT_FALSE(BLI_oahash_ensure_p(oh, SET_UINT_IN_POINTER(keys[i]), &val_p));
+		*val_p = SET_INT_IN_POINTER(i);
+	}
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p;
+		EXPECT_TRUE(BLI_oahash_ensure_p(oh, SET_UINT_IN_POINTER(keys[i]), &val_p));
+		EXPECT_EQ(i, GET_INT_FROM_POINTER(*val_p));
+		EXPECT_FALSE(BLI_oahash_reinsert(oh, SET_UINT_IN_POINTER(keys[i]), SET_INT_IN_POINTER(-i), NULL, NULL));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_oahash_size(oh));
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p = BLI_oahash_lookup_p(oh, SET_UINT_IN_POINTER(keys[i]));
+		ASSERT_TRUE(val_p != NULL);
+		EXPECT_EQ(-i, GET_INT_FROM_POINTER(*val_p));
+	}
+
+	BLI_oahash_clear(oh, NULL, NULL);
+	EXPECT_EQ(0, BLI_oahash_size(oh));
+	EXPECT_EQ(NULL, BLI_oahash_lookup_p(oh, SET_UINT_IN_POINTER(keys[0])));
+
+	BLI_oahash_free(oh, NULL, NULL);
+}
+
+/* Iterate over all entries, each key must be visited exactly once. */
+TEST(oahash, Iterator)
+{
+	OAHash *oh = BLI_oahash_ptr_new_ex(__func__, TESTCASE_SIZE);
+	OAHashIterator ohi;
+	unsigned int keys[TESTCASE_SIZE];
+	unsigned int count = 0;
+	int i;
+
+	init_keys(keys, 0);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_oahash_insert(oh, SET_UINT_IN_POINTER(keys[i]), SET_INT_IN_POINTER(0));
+	}
+
+	OAHASH_ITER (ohi, oh) {
+		void **val_p = BLI_oahashIterator_getValue_p(&ohi);
+		EXPECT_EQ(0, GET_INT_FROM_POINTER(*val_p));
+		*val_p = SET_INT_IN_POINTER(1);
+		EXPECT_TRUE(BLI_oahash_haskey(oh, BLI_oahashIterator_getKey(&ohi)));
+		count++;
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, count);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		EXPECT_EQ(1, GET_INT_FROM_POINTER(BLI_oahash_lookup(oh, SET_UINT_IN_POINTER(keys[i]))));
+	}
+
+	BLI_oahash_free(oh, NULL, NULL);
+}
+
+static void oahash_tests_valfree(void *val)
+{
+	MEM_freeN(val);
+}
+
+TEST(oahash, FreeCallbacks)
+{
+	OAHash *oh = BLI_oahash_ptr_new(__func__);
+	int i;
+
+	for (i = 1; i <= 100; i++) {
+		BLI_oahash_insert(oh, SET_INT_IN_POINTER(i), MEM_mallocN(sizeof(int), __func__));
+	}
+
+	BLI_oahash_remove(oh, SET_INT_IN_POINTER(50), NULL, oahash_tests_valfree);
+	EXPECT_TRUE(BLI_oahash_reinsert(oh, SET_INT_IN_POINTER(50), MEM_mallocN(sizeof(int), __func__),
+	                                NULL, oahash_tests_valfree));
+
+	BLI_oahash_free(oh, NULL, oahash_tests_valfree);
+
+	EXPECT_EQ(0, MEM_get_memory_blocks_in_use());
+}
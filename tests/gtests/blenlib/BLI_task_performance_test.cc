@@ -0,0 +1,196 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+
+#include "atomic_ops.h"
+}
+
+/* Scheduling overhead: push lots of tasks doing (almost) nothing. */
+
+static void task_tiny_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	size_t *count = (size_t *)BLI_task_pool_userdata(pool);
+
+	atomic_add_z(count, 1);
+}
+
+typedef struct SpawnData {
+	int num_subtasks;
+} SpawnData;
+
+static void task_spawn_func(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	const SpawnData *data = (const SpawnData *)taskdata;
+
+	for (int i = 0; i < data->num_subtasks; i++) {
+		BLI_task_pool_push(pool, task_tiny_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+}
+
+static void task_tiny_tasks_test(const char *id, const int num_tasks, const int num_threads)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	size_t count = 0;
+
+	printf("\n========== STARTING %s (%d threads) ==========\n", id, BLI_task_scheduler_num_threads(scheduler));
+
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	{
+		TIMEIT_START(push_main_thread);
+
+		for (int i = 0; i < num_tasks; i++) {
+			BLI_task_pool_push(pool, task_tiny_func, NULL, false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(push_main_thread);
+	}
+
+	EXPECT_EQ(num_tasks, count);
+
+	{
+		/* tasks pushed from within tasks land in the worker queues and get stolen by idle threads */
+		const int num_spawn_tasks = num_tasks / 1000;
+		SpawnData data = {1000};
+
+		count = 0;
+
+		TIMEIT_START(push_from_tasks);
+
+		for (int i = 0; i < num_spawn_tasks; i++) {
+			BLI_task_pool_push(pool, task_spawn_func, &data, false, TASK_PRIORITY_HIGH);
+		}
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(push_from_tasks);
+
+		EXPECT_EQ(num_spawn_tasks * data.num_subtasks, count);
+	}
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(task, TinyTasks1000000)
+{
+	task_tiny_tasks_test("TinyTasks - 1000000", 1000000, TASK_SCHEDULER_AUTO_THREADS);
+}
+
+TEST(task, TinyTasks10000000)
+{
+	task_tiny_tasks_test("TinyTasks - 10000000", 10000000, TASK_SCHEDULER_AUTO_THREADS);
+}
+
+TEST(task, TinyTasks10000000SingleThread)
+{
+	task_tiny_tasks_test("TinyTasks - 10000000 - single thread", 10000000, TASK_SCHEDULER_SINGLE_THREAD);
+}
+
+/* Parallel primitives against their serial versions. */
+
+static void range_sum_func(void *userdata, void *userdata_chunk, int iter)
+{
+	const float *data = (const float *)userdata;
+	double *sum = (double *)userdata_chunk;
+
+	*sum += (double)data[iter];
+}
+
+static void range_sum_reduce(void *UNUSED(userdata), void *__restrict chunk_join, void *__restrict chunk)
+{
+	*(double *)chunk_join += *(double *)chunk;
+}
+
+static int cmp_float(const void *a, const void *b, void *UNUSED(thunk))
+{
+	const float fa = *(const float *)a, fb = *(const float *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+static void task_primitives_test(const char *id, const int num)
+{
+	BLI_threadapi_init();
+
+	printf("\n========== STARTING %s (%d threads) ==========\n", id,
+	       BLI_task_scheduler_num_threads(BLI_task_scheduler_get()));
+
+	float *data = (float *)MEM_mallocN(sizeof(*data) * (size_t)num, __func__);
+	int *offsets = (int *)MEM_mallocN(sizeof(*offsets) * (size_t)num, __func__);
+
+	for (int i = 0; i < num; i++) {
+		data[i] = (float)(((unsigned int)i * 2654435761u) % 1000003u) / 1000003.0f;
+	}
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		printf("%s:\n", use_threading ? "parallel" : "serial");
+
+		{
+			double sum = 0.0;
+
+			TIMEIT_START(reduce);
+
+			BLI_task_parallel_reduce(0, num, data, &sum, sizeof(sum), range_sum_func, range_sum_reduce,
+			                         use_threading);
+
+			TIMEIT_END(reduce);
+		}
+
+		{
+			for (int i = 0; i < num; i++) {
+				offsets[i] = i % 5;
+			}
+
+			TIMEIT_START(prefix_sum);
+
+			BLI_task_parallel_prefix_sum_i(offsets, num, use_threading);
+
+			TIMEIT_END(prefix_sum);
+		}
+
+		{
+			float *sort_data = (float *)MEM_dupallocN(data);
+
+			TIMEIT_START(sort);
+
+			BLI_task_parallel_sort(sort_data, (size_t)num, sizeof(*sort_data), cmp_float, NULL, use_threading);
+
+			TIMEIT_END(sort);
+
+			for (int i = 1; i < num; i++) {
+				if (sort_data[i - 1] > sort_data[i]) {
+					ADD_FAILURE() << "Array not sorted at " << i;
+					break;
+				}
+			}
+
+			MEM_freeN(sort_data);
+		}
+	}
+
+	MEM_freeN(data);
+	MEM_freeN(offsets);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(task, Primitives1000000)
+{
+	task_primitives_test("Primitives - 1000000", 1000000);
+}
+
+TEST(task, Primitives10000000)
+{
+	task_primitives_test("Primitives - 10000000", 10000000);
+}
@@ -0,0 +1,474 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_listbase.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+
+#include "atomic_ops.h"
+};
+
+#include "BLI_task_testing.h"
+
+#define NUM_TASKS 10000
+#define NUM_SUBTASKS 16
+/* more threads than cores is fine, it exercises stealing between queues on any machine */
+#define NUM_THREADS 8
+
+static void task_count_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	size_t *count = (size_t *)BLI_task_pool_userdata(pool);
+
+	atomic_add_z(count, 1);
+}
+
+static void task_spawn_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	/* running tasks may push new tasks, these go to the queue of the worker thread */
+	for (int i = 0; i < NUM_SUBTASKS; i++) {
+		BLI_task_pool_push(pool, task_count_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	task_count_func(pool, NULL, 0);
+}
+
+static void task_threadid_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	int *num_invalid = (int *)BLI_task_pool_userdata(pool);
+
+	if (threadid < 0 || threadid >= BLI_pool_get_num_threads(pool)) {
+		atomic_add_uint32((uint32_t *)num_invalid, 1);
+	}
+}
+
+static void task_free_func(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	size_t *count = (size_t *)BLI_task_pool_userdata(pool);
+
+	atomic_add_z(count, 1);
+	MEM_freeN(taskdata);
+}
+
+/* Nested pools: each task creates a pool on the same scheduler and waits for it. */
+
+typedef struct NestedData {
+	TaskScheduler *scheduler;
+	size_t count;
+} NestedData;
+
+static void task_nested_count_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	NestedData *data = (NestedData *)BLI_task_pool_userdata(pool);
+
+	atomic_add_z(&data->count, 1);
+}
+
+static void task_nested_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	NestedData *data = (NestedData *)BLI_task_pool_userdata(pool);
+	TaskPool *nested_pool = BLI_task_pool_create(data->scheduler, data);
+
+	for (int i = 0; i < NUM_SUBTASKS; i++) {
+		BLI_task_pool_push(nested_pool, task_nested_count_func, NULL, false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(nested_pool);
+	BLI_task_pool_free(nested_pool);
+}
+
+static void range_count_func(void *userdata, void *UNUSED(userdata_chunk), int UNUSED(iter))
+{
+	size_t *count = (size_t *)userdata;
+
+	atomic_add_z(count, 1);
+}
+
+static void task_nested_range_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	size_t *count = (size_t *)BLI_task_pool_userdata(pool);
+
+	BLI_task_parallel_range_ex(0, NUM_SUBTASKS * 16, count, NULL, 0, range_count_func, true, true);
+}
+
+static void task_pool_count(TaskScheduler *scheduler, TaskPriority priority)
+{
+	size_t count = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	for (int i = 0; i < NUM_TASKS; i++) {
+		BLI_task_pool_push(pool, task_count_func, NULL, false, priority);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ(NUM_TASKS, count);
+	EXPECT_EQ(NUM_TASKS, BLI_task_pool_tasks_done(pool));
+
+	BLI_task_pool_free(pool);
+}
+
+TEST(task, PoolPush)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(TASK_SCHEDULER_AUTO_THREADS);
+
+	task_pool_count(scheduler, TASK_PRIORITY_LOW);
+	task_pool_count(scheduler, TASK_PRIORITY_HIGH);
+
+	BLI_task_scheduler_free(scheduler);
+
+	scheduler = BLI_task_scheduler_create(NUM_THREADS);
+
+	task_pool_count(scheduler, TASK_PRIORITY_LOW);
+	task_pool_count(scheduler, TASK_PRIORITY_HIGH);
+
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolPushSingleThread)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(TASK_SCHEDULER_SINGLE_THREAD);
+
+	task_pool_count(scheduler, TASK_PRIORITY_LOW);
+
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolPushFromTasks)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(NUM_THREADS);
+	size_t count = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	for (int i = 0; i < NUM_TASKS; i++) {
+		BLI_task_pool_push(pool, task_spawn_func, NULL, false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ(NUM_TASKS * (NUM_SUBTASKS + 1), count);
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolNumThreads)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(NUM_THREADS);
+	size_t count = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	BLI_pool_set_num_threads(pool, 2);
+	for (int i = 0; i < NUM_TASKS; i++) {
+		BLI_task_pool_push(pool, task_count_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ(NUM_TASKS, count);
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolThreadId)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(NUM_THREADS);
+	int num_invalid = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &num_invalid);
+
+	for (int i = 0; i < NUM_TASKS; i++) {
+		BLI_task_pool_push(pool, task_threadid_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ(0, num_invalid);
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolCancel)
+{
+	BLI_threadapi_init();
+	TaskScheduler *scheduler = BLI_task_scheduler_create(NUM_THREADS);
+	size_t count = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	/* freeing of task data must happen for both executed and canceled tasks */
+	for (int i = 0; i < NUM_TASKS; i++) {
+		void *taskdata = MEM_mallocN(sizeof(int), __func__);
+		BLI_task_pool_push_ex(pool, task_count_func, taskdata, true, task_free_func, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_cancel(pool);
+
+	EXPECT_GE(count, (size_t)NUM_TASKS);
+	EXPECT_LE(count, (size_t)NUM_TASKS * 2);
+	EXPECT_EQ(0, BLI_task_pool_canceled(pool));
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+}
+
+TEST(task, PoolNested)
+{
+	BLI_threadapi_init();
+	NestedData data;
+	data.scheduler = BLI_task_scheduler_create(NUM_THREADS);
+	data.count = 0;
+	TaskPool *pool = BLI_task_pool_create(data.scheduler, &data);
+
+	for (int i = 0; i < NUM_TASKS / NUM_SUBTASKS; i++) {
+		BLI_task_pool_push(pool, task_nested_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ((NUM_TASKS / NUM_SUBTASKS) * NUM_SUBTASKS, data.count);
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(data.scheduler);
+}
+
+TEST(task, PoolNestedParallelRange)
+{
+	task_testing_init();
+	/* parallel range uses the global scheduler, nest in a pool of the same scheduler */
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	size_t count = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	for (int i = 0; i < NUM_TASKS / NUM_SUBTASKS; i++) {
+		BLI_task_pool_push(pool, task_nested_range_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	EXPECT_EQ((NUM_TASKS / NUM_SUBTASKS) * NUM_SUBTASKS * 16, count);
+
+	BLI_task_pool_free(pool);
+}
+
+/* Parallel primitives, sizes are large enough to be split in several blocks. */
+
+#define NUM_ITEMS 100000
+
+static void range_sum_func(void *userdata, void *userdata_chunk, int iter)
+{
+	const int *data = (const int *)userdata;
+	int64_t *sum = (int64_t *)userdata_chunk;
+
+	*sum += data[iter];
+}
+
+static void range_sum_reduce(void *UNUSED(userdata), void *__restrict chunk_join, void *__restrict chunk)
+{
+	*(int64_t *)chunk_join += *(int64_t *)chunk;
+}
+
+TEST(task, ParallelReduce)
+{
+	task_testing_init();
+
+	int *data = (int *)MEM_mallocN(sizeof(*data) * NUM_ITEMS, __func__);
+	int64_t expected = 0;
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		data[i] = i % 1000;
+		expected += data[i];
+	}
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		int64_t sum = 0;
+
+		BLI_task_parallel_reduce(0, NUM_ITEMS, data, &sum, sizeof(sum),
+		                         range_sum_func, range_sum_reduce, use_threading);
+		EXPECT_EQ(expected, sum);
+	}
+
+	MEM_freeN(data);
+}
+
+TEST(task, ParallelPrefixSum)
+{
+	task_testing_init();
+
+	int *data = (int *)MEM_mallocN(sizeof(*data) * NUM_ITEMS, __func__);
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		for (int i = 0; i < NUM_ITEMS; i++) {
+			data[i] = i % 7;
+		}
+
+		const int total = BLI_task_parallel_prefix_sum_i(data, NUM_ITEMS, use_threading);
+
+		int expected = 0;
+		for (int i = 0; i < NUM_ITEMS; i++) {
+			EXPECT_EQ(expected, data[i]);
+			expected += i % 7;
+		}
+		EXPECT_EQ(expected, total);
+	}
+
+	MEM_freeN(data);
+}
+
+static int cmp_int(const void *a, const void *b, void *UNUSED(thunk))
+{
+	const int ia = *(const int *)a, ib = *(const int *)b;
+
+	return (ia > ib) - (ia < ib);
+}
+
+TEST(task, ParallelSort)
+{
+	task_testing_init();
+
+	int *data = (int *)MEM_mallocN(sizeof(*data) * NUM_ITEMS, __func__);
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		/* odd size so blocks differ in size */
+		const int num = NUM_ITEMS - 13;
+		int64_t sum = 0, sum_sorted = 0;
+
+		for (int i = 0; i < num; i++) {
+			data[i] = (int)(((unsigned int)i * 2654435761u) % 100003u);
+			sum += data[i];
+		}
+
+		BLI_task_parallel_sort(data, num, sizeof(*data), cmp_int, NULL, use_threading);
+
+		for (int i = 0; i < num; i++) {
+			if (i > 0) {
+				EXPECT_LE(data[i - 1], data[i]);
+			}
+			sum_sorted += data[i];
+		}
+		EXPECT_EQ(sum, sum_sorted);
+	}
+
+	MEM_freeN(data);
+}
+
+static bool pred_is_even(const void *elem, void *UNUSED(userdata))
+{
+	return (*(const int *)elem % 2) == 0;
+}
+
+TEST(task, ParallelPartition)
+{
+	task_testing_init();
+
+	int *data = (int *)MEM_mallocN(sizeof(*data) * NUM_ITEMS, __func__);
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		for (int i = 0; i < NUM_ITEMS; i++) {
+			data[i] = i;
+		}
+
+		const size_t num_true = BLI_task_parallel_partition(
+		        data, NUM_ITEMS, sizeof(*data), pred_is_even, NULL, use_threading);
+
+		EXPECT_EQ(NUM_ITEMS / 2, num_true);
+		/* stable: both parts keep their order */
+		for (int i = 0; i < NUM_ITEMS / 2; i++) {
+			EXPECT_EQ(i * 2, data[i]);
+			EXPECT_EQ(i * 2 + 1, data[NUM_ITEMS / 2 + i]);
+		}
+	}
+
+	MEM_freeN(data);
+}
+
+typedef struct ListItem {
+	struct ListItem *next, *prev;
+	int value;
+	int index;
+} ListItem;
+
+static void listbase_func(void *userdata, Link *item, int index)
+{
+	size_t *count = (size_t *)userdata;
+	ListItem *list_item = (ListItem *)item;
+
+	list_item->index = index;
+	atomic_add_z(count, (size_t)list_item->value);
+}
+
+TEST(task, ParallelListbase)
+{
+	task_testing_init();
+
+	ListBase list = {NULL, NULL};
+	ListItem *items = (ListItem *)MEM_callocN(sizeof(*items) * NUM_TASKS, __func__);
+	size_t expected = 0;
+
+	for (int i = 0; i < NUM_TASKS; i++) {
+		items[i].value = i;
+		expected += (size_t)i;
+		BLI_addtail(&list, &items[i]);
+	}
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		size_t count = 0;
+
+		BLI_task_parallel_listbase(&list, &count, listbase_func, use_threading);
+
+		EXPECT_EQ(expected, count);
+		for (int i = 0; i < NUM_TASKS; i++) {
+			EXPECT_EQ(i, items[i].index);
+		}
+	}
+
+	MEM_freeN(items);
+}
+
+static void mempool_func(void *userdata, MempoolIterData *item)
+{
+	size_t *count = (size_t *)userdata;
+	int *value = (int *)item;
+
+	atomic_add_z(count, (size_t)*value);
+	*value = -1;
+}
+
+TEST(task, ParallelMempool)
+{
+	task_testing_init();
+
+	for (int use_threading = 0; use_threading < 2; use_threading++) {
+		/* small chunks so there are many of them */
+		BLI_mempool *mempool = BLI_mempool_create(sizeof(int) * 4, 0, 64, BLI_MEMPOOL_ALLOW_ITER);
+		int **items = (int **)MEM_mallocN(sizeof(*items) * NUM_TASKS, __func__);
+		size_t expected = 0, count = 0;
+
+		for (int i = 0; i < NUM_TASKS; i++) {
+			items[i] = (int *)BLI_mempool_alloc(mempool);
+			items[i][0] = i;
+		}
+		/* freed items must be skipped */
+		for (int i = 0; i < NUM_TASKS; i += 3) {
+			BLI_mempool_free(mempool, items[i]);
+			items[i] = NULL;
+		}
+		for (int i = 0; i < NUM_TASKS; i++) {
+			if (items[i]) {
+				expected += (size_t)i;
+			}
+		}
+
+		BLI_task_parallel_mempool(mempool, &count, mempool_func, use_threading);
+
+		EXPECT_EQ(expected, count);
+		for (int i = 0; i < NUM_TASKS; i++) {
+			if (items[i]) {
+				EXPECT_EQ(-1, items[i][0]);
+			}
+		}
+
+		MEM_freeN(items);
+		BLI_mempool_destroy(mempool);
+	}
+}
@@ -0,0 +1,30 @@
+/* Apache License, Version 2.0 */
+
+#ifndef __BLENDER_TESTING_BLI_TASK_TESTING_H__
+#define __BLENDER_TESTING_BLI_TASK_TESTING_H__
+
+extern "C" {
+#include "BLI_task.h"
+#include "BLI_threads.h"
+}
+
+/* threads of the global task scheduler, also on machines with fewer cores */
+#define TASK_TESTING_NUM_THREADS 8
+
+/* The global task scheduler is created on first use and kept until the test binary exits,
+ * so its number of threads can only be set once, before any test uses it.
+ * Call at the start of every test using the global scheduler. */
+static void task_testing_init(void)
+{
+	static bool is_init = false;
+
+	if (!is_init) {
+		BLI_threadapi_init();
+		BLI_system_num_threads_override_set(TASK_TESTING_NUM_THREADS);
+		BLI_task_scheduler_get();
+
+		is_init = true;
+	}
+}
+
+#endif  /* __BLENDER_TESTING_BLI_TASK_TESTING_H__ */
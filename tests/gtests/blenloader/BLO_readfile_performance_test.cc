@@ -0,0 +1,444 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_fileops.h"
+#include "BLI_listbase.h"
+#include "BLI_path_util.h"
+#include "BLI_string.h"
+#include "BLI_threads.h"
+
+#include "DNA_group_types.h"
+#include "DNA_image_types.h"
+#include "DNA_material_types.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_node_types.h"
+#include "DNA_object_types.h"
+
+#include "BKE_appdir.h"
+#include "BKE_blender.h"
+#include "BKE_customdata.h"
+#include "BKE_global.h"
+#include "BKE_group.h"
+#include "BKE_image.h"
+#include "BKE_library.h"
+#include "BKE_main.h"
+#include "BKE_material.h"
+#include "BKE_mesh.h"
+#include "BKE_node.h"
+#include "BKE_object.h"
+
+#include "BLO_readfile.h"
+#include "BLO_writefile.h"
+#include "BLO_undofile.h"
+
+#include "IMB_imbuf.h"
+
+#include "RNA_define.h"
+
+#include "PIL_time_utildefines.h"
+}
+
+#include "BLO_synthetic_data.h"
+
+/* Timing of reading and writing large synthetic files,
+ * the behavior itself is checked on small files in BLO_readfile_test.cc. */
+
+#define NUM_READS 3
+
+#define IO_IMAGE_SIZE 256
+#define IO_NODE_TREE_TEXTURES 4
+
+/* Adds images packed in the file and shader node trees using them,
+ * for a file with large packed data blocks and many small node and socket blocks. */
+static Main *synthetic_main_io_new(
+        const int num_objects, const int num_verts, const int num_images, const int num_node_trees)
+{
+	Main *bmain = synthetic_main_new(num_objects, num_verts);
+	Image **images = (Image **)MEM_mallocN(sizeof(*images) * num_images, __func__);
+	const float color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	char name[MAX_ID_NAME - 2];
+
+	for (int i = 0; i < num_images; i++) {
+		BLI_snprintf(name, sizeof(name), "Image.%06d", i);
+		images[i] = BKE_image_add_generated(
+		        bmain, IO_IMAGE_SIZE, IO_IMAGE_SIZE, name, 24, 0, IMA_GENTYPE_GRID_COLOR, color, false);
+		BKE_image_memorypack(images[i]);
+	}
+
+	for (int i = 0; i < num_node_trees; i++) {
+		BLI_snprintf(name, sizeof(name), "NodeTree.%06d", i);
+		bNodeTree *ntree = ntreeAddTree(bmain, name, "ShaderNodeTree");
+
+		for (int j = 0; j < IO_NODE_TREE_TEXTURES; j++) {
+			bNode *node_tex = nodeAddStaticNode(NULL, ntree, SH_NODE_TEX_IMAGE);
+			bNode *node_bsdf = nodeAddStaticNode(NULL, ntree, SH_NODE_BSDF_DIFFUSE);
+
+			node_tex->id = &images[(i + j) % num_images]->id;
+			id_us_plus(node_tex->id);
+			nodeAddLink(ntree,
+			            node_tex, nodeFindSocket(node_tex, SOCK_OUT, "Color"),
+			            node_bsdf, nodeFindSocket(node_bsdf, SOCK_IN, "Color"));
+		}
+		/* without bmain, verifying the group nodes of all trees would make this quadratic */
+		ntreeUpdateTree(NULL, ntree);
+	}
+
+	MEM_freeN(images);
+
+	return bmain;
+}
+
+static void read_tests(const char *id, const int num_objects, const int num_verts, const int write_flags)
+{
+	blendfile_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_performance.blend");
+
+	Main *bmain = synthetic_main_new(num_objects, num_verts);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+
+	TIMEIT_START(write);
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, write_flags, NULL, NULL));
+	TIMEIT_END(write);
+
+	BKE_main_free(bmain);
+
+	for (int i = 0; i < NUM_READS; i++) {
+		BlendFileData *bfd;
+
+		TIMEIT_START(read);
+		bfd = BLO_read_from_file(filepath, NULL);
+		TIMEIT_END(read);
+
+		ASSERT_TRUE(bfd != NULL);
+		EXPECT_EQ(num_objects, BLI_listbase_count(&bfd->main->object));
+		EXPECT_EQ(num_objects, BLI_listbase_count(&bfd->main->mesh));
+
+		Mesh *me = (Mesh *)bfd->main->mesh.last;
+		ASSERT_TRUE(me->dvert != NULL);
+		EXPECT_EQ(1.0f, me->dvert[num_verts - 1].dw->weight);
+		EXPECT_EQ(me, ((Object *)bfd->main->object.last)->data);
+
+		BLO_blendfiledata_free(bfd);
+	}
+
+	BLI_delete(filepath, false, false);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+/* Saving in background: only creating the snapshot blocks, flushing it can run in a thread. */
+static void write_snapshot_tests(const char *id, const int num_objects, const int num_verts, const int write_flags)
+{
+	blendfile_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_performance.blend");
+
+	Main *bmain = synthetic_main_new(num_objects, num_verts);
+	BlendWriteSnapshot *snapshot;
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+
+	TIMEIT_START(snapshot_create);
+	snapshot = BLO_write_snapshot_create(bmain, filepath, write_flags, NULL, NULL);
+	TIMEIT_END(snapshot_create);
+
+	BKE_main_free(bmain);
+	ASSERT_TRUE(snapshot != NULL);
+
+	TIMEIT_START(snapshot_flush);
+	EXPECT_TRUE(BLO_write_snapshot_flush(snapshot, NULL, NULL));
+	TIMEIT_END(snapshot_flush);
+
+	BLO_write_snapshot_free(snapshot);
+
+	BLI_delete(filepath, false, false);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+/* Linking one object from a large library, the first time the index of its blocks is written,
+ * afterwards only the blocks of the object and its mesh are read. */
+static void link_tests(const char *id, const int num_objects, const int num_verts)
+{
+	blendfile_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_performance_library.blend");
+	/* don't write the index into the cache of the user */
+	BLI_setenv("XDG_CACHE_HOME", BKE_tempdir_session());
+
+	Main *bmain = synthetic_main_new(num_objects, num_verts);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, 0, NULL, NULL));
+	BKE_main_free(bmain);
+
+	Main *bmain_prev = G.main;
+
+	for (int i = 0; i < NUM_READS; i++) {
+		char name[MAX_ID_NAME - 2];
+		BLI_snprintf(name, sizeof(name), "Object.%06d", num_objects / 2);
+
+		bmain = BKE_main_new();
+		G.main = bmain;
+
+		ID *id_link;
+		TIMEIT_START(link);
+		BlendHandle *bh = BLO_blendhandle_from_file(filepath, NULL);
+		ASSERT_TRUE(bh != NULL);
+		Main *mainl = BLO_library_link_begin(bmain, &bh, filepath);
+		id_link = BLO_library_link_named_part(mainl, &bh, ID_OB, name);
+		BLO_library_link_end(mainl, &bh, 0, NULL, NULL);
+		BLO_blendhandle_close(bh);
+		TIMEIT_END(link);
+
+		ASSERT_TRUE(id_link != NULL);
+
+		G.main = bmain_prev;
+		BKE_main_free(bmain);
+	}
+
+	BLI_delete(filepath, false, false);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+/* Write two global undo steps, with one object added at the start of the file in between. */
+static void undo_tests(const char *id, const int num_objects, const int num_verts)
+{
+	blendfile_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	Main *bmain = synthetic_main_new(num_objects, num_verts);
+	synthetic_material_add(bmain);
+	MemFile memfile_prev = {{NULL, NULL}, 0};
+	MemFile memfile = {{NULL, NULL}, 0};
+
+	TIMEIT_START(undo_write_first);
+	ASSERT_TRUE(BLO_write_file_mem(bmain, NULL, &memfile_prev, 0));
+	TIMEIT_END(undo_write_first);
+
+	Object *ob = (Object *)synthetic_id_add(bmain, ID_OB, "Inserted", 0);
+	ob->type = OB_EMPTY;
+	BKE_object_init(ob);
+	BLI_remlink(&bmain->object, ob);
+	BLI_addhead(&bmain->object, ob);
+
+	TIMEIT_START(undo_write);
+	ASSERT_TRUE(BLO_write_file_mem(bmain, &memfile_prev, &memfile, 0));
+	TIMEIT_END(undo_write);
+
+	printf("undo step memory: first %zu, after insertion %zu\n", memfile_prev.size, memfile.size);
+
+	BlendFileData *bfd;
+
+	TIMEIT_START(undo_read);
+	bfd = BLO_read_from_memfile(bmain, "", &memfile_prev, NULL, NULL);
+	TIMEIT_END(undo_read);
+
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(num_objects, BLI_listbase_count(&bfd->main->object));
+	BLO_blendfiledata_free(bfd);
+
+	/* like read_undosave: the current state is written with the undo step as reference,
+	 * then all ID's but the inserted object are kept */
+	MemFile memfile_current = {{NULL, NULL}, 0};
+
+	TIMEIT_START(undo_read_incremental);
+	ASSERT_TRUE(BLO_write_file_mem(bmain, &memfile_prev, &memfile_current, 0));
+	bfd = BLO_read_from_memfile(bmain, "", &memfile_prev, &memfile_current, NULL);
+	TIMEIT_END(undo_read_incremental);
+
+	BLO_memfile_free(&memfile_current);
+
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(num_objects, BLI_listbase_count(&bfd->main->object));
+	BKE_main_free(bmain);
+	bmain = bfd->main;
+	MEM_freeN(bfd);
+
+	TIMEIT_START(undo_merge);
+	BLO_memfile_merge(&memfile_prev, &memfile);
+	TIMEIT_END(undo_merge);
+
+	TIMEIT_START(undo_read_merged);
+	bfd = BLO_read_from_memfile(bmain, "", &memfile, NULL, NULL);
+	TIMEIT_END(undo_read_merged);
+
+	ASSERT_TRUE(bfd != NULL);
+	BLO_blendfiledata_free(bfd);
+
+	BLO_memfile_free(&memfile);
+	BKE_main_free(bmain);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+typedef struct IOStats {
+	double time_start;
+	size_t mem_start;
+	unsigned int blocks_start;
+} IOStats;
+
+static void io_stats_start(IOStats *stats)
+{
+	MEM_reset_peak_memory();
+	stats->mem_start = MEM_get_memory_in_use();
+	stats->blocks_start = MEM_get_memory_blocks_in_use();
+	stats->time_start = PIL_check_seconds_timer();
+}
+
+/* Throughput is relative to the uncompressed size of the file, so it compares between compressed
+ * and uncompressed files. Blocks and memory in use are the difference at the end of the step
+ * (the data of the read Main, about zero for writing), the peak includes temporary buffers of
+ * reading and writing. */
+static void io_stats_print(const IOStats *stats, const char *str, const size_t data_size, const size_t file_size)
+{
+	const double time = PIL_check_seconds_timer() - stats->time_start;
+	const double mb = 1024.0 * 1024.0;
+
+	printf("%s: %.3f s, %.1f MB file, %.1f MB/s, %d blocks in use, %.1f MB in use, %.1f MB peak\n",
+	       str, time, (double)file_size / mb, (double)data_size / mb / time,
+	       (int)(MEM_get_memory_blocks_in_use() - stats->blocks_start),
+	       ((double)MEM_get_memory_in_use() - (double)stats->mem_start) / mb,
+	       ((double)MEM_get_peak_memory() - (double)stats->mem_start) / mb);
+}
+
+/* Saving and loading of a file with all kinds of data, uncompressed and compressed. */
+static void io_tests(
+        const char *id, const int num_objects, const int num_verts, const int num_images, const int num_node_trees)
+{
+	/* uncompressed first, for the data size */
+	const int write_flags[2] = {0, G_FILE_COMPRESS};
+	size_t data_size = 0;
+
+	blendfile_init();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_performance_io.blend");
+
+	Main *bmain = synthetic_main_io_new(num_objects, num_verts, num_images, num_node_trees);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+
+	for (size_t i = 0; i < ARRAY_SIZE(write_flags); i++) {
+		const char *str_compress = (write_flags[i] & G_FILE_COMPRESS) ? "compressed" : "uncompressed";
+		char str[64];
+		size_t file_size;
+		IOStats stats;
+
+		io_stats_start(&stats);
+		ASSERT_TRUE(BLO_write_file(bmain, filepath, write_flags[i], NULL, NULL));
+		file_size = BLI_file_size(filepath);
+		if (data_size == 0) {
+			data_size = file_size;
+		}
+		BLI_snprintf(str, sizeof(str), "write %s", str_compress);
+		io_stats_print(&stats, str, data_size, file_size);
+
+		for (int j = 0; j < NUM_READS; j++) {
+			BlendFileData *bfd;
+
+			io_stats_start(&stats);
+			bfd = BLO_read_from_file(filepath, NULL);
+			BLI_snprintf(str, sizeof(str), "read %s", str_compress);
+			io_stats_print(&stats, str, data_size, file_size);
+
+			ASSERT_TRUE(bfd != NULL);
+			EXPECT_EQ(num_objects, BLI_listbase_count(&bfd->main->mesh));
+			EXPECT_EQ(num_images, BLI_listbase_count(&bfd->main->image));
+			EXPECT_EQ(num_node_trees, BLI_listbase_count(&bfd->main->nodetree));
+
+			Image *ima = (Image *)bfd->main->image.last;
+			ASSERT_TRUE(BKE_image_has_packedfile(ima));
+
+			bNodeTree *ntree = (bNodeTree *)bfd->main->nodetree.last;
+			EXPECT_EQ(IO_NODE_TREE_TEXTURES * 2, BLI_listbase_count(&ntree->nodes));
+			EXPECT_EQ(IO_NODE_TREE_TEXTURES, BLI_listbase_count(&ntree->links));
+			bNode *node_tex = (bNode *)ntree->nodes.first;
+			EXPECT_EQ(GS(node_tex->id->name), ID_IM);
+			EXPECT_TRUE(BLI_findindex(&bfd->main->image, node_tex->id) != -1);
+
+			BLO_blendfiledata_free(bfd);
+		}
+	}
+
+	BKE_main_free(bmain);
+	BLI_delete(filepath, false, false);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(blendfile, ReadManyObjects)
+{
+	read_tests("Read - 10000 objects, 50 vertices", 10000, 50, 0);
+}
+
+TEST(blendfile, ReadLargeMeshes)
+{
+	read_tests("Read - 100 objects, 50000 vertices", 100, 50000, 0);
+}
+
+TEST(blendfile, ReadLargeMeshesCompressed)
+{
+	read_tests("Read - 100 objects, 50000 vertices, compressed", 100, 50000, G_FILE_COMPRESS);
+}
+
+TEST(blendfile, ReadManyObjectsCompressed)
+{
+	read_tests("Read - 10000 objects, 50 vertices, compressed", 10000, 50, G_FILE_COMPRESS);
+}
+
+TEST(blendfile, WriteSnapshotLargeMeshes)
+{
+	write_snapshot_tests("Write snapshot - 100 objects, 50000 vertices", 100, 50000, 0);
+}
+
+TEST(blendfile, WriteSnapshotLargeMeshesCompressed)
+{
+	write_snapshot_tests("Write snapshot - 100 objects, 50000 vertices, compressed", 100, 50000, G_FILE_COMPRESS);
+}
+
+TEST(blendfile, LinkManyObjects)
+{
+	link_tests("Link - 10000 objects, 50 vertices", 10000, 50);
+}
+
+TEST(blendfile, LinkLargeMeshes)
+{
+	link_tests("Link - 100 objects, 50000 vertices", 100, 50000);
+}
+
+TEST(blendfile, UndoManyObjects)
+{
+	undo_tests("Undo - 10000 objects, 50 vertices", 10000, 50);
+}
+
+TEST(blendfile, UndoLargeMeshes)
+{
+	undo_tests("Undo - 100 objects, 50000 vertices", 100, 50000);
+}
+
+TEST(blendfile, IOManyObjects)
+{
+	io_tests("I/O - 10000 objects, 50 vertices, 100 images, 2000 node trees", 10000, 50, 100, 2000);
+}
+
+TEST(blendfile, IOLargeMeshes)
+{
+	io_tests("I/O - 100 objects, 50000 vertices, 500 images, 200 node trees", 100, 50000, 500, 200);
+}
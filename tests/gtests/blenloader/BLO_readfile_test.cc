@@ -0,0 +1,346 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#endif
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_fileops.h"
+#include "BLI_fileops_types.h"
+#include "BLI_ghash.h"
+#include "BLI_listbase.h"
+#include "BLI_path_util.h"
+#include "BLI_string.h"
+#include "BLI_threads.h"
+
+#include "DNA_image_types.h"
+#include "DNA_material_types.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_node_types.h"
+#include "DNA_object_types.h"
+
+#include "BKE_appdir.h"
+#include "BKE_global.h"
+#include "BKE_main.h"
+#include "BKE_object.h"
+
+#include "BLO_blend_defs.h"
+#include "BLO_readfile.h"
+#include "BLO_writefile.h"
+#include "BLO_undofile.h"
+}
+
+#include "BLO_synthetic_data.h"
+
+#define NUM_OBJECTS 8
+#define NUM_VERTS 16
+
+/* more data than the gzip blocks decompressed at once by a single thread */
+#define COMPRESSED_NUM_OBJECTS 4
+#define COMPRESSED_NUM_VERTS 32768
+
+static void compressed_file_check(const char *filepath)
+{
+	BlendFileData *bfd = BLO_read_from_file(filepath, NULL);
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(COMPRESSED_NUM_OBJECTS, BLI_listbase_count(&bfd->main->object));
+	for (Mesh *me = (Mesh *)bfd->main->mesh.first; me; me = (Mesh *)me->id.next) {
+		ASSERT_TRUE(me->dvert != NULL);
+		EXPECT_EQ((float)(COMPRESSED_NUM_VERTS - 1), me->mvert[COMPRESSED_NUM_VERTS - 1].co[0]);
+		EXPECT_EQ(1.0f, me->dvert[COMPRESSED_NUM_VERTS - 1].dw->weight);
+	}
+	BLO_blendfiledata_free(bfd);
+}
+
+/* Compressed files are written as independent gzip members, which are read in parallel
+ * and refilled while reading. Files with invalid members are read with zlib as a stream. */
+TEST(blendfile, CompressedRoundTrip)
+{
+	blendfile_init();
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_compressed.blend");
+
+	Main *bmain = synthetic_main_new(COMPRESSED_NUM_OBJECTS, COMPRESSED_NUM_VERTS);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, G_FILE_COMPRESS, NULL, NULL));
+	BKE_main_free(bmain);
+
+	/* the first member has the size of the whole member in its extra field,
+	 * and is followed by the next one */
+	unsigned char header[BLEN_GZIP_BLOCK_HEADER_SIZE];
+	FILE *fp = BLI_fopen(filepath, "rb");
+	ASSERT_TRUE(fp != NULL);
+	ASSERT_EQ(1, fread(header, sizeof(header), 1, fp));
+	EXPECT_EQ(0x1f, header[0]);
+	EXPECT_EQ(0x8b, header[1]);
+	EXPECT_EQ('B', header[12]);
+	EXPECT_EQ('L', header[13]);
+	const long member_len = (long)(header[16] | (header[17] << 8) | (header[18] << 16) | (header[19] << 24));
+	ASSERT_LT(member_len, (long)BLI_file_size(filepath));
+	ASSERT_EQ(0, fseek(fp, member_len, SEEK_SET));
+	ASSERT_EQ(1, fread(header, sizeof(header), 1, fp));
+	EXPECT_EQ(0x1f, header[0]);
+	EXPECT_EQ(0x8b, header[1]);
+	fclose(fp);
+
+	BLI_system_num_threads_override_set(1);
+	compressed_file_check(filepath);
+	BLI_system_num_threads_override_set(0);
+	compressed_file_check(filepath);
+
+	/* a member size past the end of the file */
+	fp = BLI_fopen(filepath, "r+b");
+	ASSERT_TRUE(fp != NULL);
+	ASSERT_EQ(0, fseek(fp, 16, SEEK_SET));
+	EXPECT_EQ(1, fwrite("\xff\xff\xff\x7f", 4, 1, fp));
+	fclose(fp);
+	compressed_file_check(filepath);
+
+	BLI_delete(filepath, false, false);
+}
+
+/* A snapshot doesn't refer to the data it was created from, once flushed the file has
+ * the same size as when writing directly, only addresses of temporary data differ. */
+TEST(blendfile, WriteSnapshotFlush)
+{
+	blendfile_init();
+
+	char filepath[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_snapshot.blend");
+
+	Main *bmain = synthetic_main_new(NUM_OBJECTS, NUM_VERTS);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, 0, NULL, NULL));
+	const size_t file_size = BLI_file_size(filepath);
+	BLI_delete(filepath, false, false);
+
+	BlendWriteSnapshot *snapshot = BLO_write_snapshot_create(bmain, filepath, 0, NULL, NULL);
+	BKE_main_free(bmain);
+	ASSERT_TRUE(snapshot != NULL);
+	EXPECT_FALSE(BLI_exists(filepath));
+
+	float progress = 0.0f;
+	EXPECT_TRUE(BLO_write_snapshot_flush(snapshot, NULL, &progress));
+	EXPECT_EQ(1.0f, progress);
+	BLO_write_snapshot_free(snapshot);
+
+	EXPECT_EQ(file_size, BLI_file_size(filepath));
+
+	BlendFileData *bfd = BLO_read_from_file(filepath, NULL);
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(NUM_OBJECTS, BLI_listbase_count(&bfd->main->object));
+	Mesh *me = (Mesh *)bfd->main->mesh.last;
+	EXPECT_EQ(1.0f, me->dvert[NUM_VERTS - 1].dw->weight);
+	BLO_blendfiledata_free(bfd);
+
+	BLI_delete(filepath, false, false);
+}
+
+#ifndef WIN32
+/* Index files in the cache directory, which is set to the temporary directory of the test. */
+static int link_index_files_count(void)
+{
+	char dirpath[FILE_MAX];
+	struct direntry *files;
+	int count = 0;
+
+	BLI_join_dirfile(dirpath, sizeof(dirpath), BKE_tempdir_session(), "blender/blend_index");
+	const unsigned int files_len = BLI_filelist_dir_contents(dirpath, &files);
+	for (unsigned int i = 0; i < files_len; i++) {
+		if (BLI_testextensie(files[i].relname, ".idx")) {
+			count++;
+		}
+	}
+	BLI_filelist_free(files, files_len);
+
+	return count;
+}
+
+/* Links the object of the library with the given index, checks it and its mesh. */
+static void link_object_check(const char *filepath, const int index)
+{
+	char name[MAX_ID_NAME - 2];
+	BLI_snprintf(name, sizeof(name), "Object.%06d", index);
+
+	Main *bmain_prev = G.main;
+	Main *bmain = BKE_main_new();
+	G.main = bmain;
+
+	BlendHandle *bh = BLO_blendhandle_from_file(filepath, NULL);
+	ASSERT_TRUE(bh != NULL);
+	Main *mainl = BLO_library_link_begin(bmain, &bh, filepath);
+	ID *id_link = BLO_library_link_named_part(mainl, &bh, ID_OB, name);
+	BLO_library_link_end(mainl, &bh, 0, NULL, NULL);
+	BLO_blendhandle_close(bh);
+
+	ASSERT_TRUE(id_link != NULL);
+	EXPECT_STREQ(name, id_link->name + 2);
+	EXPECT_EQ(1, BLI_listbase_count(&bmain->object));
+	EXPECT_EQ(1, BLI_listbase_count(&bmain->mesh));
+	Mesh *me = (Mesh *)((Object *)id_link)->data;
+	ASSERT_TRUE(me != NULL);
+	BLI_snprintf(name, sizeof(name), "Mesh.%06d", index);
+	EXPECT_STREQ(name, me->id.name + 2);
+	EXPECT_EQ(1.0f, me->dvert[NUM_VERTS - 1].dw->weight);
+
+	G.main = bmain_prev;
+	BKE_main_free(bmain);
+}
+
+/* Linking from a library writes an index of its blocks into the user cache, not beside it,
+ * later links read only the blocks they need through it. */
+TEST(blendfile, LinkIndex)
+{
+	blendfile_init();
+
+	char filepath[FILE_MAX], filepath_beside[FILE_MAX];
+	BLI_join_dirfile(filepath, sizeof(filepath), BKE_tempdir_session(), "readfile_library.blend");
+	BLI_snprintf(filepath_beside, sizeof(filepath_beside), "%s.idx", filepath);
+	BLI_setenv("XDG_CACHE_HOME", BKE_tempdir_session());
+
+	Main *bmain = synthetic_main_new(NUM_OBJECTS, NUM_VERTS);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, 0, NULL, NULL));
+	BKE_main_free(bmain);
+
+	for (int i = 0; i < 2; i++) {
+		link_object_check(filepath, NUM_OBJECTS / 2);
+		EXPECT_EQ(1, link_index_files_count());
+		EXPECT_FALSE(BLI_exists(filepath_beside));
+	}
+
+	/* Save the library again with the same size and time, the old addresses in the index
+	 * are outdated then, but it still matches the file. Linking has to notice and remove it. */
+	struct stat st;
+	ASSERT_EQ(0, stat(filepath, &st));
+	bmain = synthetic_main_new(NUM_OBJECTS, NUM_VERTS);
+	BLI_strncpy(bmain->name, filepath, sizeof(bmain->name));
+	ASSERT_TRUE(BLO_write_file(bmain, filepath, 0, NULL, NULL));
+	BKE_main_free(bmain);
+	const struct timespec times[2] = {st.st_atim, st.st_mtim};
+	ASSERT_EQ(0, utimensat(AT_FDCWD, filepath, times, 0));
+	ASSERT_EQ((size_t)st.st_size, BLI_file_size(filepath));
+
+	link_object_check(filepath, NUM_OBJECTS / 2);
+	EXPECT_EQ(0, link_index_files_count());
+
+	BLI_delete(filepath, false, false);
+}
+#endif
+
+/* Memory of the buffers 'memfile' shares with the step it was written against,
+ * which is accounted there until the steps are merged. */
+static size_t memfile_shared_size(const MemFile *memfile)
+{
+	GSet *buffers = BLI_gset_ptr_new(__func__);
+	size_t size = 0;
+
+	for (const MemFileChunk *chunk = (const MemFileChunk *)memfile->chunks.first; chunk;
+	     chunk = (const MemFileChunk *)chunk->next)
+	{
+		if (chunk->is_identical && BLI_gset_add(buffers, (void *)chunk->buf)) {
+			size += chunk->size;
+		}
+	}
+
+	BLI_gset_free(buffers, NULL);
+	return size;
+}
+
+/* Undo steps share chunks by content, also when data is inserted before them.
+ * Merging moves the shared buffers into the later step, which has to account for them. */
+TEST(blendfile, UndoMergeShared)
+{
+	blendfile_init();
+
+	Main *bmain = synthetic_main_new(NUM_OBJECTS, NUM_VERTS);
+	MemFile memfile_prev = {{NULL, NULL}, 0};
+	MemFile memfile = {{NULL, NULL}, 0};
+
+	ASSERT_TRUE(BLO_write_file_mem(bmain, NULL, &memfile_prev, 0));
+
+	Object *ob = (Object *)synthetic_id_add(bmain, ID_OB, "Inserted", 0);
+	ob->type = OB_EMPTY;
+	BKE_object_init(ob);
+	BLI_remlink(&bmain->object, ob);
+	BLI_addhead(&bmain->object, ob);
+
+	ASSERT_TRUE(BLO_write_file_mem(bmain, &memfile_prev, &memfile, 0));
+	EXPECT_LT(memfile.size, memfile_prev.size / 2);
+
+	/* the shared buffers must survive freeing the previous step */
+	const size_t memfile_shared = memfile_shared_size(&memfile);
+	const size_t memfile_size_merged = memfile.size + memfile_shared;
+	EXPECT_GT(memfile_shared, 0);
+	BLO_memfile_merge(&memfile_prev, &memfile);
+	EXPECT_EQ(memfile_size_merged, memfile.size);
+	EXPECT_EQ(0, memfile_prev.size);
+
+	BlendFileData *bfd = BLO_read_from_memfile(bmain, "", &memfile, NULL, NULL);
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(NUM_OBJECTS + 1, BLI_listbase_count(&bfd->main->object));
+	Mesh *me = (Mesh *)bfd->main->mesh.last;
+	EXPECT_EQ(1.0f, me->dvert[NUM_VERTS - 1].dw->weight);
+	BLO_blendfiledata_free(bfd);
+
+	BLO_memfile_free(&memfile);
+	BKE_main_free(bmain);
+}
+
+/* Reading the current state against the previous undo step keeps all unchanged ID's,
+ * also when only their runtime data changed, and materials with their node trees. */
+TEST(blendfile, UndoReuseUnchanged)
+{
+	blendfile_init();
+
+	Main *bmain = synthetic_main_new(NUM_OBJECTS, NUM_VERTS);
+	Material *ma = synthetic_material_add(bmain);
+	Image *ima = (Image *)bmain->image.first;
+	Mesh *me = (Mesh *)bmain->mesh.last;
+	Object *ob_last = (Object *)bmain->object.last;
+	MemFile memfile_prev = {{NULL, NULL}, 0};
+	MemFile memfile = {{NULL, NULL}, 0};
+
+	ASSERT_TRUE(BLO_write_file_mem(bmain, NULL, &memfile_prev, 0));
+
+	/* insert an object at the start of the file, which is not in the undo step */
+	Object *ob = (Object *)synthetic_id_add(bmain, ID_OB, "Inserted", 0);
+	ob->type = OB_EMPTY;
+	BKE_object_init(ob);
+	BLI_remlink(&bmain->object, ob);
+	BLI_addhead(&bmain->object, ob);
+	ob_last->bb = BKE_boundbox_alloc_unit();
+
+	ASSERT_TRUE(BLO_write_file_mem(bmain, &memfile_prev, &memfile, 0));
+	BlendFileData *bfd = BLO_read_from_memfile(bmain, "", &memfile_prev, &memfile, NULL);
+	BLO_memfile_free(&memfile);
+
+	ASSERT_TRUE(bfd != NULL);
+	EXPECT_EQ(NUM_OBJECTS, BLI_listbase_count(&bfd->main->object));
+	EXPECT_EQ(me, bfd->main->mesh.last);
+	EXPECT_EQ(ob_last, bfd->main->object.last);
+	EXPECT_EQ(me, ob_last->data);
+	EXPECT_EQ(1, me->id.us);
+	EXPECT_EQ(1.0f, me->dvert[NUM_VERTS - 1].dw->weight);
+	EXPECT_EQ(ma, me->mat[0]);
+	EXPECT_EQ(ma, bfd->main->mat.first);
+	EXPECT_EQ(ima, bfd->main->image.first);
+	EXPECT_EQ(&ima->id, ((bNode *)ma->nodetree->nodes.first)->id);
+	EXPECT_EQ(NUM_OBJECTS, ma->id.us);
+	EXPECT_EQ(1, ima->id.us);
+
+	/* only the inserted object is left in the old main */
+	EXPECT_EQ(1, BLI_listbase_count(&bmain->object));
+	EXPECT_EQ(0, BLI_listbase_count(&bmain->group));
+	BKE_main_free(bmain);
+
+	BLO_blendfiledata_free(bfd);
+	BLO_memfile_free(&memfile_prev);
+}
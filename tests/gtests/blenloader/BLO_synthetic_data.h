@@ -0,0 +1,133 @@
+/* Apache License, Version 2.0 */
+
+#ifndef __BLENDER_TESTING_BLO_SYNTHETIC_DATA_H__
+#define __BLENDER_TESTING_BLO_SYNTHETIC_DATA_H__
+
+/* Synthetic files for the blend file tests: many objects with their own mesh, all in one group.
+ * Every vertex has a deform weight, which is a separate data block, so the data of each mesh
+ * and the ID's of the file fill large pointer maps. */
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_listbase.h"
+#include "BLI_string.h"
+#include "BLI_threads.h"
+
+#include "DNA_group_types.h"
+#include "DNA_image_types.h"
+#include "DNA_material_types.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_node_types.h"
+#include "DNA_object_types.h"
+
+#include "BKE_appdir.h"
+#include "BKE_blender.h"
+#include "BKE_customdata.h"
+#include "BKE_group.h"
+#include "BKE_image.h"
+#include "BKE_library.h"
+#include "BKE_main.h"
+#include "BKE_material.h"
+#include "BKE_mesh.h"
+#include "BKE_node.h"
+#include "BKE_object.h"
+
+#include "IMB_imbuf.h"
+
+#include "RNA_define.h"
+}
+
+static void blendfile_init(void)
+{
+	static bool is_init = false;
+
+	if (!is_init) {
+		BLI_threadapi_init();
+		initglobals();
+		BKE_tempdir_init(NULL);
+
+		/* for the images and node trees of materials and the I/O tests, same order as in creator.c */
+		IMB_init();
+		BKE_images_init();
+		RNA_init();
+		init_nodesystem();
+
+		is_init = true;
+	}
+}
+
+/* Like BKE_libblock_alloc, but with a name that is unique by construction,
+ * checking names in the usual way is quadratic in the number of ID's. */
+static void *synthetic_id_add(Main *bmain, const short type, const char *prefix, const int index)
+{
+	ID *id = (ID *)BKE_libblock_alloc_notest(type);
+
+	*((short *)id->name) = type;
+	BLI_snprintf(id->name + 2, sizeof(id->name) - 2, "%s.%06d", prefix, index);
+	id->us = 1;
+	BLI_addtail(which_libbase(bmain, type), id);
+
+	return id;
+}
+
+static Main *synthetic_main_new(const int num_objects, const int num_verts)
+{
+	Main *bmain = BKE_main_new();
+	Group *group = BKE_group_add(bmain, "Group");
+
+	for (int i = 0; i < num_objects; i++) {
+		Mesh *me = (Mesh *)synthetic_id_add(bmain, ID_ME, "Mesh", i);
+		Object *ob = (Object *)synthetic_id_add(bmain, ID_OB, "Object", i);
+
+		BKE_mesh_init(me);
+		ob->type = OB_MESH;
+		BKE_object_init(ob);
+
+		me->totvert = num_verts;
+		me->mvert = (MVert *)CustomData_add_layer(&me->vdata, CD_MVERT, CD_CALLOC, NULL, num_verts);
+		me->dvert = (MDeformVert *)CustomData_add_layer(&me->vdata, CD_MDEFORMVERT, CD_CALLOC, NULL, num_verts);
+		for (int j = 0; j < num_verts; j++) {
+			me->mvert[j].co[0] = (float)j;
+			me->dvert[j].dw = (MDeformWeight *)MEM_callocN(sizeof(MDeformWeight), __func__);
+			me->dvert[j].dw->weight = 1.0f;
+			me->dvert[j].totweight = 1;
+		}
+
+		ob->data = me;
+		BKE_group_object_add(group, ob, NULL, NULL);
+	}
+
+	return bmain;
+}
+
+/* A material with a shader node tree using an image, assigned to all meshes. */
+static Material *synthetic_material_add(Main *bmain)
+{
+	Material *ma = (Material *)synthetic_id_add(bmain, ID_MA, "Material", 0);
+	const float color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	Image *ima = BKE_image_add_generated(bmain, 16, 16, "Image", 24, 0, IMA_GENTYPE_GRID, color, false);
+
+	BKE_material_init(ma);
+	ma->nodetree = ntreeAddTree(NULL, "Shader Nodetree", "ShaderNodeTree");
+	ma->use_nodes = true;
+	bNode *node_tex = nodeAddStaticNode(NULL, ma->nodetree, SH_NODE_TEX_IMAGE);
+	node_tex->id = &ima->id;
+	id_us_plus(node_tex->id);
+	ntreeUpdateTree(NULL, ma->nodetree);
+
+	for (Mesh *me = (Mesh *)bmain->mesh.first; me; me = (Mesh *)me->id.next) {
+		me->mat = (Material **)MEM_callocN(sizeof(*me->mat), __func__);
+		me->mat[0] = ma;
+		me->totcol = 1;
+		id_us_plus(&ma->id);
+	}
+	for (Object *ob = (Object *)bmain->object.first; ob; ob = (Object *)ob->id.next) {
+		BKE_material_resize_object(ob, 1, false);
+	}
+
+	return ma;
+}
+
+#endif  /* __BLENDER_TESTING_BLO_SYNTHETIC_DATA_H__ */
@@ -0,0 +1,91 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <pthread.h>
+
+#include "MEM_guardedalloc.h"
+
+#define NUM_THREADS 16
+#define NUM_BLOCKS 1000
+#define BLOCK_SIZE 64
+
+namespace {
+
+struct ThreadData {
+	void *blocks[NUM_BLOCKS];
+	bool do_free;
+};
+
+void *alloc_thread(void *userdata)
+{
+	ThreadData *data = (ThreadData *)userdata;
+
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		data->blocks[i] = MEM_mallocN(BLOCK_SIZE, "test");
+	}
+
+	if (data->do_free) {
+		for (int i = 0; i < NUM_BLOCKS; i++) {
+			MEM_freeN(data->blocks[i]);
+		}
+	}
+
+	return NULL;
+}
+
+void run_threads(ThreadData *data, bool do_free)
+{
+	pthread_t threads[NUM_THREADS];
+
+	for (int i = 0; i < NUM_THREADS; i++) {
+		data[i].do_free = do_free;
+		pthread_create(&threads[i], NULL, alloc_thread, &data[i]);
+	}
+	for (int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+}  // namespace
+
+/* Statistics are exact once threads are done, also for blocks freed by another thread. */
+TEST(guardedalloc, LockfreeThreadedStatistics)
+{
+	static ThreadData data[NUM_THREADS];
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+	const size_t memory_in_use = MEM_get_memory_in_use();
+
+	run_threads(data, true);
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(memory_in_use, MEM_get_memory_in_use());
+
+	MEM_reset_peak_memory();
+	run_threads(data, false);
+	EXPECT_EQ(blocks_in_use + NUM_THREADS * NUM_BLOCKS, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(memory_in_use + NUM_THREADS * NUM_BLOCKS * BLOCK_SIZE, MEM_get_memory_in_use());
+
+	/* free from the main thread */
+	for (int i = 0; i < NUM_THREADS; i++) {
+		for (int j = 0; j < NUM_BLOCKS; j++) {
+			MEM_freeN(data[i].blocks[j]);
+		}
+	}
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(memory_in_use, MEM_get_memory_in_use());
+}
+
+/* Peak is updated for large allocations. */
+TEST(guardedalloc, LockfreePeakMemory)
+{
+	const size_t len = 16 * 1024 * 1024;
+
+	MEM_reset_peak_memory();
+	const size_t peak = MEM_get_peak_memory();
+
+	void *ptr = MEM_mallocN(len, "test");
+	EXPECT_LE(peak + len, MEM_get_peak_memory());
+	MEM_freeN(ptr);
+
+	EXPECT_LE(peak + len, MEM_get_peak_memory());
+}